@@ -23,12 +23,18 @@
 #include <dpcommon/common.h>
 #include <dpcommon/input.h>
 #include <dpcommon/output.h>
-#include <dpengine/canvas_history.h>
 #include <dpengine/canvas_state.h>
 #include <dpengine/draw_context.h>
+#include <dpcommon/threading.h>
+#include <dpcommon/worker.h>
+#include <dpengine/canvas_history.h>
 #include <dpengine/image.h>
 #include <dpmsg/binary_reader.h>
+#include <dpmsg/binary_writer.h>
 #include <dpmsg/message.h>
+#include <dpmsg/message_arena.h>
+#include <dpmsg/parallel_text_writer.h>
+#include <dpmsg/text_reader.h>
 #include <ctype.h>
 #include <stdio.h>
 #include <string.h>
@@ -47,10 +53,20 @@ typedef struct DP_ConvParams {
     bool want_help;
     DP_ConvFormat input_format;
     DP_ConvFormat output_format;
+    int threads;
     const char *input;
     const char *output;
 } DP_ConvParams;
 
+typedef struct DP_ConvReader {
+    DP_ConvFormat format;
+    DP_MessageArena *arena;
+    union {
+        DP_BinaryReader *binary;
+        DP_TextReader *text;
+    };
+} DP_ConvReader;
+
 
 static void print_usage(const char *progname)
 {
@@ -61,11 +77,13 @@ static void print_usage(const char *progname)
             "    %s [--input=INPUTFILE] \\\n"
             "    %*c [--output=OUTPUTFILE] \\\n"
             "    %*c [--input-format=guess|dprec|dptxt] \\\n"
-            "    %*c [--output-format=guess|dprec|dptxt|ora|png|jpg|jpeg]\n"
+            "    %*c [--output-format=guess|dprec|dptxt|ora|png|jpg|jpeg] \\\n"
+            "    %*c [--threads=COUNT]\n"
             "Show full help:\n"
             "    %s --help|-help|-h|-?\n"
             "\n",
-            progname, spaces, ' ', spaces, ' ', spaces, ' ', progname);
+            progname, spaces, ' ', spaces, ' ', spaces, ' ', spaces, ' ',
+            progname);
 }
 
 static void print_help(void)
@@ -119,6 +137,10 @@ static bool parse_input_format(DP_ConvParams *params, const char *format)
         params->input_format = DP_CONV_FORMAT_DPREC;
         return true;
     }
+    else if (eq_ignore_case(format, "dptxt")) {
+        params->input_format = DP_CONV_FORMAT_DPTXT;
+        return true;
+    }
     else {
         warn("Unknown input format '%s'", format);
         return false;
@@ -131,6 +153,14 @@ static bool parse_output_format(DP_ConvParams *params, const char *format)
         params->output_format = DP_CONV_FORMAT_GUESS;
         return true;
     }
+    else if (eq_ignore_case(format, "dprec")) {
+        params->output_format = DP_CONV_FORMAT_DPREC;
+        return true;
+    }
+    else if (eq_ignore_case(format, "dptxt")) {
+        params->output_format = DP_CONV_FORMAT_DPTXT;
+        return true;
+    }
     else if (eq_ignore_case(format, "png")) {
         params->output_format = DP_CONV_FORMAT_PNG;
         return true;
@@ -141,6 +171,20 @@ static bool parse_output_format(DP_ConvParams *params, const char *format)
     }
 }
 
+static bool parse_threads(DP_ConvParams *params, const char *value)
+{
+    char *end;
+    long threads = strtol(value, &end, 10);
+    if (*value != '\0' && *end == '\0' && threads > 0 && threads <= 1024) {
+        params->threads = DP_long_to_int(threads);
+        return true;
+    }
+    else {
+        warn("Invalid thread count '%s'", value);
+        return false;
+    }
+}
+
 static bool parse_arg(DP_ConvParams *params, const char *arg)
 {
     int offset;
@@ -155,6 +199,9 @@ static bool parse_arg(DP_ConvParams *params, const char *arg)
     else if (starts_with(arg, "--output-format=", &offset)) {
         return parse_output_format(params, arg + offset);
     }
+    else if (starts_with(arg, "--threads=", &offset)) {
+        return parse_threads(params, arg + offset);
+    }
     else if (starts_with(arg, "--input=", &offset)) {
         params->input = arg + offset;
         return true;
@@ -214,41 +261,202 @@ static DP_Output *open_output(const char *path)
     }
 }
 
-int main(int argc, char **argv)
+static bool has_extension(const char *path, const char *extension)
 {
-    DP_ConvParams params = {false, DP_CONV_FORMAT_GUESS, DP_CONV_FORMAT_GUESS,
-                            NULL, NULL};
-    int ret = parse_args(&params, argc, argv);
-    if (ret != 0) {
-        return ret < 0 ? 0 : ret;
+    if (path) {
+        size_t path_length = strlen(path);
+        size_t extension_length = strlen(extension);
+        return path_length > extension_length
+            && eq_ignore_case(path + path_length - extension_length,
+                              extension);
+    }
+    else {
+        return false;
     }
+}
 
-    DP_Input *input = open_input(params.input);
-    if (!input) {
-        warn("Can't open input '%s': %s", params.input, DP_error());
+static DP_ConvFormat guess_input_format(const char *path)
+{
+    return has_extension(path, ".dptxt") ? DP_CONV_FORMAT_DPTXT
+                                         : DP_CONV_FORMAT_DPREC;
+}
+
+static DP_ConvFormat guess_output_format(const char *path)
+{
+    if (has_extension(path, ".dprec")) {
+        return DP_CONV_FORMAT_DPREC;
+    }
+    else if (has_extension(path, ".dptxt")) {
+        return DP_CONV_FORMAT_DPTXT;
+    }
+    else {
+        return DP_CONV_FORMAT_PNG;
+    }
+}
+
+
+static bool reader_open(DP_ConvReader *reader, DP_ConvFormat format,
+                        DP_Input *input)
+{
+    reader->format = format;
+    if (format == DP_CONV_FORMAT_DPTXT) {
+        reader->text = DP_text_reader_new(input);
+        if (!reader->text) {
+            return false;
+        }
+    }
+    else {
+        reader->binary = DP_binary_reader_new(input);
+        if (!reader->binary) {
+            return false;
+        }
+    }
+
+    // Pretty much every message we read dies young, so let them share memory.
+    reader->arena =
+        DP_message_arena_new(DP_MESSAGE_ARENA_DEFAULT_CHUNK_SIZE);
+    if (format == DP_CONV_FORMAT_DPTXT) {
+        DP_text_reader_arena_set(reader->text, reader->arena);
+    }
+    else {
+        DP_binary_reader_arena_set(reader->binary, reader->arena);
+    }
+    return true;
+}
+
+static JSON_Object *reader_header(DP_ConvReader *reader)
+{
+    return reader->format == DP_CONV_FORMAT_DPTXT
+             ? DP_text_reader_header(reader->text)
+             : DP_binary_reader_header(reader->binary);
+}
+
+static bool reader_has_next(DP_ConvReader *reader)
+{
+    return reader->format == DP_CONV_FORMAT_DPTXT
+             ? DP_text_reader_has_next(reader->text)
+             : DP_binary_reader_has_next(reader->binary);
+}
+
+static DP_Message *reader_read_next(DP_ConvReader *reader)
+{
+    return reader->format == DP_CONV_FORMAT_DPTXT
+             ? DP_text_reader_read_next(reader->text)
+             : DP_binary_reader_read_next(reader->binary);
+}
+
+static void reader_close(DP_ConvReader *reader)
+{
+    if (reader->format == DP_CONV_FORMAT_DPTXT) {
+        DP_text_reader_free(reader->text);
+    }
+    else {
+        DP_binary_reader_free(reader->binary);
+    }
+    DP_message_arena_free(reader->arena);
+}
+
+
+static int convert_to_dprec(DP_ConvReader *reader, DP_Output *output)
+{
+    DP_BinaryWriter *writer = DP_binary_writer_new(output);
+    if (!DP_binary_writer_write_header(writer, reader_header(reader))) {
+        warn("Write header: %s", DP_error());
+        DP_binary_writer_free(writer);
         return 1;
     }
 
-    DP_Output *output = open_output(params.output);
-    if (!output) {
-        warn("Can't open output '%s': %s", params.output, DP_error());
-        DP_input_free(input);
+    int ret = 0;
+    while (reader_has_next(reader)) {
+        DP_Message *msg = reader_read_next(reader);
+        if (!msg) {
+            warn("Read: %s", DP_error());
+            continue;
+        }
+
+        bool ok = DP_binary_writer_write_message(writer, msg);
+        DP_message_decref(msg);
+        if (!ok) {
+            warn("Write: %s", DP_error());
+            ret = 1;
+            break;
+        }
+    }
+
+    DP_binary_writer_free(writer);
+    return ret;
+}
+
+static int convert_to_dptxt(DP_ConvReader *reader, DP_Output *output,
+                            int threads)
+{
+    DP_ParallelTextWriter *writer =
+        DP_parallel_text_writer_new(output, threads);
+    if (!writer) {
+        warn("Can't create text writer: %s", DP_error());
         return 1;
     }
 
-    DP_BinaryReader *reader = DP_binary_reader_new(input);
+    if (!DP_parallel_text_writer_write_header(writer, reader_header(reader))) {
+        warn("Write header: %s", DP_error());
+        DP_parallel_text_writer_free(writer);
+        return 1;
+    }
+
+    int ret = 0;
+    while (reader_has_next(reader)) {
+        DP_Message *msg = reader_read_next(reader);
+        if (!msg) {
+            warn("Read: %s", DP_error());
+            continue;
+        }
+
+        bool ok = DP_parallel_text_writer_write_message(writer, msg);
+        DP_message_decref(msg);
+        if (!ok) {
+            break;
+        }
+    }
+
+    if (!DP_parallel_text_writer_finish(writer)) {
+        warn("Write: %s", DP_error());
+        ret = 1;
+    }
+
+    DP_parallel_text_writer_free(writer);
+    return ret;
+}
+
+#define WORKER_QUEUE_CAPACITY 256
+
+static int convert_to_png(DP_ConvReader *reader, DP_Output *output,
+                          int threads)
+{
     DP_CanvasHistory *ch = DP_canvas_history_new();
     DP_DrawContext *dc = DP_draw_context_new();
+    DP_Worker *worker = NULL;
+    if (threads > 1) {
+        worker = DP_worker_new(WORKER_QUEUE_CAPACITY, threads);
+        if (worker) {
+            DP_draw_context_paint_worker_set(
+                dc, worker, DP_DRAW_CONTEXT_PAINT_PARALLEL_MIN_AREA);
+        }
+        else {
+            warn("Can't create worker: %s", DP_error());
+        }
+    }
+    // Without a worker, this just handles every message right away.
+    DP_CanvasHistoryBatcher *chb = DP_canvas_history_batcher_new(worker, dc);
 
-    while (DP_binary_reader_has_next(reader)) {
-        DP_Message *msg = DP_binary_reader_read_next(reader);
+    while (reader_has_next(reader)) {
+        DP_Message *msg = reader_read_next(reader);
         if (!msg) {
             warn("Read: %s", DP_error());
             continue;
         }
 
         if (DP_message_type_command(DP_message_type(msg))) {
-            if (!DP_canvas_history_handle(ch, dc, msg)) {
+            if (!DP_canvas_history_batcher_handle(chb, ch, msg)) {
                 warn("Handle: %s", DP_error());
             }
         }
@@ -256,8 +464,10 @@ int main(int argc, char **argv)
         DP_message_decref(msg);
     }
 
-    // TODO error
-    DP_binary_reader_free(reader);
+    if (!DP_canvas_history_batcher_flush(chb, ch)) {
+        warn("Handle: %s", DP_error());
+    }
+    DP_canvas_history_batcher_free(chb);
 
     DP_CanvasState *cs = DP_canvas_history_compare_and_get(ch, NULL);
     DP_Image *img =
@@ -265,12 +475,66 @@ int main(int argc, char **argv)
     DP_canvas_state_decref(cs);
 
     DP_draw_context_free(dc);
+    DP_worker_free(worker);
     DP_canvas_history_free(ch);
+
+    int ret = 0;
     if (!DP_image_write_png(img, output)) {
         warn("Couldn't write PNG: %s", DP_error());
+        ret = 1;
     }
-    // TODO error
     DP_output_free(output);
     DP_image_free(img);
-    return 0;
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    DP_ConvParams params = {false, DP_CONV_FORMAT_GUESS, DP_CONV_FORMAT_GUESS,
+                            DP_thread_cpu_count(), NULL, NULL};
+    int ret = parse_args(&params, argc, argv);
+    if (ret != 0) {
+        return ret < 0 ? 0 : ret;
+    }
+
+    DP_ConvFormat input_format = params.input_format == DP_CONV_FORMAT_GUESS
+                                   ? guess_input_format(params.input)
+                                   : params.input_format;
+    DP_ConvFormat output_format = params.output_format == DP_CONV_FORMAT_GUESS
+                                    ? guess_output_format(params.output)
+                                    : params.output_format;
+
+    DP_Input *input = open_input(params.input);
+    if (!input) {
+        warn("Can't open input '%s': %s", params.input, DP_error());
+        return 1;
+    }
+
+    DP_ConvReader reader;
+    if (!reader_open(&reader, input_format, input)) {
+        warn("Can't read input '%s': %s", params.input, DP_error());
+        return 1;
+    }
+
+    DP_Output *output = open_output(params.output);
+    if (!output) {
+        warn("Can't open output '%s': %s", params.output, DP_error());
+        reader_close(&reader);
+        return 1;
+    }
+
+    switch (output_format) {
+    case DP_CONV_FORMAT_DPREC:
+        ret = convert_to_dprec(&reader, output);
+        break;
+    case DP_CONV_FORMAT_DPTXT:
+        ret = convert_to_dptxt(&reader, output, params.threads);
+        break;
+    default:
+        ret = convert_to_png(&reader, output, params.threads);
+        break;
+    }
+
+    reader_close(&reader);
+    return ret;
 }
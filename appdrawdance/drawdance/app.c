@@ -24,15 +24,14 @@
 #include "dpclient/client.h"
 #include "emproxy.h"
 #include "gl.h"
+#include "render_pipeline.h"
 #include "ui.h"
-#include <dpclient/document.h>
 #include <dpcommon/common.h>
 #include <dpcommon/input.h>
 #include <dpcommon/threading.h>
+#include <dpcommon/trace.h>
 #include <dpcommon/worker.h>
-#include <dpengine/canvas_diff.h>
 #include <dpengine/canvas_state.h>
-#include <dpengine/layer.h>
 #include <dpmsg/binary_reader.h>
 #include <dpmsg/message.h>
 #include <dpmsg/messages/command.h>
@@ -53,17 +52,15 @@
 
 #define HANDLE_EVENTS_QUIT         0
 #define HANDLE_EVENTS_KEEP_RUNNING 1
+#define WORKER_QUEUE_CAPACITY      64
 
 typedef struct DP_App {
     bool running;
     SDL_Window *window;
     SDL_GLContext gl_context;
-    DP_Document *doc;
     DP_CanvasState *blank_state;
-    DP_CanvasState *previous_state;
     DP_CanvasState *current_state;
-    DP_TransientLayer *layer;
-    DP_CanvasDiff *diff;
+    DP_RenderPipeline *render_pipeline;
     DP_CanvasRenderer *canvas_renderer;
     DP_LuaWarnBuffer lua_warn_buffer;
     lua_State *L;
@@ -84,8 +81,6 @@ static bool init_canvas_renderer(DP_App *app)
     DP_CanvasRenderer *cr = DP_EMPROXY_P(DP_canvas_renderer_new);
     if (cr) {
         app->canvas_renderer = cr;
-        app->diff = DP_canvas_diff_new();
-        app->layer = DP_transient_layer_new_init(0, 0, 0, NULL);
         app->blank_state = DP_canvas_state_new();
         return true;
     }
@@ -94,6 +89,19 @@ static bool init_canvas_renderer(DP_App *app)
     }
 }
 
+static bool init_render_pipeline(DP_App *app)
+{
+#ifdef __EMSCRIPTEN__
+    // Flattening in a separate thread in the browser is slower than in
+    // serial, same as with the GUI thread.
+    bool threaded = false;
+#else
+    bool threaded = true;
+#endif
+    app->render_pipeline = DP_render_pipeline_new(app->blank_state, threaded);
+    return app->render_pipeline;
+}
+
 static bool init_lua(DP_App *app)
 {
     lua_State *L = luaL_newstate();
@@ -154,7 +162,7 @@ static bool init_gui_thread(DP_UNUSED DP_App *app)
 
 static bool init_worker(DP_App *app)
 {
-    return (app->worker = DP_worker_new(1));
+    return (app->worker = DP_worker_new(WORKER_QUEUE_CAPACITY, 1));
 }
 
 
@@ -195,25 +203,27 @@ static void prepare_gui(DP_App *app)
 }
 #endif
 
-static DP_CanvasDiff *prepare_canvas(DP_App *app)
+// Updates the pipeline's viewport before taking the frame, so that the render
+// thread flattens the visible tiles first when it wakes up. The view size is
+// the one from the last frame, the window doesn't usually change in between.
+static DP_RenderFrame *take_frame(DP_App *app)
 {
-    DP_Document *doc = app->doc;
-    DP_CanvasState *prev = app->previous_state;
-    DP_CanvasState *next =
-        doc ? DP_document_canvas_state_compare_and_get(doc, prev)
-            : DP_canvas_state_incref(app->blank_state);
-    if (next) {
-        DP_CanvasDiff *diff = app->diff;
-        DP_canvas_state_diff(next, prev, diff);
-        if (prev) {
-            DP_canvas_state_decref(prev);
-        }
-        app->previous_state = next;
-        DP_canvas_state_render(next, app->layer, diff);
-        return diff;
+    int view_width = app->inputs.view_width;
+    int view_height = app->inputs.view_height;
+    DP_Rect viewport;
+    if (view_width > 0 && view_height > 0
+        && DP_canvas_renderer_view_bounds(app->canvas_renderer, view_width,
+                                          view_height, &viewport)) {
+        DP_render_pipeline_viewport_set(app->render_pipeline, viewport);
     }
-    else {
-        return NULL;
+    return DP_render_pipeline_frame_take(app->render_pipeline);
+}
+
+static void update_current_state(DP_App *app, DP_RenderFrame *frame_or_null)
+{
+    if (frame_or_null) {
+        DP_canvas_state_decref(app->current_state);
+        app->current_state = DP_canvas_state_incref(frame_or_null->cs);
     }
 }
 
@@ -223,13 +233,20 @@ static void clear_screen(void)
     DP_gl_clear(0.5f, 0.5f, 0.5f, 1.0f, 0.0f, 0);
 }
 
-static void render_canvas(DP_App *app, DP_CanvasDiff *diff_or_null)
+static void invalidate_tile(void *user, int tile_x, int tile_y)
+{
+    DP_render_pipeline_tile_invalidate(user, tile_x, tile_y);
+}
+
+static void render_canvas(DP_App *app, DP_RenderFrame *frame_or_null)
 {
     int view_width, view_height;
     SDL_GL_GetDrawableSize(app->window, &view_width, &view_height);
     DP_user_input_view_dimensions_set(&app->inputs, view_width, view_height);
-    DP_canvas_renderer_render(app->canvas_renderer, (DP_Layer *)app->layer,
-                              view_width, view_height, diff_or_null);
+    DP_canvas_renderer_render(app->canvas_renderer, frame_or_null, view_width,
+                              view_height);
+    DP_canvas_renderer_stale_tiles_take(app->canvas_renderer, invalidate_tile,
+                                        app->render_pipeline);
 }
 
 #ifdef DRAWDANCE_IMGUI
@@ -246,8 +263,8 @@ DP_App *DP_app_new(SDL_Window *window, SDL_GLContext gl_context)
     DP_App *app = DP_malloc(sizeof(*app));
     *app = (DP_App)
     {
-        true, window, gl_context, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-            {0, 0, NULL}, NULL, LUA_NOREF,
+        true, window, gl_context, NULL, NULL, NULL, NULL, {0, 0, NULL}, NULL,
+            LUA_NOREF,
 #if defined(DRAWDANCE_IMGUI) && !defined(__EMSCRIPTEN__)
             NULL, NULL, NULL,
 #endif
@@ -259,6 +276,7 @@ DP_App *DP_app_new(SDL_Window *window, SDL_GLContext gl_context)
     DP_user_inputs_init(&app->inputs);
 
     bool ok = init_canvas_renderer(app) //
+           && init_render_pipeline(app) //
            && init_lua(app)             //
            && init_gui_thread(app)      //
            && init_worker(app);
@@ -279,6 +297,8 @@ void DP_app_free(DP_App *app)
         DP_Worker *worker = app->worker;
         app->worker = NULL;
         DP_worker_free(worker);
+        // Stop flattening before Lua gets closed and frees the document.
+        DP_render_pipeline_free(app->render_pipeline);
 #if defined(DRAWDANCE_IMGUI) && !defined(__EMSCRIPTEN__)
         if (app->thread_gui) {
             DP_SEMAPHORE_MUST_POST(app->sem_gui_prepare);
@@ -293,13 +313,6 @@ void DP_app_free(DP_App *app)
         }
         DP_lua_warn_buffer_dispose(&app->lua_warn_buffer);
         DP_canvas_renderer_free(app->canvas_renderer);
-        DP_canvas_diff_free(app->diff);
-        if (app->layer) {
-            DP_transient_layer_decref(app->layer);
-        }
-        if (app->previous_state) {
-            DP_canvas_state_decref(app->previous_state);
-        }
         if (app->blank_state) {
             DP_canvas_state_decref(app->blank_state);
         }
@@ -309,10 +322,10 @@ void DP_app_free(DP_App *app)
 }
 
 #ifdef __EMSCRIPTEN__
-static void em_render_gl(DP_App *app, DP_CanvasDiff *diff_or_null)
+static void em_render_gl(DP_App *app, DP_RenderFrame *frame_or_null)
 {
     clear_screen();
-    render_canvas(app, diff_or_null);
+    render_canvas(app, frame_or_null);
 #    ifdef DRAWDANCE_IMGUI
     render_gui(app);
 #    endif
@@ -327,10 +340,9 @@ static void em_main_loop(void *arg)
 #    ifdef DRAWDANCE_IMGUI
         prepare_gui(app);
 #    endif
-        DP_CanvasDiff *diff_or_null = prepare_canvas(app);
-        DP_EMPROXY_VII(em_render_gl, app, diff_or_null);
-        DP_canvas_state_decref(app->current_state);
-        app->current_state = DP_canvas_state_incref(app->previous_state);
+        DP_RenderFrame *frame_or_null = take_frame(app);
+        DP_EMPROXY_VII(em_render_gl, app, frame_or_null);
+        update_current_state(app, frame_or_null);
     }
     else {
         DP_canvas_state_decref(app->current_state);
@@ -348,24 +360,28 @@ void DP_app_run(DP_App *app)
     emscripten_set_main_loop_arg(em_main_loop, app, 0, false);
 #else
     app->current_state = DP_canvas_state_incref(app->blank_state);
+    DP_TRACE_THREAD_NAME("main");
     while (handle_events(app) != HANDLE_EVENTS_QUIT) {
+        DP_TRACE_BEGIN("frame");
         DP_GL_CLEAR_ERROR();
 #    ifdef DRAWDANCE_IMGUI
         prepare_gui(app);
 #    endif
-        DP_CanvasDiff *diff_or_null = prepare_canvas(app);
+        DP_RenderFrame *frame_or_null = take_frame(app);
         clear_screen();
-        render_canvas(app, diff_or_null);
+        render_canvas(app, frame_or_null);
 #    ifdef DRAWDANCE_IMGUI
         DP_SEMAPHORE_MUST_WAIT(app->sem_gui_render);
 #    endif
-        DP_canvas_state_decref(app->current_state);
-        app->current_state = DP_canvas_state_incref(app->previous_state);
+        update_current_state(app, frame_or_null);
 #    ifdef DRAWDANCE_IMGUI
         render_gui(app);
 #    endif
         DP_user_inputs_render(&app->inputs);
+        DP_TRACE_BEGIN("swap_window");
         SDL_GL_SwapWindow(app->window);
+        DP_TRACE_END();
+        DP_TRACE_END();
     }
     DP_canvas_state_decref(app->current_state);
     app->current_state = NULL;
@@ -383,7 +399,7 @@ void DP_app_document_set(DP_App *app, DP_Document *doc_or_null)
 {
     DP_ASSERT(app);
     DP_debug("App document set to %p", (void *)doc_or_null);
-    app->doc = doc_or_null;
+    DP_render_pipeline_document_set(app->render_pipeline, doc_or_null);
 }
 
 void DP_app_canvas_renderer_transform(DP_App *app, double *out_x, double *out_y,
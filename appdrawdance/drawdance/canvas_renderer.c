@@ -21,11 +21,14 @@
  */
 #include "canvas_renderer.h"
 #include "gl.h"
+#include "render_pipeline.h"
+#include "tile_atlas.h"
 #include <dpcommon/common.h>
 #include <dpcommon/conversions.h>
 #include <dpcommon/geom.h>
-#include <dpengine/canvas_diff.h>
-#include <dpengine/layer.h>
+#include <dpcommon/trace.h>
+#include <dpengine/mipmap.h>
+#include <dpengine/perf.h>
 #include <dpengine/pixels.h>
 #include <dpengine/tile.h>
 #include <gles2_inc.h>
@@ -34,7 +37,7 @@
 
 struct DP_CanvasRenderer {
     int width, height;
-    bool recalculate_vertices;
+    bool recalculate_transform;
     unsigned int program;
     unsigned int buffers[2];
     struct {
@@ -43,12 +46,26 @@ struct DP_CanvasRenderer {
     } attributes;
     struct {
         int view;
+        int transform;
         int sampler;
     } uniforms;
+    // Vertices are in canvas pixel coordinates, this matrix puts them into
+    // the view. That way, moving the view doesn't touch any vertex data.
+    float transform_matrix[9];
+    DP_TileAtlas *atlas;
+    // When zoomed out, a smaller level of the mipmap gets rendered from its
+    // own texture instead. Frame tiles aren't uploaded to the tile atlas in
+    // the meantime, they're marked as stale instead, so that they can be
+    // flattened again when zooming back in.
     struct {
+        DP_Mipmap *mm;
+        int level;
+        int uploaded_level;
         unsigned int id;
         int width, height;
-    } texture;
+        int stale_count;
+        unsigned char *stale;
+    } mip;
     struct {
         double x, y;
         double scale;
@@ -57,17 +74,19 @@ struct DP_CanvasRenderer {
 };
 
 
-static void init_texture(DP_CanvasRenderer *cr)
+static unsigned int init_texture(int filter)
 {
+    unsigned int id;
     DP_GL_CLEAR_ERROR();
     DP_GL(glActiveTexture, GL_TEXTURE0);
-    DP_GL(glGenTextures, 1, &cr->texture.id);
-    DP_GL(glBindTexture, GL_TEXTURE_2D, cr->texture.id);
-    DP_GL(glTexParameteri, GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    DP_GL(glTexParameteri, GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    DP_GL(glGenTextures, 1, &id);
+    DP_GL(glBindTexture, GL_TEXTURE_2D, id);
+    DP_GL(glTexParameteri, GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    DP_GL(glTexParameteri, GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
     DP_GL(glTexParameteri, GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     DP_GL(glTexParameteri, GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     DP_GL(glBindTexture, GL_TEXTURE_2D, 0);
+    return id;
 }
 
 static unsigned int init_program(void)
@@ -75,13 +94,15 @@ static unsigned int init_program(void)
     static const char *vert =
         "#version 100\n"
         "uniform vec2 u_view;\n"
-        "attribute mediump vec2 v_pos;\n"
+        "uniform mat3 u_transform;\n"
+        "attribute highp vec2 v_pos;\n"
         "attribute mediump vec2 v_uv;\n"
         "varying vec2 f_uv;\n"
         "void main()\n"
         "{\n"
-        "    gl_Position = vec4(2.0 * v_pos.x / u_view.x,\n"
-        "                       -2.0 * v_pos.y / u_view.y,\n"
+        "    vec3 pos = u_transform * vec3(v_pos, 1.0);\n"
+        "    gl_Position = vec4(2.0 * pos.x / u_view.x,\n"
+        "                       -2.0 * pos.y / u_view.y,\n"
         "                       0.0, 1.0);\n"
         "    f_uv = v_uv;\n"
         "}\n";
@@ -100,16 +121,28 @@ static unsigned int init_program(void)
 DP_CanvasRenderer *DP_canvas_renderer_new(void)
 {
     DP_CanvasRenderer *cr = DP_malloc(sizeof(*cr));
-    (*cr) = (DP_CanvasRenderer){0,      0,         true,
-                                0,      {0, 0},    {{0}, {0}},
-                                {0, 0}, {0, 0, 0}, {0.0, 0.0, 1.0, 0.0}};
+    (*cr) = (DP_CanvasRenderer){0,
+                                0,
+                                true,
+                                0,
+                                {0, 0},
+                                {{0}, {0}},
+                                {0, 0, 0},
+                                {0},
+                                NULL,
+                                {DP_mipmap_new(), 0, -1, 0, 0, 0, 0, NULL},
+                                {0.0, 0.0, 1.0, 0.0}};
     cr->program = init_program();
     DP_GL(glGenBuffers, DP_ARRAY_LENGTH(cr->buffers), cr->buffers);
     cr->uniforms.view = glGetUniformLocation(cr->program, "u_view");
     DP_GL_CLEAR_ERROR();
+    cr->uniforms.transform = glGetUniformLocation(cr->program, "u_transform");
+    DP_GL_CLEAR_ERROR();
     cr->uniforms.sampler = glGetUniformLocation(cr->program, "u_sampler");
     DP_GL_CLEAR_ERROR();
-    init_texture(cr);
+    cr->atlas = DP_tile_atlas_new();
+    // The mipmap levels are already box-filtered, smooth out the rest.
+    cr->mip.id = init_texture(GL_LINEAR);
     return cr;
 }
 
@@ -118,7 +151,10 @@ void DP_canvas_renderer_free(DP_CanvasRenderer *cr)
     if (cr) {
         DP_GL(glDeleteBuffers, DP_ARRAY_LENGTH(cr->buffers), cr->buffers);
         DP_GL(glDeleteProgram, cr->program);
-        DP_GL(glDeleteTextures, 1, &cr->texture.id);
+        DP_GL(glDeleteTextures, 1, &cr->mip.id);
+        DP_tile_atlas_free(cr->atlas);
+        DP_free(cr->mip.stale);
+        DP_mipmap_free(cr->mip.mm);
         DP_free(cr);
     }
 }
@@ -166,7 +202,7 @@ void DP_canvas_renderer_transform_set(DP_CanvasRenderer *cr, double x, double y,
         dirty = true;
     }
     if (dirty) {
-        cr->recalculate_vertices = true;
+        cr->recalculate_transform = true;
     }
 }
 
@@ -177,38 +213,11 @@ static int next_power_of_two(int x)
         pow(2.0, ceil(log(DP_int_to_double(x)) / log(2.0))));
 }
 
-static bool resize_texture(DP_CanvasRenderer *cr, int layer_width,
-                           int layer_height)
+static void set_uvs(DP_CanvasRenderer *cr, int width, int height,
+                    int texture_width, int texture_height)
 {
-    DP_ASSERT(cr->texture.width % DP_TILE_SIZE == 0);
-    DP_ASSERT(cr->texture.height % DP_TILE_SIZE == 0);
-    // It's enough to compare against the raw layer dimensions here,
-    // since the texture dimensions are always tile-extended. So if
-    // the raw dimensions fit, the tile-extended size will too.
-    if (cr->texture.width < layer_width || cr->texture.height < layer_height) {
-        int tiles_width = DP_tile_size_round_up(layer_width) * DP_TILE_SIZE;
-        int tiles_height = DP_tile_size_round_up(layer_height) * DP_TILE_SIZE;
-        int texture_width = next_power_of_two(tiles_width);
-        int texture_height = next_power_of_two(tiles_height);
-        cr->texture.width = texture_width;
-        cr->texture.height = texture_height;
-        DP_GL(glTexImage2D, GL_TEXTURE_2D, 0, GL_RGBA, texture_width,
-              texture_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-        return true;
-    }
-    else {
-        return false;
-    }
-}
-
-static void resize_attributes(DP_CanvasRenderer *cr, int layer_width,
-                              int layer_height)
-{
-    cr->recalculate_vertices = true;
-    float w = DP_int_to_float(layer_width);
-    float h = DP_int_to_float(layer_height);
-    float u = w / DP_int_to_float(cr->texture.width);
-    float v = h / DP_int_to_float(cr->texture.height);
+    float u = DP_int_to_float(width) / DP_int_to_float(texture_width);
+    float v = DP_int_to_float(height) / DP_int_to_float(texture_height);
     float *uvs = cr->attributes.uvs;
     uvs[1] = v;
     uvs[4] = u;
@@ -216,39 +225,153 @@ static void resize_attributes(DP_CanvasRenderer *cr, int layer_width,
     uvs[6] = u;
 }
 
-static bool resize(DP_CanvasRenderer *cr, int layer_width, int layer_height)
+static void set_vertices(DP_CanvasRenderer *cr, int width, int height)
+{
+    float w = DP_int_to_float(width);
+    float h = DP_int_to_float(height);
+    float *vertices = cr->attributes.vertices;
+    vertices[1] = h;
+    vertices[4] = w;
+    vertices[5] = h;
+    vertices[6] = w;
+}
+
+static void resize_mipmap(DP_CanvasRenderer *cr, int layer_width,
+                          int layer_height)
+{
+    DP_mipmap_resize(cr->mip.mm, layer_width, layer_height);
+    cr->mip.level = 0;
+    cr->mip.uploaded_level = -1;
+    // The tile atlas gets every tile again after a resize anyway.
+    size_t tile_total =
+        DP_int_to_size(DP_tile_total_round(layer_width, layer_height));
+    DP_free(cr->mip.stale);
+    cr->mip.stale = DP_malloc(tile_total);
+    memset(cr->mip.stale, 0, tile_total);
+    cr->mip.stale_count = 0;
+}
+
+static void resize(DP_CanvasRenderer *cr, int layer_width, int layer_height)
 {
     if (cr->width != layer_width || cr->height != layer_height) {
-        bool texture_resized = resize_texture(cr, layer_width, layer_height);
-        resize_attributes(cr, layer_width, layer_height);
+        DP_tile_atlas_resize(cr->atlas, layer_width, layer_height);
+        set_vertices(cr, layer_width, layer_height);
+        resize_mipmap(cr, layer_width, layer_height);
         cr->width = layer_width;
         cr->height = layer_height;
-        return texture_resized;
+        cr->recalculate_transform = true;
+    }
+}
+
+static void write_tile_to_atlas(DP_CanvasRenderer *cr, DP_RenderTile *rt)
+{
+    DP_Tile *tile = rt->tile;
+    DP_tile_atlas_tile_set(cr->atlas, rt->x, rt->y,
+                           tile ? DP_tile_pixels(tile) : NULL);
+}
+
+static void mark_stale(DP_CanvasRenderer *cr, DP_RenderTile *rt)
+{
+    int tile_index = rt->y * DP_tile_size_round_up(cr->width) + rt->x;
+    if (!cr->mip.stale[tile_index]) {
+        cr->mip.stale[tile_index] = 1;
+        ++cr->mip.stale_count;
+    }
+}
+
+static void upload_frame(DP_CanvasRenderer *cr, DP_RenderFrame *frame)
+{
+    DP_TRACE_BEGIN("tile_upload");
+    // Resizing only remaps the atlas' table, its tiles are dropped. Every
+    // tile is either in this frame or still pending and will come later.
+    resize(cr, frame->width, frame->height);
+    DP_Mipmap *mm = cr->mip.mm;
+    bool full_size = cr->mip.level == 0;
+    int tile_count = frame->tile_count;
+    for (int i = 0; i < tile_count; ++i) {
+        DP_RenderTile *rt = &frame->tiles[i];
+        DP_mipmap_tile_set(mm, rt->x, rt->y, rt->tile);
+        if (full_size) {
+            write_tile_to_atlas(cr, rt);
+        }
+        else {
+            mark_stale(cr, rt);
+        }
+    }
+    DP_tile_atlas_flush(cr->atlas);
+    DP_mipmap_update(mm);
+    DP_TRACE_END();
+}
+
+static int pick_mipmap_level(DP_CanvasRenderer *cr)
+{
+    int max_level = DP_mipmap_level_count(cr->mip.mm) - 1;
+    double scale = cr->transform.scale;
+    if (scale <= 0.0) {
+        return DP_max_int(max_level, 0);
     }
     else {
-        return false;
+        int level = DP_double_to_int(floor(-log2(scale)));
+        return DP_max_int(0, DP_min_int(level, max_level));
     }
 }
 
-static void write_tile_to_texture(void *layer, int tile_x, int tile_y)
+static void write_mipmap_tile(void *user, int tile_x, int tile_y)
 {
-    static const DP_Pixel BLANK_PIXELS[DP_TILE_LENGTH];
-    DP_Tile *tile = DP_layer_tile_at(layer, tile_x, tile_y);
-    const DP_Pixel *pixels = tile ? DP_tile_pixels(tile) : BLANK_PIXELS;
+    DP_CanvasRenderer *cr = user;
     DP_GL(glTexSubImage2D, GL_TEXTURE_2D, 0, tile_x * DP_TILE_SIZE,
           tile_y * DP_TILE_SIZE, DP_TILE_SIZE, DP_TILE_SIZE, GL_RGBA,
-          GL_UNSIGNED_BYTE, pixels);
+          GL_UNSIGNED_BYTE,
+          DP_mipmap_tile_pixels(cr->mip.mm, cr->mip.level, tile_x, tile_y));
+    DP_perf_record_uploads(1, 1, DP_TILE_BYTES);
 }
 
-static void write_all_tiles_to_texture(DP_Layer *layer, int layer_width,
-                                       int layer_height)
+// Brings the mipmap texture up to date with the current level. Switching
+// levels means uploading that whole level, after that only changed tiles.
+static void upload_mipmap_level(DP_CanvasRenderer *cr)
 {
-    DP_TileCounts counts = DP_tile_counts_round(layer_width, layer_height);
-    for (int tile_y = 0; tile_y < counts.y; ++tile_y) {
-        for (int tile_x = 0; tile_x < counts.x; ++tile_x) {
-            write_tile_to_texture(layer, tile_x, tile_y);
+    DP_Mipmap *mm = cr->mip.mm;
+    int level = cr->mip.level;
+    if (cr->mip.uploaded_level == level) {
+        DP_mipmap_dirty_take(mm, level, write_mipmap_tile, cr);
+        return;
+    }
+
+    DP_TRACE_BEGIN("mipmap_upload");
+    int level_width = DP_mipmap_level_width(mm, level);
+    int level_height = DP_mipmap_level_height(mm, level);
+    int xtiles = DP_tile_size_round_up(level_width);
+    int ytiles = DP_tile_size_round_up(level_height);
+    int texture_width = next_power_of_two(xtiles * DP_TILE_SIZE);
+    int texture_height = next_power_of_two(ytiles * DP_TILE_SIZE);
+    if (cr->mip.width != texture_width || cr->mip.height != texture_height) {
+        cr->mip.width = texture_width;
+        cr->mip.height = texture_height;
+        DP_GL(glTexImage2D, GL_TEXTURE_2D, 0, GL_RGBA, texture_width,
+              texture_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    }
+    for (int y = 0; y < ytiles; ++y) {
+        for (int x = 0; x < xtiles; ++x) {
+            write_mipmap_tile(cr, x, y);
         }
     }
+    DP_mipmap_dirty_clear(mm, level);
+    cr->mip.uploaded_level = level;
+    DP_TRACE_END();
+}
+
+static void update_mipmap_level(DP_CanvasRenderer *cr)
+{
+    int level = pick_mipmap_level(cr);
+    cr->mip.level = level;
+    if (level != 0) {
+        DP_GL(glBindTexture, GL_TEXTURE_2D, cr->mip.id);
+        upload_mipmap_level(cr);
+        DP_Mipmap *mm = cr->mip.mm;
+        set_uvs(cr, DP_mipmap_level_width(mm, level),
+                DP_mipmap_level_height(mm, level), cr->mip.width,
+                cr->mip.height);
+    }
 }
 
 static DP_Transform calculate_transform(double x, double y, double scale,
@@ -261,43 +384,24 @@ static DP_Transform calculate_transform(double x, double y, double scale,
     return tf;
 }
 
-static void calculate_vertices(DP_CanvasRenderer *cr)
+static void calculate_transform_matrix(DP_CanvasRenderer *cr)
 {
-    double w = DP_int_to_float(cr->width);
-    double h = DP_int_to_float(cr->height);
-    double x2 = w * 0.5f, y2 = h * 0.5f;
-    double x1 = -x2, y1 = -y2;
-
-    DP_Transform tf = calculate_transform(cr->transform.x, cr->transform.y,
-                                          cr->transform.scale,
-                                          cr->transform.rotation_in_radians);
-    DP_Vec2 tl = DP_transform_xy(tf, x1, y1);
-    DP_Vec2 tr = DP_transform_xy(tf, x2, y1);
-    DP_Vec2 br = DP_transform_xy(tf, x2, y2);
-    DP_Vec2 bl = DP_transform_xy(tf, x1, y2);
-
-    float *vertices = cr->attributes.vertices;
-    vertices[0] = DP_double_to_float(bl.x);
-    vertices[1] = DP_double_to_float(bl.y);
-    vertices[2] = DP_double_to_float(tl.x);
-    vertices[3] = DP_double_to_float(tl.y);
-    vertices[4] = DP_double_to_float(br.x);
-    vertices[5] = DP_double_to_float(br.y);
-    vertices[6] = DP_double_to_float(tr.x);
-    vertices[7] = DP_double_to_float(tr.y);
+    // Canvas coordinates start in the top-left, the view's in its center.
+    DP_Transform tf = DP_transform_mul(
+        DP_transform_translation(DP_int_to_double(cr->width) * -0.5,
+                                 DP_int_to_double(cr->height) * -0.5),
+        calculate_transform(cr->transform.x, cr->transform.y,
+                            cr->transform.scale,
+                            cr->transform.rotation_in_radians));
+    for (int i = 0; i < 9; ++i) {
+        cr->transform_matrix[i] = DP_double_to_float(tf.matrix[i]);
+    }
+    cr->recalculate_transform = false;
 }
 
-static void render_texture(DP_CanvasRenderer *cr, int view_height,
-                           int view_width)
+static void render_mipmap(DP_CanvasRenderer *cr)
 {
-    DP_GL_CLEAR_ERROR();
-    DP_GL(glEnable, GL_BLEND);
-    DP_GL(glBlendFunc, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-    DP_GL(glUseProgram, cr->program);
-    DP_GL(glUniform2f, cr->uniforms.view, DP_int_to_float(view_width),
-          DP_int_to_float(view_height));
-    DP_GL(glUniform1i, cr->uniforms.sampler, 0);
+    DP_GL(glBindTexture, GL_TEXTURE_2D, cr->mip.id);
 
     DP_GL(glEnableVertexAttribArray, 0);
     DP_GL(glBindBuffer, GL_ARRAY_BUFFER, cr->buffers[0]);
@@ -314,33 +418,106 @@ static void render_texture(DP_CanvasRenderer *cr, int view_height,
     DP_GL(glDrawArrays, GL_TRIANGLE_STRIP, 0, 4);
 }
 
-void DP_canvas_renderer_render(DP_CanvasRenderer *cr, DP_Layer *layer,
-                               int view_width, int view_height,
-                               DP_CanvasDiff *diff_or_null)
+static void render_canvas(DP_CanvasRenderer *cr, int view_height,
+                          int view_width)
+{
+    DP_GL_CLEAR_ERROR();
+    DP_GL(glEnable, GL_BLEND);
+    DP_GL(glBlendFunc, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    DP_GL(glUseProgram, cr->program);
+    DP_GL(glUniform2f, cr->uniforms.view, DP_int_to_float(view_width),
+          DP_int_to_float(view_height));
+    DP_GL(glUniformMatrix3fv, cr->uniforms.transform, 1, GL_FALSE,
+          cr->transform_matrix);
+    DP_GL(glUniform1i, cr->uniforms.sampler, 0);
+
+    if (cr->mip.level == 0) {
+        DP_tile_atlas_draw(cr->atlas);
+    }
+    else {
+        render_mipmap(cr);
+    }
+}
+
+void DP_canvas_renderer_render(DP_CanvasRenderer *cr,
+                               DP_RenderFrame *frame_or_null, int view_width,
+                               int view_height)
 {
     DP_ASSERT(cr);
+    DP_GL(glActiveTexture, GL_TEXTURE0);
+    // Upload even if there's nothing to render to, the tiles are only handed
+    // over once and would be missing from the atlas afterwards otherwise.
+    if (frame_or_null) {
+        upload_frame(cr, frame_or_null);
+    }
+
     if (view_width <= 0 || view_height <= 0) {
         return; // No view to render to, bail out.
     }
 
-    int layer_width = DP_layer_width(layer);
-    int layer_height = DP_layer_height(layer);
-    if (layer_width <= 0 || layer_height <= 0) {
-        return; // Layer with zero dimension(s), bail out.
+    if (cr->width <= 0 || cr->height <= 0) {
+        return; // Canvas with zero dimension(s), bail out.
     }
 
-    DP_GL(glActiveTexture, GL_TEXTURE0);
-    DP_GL(glBindTexture, GL_TEXTURE_2D, cr->texture.id);
-    if (resize(cr, layer_width, layer_height)) {
-        write_all_tiles_to_texture(layer, layer_width, layer_height);
+    update_mipmap_level(cr);
+
+    if (cr->recalculate_transform) {
+        calculate_transform_matrix(cr);
     }
-    else if (diff_or_null) {
-        DP_canvas_diff_each_pos(diff_or_null, write_tile_to_texture, layer);
+
+    render_canvas(cr, view_height, view_width);
+}
+
+void DP_canvas_renderer_stale_tiles_take(DP_CanvasRenderer *cr,
+                                         DP_MipmapTileFn fn, void *user)
+{
+    DP_ASSERT(cr);
+    DP_ASSERT(fn);
+    if (cr->mip.level == 0 && cr->mip.stale_count != 0) {
+        int xtiles = DP_tile_size_round_up(cr->width);
+        int tile_total = DP_tile_total_round(cr->width, cr->height);
+        for (int i = 0; i < tile_total; ++i) {
+            if (cr->mip.stale[i]) {
+                cr->mip.stale[i] = 0;
+                fn(user, i % xtiles, i / xtiles);
+            }
+        }
+        cr->mip.stale_count = 0;
     }
+}
 
-    if (cr->recalculate_vertices) {
-        calculate_vertices(cr);
+static int view_to_canvas(double v, double offset)
+{
+    return DP_double_to_int(floor(v + offset));
+}
+
+bool DP_canvas_renderer_view_bounds(DP_CanvasRenderer *cr, int view_width,
+                                    int view_height, DP_Rect *out_bounds)
+{
+    DP_ASSERT(cr);
+    DP_ASSERT(out_bounds);
+    DP_MaybeTransform mtf = DP_transform_invert(calculate_transform(
+        cr->transform.x, cr->transform.y, cr->transform.scale,
+        cr->transform.rotation_in_radians));
+    if (!mtf.valid) {
+        return false;
     }
 
-    render_texture(cr, view_height, view_width);
+    // The view's origin is in its center, the canvas' is in its top-left.
+    double w = DP_int_to_double(view_width) * 0.5;
+    double h = DP_int_to_double(view_height) * 0.5;
+    double cx = DP_int_to_double(cr->width) * 0.5;
+    double cy = DP_int_to_double(cr->height) * 0.5;
+    DP_Vec2 tl = DP_transform_xy(mtf.tf, -w, -h);
+    DP_Vec2 tr = DP_transform_xy(mtf.tf, w, -h);
+    DP_Vec2 br = DP_transform_xy(mtf.tf, w, h);
+    DP_Vec2 bl = DP_transform_xy(mtf.tf, -w, h);
+    DP_Rect bounds = DP_quad_bounds(DP_quad_make(
+        view_to_canvas(tl.x, cx), view_to_canvas(tl.y, cy),
+        view_to_canvas(tr.x, cx), view_to_canvas(tr.y, cy),
+        view_to_canvas(br.x, cx), view_to_canvas(br.y, cy),
+        view_to_canvas(bl.x, cx), view_to_canvas(bl.y, cy)));
+    *out_bounds = bounds;
+    return true;
 }
@@ -22,9 +22,10 @@
 #ifndef DRAWDANCE_CANVAS_RENDERER_H
 #define DRAWDANCE_CANVAS_RENDERER_H
 #include <dpcommon/common.h>
+#include <dpcommon/geom.h>
+#include <dpengine/mipmap.h>
 
-typedef struct DP_CanvasDiff DP_CanvasDiff;
-typedef struct DP_Layer DP_Layer;
+typedef struct DP_RenderFrame DP_RenderFrame;
 
 
 typedef struct DP_CanvasRenderer DP_CanvasRenderer;
@@ -42,9 +43,23 @@ void DP_canvas_renderer_transform_set(DP_CanvasRenderer *cr, double x, double y,
                                       double scale, double rotation_in_radians);
 
 
-void DP_canvas_renderer_render(DP_CanvasRenderer *cr, DP_Layer *layer,
-                               int view_width, int view_height,
-                               DP_CanvasDiff *diff_or_null);
+// Uploads the tiles of the given frame, if any, then renders the canvas. When
+// zoomed out, it renders a smaller mipmap level instead of the full canvas.
+void DP_canvas_renderer_render(DP_CanvasRenderer *cr,
+                               DP_RenderFrame *frame_or_null, int view_width,
+                               int view_height);
+
+// Calls the given function for every tile that changed while a smaller
+// mipmap level was being rendered, once back at full size. Those tiles were
+// never uploaded, so they need to be flattened again.
+void DP_canvas_renderer_stale_tiles_take(DP_CanvasRenderer *cr,
+                                         DP_MipmapTileFn fn, void *user);
+
+// Gets the bounding box of the canvas area visible in a view of the given
+// size, in canvas pixel coordinates. It may extend past the canvas. Returns
+// false if the current transform can't be inverted, such as at zero scale.
+bool DP_canvas_renderer_view_bounds(DP_CanvasRenderer *cr, int view_width,
+                                    int view_height, DP_Rect *out_bounds);
 
 
 #endif
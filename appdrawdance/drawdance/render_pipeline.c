@@ -0,0 +1,560 @@
+/*
+ * Copyright (c) 2022 askmeaboutloom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "render_pipeline.h"
+#include <dpclient/document.h>
+#include <dpcommon/common.h>
+#include <dpcommon/conversions.h>
+#include <dpcommon/geom.h>
+#include <dpcommon/threading.h>
+#include <dpcommon/trace.h>
+#include <dpengine/canvas_diff.h>
+#include <dpengine/canvas_state.h>
+#include <dpengine/tile.h>
+#include <SDL_atomic.h>
+#include <SDL_timer.h>
+
+#define INITIAL_TILE_CAPACITY 64
+
+// How long a single pass may spend on flattening tiles outside of the
+// viewport. Whatever doesn't fit gets carried over into the next frame.
+#define FLATTEN_BUDGET_MS 6
+
+
+// There's three frames that get passed around: the render thread flattens
+// into the back frame, then swaps it with the ready frame. The main thread
+// swaps the ready frame with the one it has taken. If the main thread didn't
+// get around to taking the ready frame before the next one got flattened,
+// the newer tiles are merged into it so that no changes get lost.
+//
+// Flattened tiles aren't kept around anywhere else, the texture already has
+// all of them. They're released once the main thread is done uploading them,
+// so at most the tiles of those three frames are alive at any point.
+//
+// Changed tiles don't all get flattened in one go. They're kept in a pending
+// list, ordered by their distance from the viewport. Tiles inside of the
+// viewport are always flattened right away, the rest only as long as the
+// pass stays within its time budget. Pending tiles are always flattened from
+// the newest canvas state, so it doesn't matter how long they wait.
+typedef struct DP_RenderPendingTile {
+    int distance;
+    int tile_index;
+} DP_RenderPendingTile;
+
+struct DP_RenderPipeline {
+    DP_CanvasState *blank_state;
+    DP_Mutex *mutex_doc; // Also guards the viewport and invalidated tiles.
+    DP_Document *doc;
+    bool viewport_valid;
+    DP_Rect viewport;
+    struct {
+        int count;
+        int capacity;
+        int *positions;
+    } invalidated;
+    DP_CanvasState *prev;
+    DP_CanvasDiff *diff;
+    struct {
+        int xtiles, ytiles;
+        int count;
+        unsigned char *marks;
+        DP_RenderPendingTile *tiles;
+    } pending;
+    int *merge_slots;
+    int merge_slots_capacity;
+    DP_Mutex *mutex_ready;
+    bool ready_valid;
+    DP_RenderFrame *back;
+    DP_RenderFrame *ready;
+    DP_RenderFrame *taken;
+    DP_RenderFrame frames[3];
+    SDL_atomic_t running;
+    SDL_atomic_t wake_pending;
+    DP_Semaphore *sem_wake;
+    DP_Thread *thread;
+};
+
+
+static void frame_push(DP_RenderFrame *frame, int x, int y, DP_Tile *tile)
+{
+    int index = frame->tile_count++;
+    if (index == frame->tile_capacity) {
+        int capacity = DP_max_int(INITIAL_TILE_CAPACITY, index * 2);
+        frame->tiles = DP_realloc(frame->tiles, DP_int_to_size(capacity)
+                                                    * sizeof(*frame->tiles));
+        frame->tile_capacity = capacity;
+    }
+    frame->tiles[index] = (DP_RenderTile){x, y, tile};
+}
+
+static void frame_clear(DP_RenderFrame *frame)
+{
+    if (frame->cs) {
+        DP_canvas_state_decref(frame->cs);
+        frame->cs = NULL;
+    }
+    int tile_count = frame->tile_count;
+    for (int i = 0; i < tile_count; ++i) {
+        DP_tile_decref_nullable(frame->tiles[i].tile);
+    }
+    frame->tile_count = 0;
+}
+
+static void frame_dispose(DP_RenderFrame *frame)
+{
+    frame_clear(frame);
+    DP_free(frame->tiles);
+}
+
+
+static void mark_pending(void *data, int tile_index)
+{
+    DP_RenderPipeline *rp = data;
+    if (!rp->pending.marks[tile_index]) {
+        rp->pending.marks[tile_index] = 1;
+        rp->pending.tiles[rp->pending.count++] =
+            (DP_RenderPendingTile){0, tile_index};
+    }
+}
+
+// Tiles outside of the current bounds can be skipped, since after a resize,
+// every tile is pending anyway.
+static void take_invalidated(DP_RenderPipeline *rp)
+{
+    int count = rp->invalidated.count;
+    int *positions = rp->invalidated.positions;
+    int xtiles = rp->pending.xtiles;
+    int ytiles = rp->pending.ytiles;
+    for (int i = 0; i < count; ++i) {
+        int tile_x = positions[i * 2];
+        int tile_y = positions[i * 2 + 1];
+        if (tile_x < xtiles && tile_y < ytiles) {
+            mark_pending(rp, tile_y * xtiles + tile_x);
+        }
+    }
+    rp->invalidated.count = 0;
+}
+
+static DP_CanvasState *next_state(DP_RenderPipeline *rp,
+                                  bool *out_viewport_valid,
+                                  DP_Rect *out_viewport)
+{
+    DP_CanvasState *prev = rp->prev;
+    DP_MUTEX_MUST_LOCK(rp->mutex_doc);
+    DP_Document *doc = rp->doc;
+    DP_CanvasState *next =
+        doc ? DP_document_canvas_state_compare_and_get(doc, prev)
+        : prev == rp->blank_state ? NULL
+                                  : DP_canvas_state_incref(rp->blank_state);
+    *out_viewport_valid = rp->viewport_valid;
+    *out_viewport = rp->viewport;
+    take_invalidated(rp);
+    DP_MUTEX_MUST_UNLOCK(rp->mutex_doc);
+    return next;
+}
+
+static void pending_resize(DP_RenderPipeline *rp, int xtiles, int ytiles)
+{
+    if (rp->pending.xtiles != xtiles || rp->pending.ytiles != ytiles) {
+        size_t tile_total = DP_int_to_size(xtiles * ytiles);
+        DP_free(rp->pending.marks);
+        DP_free(rp->pending.tiles);
+        rp->pending.xtiles = xtiles;
+        rp->pending.ytiles = ytiles;
+        rp->pending.count = 0;
+        rp->pending.marks = DP_malloc(tile_total);
+        memset(rp->pending.marks, 0, tile_total);
+        rp->pending.tiles =
+            DP_malloc(tile_total * sizeof(*rp->pending.tiles));
+    }
+}
+
+static int to_tile(int value)
+{
+    return value < 0 ? (value + 1) / DP_TILE_SIZE - 1 : value / DP_TILE_SIZE;
+}
+
+static int distance_to_range(int value, int min, int max)
+{
+    return value < min ? min - value : value > max ? value - max : 0;
+}
+
+static int compare_pending_tiles(const void *a, const void *b)
+{
+    const DP_RenderPendingTile *pa = a;
+    const DP_RenderPendingTile *pb = b;
+    int d = pa->distance - pb->distance;
+    return d == 0 ? pa->tile_index - pb->tile_index : d;
+}
+
+// Sorts pending tiles by their distance from the viewport in tiles, tiles
+// inside of it come first with a distance of zero. Without a viewport, every
+// tile counts as visible.
+static void sort_pending(DP_RenderPipeline *rp, DP_Rect *viewport_or_null)
+{
+    if (viewport_or_null) {
+        int xtiles = rp->pending.xtiles;
+        int x1 = to_tile(viewport_or_null->x1);
+        int y1 = to_tile(viewport_or_null->y1);
+        int x2 = to_tile(viewport_or_null->x2);
+        int y2 = to_tile(viewport_or_null->y2);
+        int count = rp->pending.count;
+        DP_RenderPendingTile *tiles = rp->pending.tiles;
+        for (int i = 0; i < count; ++i) {
+            int tile_index = tiles[i].tile_index;
+            int dx = distance_to_range(tile_index % xtiles, x1, x2);
+            int dy = distance_to_range(tile_index / xtiles, y1, y2);
+            tiles[i].distance = DP_max_int(dx, dy);
+        }
+        qsort(tiles, DP_int_to_size(count), sizeof(*tiles),
+              compare_pending_tiles);
+    }
+}
+
+static void push_flattened_tile(DP_RenderPipeline *rp, int tile_index)
+{
+    DP_RenderFrame *back = rp->back;
+    DP_Tile *tile = DP_canvas_state_flatten_tile(back->cs, tile_index);
+    // Blank tiles are uploaded from a static buffer, no need to keep them.
+    if (DP_tile_blank(tile)) {
+        DP_tile_decref(tile);
+        tile = NULL;
+    }
+    int xtiles = rp->pending.xtiles;
+    frame_push(back, tile_index % xtiles, tile_index / xtiles, tile);
+}
+
+static void flatten_pending(DP_RenderPipeline *rp)
+{
+    Uint64 start = SDL_GetPerformanceCounter();
+    Uint64 budget = SDL_GetPerformanceFrequency() * FLATTEN_BUDGET_MS / 1000;
+    int count = rp->pending.count;
+    DP_RenderPendingTile *tiles = rp->pending.tiles;
+    int done = 0;
+    bool offscreen_done = false;
+    while (done < count) {
+        DP_RenderPendingTile *pt = &tiles[done];
+        // Always flatten at least one tile outside of the viewport, so that
+        // they make progress even if the visible ones eat up the budget.
+        if (pt->distance != 0) {
+            if (offscreen_done
+                && SDL_GetPerformanceCounter() - start >= budget) {
+                break;
+            }
+            offscreen_done = true;
+        }
+        rp->pending.marks[pt->tile_index] = 0;
+        push_flattened_tile(rp, pt->tile_index);
+        ++done;
+    }
+
+    int left = count - done;
+    if (done != 0 && left != 0) {
+        memmove(tiles, tiles + done, DP_int_to_size(left) * sizeof(*tiles));
+    }
+    rp->pending.count = left;
+}
+
+static bool flatten(DP_RenderPipeline *rp)
+{
+    bool viewport_valid;
+    DP_Rect viewport;
+    DP_CanvasState *next = next_state(rp, &viewport_valid, &viewport);
+    if (next) {
+        DP_CanvasDiff *diff = rp->diff;
+        DP_canvas_state_diff(next, rp->prev, diff);
+        if (rp->prev) {
+            DP_canvas_state_decref(rp->prev);
+        }
+        rp->prev = next;
+        int width = DP_canvas_state_width(next);
+        int height = DP_canvas_state_height(next);
+        // On resize, every tile is part of the diff, so nothing gets lost.
+        pending_resize(rp, DP_tile_size_round_up(width),
+                       DP_tile_size_round_up(height));
+        DP_canvas_diff_each_index(diff, mark_pending, rp);
+    }
+    else if (rp->pending.count == 0) {
+        return false;
+    }
+
+    DP_RenderFrame *back = rp->back;
+    DP_ASSERT(!back->cs);
+    DP_ASSERT(back->tile_count == 0);
+    DP_CanvasState *cs = rp->prev;
+    back->cs = DP_canvas_state_incref(cs);
+    back->width = DP_canvas_state_width(cs);
+    back->height = DP_canvas_state_height(cs);
+    DP_TRACE_BEGIN("flatten");
+    sort_pending(rp, viewport_valid ? &viewport : NULL);
+    flatten_pending(rp);
+    DP_TRACE_END();
+    return true;
+}
+
+static int *get_merge_slots(DP_RenderPipeline *rp, int tile_total)
+{
+    if (rp->merge_slots_capacity < tile_total) {
+        rp->merge_slots = DP_realloc(rp->merge_slots,
+                                     DP_int_to_size(tile_total) * sizeof(int));
+        for (int i = rp->merge_slots_capacity; i < tile_total; ++i) {
+            rp->merge_slots[i] = -1;
+        }
+        rp->merge_slots_capacity = tile_total;
+    }
+    return rp->merge_slots;
+}
+
+// Moves the tiles from src into dst, replacing the ones at the same position
+// so that there's never more than one per position.
+static void merge_tiles(DP_RenderPipeline *rp, DP_RenderFrame *dst,
+                        DP_RenderFrame *src)
+{
+    int xtiles = DP_tile_size_round_up(dst->width);
+    int *slots = get_merge_slots(
+        rp, xtiles * DP_tile_size_round_up(dst->height));
+
+    int dst_count = dst->tile_count;
+    for (int i = 0; i < dst_count; ++i) {
+        DP_RenderTile *rt = &dst->tiles[i];
+        slots[rt->y * xtiles + rt->x] = i;
+    }
+
+    int src_count = src->tile_count;
+    for (int i = 0; i < src_count; ++i) {
+        DP_RenderTile *rt = &src->tiles[i];
+        int tile_index = rt->y * xtiles + rt->x;
+        int slot = slots[tile_index];
+        if (slot == -1) {
+            slots[tile_index] = dst->tile_count;
+            frame_push(dst, rt->x, rt->y, rt->tile);
+        }
+        else {
+            DP_tile_decref_nullable(dst->tiles[slot].tile);
+            dst->tiles[slot].tile = rt->tile;
+        }
+    }
+    src->tile_count = 0;
+
+    dst_count = dst->tile_count;
+    for (int i = 0; i < dst_count; ++i) {
+        DP_RenderTile *rt = &dst->tiles[i];
+        slots[rt->y * xtiles + rt->x] = -1;
+    }
+}
+
+static void merge_into_ready(DP_RenderPipeline *rp)
+{
+    DP_RenderFrame *back = rp->back;
+    DP_RenderFrame *ready = rp->ready;
+    // After a resize, the ready frame's tiles are all stale, since every
+    // tile is either part of the back frame or still pending.
+    if (back->width != ready->width || back->height != ready->height) {
+        rp->back = ready;
+        rp->ready = back;
+    }
+    else {
+        merge_tiles(rp, ready, back);
+        DP_CanvasState *cs = ready->cs;
+        ready->cs = back->cs;
+        back->cs = cs;
+    }
+}
+
+static void publish(DP_RenderPipeline *rp)
+{
+    DP_MUTEX_MUST_LOCK(rp->mutex_ready);
+    if (rp->ready_valid) {
+        merge_into_ready(rp);
+    }
+    else {
+        DP_RenderFrame *back = rp->back;
+        rp->back = rp->ready;
+        rp->ready = back;
+        rp->ready_valid = true;
+    }
+    DP_MUTEX_MUST_UNLOCK(rp->mutex_ready);
+    // Whatever ended up in the back frame is stale now.
+    frame_clear(rp->back);
+}
+
+
+static void run_render_thread(void *data)
+{
+    DP_RenderPipeline *rp = data;
+    DP_TRACE_THREAD_NAME("render");
+    while (true) {
+        DP_SEMAPHORE_MUST_WAIT(rp->sem_wake);
+        SDL_AtomicSet(&rp->wake_pending, 0);
+        if (SDL_AtomicGet(&rp->running)) {
+            if (flatten(rp)) {
+                publish(rp);
+            }
+        }
+        else {
+            break;
+        }
+    }
+}
+
+DP_RenderPipeline *DP_render_pipeline_new(DP_CanvasState *blank_state,
+                                          bool threaded)
+{
+    DP_ASSERT(blank_state);
+    DP_RenderPipeline *rp = DP_malloc(sizeof(*rp));
+    *rp = (DP_RenderPipeline){DP_canvas_state_incref(blank_state),
+                              NULL,
+                              NULL,
+                              false,
+                              {0, 0, 0, 0},
+                              {0, 0, NULL},
+                              NULL,
+                              DP_canvas_diff_new(),
+                              {0, 0, 0, NULL, NULL},
+                              NULL,
+                              0,
+                              NULL,
+                              false,
+                              NULL,
+                              NULL,
+                              NULL,
+                              {{NULL, 0, 0, 0, 0, NULL},
+                               {NULL, 0, 0, 0, 0, NULL},
+                               {NULL, 0, 0, 0, 0, NULL}},
+                              {0},
+                              {0},
+                              NULL,
+                              NULL};
+    rp->back = &rp->frames[0];
+    rp->ready = &rp->frames[1];
+    rp->taken = &rp->frames[2];
+
+    if (!(rp->mutex_doc = DP_mutex_new())
+        || !(rp->mutex_ready = DP_mutex_new())) {
+        DP_render_pipeline_free(rp);
+        return NULL;
+    }
+
+    if (threaded) {
+        SDL_AtomicSet(&rp->running, 1);
+        if (!(rp->sem_wake = DP_semaphore_new(0))
+            || !(rp->thread = DP_thread_new(run_render_thread, rp))) {
+            DP_render_pipeline_free(rp);
+            return NULL;
+        }
+    }
+
+    return rp;
+}
+
+void DP_render_pipeline_free(DP_RenderPipeline *rp)
+{
+    if (rp) {
+        if (rp->thread) {
+            SDL_AtomicSet(&rp->running, 0);
+            DP_SEMAPHORE_MUST_POST(rp->sem_wake);
+            DP_thread_free_join(rp->thread);
+        }
+        DP_semaphore_free(rp->sem_wake);
+        for (int i = 0; i < 3; ++i) {
+            frame_dispose(&rp->frames[i]);
+        }
+        DP_mutex_free(rp->mutex_ready);
+        DP_free(rp->merge_slots);
+        DP_free(rp->pending.tiles);
+        DP_free(rp->pending.marks);
+        DP_canvas_diff_free(rp->diff);
+        if (rp->prev) {
+            DP_canvas_state_decref(rp->prev);
+        }
+        DP_free(rp->invalidated.positions);
+        DP_mutex_free(rp->mutex_doc);
+        DP_canvas_state_decref(rp->blank_state);
+        DP_free(rp);
+    }
+}
+
+void DP_render_pipeline_document_set(DP_RenderPipeline *rp,
+                                     DP_Document *doc_or_null)
+{
+    DP_ASSERT(rp);
+    // Blocks until the render thread is done getting the state out of the
+    // previous document, so the caller may free that one afterwards.
+    DP_MUTEX_MUST_LOCK(rp->mutex_doc);
+    rp->doc = doc_or_null;
+    DP_MUTEX_MUST_UNLOCK(rp->mutex_doc);
+}
+
+void DP_render_pipeline_viewport_set(DP_RenderPipeline *rp, DP_Rect viewport)
+{
+    DP_ASSERT(rp);
+    DP_MUTEX_MUST_LOCK(rp->mutex_doc);
+    rp->viewport_valid = true;
+    rp->viewport = viewport;
+    DP_MUTEX_MUST_UNLOCK(rp->mutex_doc);
+}
+
+void DP_render_pipeline_tile_invalidate(DP_RenderPipeline *rp, int tile_x,
+                                        int tile_y)
+{
+    DP_ASSERT(rp);
+    DP_ASSERT(tile_x >= 0);
+    DP_ASSERT(tile_y >= 0);
+    DP_MUTEX_MUST_LOCK(rp->mutex_doc);
+    int index = rp->invalidated.count++;
+    if (index == rp->invalidated.capacity) {
+        int capacity = DP_max_int(INITIAL_TILE_CAPACITY, index * 2);
+        rp->invalidated.positions =
+            DP_realloc(rp->invalidated.positions,
+                       DP_int_to_size(capacity) * 2 * sizeof(int));
+        rp->invalidated.capacity = capacity;
+    }
+    rp->invalidated.positions[index * 2] = tile_x;
+    rp->invalidated.positions[index * 2 + 1] = tile_y;
+    DP_MUTEX_MUST_UNLOCK(rp->mutex_doc);
+}
+
+DP_RenderFrame *DP_render_pipeline_frame_take(DP_RenderPipeline *rp)
+{
+    DP_ASSERT(rp);
+    bool threaded = rp->thread != NULL;
+    if (!threaded && flatten(rp)) {
+        publish(rp);
+    }
+
+    DP_RenderFrame *frame;
+    DP_MUTEX_MUST_LOCK(rp->mutex_ready);
+    if (rp->ready_valid) {
+        frame = rp->ready;
+        rp->ready = rp->taken;
+        rp->taken = frame;
+        rp->ready_valid = false;
+    }
+    else {
+        frame = NULL;
+    }
+    DP_MUTEX_MUST_UNLOCK(rp->mutex_ready);
+
+    if (threaded && SDL_AtomicCAS(&rp->wake_pending, 0, 1)) {
+        DP_SEMAPHORE_MUST_POST(rp->sem_wake);
+    }
+    return frame;
+}
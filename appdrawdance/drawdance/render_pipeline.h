@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2022 askmeaboutloom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef DRAWDANCE_RENDER_PIPELINE_H
+#define DRAWDANCE_RENDER_PIPELINE_H
+#include <dpcommon/common.h>
+#include <dpcommon/geom.h>
+
+typedef struct DP_CanvasState DP_CanvasState;
+typedef struct DP_Document DP_Document;
+typedef struct DP_Tile DP_Tile;
+
+
+// Flattens the canvas off the main thread. The main thread takes a frame each
+// time around its loop, which contains the tiles that changed since the last
+// frame it took, ready to be uploaded. Changed tiles away from the viewport
+// may be spread over several frames. Taking a frame also wakes up the render
+// thread to flatten the next one, so that overlaps with presentation.
+
+typedef struct DP_RenderTile {
+    int x, y;
+    DP_Tile *tile; // NULL for a blank tile.
+} DP_RenderTile;
+
+typedef struct DP_RenderFrame {
+    DP_CanvasState *cs;
+    int width, height;
+    int tile_count;
+    int tile_capacity;
+    DP_RenderTile *tiles;
+} DP_RenderFrame;
+
+typedef struct DP_RenderPipeline DP_RenderPipeline;
+
+// Without threading, frames get flattened on the spot when they're taken.
+DP_RenderPipeline *DP_render_pipeline_new(DP_CanvasState *blank_state,
+                                          bool threaded);
+
+void DP_render_pipeline_free(DP_RenderPipeline *rp);
+
+void DP_render_pipeline_document_set(DP_RenderPipeline *rp,
+                                     DP_Document *doc_or_null);
+
+// Sets the area of the canvas that's visible, in canvas pixel coordinates.
+// Changed tiles in there are flattened first and aren't subject to the time
+// budget, so the view is up to date in the next frame even if the entire
+// canvas changed. Until this is called, everything is considered visible.
+void DP_render_pipeline_viewport_set(DP_RenderPipeline *rp, DP_Rect viewport);
+
+// Flattens the given tile again in a later frame, even if it didn't change.
+void DP_render_pipeline_tile_invalidate(DP_RenderPipeline *rp, int tile_x,
+                                        int tile_y);
+
+// Returns the newest flattened frame or NULL if nothing changed. The frame
+// stays valid until the next call to this function.
+DP_RenderFrame *DP_render_pipeline_frame_take(DP_RenderPipeline *rp);
+
+
+#endif
@@ -0,0 +1,463 @@
+/*
+ * Copyright (c) 2022 askmeaboutloom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "tile_atlas.h"
+#include "gl.h"
+#include <dpcommon/common.h>
+#include <dpcommon/conversions.h>
+#include <dpengine/perf.h>
+#include <dpengine/pixels.h>
+#include <dpengine/tile.h>
+#include <gles2_inc.h>
+
+#define PAGE_TILES_PER_ROW (DP_TILE_ATLAS_PAGE_SIZE / DP_TILE_SIZE)
+#define PAGE_CAPACITY      (PAGE_TILES_PER_ROW * PAGE_TILES_PER_ROW)
+#define VERTICES_PER_TILE  6
+#define FLOATS_PER_TILE    (VERTICES_PER_TILE * 2)
+
+
+typedef struct DP_TileAtlasPage {
+    unsigned int texture;
+    int used;
+    int draw_first, draw_count;
+    int tile_indexes[PAGE_CAPACITY]; // -1 for free cells.
+} DP_TileAtlasPage;
+
+typedef struct DP_TileAtlasUpload {
+    int slot;
+    int order;
+    const DP_Pixel *pixels;
+} DP_TileAtlasUpload;
+
+struct DP_TileAtlas {
+    int width, height;
+    int xtiles, ytiles;
+    int *slots; // Per tile position, page * PAGE_CAPACITY + cell or -1.
+    int tile_count;
+    int page_count;
+    DP_TileAtlasPage **pages; // NULL entries for released pages.
+    bool geometry_dirty;
+    unsigned int buffers[2];
+    int geometry_capacity;
+    float *positions;
+    float *uvs;
+    struct {
+        int count, capacity;
+        DP_TileAtlasUpload *entries;
+        DP_Pixel *staging; // Page row sized, spans get put together in here.
+    } uploads;
+};
+
+
+DP_TileAtlas *DP_tile_atlas_new(void)
+{
+    DP_TileAtlas *ta = DP_malloc(sizeof(*ta));
+    *ta = (DP_TileAtlas){0,     0,
+                         0,     0,
+                         NULL,  0,
+                         0,     NULL,
+                         false, {0, 0},
+                         0,     NULL,
+                         NULL,  {0, 0, NULL, NULL}};
+    DP_GL(glGenBuffers, 2, ta->buffers);
+    return ta;
+}
+
+static void page_free(DP_TileAtlasPage *page)
+{
+    DP_GL(glDeleteTextures, 1, &page->texture);
+    DP_free(page);
+}
+
+void DP_tile_atlas_free(DP_TileAtlas *ta)
+{
+    if (ta) {
+        for (int i = 0; i < ta->page_count; ++i) {
+            if (ta->pages[i]) {
+                page_free(ta->pages[i]);
+            }
+        }
+        DP_free(ta->pages);
+        DP_free(ta->uploads.staging);
+        DP_free(ta->uploads.entries);
+        DP_free(ta->uvs);
+        DP_free(ta->positions);
+        DP_free(ta->slots);
+        DP_GL(glDeleteBuffers, 2, ta->buffers);
+        DP_free(ta);
+    }
+}
+
+
+void DP_tile_atlas_resize(DP_TileAtlas *ta, int width, int height)
+{
+    DP_ASSERT(ta);
+    int xtiles = DP_tile_size_round_up(width);
+    int ytiles = DP_tile_size_round_up(height);
+    size_t tile_total = DP_int_to_size(xtiles) * DP_int_to_size(ytiles);
+    DP_free(ta->slots);
+    ta->slots = DP_malloc(tile_total * sizeof(*ta->slots));
+    for (size_t i = 0; i < tile_total; ++i) {
+        ta->slots[i] = -1;
+    }
+    ta->width = width;
+    ta->height = height;
+    ta->xtiles = xtiles;
+    ta->ytiles = ytiles;
+
+    for (int i = 0; i < ta->page_count; ++i) {
+        DP_TileAtlasPage *page = ta->pages[i];
+        if (page) {
+            page->used = 0;
+            for (int j = 0; j < PAGE_CAPACITY; ++j) {
+                page->tile_indexes[j] = -1;
+            }
+        }
+    }
+    ta->tile_count = 0;
+    ta->uploads.count = 0;
+    ta->geometry_dirty = true;
+}
+
+
+static DP_TileAtlasPage *page_new(void)
+{
+    DP_TileAtlasPage *page = DP_malloc(sizeof(*page));
+    page->used = 0;
+    page->draw_first = 0;
+    page->draw_count = 0;
+    for (int i = 0; i < PAGE_CAPACITY; ++i) {
+        page->tile_indexes[i] = -1;
+    }
+    DP_GL(glGenTextures, 1, &page->texture);
+    DP_GL(glBindTexture, GL_TEXTURE_2D, page->texture);
+    DP_GL(glTexParameteri, GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    DP_GL(glTexParameteri, GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    DP_GL(glTexParameteri, GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    DP_GL(glTexParameteri, GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    DP_GL(glTexImage2D, GL_TEXTURE_2D, 0, GL_RGBA, DP_TILE_ATLAS_PAGE_SIZE,
+          DP_TILE_ATLAS_PAGE_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    return page;
+}
+
+static int find_free_cell(DP_TileAtlasPage *page)
+{
+    DP_ASSERT(page->used < PAGE_CAPACITY);
+    int cell = 0;
+    while (page->tile_indexes[cell] != -1) {
+        ++cell;
+    }
+    return cell;
+}
+
+static int allocate_slot(DP_TileAtlas *ta, int tile_index)
+{
+    int page_index = -1;
+    int page_count = ta->page_count;
+    for (int i = 0; i < page_count; ++i) {
+        DP_TileAtlasPage *page = ta->pages[i];
+        if (page ? page->used < PAGE_CAPACITY : page_index == -1) {
+            page_index = i;
+            if (page) {
+                break;
+            }
+        }
+    }
+
+    if (page_index == -1) {
+        page_index = ta->page_count++;
+        ta->pages = DP_realloc(ta->pages, DP_int_to_size(ta->page_count)
+                                              * sizeof(*ta->pages));
+        ta->pages[page_index] = NULL;
+    }
+
+    DP_TileAtlasPage *page = ta->pages[page_index];
+    if (!page) {
+        page = page_new();
+        ta->pages[page_index] = page;
+    }
+
+    int cell = find_free_cell(page);
+    page->tile_indexes[cell] = tile_index;
+    ++page->used;
+    ++ta->tile_count;
+    ta->geometry_dirty = true;
+    return page_index * PAGE_CAPACITY + cell;
+}
+
+static void release_slot(DP_TileAtlas *ta, int slot)
+{
+    DP_TileAtlasPage *page = ta->pages[slot / PAGE_CAPACITY];
+    page->tile_indexes[slot % PAGE_CAPACITY] = -1;
+    --page->used;
+    --ta->tile_count;
+    ta->geometry_dirty = true;
+}
+
+static void queue_upload(DP_TileAtlas *ta, int slot, const DP_Pixel *pixels)
+{
+    int index = ta->uploads.count++;
+    if (index == ta->uploads.capacity) {
+        int capacity = DP_max_int(index * 2, 64);
+        ta->uploads.entries =
+            DP_realloc(ta->uploads.entries,
+                       DP_int_to_size(capacity) * sizeof(*ta->uploads.entries));
+        ta->uploads.capacity = capacity;
+    }
+    ta->uploads.entries[index] = (DP_TileAtlasUpload){slot, index, pixels};
+}
+
+void DP_tile_atlas_tile_set(DP_TileAtlas *ta, int tile_x, int tile_y,
+                            const DP_Pixel *pixels_or_null)
+{
+    DP_ASSERT(ta);
+    DP_ASSERT(tile_x >= 0 && tile_x < ta->xtiles);
+    DP_ASSERT(tile_y >= 0 && tile_y < ta->ytiles);
+    int tile_index = tile_y * ta->xtiles + tile_x;
+    int slot = ta->slots[tile_index];
+    if (pixels_or_null) {
+        if (slot == -1) {
+            slot = allocate_slot(ta, tile_index);
+            ta->slots[tile_index] = slot;
+        }
+        queue_upload(ta, slot, pixels_or_null);
+    }
+    else if (slot != -1) {
+        release_slot(ta, slot);
+        ta->slots[tile_index] = -1;
+    }
+}
+
+static int compare_uploads(const void *a, const void *b)
+{
+    const DP_TileAtlasUpload *ua = a;
+    const DP_TileAtlasUpload *ub = b;
+    return ua->slot == ub->slot ? ua->order - ub->order : ua->slot - ub->slot;
+}
+
+// Sorts the uploads by slot and drops the ones that don't apply anymore: a
+// slot may have been written several times, where only the last one counts,
+// or it may have been freed again since.
+static int sort_uploads(DP_TileAtlas *ta)
+{
+    DP_TileAtlasUpload *entries = ta->uploads.entries;
+    int count = ta->uploads.count;
+    qsort(entries, DP_int_to_size(count), sizeof(*entries), compare_uploads);
+    int used = 0;
+    for (int i = 0; i < count; ++i) {
+        int slot = entries[i].slot;
+        bool superseded = i + 1 < count && entries[i + 1].slot == slot;
+        int tile_index =
+            ta->pages[slot / PAGE_CAPACITY]->tile_indexes[slot % PAGE_CAPACITY];
+        if (!superseded && tile_index != -1) {
+            entries[used++] = entries[i];
+        }
+    }
+    return used;
+}
+
+static int span_length(DP_TileAtlasUpload *entries, int count, int start)
+{
+    // Page capacity is a multiple of the row length, so the same row in the
+    // same page means the same quotient.
+    int row = entries[start].slot / PAGE_TILES_PER_ROW;
+    int end = start + 1;
+    while (end < count && entries[end].slot == entries[end - 1].slot + 1
+           && entries[end].slot / PAGE_TILES_PER_ROW == row) {
+        ++end;
+    }
+    return end - start;
+}
+
+// GLES2 has no unpack row length, so a span's tiles get interleaved row by
+// row in the staging buffer. A single tile can be uploaded as-is.
+static const DP_Pixel *span_pixels(DP_TileAtlas *ta,
+                                   DP_TileAtlasUpload *entries, int length)
+{
+    if (length == 1) {
+        return entries[0].pixels;
+    }
+
+    DP_Pixel *staging = ta->uploads.staging;
+    if (!staging) {
+        staging = DP_malloc(PAGE_TILES_PER_ROW * DP_TILE_BYTES);
+        ta->uploads.staging = staging;
+    }
+
+    int stride = length * DP_TILE_SIZE;
+    for (int i = 0; i < length; ++i) {
+        const DP_Pixel *src = entries[i].pixels;
+        for (int y = 0; y < DP_TILE_SIZE; ++y) {
+            memcpy(staging + y * stride + i * DP_TILE_SIZE,
+                   src + y * DP_TILE_SIZE, DP_TILE_SIZE * sizeof(*src));
+        }
+    }
+    return staging;
+}
+
+void DP_tile_atlas_flush(DP_TileAtlas *ta)
+{
+    DP_ASSERT(ta);
+    int count = sort_uploads(ta);
+    int calls = 0;
+    unsigned int bound_texture = 0;
+    for (int i = 0; i < count;) {
+        DP_TileAtlasUpload *entries = &ta->uploads.entries[i];
+        int length = span_length(ta->uploads.entries, count, i);
+        int slot = entries[0].slot;
+        unsigned int texture = ta->pages[slot / PAGE_CAPACITY]->texture;
+        if (texture != bound_texture) {
+            DP_GL(glBindTexture, GL_TEXTURE_2D, texture);
+            bound_texture = texture;
+        }
+        int cell = slot % PAGE_CAPACITY;
+        DP_GL(glTexSubImage2D, GL_TEXTURE_2D, 0,
+              (cell % PAGE_TILES_PER_ROW) * DP_TILE_SIZE,
+              (cell / PAGE_TILES_PER_ROW) * DP_TILE_SIZE,
+              length * DP_TILE_SIZE, DP_TILE_SIZE, GL_RGBA, GL_UNSIGNED_BYTE,
+              span_pixels(ta, entries, length));
+        ++calls;
+        i += length;
+    }
+    DP_perf_record_uploads(calls, count,
+                           DP_int_to_size(count) * DP_TILE_BYTES);
+    ta->uploads.count = 0;
+}
+
+
+int DP_tile_atlas_tile_count(DP_TileAtlas *ta)
+{
+    DP_ASSERT(ta);
+    return ta->tile_count;
+}
+
+int DP_tile_atlas_page_count(DP_TileAtlas *ta)
+{
+    DP_ASSERT(ta);
+    int count = 0;
+    for (int i = 0; i < ta->page_count; ++i) {
+        if (ta->pages[i]) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+
+static float *push_quad(float *out, float x1, float y1, float x2, float y2)
+{
+    float quad[FLOATS_PER_TILE] = {x1, y1, x1, y2, x2, y1,
+                                   x2, y1, x1, y2, x2, y2};
+    memcpy(out, quad, sizeof(quad));
+    return out + FLOATS_PER_TILE;
+}
+
+static void push_tile_geometry(DP_TileAtlas *ta, int tile_index, int cell,
+                               float **positions, float **uvs)
+{
+    // Tiles on the right and bottom edges get cut off at the canvas bounds.
+    int x = (tile_index % ta->xtiles) * DP_TILE_SIZE;
+    int y = (tile_index / ta->xtiles) * DP_TILE_SIZE;
+    int width = DP_min_int(DP_TILE_SIZE, ta->width - x);
+    int height = DP_min_int(DP_TILE_SIZE, ta->height - y);
+    *positions =
+        push_quad(*positions, DP_int_to_float(x), DP_int_to_float(y),
+                  DP_int_to_float(x + width), DP_int_to_float(y + height));
+
+    float page_size = DP_int_to_float(DP_TILE_ATLAS_PAGE_SIZE);
+    int u = (cell % PAGE_TILES_PER_ROW) * DP_TILE_SIZE;
+    int v = (cell / PAGE_TILES_PER_ROW) * DP_TILE_SIZE;
+    *uvs = push_quad(*uvs, DP_int_to_float(u) / page_size,
+                     DP_int_to_float(v) / page_size,
+                     DP_int_to_float(u + width) / page_size,
+                     DP_int_to_float(v + height) / page_size);
+}
+
+// Releases pages that ended up empty and lays out the vertices so that each
+// page's tiles are next to each other and can be drawn in one call.
+static void rebuild_geometry(DP_TileAtlas *ta)
+{
+    int tile_count = ta->tile_count;
+    if (ta->geometry_capacity < tile_count) {
+        size_t size = DP_int_to_size(tile_count) * FLOATS_PER_TILE
+                    * sizeof(*ta->positions);
+        ta->positions = DP_realloc(ta->positions, size);
+        ta->uvs = DP_realloc(ta->uvs, size);
+        ta->geometry_capacity = tile_count;
+    }
+
+    float *positions = ta->positions;
+    float *uvs = ta->uvs;
+    int vertex_count = 0;
+    for (int i = 0; i < ta->page_count; ++i) {
+        DP_TileAtlasPage *page = ta->pages[i];
+        if (page && page->used == 0) {
+            page_free(page);
+            ta->pages[i] = NULL;
+        }
+        else if (page) {
+            page->draw_first = vertex_count;
+            for (int cell = 0; cell < PAGE_CAPACITY; ++cell) {
+                int tile_index = page->tile_indexes[cell];
+                if (tile_index != -1) {
+                    push_tile_geometry(ta, tile_index, cell, &positions, &uvs);
+                }
+            }
+            page->draw_count = page->used * VERTICES_PER_TILE;
+            vertex_count += page->draw_count;
+        }
+    }
+
+    size_t size =
+        DP_int_to_size(vertex_count) * 2 * sizeof(*ta->positions);
+    DP_GL(glBindBuffer, GL_ARRAY_BUFFER, ta->buffers[0]);
+    DP_GL(glBufferData, GL_ARRAY_BUFFER, DP_size_to_int(size), ta->positions,
+          GL_STATIC_DRAW);
+    DP_GL(glBindBuffer, GL_ARRAY_BUFFER, ta->buffers[1]);
+    DP_GL(glBufferData, GL_ARRAY_BUFFER, DP_size_to_int(size), ta->uvs,
+          GL_STATIC_DRAW);
+    ta->geometry_dirty = false;
+}
+
+void DP_tile_atlas_draw(DP_TileAtlas *ta)
+{
+    DP_ASSERT(ta);
+    DP_ASSERT(ta->uploads.count == 0);
+    if (ta->geometry_dirty) {
+        rebuild_geometry(ta);
+    }
+
+    DP_GL(glEnableVertexAttribArray, 0);
+    DP_GL(glBindBuffer, GL_ARRAY_BUFFER, ta->buffers[0]);
+    DP_GL(glVertexAttribPointer, 0, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+    DP_GL(glEnableVertexAttribArray, 1);
+    DP_GL(glBindBuffer, GL_ARRAY_BUFFER, ta->buffers[1]);
+    DP_GL(glVertexAttribPointer, 1, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+
+    for (int i = 0; i < ta->page_count; ++i) {
+        DP_TileAtlasPage *page = ta->pages[i];
+        if (page) {
+            DP_GL(glBindTexture, GL_TEXTURE_2D, page->texture);
+            DP_GL(glDrawArrays, GL_TRIANGLES, page->draw_first,
+                  page->draw_count);
+        }
+    }
+}
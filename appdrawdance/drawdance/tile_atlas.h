@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2022 askmeaboutloom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef DRAWDANCE_TILE_ATLAS_H
+#define DRAWDANCE_TILE_ATLAS_H
+#include <dpcommon/common.h>
+
+typedef union DP_Pixel DP_Pixel;
+
+
+#define DP_TILE_ATLAS_PAGE_SIZE 1024
+
+// Holds the canvas' tiles in fixed-size texture pages instead of a single
+// texture covering the whole canvas. A table maps each tile position to the
+// page and cell its pixels are in. Blank tiles aren't stored at all and
+// don't get drawn either, so they don't cost any texture memory. Resizing
+// only reallocates the table, the pages are left alone.
+
+typedef struct DP_TileAtlas DP_TileAtlas;
+
+DP_TileAtlas *DP_tile_atlas_new(void);
+
+void DP_tile_atlas_free(DP_TileAtlas *ta);
+
+// Forgets about all tiles, the next frame after a resize brings them anew.
+void DP_tile_atlas_resize(DP_TileAtlas *ta, int width, int height);
+
+// Queues the given pixels for upload to the tile at the given position,
+// taking a free cell if it doesn't have one yet. They must stay valid until
+// the next flush. NULL means blank, which frees its cell without an upload.
+void DP_tile_atlas_tile_set(DP_TileAtlas *ta, int tile_x, int tile_y,
+                            const DP_Pixel *pixels_or_null);
+
+// Uploads the queued tiles. Tiles in adjacent cells of the same page row get
+// merged into a single upload, so a full redraw takes one call per row.
+void DP_tile_atlas_flush(DP_TileAtlas *ta);
+
+int DP_tile_atlas_tile_count(DP_TileAtlas *ta);
+
+int DP_tile_atlas_page_count(DP_TileAtlas *ta);
+
+// Draws the stored tiles with the currently bound program, one draw call per
+// page. Must be flushed beforehand. Canvas pixel positions go into attribute
+// 0, texture coordinates into attribute 1. Pages are bound to the active
+// texture unit.
+void DP_tile_atlas_draw(DP_TileAtlas *ta);
+
+
+#endif
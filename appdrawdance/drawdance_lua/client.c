@@ -27,6 +27,7 @@
 #include <dpclient/ext_auth.h>
 #include <dpcommon/common.h>
 #include <dpcommon/worker.h>
+#include <dpengine/canvas_history.h>
 #include <dpmsg/message.h>
 #include <dpmsg/messages/command.h>
 #include <dpmsg/messages/internal.h>
@@ -95,6 +96,9 @@ static void on_event(void *data, DP_Client *client, DP_ClientEventType type,
                                        message_or_null);
 
     if (type == DP_CLIENT_EVENT_FREE) {
+        if (lcd->doc) {
+            DP_document_networked_set(lcd->doc, false);
+        }
         int doc_ref = lcd->doc_ref;
         if (doc_ref != LUA_NOREF) {
             luaL_unref(L, LUA_REGISTRYINDEX, doc_ref);
@@ -247,7 +251,16 @@ static int client_send(lua_State *L)
 {
     DP_Client *client = check_client(L, 1);
     DP_Message **pp = luaL_checkudata(L, 2, "DP_Message");
-    DP_client_send_inc(client, *pp);
+    DP_Message *msg = *pp;
+    // Show drawing commands right away instead of waiting for the echo. The
+    // echo gets pushed from the receiving thread, so the local command has to
+    // be queued before sending, otherwise the echo could get there first.
+    DP_LuaClientData *lcd = DP_client_callback_data(client);
+    DP_MessageType type = DP_message_type(msg);
+    if (lcd->doc && DP_canvas_history_can_handle_local(type)) {
+        DP_document_command_push_local_inc(lcd->doc, msg);
+    }
+    DP_client_send_inc(client, msg);
     return 0;
 }
 
@@ -263,6 +276,20 @@ static int client_attach_document(lua_State *L)
         lua_pushvalue(L, 2);
         lcd->doc_ref = luaL_ref(L, LUA_REGISTRYINDEX);
         lcd->doc = *pp;
+        DP_document_networked_set(lcd->doc, true);
+    }
+    return 0;
+}
+
+static int client_set_local_context_id(lua_State *L)
+{
+    DP_Client *client = check_client(L, 1);
+    lua_Integer context_id = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, context_id >= 0 && context_id <= 255, 2,
+                  "context id out of bounds");
+    DP_LuaClientData *lcd = DP_client_callback_data(client);
+    if (lcd->doc) {
+        DP_document_local_context_id_set(lcd->doc, (unsigned int)context_id);
     }
     return 0;
 }
@@ -300,6 +327,7 @@ static const luaL_Reg client_methods[] = {
     {"terminate", client_gc},
     {"send", client_send},
     {"attach_document", client_attach_document},
+    {"set_local_context_id", client_set_local_context_id},
     {"start_ping_timer", client_start_ping_timer},
     {"ext_auth", client_ext_auth},
     {NULL, NULL},
@@ -599,14 +599,22 @@ int DP_lua_canvas_state_init(lua_State *L);
 int DP_lua_client_init(lua_State *L);
 int DP_lua_document_init(lua_State *L);
 int DP_lua_message_init(lua_State *L);
+int DP_lua_perf_init(lua_State *L);
 int DP_lua_ui_init(lua_State *L);
 
 static int init_bindings(lua_State *L)
 {
     static const lua_CFunction init_funcs[] = {
-        init_lua_libs,        init_app_funcs,           init_imgui,
-        init_package,         DP_lua_canvas_state_init, DP_lua_client_init,
-        DP_lua_document_init, DP_lua_message_init,      init_global_environment,
+        init_lua_libs,
+        init_app_funcs,
+        init_imgui,
+        init_package,
+        DP_lua_canvas_state_init,
+        DP_lua_client_init,
+        DP_lua_document_init,
+        DP_lua_message_init,
+        DP_lua_perf_init,
+        init_global_environment,
         DP_lua_ui_init,
     };
     lua_pushcfunction(L, init_lua_app_state);
@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2022 askmeaboutloom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "lua_bindings.h"
+#include "lua_util.h"
+#include <dpcommon/common.h>
+#include <dpcommon/memory_stats.h>
+#include <dpcommon/output.h>
+#include <dpcommon/trace.h>
+#include <dpengine/perf.h>
+#include <dpengine/tile.h>
+#include <lauxlib.h>
+#include <lua.h>
+#include <lualib.h>
+
+
+static int perf_enable(lua_State *L)
+{
+    DP_perf_enable(lua_toboolean(L, 1));
+    return 0;
+}
+
+static int perf_enabled(lua_State *L)
+{
+    lua_pushboolean(L, DP_perf_enabled());
+    return 1;
+}
+
+static int perf_reset(DP_UNUSED lua_State *L)
+{
+    DP_perf_reset();
+    return 0;
+}
+
+static void push_buckets(lua_State *L, const unsigned long long *buckets)
+{
+    lua_createtable(L, DP_PERF_BUCKET_COUNT, 0);
+    for (int i = 0; i < DP_PERF_BUCKET_COUNT; ++i) {
+        lua_pushinteger(L, (lua_Integer)buckets[i]);
+        lua_seti(L, -2, i + 1);
+    }
+}
+
+static void push_timing(lua_State *L, const DP_PerfTiming *timing)
+{
+    lua_createtable(L, 0, 3);
+    lua_pushinteger(L, (lua_Integer)timing->count);
+    lua_setfield(L, -2, "count");
+    lua_pushinteger(L, (lua_Integer)timing->total_ns);
+    lua_setfield(L, -2, "total_ns");
+    push_buckets(L, timing->buckets);
+    lua_setfield(L, -2, "buckets");
+}
+
+// Keyed by message type, types that didn't get handled are left out.
+static void push_timings_by_type(lua_State *L, const DP_PerfTiming *timings)
+{
+    lua_newtable(L);
+    for (int i = 0; i < DP_MSG_COUNT; ++i) {
+        if (timings[i].count != 0) {
+            push_timing(L, &timings[i]);
+            lua_seti(L, -2, i);
+        }
+    }
+}
+
+static void push_uploads(lua_State *L, const DP_PerfUploads *uploads)
+{
+    lua_createtable(L, 0, 3);
+    lua_pushinteger(L, (lua_Integer)uploads->calls);
+    lua_setfield(L, -2, "calls");
+    lua_pushinteger(L, (lua_Integer)uploads->tiles);
+    lua_setfield(L, -2, "tiles");
+    lua_pushinteger(L, (lua_Integer)uploads->bytes);
+    lua_setfield(L, -2, "bytes");
+}
+
+static int perf_stats(lua_State *L)
+{
+    DP_PerfStats *stats = DP_malloc(sizeof(*stats));
+    DP_perf_stats(stats);
+    lua_createtable(L, 0, 5);
+    push_timings_by_type(L, stats->handle);
+    lua_setfield(L, -2, "handle");
+    push_timings_by_type(L, stats->history);
+    lua_setfield(L, -2, "history");
+    push_timing(L, &stats->undo_replay);
+    lua_setfield(L, -2, "undo_replay");
+    push_buckets(L, stats->undo_replay_lengths);
+    lua_setfield(L, -2, "undo_replay_lengths");
+    push_uploads(L, &stats->uploads);
+    lua_setfield(L, -2, "uploads");
+    DP_free(stats);
+    return 1;
+}
+
+static int perf_memory_stats(lua_State *L)
+{
+    DP_MemoryStats stats;
+    DP_memory_stats(&stats);
+    lua_createtable(L, 0, DP_MEMORY_CATEGORY_COUNT + 2);
+    for (int i = 0; i < DP_MEMORY_CATEGORY_COUNT; ++i) {
+        lua_pushinteger(L, (lua_Integer)stats.bytes[i]);
+        lua_setfield(L, -2, DP_memory_category_name((DP_MemoryCategory)i));
+    }
+    lua_pushinteger(L, (lua_Integer)stats.total);
+    lua_setfield(L, -2, "total");
+    lua_pushinteger(L, (lua_Integer)stats.budget);
+    lua_setfield(L, -2, "budget");
+    return 1;
+}
+
+static int perf_memory_budget_set(lua_State *L)
+{
+    lua_Integer bytes = luaL_checkinteger(L, 1);
+    luaL_argcheck(L, bytes >= 0, 1, "budget must not be negative");
+    DP_memory_budget_set((size_t)bytes);
+    return 0;
+}
+
+static int perf_tile_intern_enable(lua_State *L)
+{
+    DP_tile_intern_enable(lua_toboolean(L, 1));
+    return 0;
+}
+
+static int perf_tile_intern_stats(lua_State *L)
+{
+    DP_TileInternStats stats;
+    DP_tile_intern_stats(&stats);
+    lua_createtable(L, 0, 3);
+    lua_pushinteger(L, (lua_Integer)stats.lookups);
+    lua_setfield(L, -2, "lookups");
+    lua_pushinteger(L, (lua_Integer)stats.hits);
+    lua_setfield(L, -2, "hits");
+    lua_pushinteger(L, (lua_Integer)stats.interned);
+    lua_setfield(L, -2, "interned");
+    return 1;
+}
+
+static int perf_tile_intern_stats_reset(DP_UNUSED lua_State *L)
+{
+    DP_tile_intern_stats_reset();
+    return 0;
+}
+
+static int perf_trace_dump(lua_State *L)
+{
+    const char *path = luaL_checkstring(L, 1);
+    DP_Output *output = DP_file_output_new_from_path(path);
+    bool ok = output && DP_trace_dump(output);
+    DP_output_free(output);
+    if (!ok) {
+        return luaL_error(L, "%s", DP_error());
+    }
+    return 0;
+}
+
+
+int DP_lua_perf_init(lua_State *L)
+{
+    lua_pushglobaltable(L);
+    luaL_getsubtable(L, -1, "DP");
+    luaL_getsubtable(L, -1, "Perf");
+    lua_pushcfunction(L, perf_enable);
+    lua_setfield(L, -2, "enable");
+    lua_pushcfunction(L, perf_enabled);
+    lua_setfield(L, -2, "enabled");
+    lua_pushcfunction(L, perf_reset);
+    lua_setfield(L, -2, "reset");
+    lua_pushcfunction(L, perf_stats);
+    lua_setfield(L, -2, "stats");
+    lua_pushcfunction(L, perf_memory_stats);
+    lua_setfield(L, -2, "memory_stats");
+    lua_pushcfunction(L, perf_memory_budget_set);
+    lua_setfield(L, -2, "memory_budget_set");
+    lua_pushcfunction(L, perf_tile_intern_enable);
+    lua_setfield(L, -2, "tile_intern_enable");
+    lua_pushcfunction(L, perf_tile_intern_stats);
+    lua_setfield(L, -2, "tile_intern_stats");
+    lua_pushcfunction(L, perf_tile_intern_stats_reset);
+    lua_setfield(L, -2, "tile_intern_stats_reset");
+    lua_pushcfunction(L, perf_trace_dump);
+    lua_setfield(L, -2, "trace_dump");
+    lua_pushboolean(L, DP_trace_available());
+    lua_setfield(L, -2, "TRACE_AVAILABLE");
+    lua_pushinteger(L, DP_PERF_BUCKET_COUNT);
+    lua_setfield(L, -2, "BUCKET_COUNT");
+    lua_pop(L, 3);
+    return 0;
+}
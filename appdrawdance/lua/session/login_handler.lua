@@ -423,6 +423,13 @@ function LoginHandler:_expect_join(session, command)
     local room_flags = {}
     read_flags(command.flags, command.join and command.join.flags)
 
+    -- Locally sent drawing commands have a context id of zero, their echoes
+    -- from the server carry the one assigned to us here.
+    local user_id = command.join and command.join.id
+    if user_id then
+        session.client:set_local_context_id(user_id)
+    end
+
     self._app:publish(EventTypes.SESSION_CREATE, {
         client_id = session.client_id,
         client = session.client,
@@ -295,16 +295,28 @@ static unsigned char *get_buffer(void *user, size_t length)
 {
     unsigned char **out_buffer = ((void **)user)[0];
     size_t *out_reserved = ((void **)user)[1];
-    if (*out_reserved < length) {
-        *out_buffer = DP_realloc(*out_buffer, length);
-        *out_reserved = length;
+    size_t offset = *(size_t *)((void **)user)[2];
+    size_t required = offset + length;
+    if (*out_reserved < required) {
+        size_t doubled = *out_reserved * 2;
+        size_t reserved = doubled < required ? required : doubled;
+        *out_buffer = DP_realloc(*out_buffer, reserved);
+        *out_reserved = reserved;
     }
-    return *out_buffer;
+    return *out_buffer + offset;
 }
 
 size_t DP_client_message_serialize(DP_Message *msg, unsigned char **out_buffer,
                                    size_t *out_reserved)
+{
+    return DP_client_message_serialize_append(msg, 0, out_buffer,
+                                              out_reserved);
+}
+
+size_t DP_client_message_serialize_append(DP_Message *msg, size_t offset,
+                                          unsigned char **out_buffer,
+                                          size_t *out_reserved)
 {
     return DP_message_serialize(msg, WITH_LENGTH, get_buffer,
-                                (void *[]){out_buffer, out_reserved});
+                                (void *[]){out_buffer, out_reserved, &offset});
 }
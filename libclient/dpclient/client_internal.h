@@ -26,8 +26,12 @@ typedef struct DP_Message DP_Message;
 
 
 #define DP_CLIENT_INITIAL_SEND_BUFFER_SIZE    64
-#define DP_CLIENT_INITIAL_RECV_BUFFER_SIZE    64
 #define DP_CLIENT_INITIAL_SEND_QUEUE_CAPACITY 64
+// For the lock-free queue in the TCP client, sending blocks when it's full.
+#define DP_CLIENT_SEND_QUEUE_CAPACITY 4096
+// Must be able to hold at least one message of maximum size, anything beyond
+// that lets a single recv pick up more messages in one go.
+#define DP_CLIENT_RECV_BUFFER_SIZE 131072
 
 
 bool DP_client_running(DP_Client *client);
@@ -51,3 +55,9 @@ void DP_client_handle_message(DP_Client *client, unsigned char *buffer,
 
 size_t DP_client_message_serialize(DP_Message *msg, unsigned char **out_buffer,
                                    size_t *out_reserved);
+
+// Serializes the message into the buffer starting at the given offset,
+// growing it as needed. Returns the number of bytes written after the offset.
+size_t DP_client_message_serialize_append(DP_Message *msg, size_t offset,
+                                          unsigned char **out_buffer,
+                                          size_t *out_reserved);
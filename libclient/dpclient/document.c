@@ -21,83 +21,126 @@
  */
 #include "document.h"
 #include <dpcommon/common.h>
-#include <dpcommon/queue.h>
+#include <dpcommon/ring_queue.h>
 #include <dpcommon/threading.h>
+#include <dpcommon/trace.h>
+#include <dpcommon/worker.h>
 #include <dpengine/canvas_history.h>
 #include <dpengine/draw_context.h>
 #include <dpmsg/message.h>
-#include <dpmsg/message_queue.h>
 
 typedef struct DP_Message DP_Message;
 
 
-#define INITIAL_CAPACITY 64
+// Pushing commands blocks once this many are waiting to be handled.
+#define QUEUE_CAPACITY 4096
+
+// Jobs for handling commands on different layers at the same time.
+#define WORKER_QUEUE_CAPACITY 256
 
 struct DP_Document {
     size_t title_length;
     char *title;
-    bool running;
-    DP_Queue queue;
+    DP_RingQueue *queue;
     DP_DrawContext *draw_context;
     DP_CanvasHistory *canvas_history;
-    DP_Mutex *mutex_queue;
-    DP_Semaphore *sem_queue_ready;
+    DP_Worker *worker;
+    DP_CanvasHistoryBatcher *batcher;
     DP_Thread *dequeue_thread;
 };
 
+typedef struct DP_DocumentCommand {
+    DP_Message *msg;
+    bool local;
+} DP_DocumentCommand;
+
+static void handle_command(DP_CanvasHistoryBatcher *chb, DP_CanvasHistory *ch,
+                           DP_DrawContext *dc, DP_DocumentCommand *command)
+{
+    DP_Message *msg = command->msg;
+    if (command->local) {
+        if (!DP_canvas_history_handle_local(ch, dc, msg)) {
+            DP_warn("Error handling local drawing command: %s", DP_error());
+        }
+    }
+    else if (!DP_canvas_history_batcher_handle(chb, ch, msg)) {
+        DP_warn("Error handling drawing command: %s", DP_error());
+    }
+    DP_message_decref(msg);
+}
+
+static void flush_commands(DP_CanvasHistoryBatcher *chb, DP_CanvasHistory *ch)
+{
+    if (!DP_canvas_history_batcher_flush(chb, ch)) {
+        DP_warn("Error handling drawing command: %s", DP_error());
+    }
+}
+
 static void run_command_thread(void *data)
 {
     DP_Document *doc = data;
-    DP_Queue *queue = &doc->queue;
-    DP_DrawContext *dc = doc->draw_context;
+    DP_RingQueue *queue = doc->queue;
+    DP_CanvasHistoryBatcher *chb = doc->batcher;
     DP_CanvasHistory *ch = doc->canvas_history;
-    DP_Mutex *mutex_queue = doc->mutex_queue;
-    DP_Semaphore *sem_queue_ready = doc->sem_queue_ready;
-    while (true) {
-        DP_SEMAPHORE_MUST_WAIT(sem_queue_ready);
-        if (doc->running) {
-            DP_MUTEX_MUST_LOCK(mutex_queue);
-            DP_Message *msg = DP_message_queue_shift(queue);
-            DP_MUTEX_MUST_UNLOCK(mutex_queue);
-            if (msg) {
-                if (!DP_canvas_history_handle(ch, dc, msg)) {
-                    DP_warn("Error handling drawing command: %s", DP_error());
-                }
-                DP_message_decref(msg);
-            }
-            else {
-                DP_warn("Dequeue got NULL message");
-                DP_ASSERT(false); // Shouldn't happen.
-            }
+    DP_DrawContext *dc = doc->draw_context;
+    DP_DocumentCommand command;
+    DP_TRACE_THREAD_NAME("document");
+    // Look ahead as far as the queue goes so that commands on different
+    // layers get handled together, but don't hold any back while waiting.
+    while (!DP_ring_queue_closed(queue)) {
+        if (DP_ring_queue_try_shift(queue, &command)) {
+            handle_command(chb, ch, dc, &command);
         }
         else {
-            break;
+            flush_commands(chb, ch);
+            // Nothing else to do right now, so tidy up the history.
+            DP_canvas_history_release_retired(ch);
+            DP_canvas_history_compress_savepoints(ch, doc->worker);
+            if (DP_ring_queue_shift(queue, &command)) {
+                handle_command(chb, ch, dc, &command);
+            }
         }
     }
+    flush_commands(chb, ch);
 }
 
-DP_Document *DP_document_new(void)
+static DP_Worker *make_worker(void)
 {
-    DP_Document *doc = DP_malloc(sizeof(*doc));
-    *doc = (DP_Document){0,    NULL, true, DP_QUEUE_NULL, NULL,
-                         NULL, NULL, NULL, NULL};
-    DP_message_queue_init(&doc->queue, INITIAL_CAPACITY);
-    if (!(doc->draw_context = DP_draw_context_new())) {
-        DP_document_free(doc);
+    // The command thread itself handles one command of each batch.
+    int thread_count = DP_thread_cpu_count() - 1;
+    if (thread_count > 0) {
+        DP_Worker *worker = DP_worker_new(WORKER_QUEUE_CAPACITY, thread_count);
+        if (!worker) {
+            DP_warn("Can't create document worker: %s", DP_error());
+        }
+        return worker;
+    }
+    else {
         return NULL;
     }
-    if (!(doc->canvas_history = DP_canvas_history_new())) {
+}
+
+DP_Document *DP_document_new(void)
+{
+    DP_Document *doc = DP_malloc(sizeof(*doc));
+    *doc = (DP_Document){0, NULL, NULL, NULL, NULL, NULL, NULL, NULL};
+    doc->queue = DP_ring_queue_new(QUEUE_CAPACITY, sizeof(DP_DocumentCommand));
+    if (!doc->queue) {
         DP_document_free(doc);
         return NULL;
     }
-    if (!(doc->mutex_queue = DP_mutex_new())) {
+    if (!(doc->draw_context = DP_draw_context_new())) {
         DP_document_free(doc);
         return NULL;
     }
-    if (!(doc->sem_queue_ready = DP_semaphore_new(0))) {
+    if (!(doc->canvas_history = DP_canvas_history_new())) {
         DP_document_free(doc);
         return NULL;
     }
+    // Without a worker, commands simply get handled one at a time.
+    doc->worker = make_worker();
+    doc->batcher =
+        DP_canvas_history_batcher_new(doc->worker, doc->draw_context);
     if (!(doc->dequeue_thread = DP_thread_new(run_command_thread, doc))) {
         DP_document_free(doc);
         return NULL;
@@ -108,18 +151,18 @@ DP_Document *DP_document_new(void)
 void DP_document_free(DP_Document *doc)
 {
     if (doc) {
-        doc->running = false;
-        if (doc->dequeue_thread) {
-            DP_SEMAPHORE_MUST_POST(doc->sem_queue_ready);
+        DP_RingQueue *queue = doc->queue;
+        if (queue) {
+            DP_ring_queue_close(queue);
             DP_thread_free_join(doc->dequeue_thread);
+            DP_DocumentCommand command;
+            while (DP_ring_queue_try_shift(queue, &command)) {
+                DP_message_decref(command.msg);
+            }
+            DP_ring_queue_free(queue);
         }
-        if (doc->sem_queue_ready) {
-            DP_semaphore_free(doc->sem_queue_ready);
-        }
-        if (doc->mutex_queue) {
-            DP_mutex_free(doc->mutex_queue);
-        }
-        DP_message_queue_dispose(&doc->queue);
+        DP_canvas_history_batcher_free(doc->batcher);
+        DP_worker_free(doc->worker);
         DP_canvas_history_free(doc->canvas_history);
         DP_draw_context_free(doc->draw_context);
         DP_free(doc->title);
@@ -137,10 +180,17 @@ const char *DP_document_title(DP_Document *doc, size_t *out_length)
     return doc->title;
 }
 
-DP_Queue *DP_document_queue(DP_Document *doc)
+void DP_document_networked_set(DP_Document *doc, bool networked)
+{
+    DP_ASSERT(doc);
+    DP_canvas_history_networked_set(doc->canvas_history, networked);
+}
+
+void DP_document_local_context_id_set(DP_Document *doc,
+                                      unsigned int context_id)
 {
     DP_ASSERT(doc);
-    return &doc->queue;
+    DP_canvas_history_local_context_id_set(doc->canvas_history, context_id);
 }
 
 DP_CanvasState *DP_document_canvas_state_compare_and_get(DP_Document *doc,
@@ -150,15 +200,20 @@ DP_CanvasState *DP_document_canvas_state_compare_and_get(DP_Document *doc,
     return DP_canvas_history_compare_and_get(doc->canvas_history, prev);
 }
 
+static void push_command(DP_Document *doc, DP_Message *msg, bool local)
+{
+    DP_DocumentCommand command = {msg, local};
+    // Only fails if the document is being freed, nothing to handle it then.
+    if (!DP_ring_queue_push(doc->queue, &command)) {
+        DP_message_decref(msg);
+    }
+}
+
 void DP_document_command_push_noinc(DP_Document *doc, DP_Message *msg)
 {
     DP_ASSERT(doc);
     DP_ASSERT(msg);
-    DP_Mutex *mutex_queue = doc->mutex_queue;
-    DP_MUTEX_MUST_LOCK(mutex_queue);
-    DP_message_queue_push_noinc(&doc->queue, msg);
-    DP_MUTEX_MUST_UNLOCK(mutex_queue);
-    DP_SEMAPHORE_MUST_POST(doc->sem_queue_ready);
+    push_command(doc, msg, false);
 }
 
 void DP_document_command_push_inc(DP_Document *doc, DP_Message *msg)
@@ -167,3 +222,17 @@ void DP_document_command_push_inc(DP_Document *doc, DP_Message *msg)
     DP_ASSERT(msg);
     DP_document_command_push_noinc(doc, DP_message_incref(msg));
 }
+
+void DP_document_command_push_local_noinc(DP_Document *doc, DP_Message *msg)
+{
+    DP_ASSERT(doc);
+    DP_ASSERT(msg);
+    push_command(doc, msg, true);
+}
+
+void DP_document_command_push_local_inc(DP_Document *doc, DP_Message *msg)
+{
+    DP_ASSERT(doc);
+    DP_ASSERT(msg);
+    DP_document_command_push_local_noinc(doc, DP_message_incref(msg));
+}
@@ -35,6 +35,14 @@ void DP_document_free(DP_Document *doc);
 
 const char *DP_document_title(DP_Document *doc, size_t *out_length);
 
+// Set while a client connected to a session is feeding this document, see
+// DP_canvas_history_networked_set.
+void DP_document_networked_set(DP_Document *doc, bool networked);
+
+// See DP_canvas_history_local_context_id_set.
+void DP_document_local_context_id_set(DP_Document *doc,
+                                      unsigned int context_id);
+
 DP_CanvasState *DP_document_canvas_state_compare_and_get(DP_Document *doc,
                                                          DP_CanvasState *prev);
 
@@ -42,5 +50,12 @@ void DP_document_command_push_noinc(DP_Document *doc, DP_Message *msg);
 
 void DP_document_command_push_inc(DP_Document *doc, DP_Message *msg);
 
+// For drawing commands sent by the local user. They're shown right away on top
+// of the current canvas state and dropped again when the server echoes them
+// back, or rolled back if it doesn't echo them in the order they were sent.
+void DP_document_command_push_local_noinc(DP_Document *doc, DP_Message *msg);
+
+void DP_document_command_push_local_inc(DP_Document *doc, DP_Message *msg);
+
 
 #endif
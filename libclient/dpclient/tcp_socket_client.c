@@ -25,9 +25,11 @@
 #include "uri_utils.h"
 #include <dpcommon/binary.h>
 #include <dpcommon/common.h>
+#include <dpcommon/conversions.h>
+#include <dpcommon/ring_queue.h>
 #include <dpcommon/threading.h>
+#include <dpcommon/trace.h>
 #include <dpmsg/message.h>
-#include <dpmsg/message_queue.h>
 #include <SDL_atomic.h>
 #include <uriparser/Uri.h>
 
@@ -36,6 +38,8 @@
 #else
 #    include <errno.h>
 #    include <netdb.h>
+#    include <netinet/in.h>
+#    include <netinet/tcp.h>
 #    include <sys/socket.h>
 #    include <sys/types.h>
 #    include <unistd.h>
@@ -124,6 +128,15 @@ static const char *address_family_to_string(int family)
     }
 }
 
+static void set_nodelay(int sockfd)
+{
+    int value = DP_TCP_SOCKET_CLIENT_NODELAY;
+    if (setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &value, sizeof(value))
+        == -1) {
+        DP_warn("Can't set TCP_NODELAY to %d: %s", value, strerror(errno));
+    }
+}
+
 static int open_socket(DP_Client *client, struct addrinfo *addrinfos)
 {
     for (struct addrinfo *ai = addrinfos; ai && DP_client_running(client);
@@ -144,6 +157,7 @@ static int open_socket(DP_Client *client, struct addrinfo *addrinfos)
         }
         else {
             DP_debug("Connected socket with fd %d", sockfd);
+            set_nodelay(sockfd);
             DP_client_report_event(
                 client, DP_CLIENT_EVENT_CONNECT_SOCKET_SUCCESS, NULL);
             return sockfd;
@@ -152,27 +166,54 @@ static int open_socket(DP_Client *client, struct addrinfo *addrinfos)
     return -1;
 }
 
+static_assert(DP_CLIENT_RECV_BUFFER_SIZE
+                  >= DP_MESSAGE_HEADER_LENGTH + (size_t)UINT16_MAX,
+              "Receive buffer can hold a message of maximum size");
+
 static bool try_recv(DP_Client *client, int sockfd, unsigned char *buffer,
-                     size_t length)
+                     size_t length, size_t *out_received)
 {
-    size_t received = 0;
-    while (DP_client_running(client) && received < length) {
-        ssize_t result = recv(sockfd, buffer + received, length - received, 0);
-        if (result >= 0) {
-            received += (size_t)result;
+    while (DP_client_running(client)) {
+        DP_TRACE_BEGIN("recv");
+        ssize_t result = recv(sockfd, buffer, length, 0);
+        DP_TRACE_END();
+        if (result > 0) {
+            *out_received = (size_t)result;
+            return true;
         }
-        else {
+        else if (result == 0 || errno != EINTR) {
+            const char *error =
+                result == 0 ? "Connection closed by peer" : strerror(errno);
             if (DP_client_running(client)) {
                 DP_client_report_event(client, DP_CLIENT_EVENT_RECV_ERROR,
-                                       strerror(errno));
+                                       error);
             }
             else {
-                DP_debug("Receive error during shutdown: %s", strerror(errno));
+                DP_debug("Receive error during shutdown: %s", error);
             }
             return false;
         }
     }
-    return received == length;
+    return false;
+}
+
+// Handles every complete message in the given buffer range, returns the
+// number of bytes consumed. Messages are deserialized straight out of the
+// receive buffer, a partial message at the end is left for the next recv.
+static size_t handle_messages(DP_Client *client, unsigned char *buffer,
+                              size_t length)
+{
+    size_t offset = 0;
+    while (length - offset >= DP_MESSAGE_HEADER_LENGTH) {
+        size_t body_length = DP_read_bigendian_uint16(buffer + offset);
+        size_t total_length = body_length + DP_MESSAGE_HEADER_LENGTH;
+        if (length - offset < total_length) {
+            break;
+        }
+        DP_client_handle_message(client, buffer + offset, total_length);
+        offset += total_length;
+    }
+    return offset;
 }
 
 static void run_recv(void *data)
@@ -180,21 +221,27 @@ static void run_recv(void *data)
     DP_Client *client = data;
     DP_TcpSocketClient *tsc = DP_client_inner(client);
     int sockfd = SDL_AtomicGet(&tsc->socket);
-    size_t reserved = DP_CLIENT_INITIAL_RECV_BUFFER_SIZE;
-    unsigned char *buffer = DP_malloc(reserved);
+    unsigned char *buffer = DP_malloc(DP_CLIENT_RECV_BUFFER_SIZE);
+    size_t used = 0;
+    DP_TRACE_THREAD_NAME("tcp_recv");
 
     while (DP_client_running(client)) {
-        if (try_recv(client, sockfd, buffer, DP_MESSAGE_HEADER_LENGTH)) {
-            size_t body_length = DP_read_bigendian_uint16(buffer);
-            size_t total_length = body_length + DP_MESSAGE_HEADER_LENGTH;
-            if (reserved < total_length) {
-                buffer = DP_realloc(buffer, total_length);
-                reserved = total_length;
-            }
-            if (try_recv(client, sockfd, buffer + DP_MESSAGE_HEADER_LENGTH,
-                         body_length)) {
-                DP_client_handle_message(client, buffer, total_length);
-            }
+        size_t received;
+        if (!try_recv(client, sockfd, buffer + used,
+                      DP_CLIENT_RECV_BUFFER_SIZE - used, &received)) {
+            DP_client_stop(client);
+            break;
+        }
+
+        used += received;
+        DP_TRACE_BEGIN("handle_received");
+        size_t consumed = handle_messages(client, buffer, used);
+        DP_TRACE_END();
+        // Move the leftover partial message to the front. It's always
+        // smaller than a single message, so this is cheap.
+        if (consumed != 0) {
+            used -= consumed;
+            memmove(buffer, buffer + consumed, used);
         }
     }
 
@@ -231,11 +278,55 @@ static bool establish_connection(DP_Client *client, DP_TcpSocketClient *tsc)
     return true;
 }
 
+static void send_all(DP_Client *client, int sockfd,
+                     const unsigned char *buffer, size_t length)
+{
+    size_t sent = 0;
+    while (sent < length) {
+        DP_TRACE_BEGIN("send");
+        ssize_t result =
+            send(sockfd, buffer + sent, length - sent, MSG_NOSIGNAL);
+        DP_TRACE_END();
+        if (result >= 0) {
+            sent += (size_t)result;
+        }
+        else {
+            if (DP_client_running(client)) {
+                DP_client_report_event(client, DP_CLIENT_EVENT_SEND_ERROR,
+                                       strerror(errno));
+            }
+            else {
+                DP_debug("Send error during shutdown: %s", strerror(errno));
+            }
+            return;
+        }
+    }
+}
+
+// Blocks until there's at least one message, then takes whatever else is
+// queued up without waiting. Returns 0 if the queue got closed.
+static int shift_batch(DP_RingQueue *queue, DP_Message **batch, int capacity)
+{
+    int count = 0;
+    if (DP_ring_queue_shift(queue, &batch[count])) {
+        ++count;
+        while (count < capacity
+               && DP_ring_queue_try_shift(queue, &batch[count])) {
+            ++count;
+        }
+    }
+    return count;
+}
+
 static void run_send(void *data)
 {
     DP_Client *client = data;
     DP_TcpSocketClient *tsc = DP_client_inner(client);
+    DP_TRACE_THREAD_NAME("tcp_send");
     if (!establish_connection(client, tsc)) {
+        // Nobody is going to take messages out of the queue anymore, make
+        // sure that pushing to it doesn't end up blocking once it's full.
+        DP_ring_queue_close(tsc->queue);
         DP_client_report_event(client, DP_CLIENT_EVENT_CONNECTION_CLOSED, NULL);
         return;
     }
@@ -244,52 +335,47 @@ static void run_send(void *data)
                            NULL);
 
     int sockfd = SDL_AtomicGet(&tsc->socket);
-    DP_Queue *queue = &tsc->queue;
-    DP_Mutex *mutex_queue = tsc->mutex_queue;
-    DP_Semaphore *sem_queue = tsc->sem_queue;
+    DP_RingQueue *queue = tsc->queue;
     size_t reserved = DP_CLIENT_INITIAL_SEND_BUFFER_SIZE;
     unsigned char *buffer = DP_malloc(reserved);
+    size_t batch_capacity = DP_ring_queue_capacity(queue);
+    DP_Message **batch = DP_malloc(sizeof(*batch) * batch_capacity);
 
     while (true) {
-        DP_SEMAPHORE_MUST_WAIT(sem_queue);
-        if (!DP_client_running(client)) {
+        // Take everything that's queued up in one go and send it with a
+        // single syscall, rather than doing one send per message.
+        int count =
+            shift_batch(queue, batch, DP_size_to_int(batch_capacity));
+        if (count == 0 || !DP_client_running(client)) {
+            for (int i = 0; i < count; ++i) {
+                DP_message_decref(batch[i]);
+            }
             break;
         }
 
-        DP_MUTEX_MUST_LOCK(mutex_queue);
-        DP_Message *msg = DP_message_queue_shift(queue);
-        DP_MUTEX_MUST_UNLOCK(mutex_queue);
-
-        DP_MessageType type = DP_message_type(msg);
-        size_t length = DP_client_message_serialize(msg, &buffer, &reserved);
-        DP_message_decref(msg);
-
-        size_t sent = 0;
-        do {
-            ssize_t result =
-                send(sockfd, buffer + sent, length - sent, MSG_NOSIGNAL);
-            if (result >= 0) {
-                sent += (size_t)result;
-            }
-            else {
-                if (DP_client_running(client)) {
-                    DP_client_report_event(client, DP_CLIENT_EVENT_SEND_ERROR,
-                                           strerror(errno));
-                }
-                else {
-                    DP_debug("Send error during shutdown: %s", strerror(errno));
-                }
-                break;
+        size_t length = 0;
+        bool disconnect = false;
+        for (int i = 0; i < count; ++i) {
+            DP_Message *msg = batch[i];
+            // Nothing may be sent after a disconnect message.
+            if (!disconnect) {
+                length += DP_client_message_serialize_append(
+                    msg, length, &buffer, &reserved);
+                disconnect = DP_message_type(msg) == DP_MSG_DISCONNECT;
             }
-        } while (sent < length);
+            DP_message_decref(msg);
+        }
+
+        send_all(client, sockfd, buffer, length);
 
-        if (type == DP_MSG_DISCONNECT) {
+        if (disconnect) {
             DP_debug("Sent disconnect, stopping client");
             DP_client_stop(client);
             break;
         }
     }
 
+    DP_free(batch);
     DP_free(buffer);
 }
 
@@ -303,13 +389,8 @@ bool DP_tcp_socket_client_init(DP_Client *client)
         return false;
     }
 
-    DP_message_queue_init(&tsc->queue, DP_CLIENT_INITIAL_SEND_QUEUE_CAPACITY);
-
-    if (!(tsc->mutex_queue = DP_mutex_new())) {
-        return false;
-    }
-
-    if (!(tsc->sem_queue = DP_semaphore_new(0))) {
+    if (!(tsc->queue = DP_ring_queue_new(DP_CLIENT_SEND_QUEUE_CAPACITY,
+                                         sizeof(DP_Message *)))) {
         return false;
     }
 
@@ -327,13 +408,15 @@ void DP_tcp_socket_client_dispose(DP_Client *client)
     DP_TcpSocketClient *tsc = DP_client_inner(client);
     DP_tcp_socket_client_stop(client);
     DP_thread_free_join(tsc->thread_recv);
-    if (tsc->thread_send) {
-        DP_SEMAPHORE_MUST_POST(tsc->sem_queue);
-        DP_thread_free_join(tsc->thread_send);
+    DP_thread_free_join(tsc->thread_send);
+    DP_RingQueue *queue = tsc->queue;
+    if (queue) {
+        DP_Message *msg;
+        while (DP_ring_queue_try_shift(queue, &msg)) {
+            DP_message_decref(msg);
+        }
+        DP_ring_queue_free(queue);
     }
-    DP_semaphore_free(tsc->sem_queue);
-    DP_mutex_free(tsc->mutex_queue);
-    DP_message_queue_dispose(&tsc->queue);
     uriFreeUriMembersA(&tsc->uri);
 }
 
@@ -347,6 +430,9 @@ void DP_tcp_socket_client_stop(DP_Client *client)
         shutdown(socket, SHUT_RDWR);
         close(socket);
     }
+    if (tsc->queue) {
+        DP_ring_queue_close(tsc->queue);
+    }
 }
 
 
@@ -355,9 +441,8 @@ void DP_tcp_socket_client_send(DP_Client *client, DP_Message *msg)
     DP_ASSERT(client);
     DP_ASSERT(msg);
     DP_TcpSocketClient *tsc = DP_client_inner(client);
-    DP_Mutex *mutex_queue = tsc->mutex_queue;
-    DP_MUTEX_MUST_LOCK(mutex_queue);
-    DP_message_queue_push_noinc(&tsc->queue, msg);
-    DP_MUTEX_MUST_UNLOCK(mutex_queue);
-    DP_SEMAPHORE_MUST_POST(tsc->sem_queue);
+    // Only fails if the client has been stopped, the message goes nowhere.
+    if (!DP_ring_queue_push(tsc->queue, &msg)) {
+        DP_message_decref(msg);
+    }
 }
@@ -28,34 +28,34 @@
 
 #include "client.h"
 #include <dpcommon/common.h>
-#include <dpcommon/queue.h>
 #include <SDL_atomic.h>
 #include <uriparser/Uri.h>
 
 typedef struct DP_Client DP_Client;
 typedef struct DP_Message DP_Message;
-typedef struct DP_Mutex DP_Mutex;
-typedef struct DP_Semaphore DP_Semaphore;
+typedef struct DP_RingQueue DP_RingQueue;
 typedef struct DP_Thread DP_Thread;
 
 
 #define DP_TCP_SOCKET_CLIENT_SCHEME       "drawpile"
 #define DP_TCP_SOCKET_CLIENT_DEFAULT_PORT "27750"
 
-#define DP_TCP_SOCKET_CLIENT_NULL                   \
-    (DP_TcpSocketClient)                            \
-    {                                               \
-        {0}, DP_QUEUE_NULL, NULL, NULL, NULL, NULL, \
-        {                                           \
-            -1                                      \
-        }                                           \
+// Whether to disable Nagle's algorithm on the socket. The sender already
+// batches up everything that's queued into a single send, so letting the
+// kernel hold back small writes on top of that only adds latency to strokes.
+#ifndef DP_TCP_SOCKET_CLIENT_NODELAY
+#    define DP_TCP_SOCKET_CLIENT_NODELAY 1
+#endif
+
+#define DP_TCP_SOCKET_CLIENT_NULL \
+    (DP_TcpSocketClient)          \
+    {                             \
+        .socket = {-1}            \
     }
 
 typedef struct DP_TcpSocketClient {
     UriUriA uri;
-    DP_Queue queue;
-    DP_Mutex *mutex_queue;
-    DP_Semaphore *sem_queue;
+    DP_RingQueue *queue;
     DP_Thread *thread_send;
     DP_Thread *thread_recv;
     SDL_atomic_t socket;
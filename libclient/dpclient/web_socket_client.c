@@ -25,6 +25,7 @@
 #include "uri_utils.h"
 #include <dpcommon/common.h>
 #include <dpcommon/threading.h>
+#include <dpcommon/trace.h>
 #include <dpmsg/message.h>
 #include <dpmsg/message_queue.h>
 #include <SDL_atomic.h>
@@ -175,6 +176,7 @@ static void run_send(void *data)
 {
     DP_Client *client = data;
     DP_WebSocketClient *wsc = DP_client_inner(client);
+    DP_TRACE_THREAD_NAME("websocket_send");
     if (!establish_connection(client, wsc)) {
         return;
     }
@@ -210,8 +212,11 @@ static void run_send(void *data)
         size_t length = DP_client_message_serialize(msg, &buffer, &reserved);
         DP_message_decref(msg);
 
-        if (emscripten_websocket_send_binary(socket, buffer, length)
-            != EMSCRIPTEN_RESULT_SUCCESS) {
+        DP_TRACE_BEGIN("send");
+        EMSCRIPTEN_RESULT result =
+            emscripten_websocket_send_binary(socket, buffer, length);
+        DP_TRACE_END();
+        if (result != EMSCRIPTEN_RESULT_SUCCESS) {
             DP_client_report_event(client, DP_CLIENT_EVENT_SEND_ERROR, NULL);
         }
 
@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2022 askmeaboutloom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <dpcommon/common.h>
+#include <dpcommon/queue.h>
+#include <dpcommon/ring_queue.h>
+#include <dpcommon/threading.h>
+#include <SDL_timer.h>
+#include <stdio.h>
+
+// Compares handing elements from producer threads to a single consumer thread
+// through a DP_Queue guarded by a mutex and semaphore, which is what the
+// document, client and worker pipelines used to do, against a DP_RingQueue.
+
+#define ITEMS          2000000
+#define RING_CAPACITY  4096
+#define QUEUE_CAPACITY 64
+
+
+typedef struct LockedQueue {
+    DP_Queue queue;
+    DP_Mutex *mutex;
+    DP_Semaphore *sem;
+} LockedQueue;
+
+typedef struct BenchParams {
+    void *queue;
+    int items;
+} BenchParams;
+
+static void locked_produce(void *data)
+{
+    BenchParams *params = data;
+    LockedQueue *lq = params->queue;
+    for (int i = 0; i < params->items; ++i) {
+        DP_MUTEX_MUST_LOCK(lq->mutex);
+        *(int *)DP_queue_push(&lq->queue, sizeof(int)) = i;
+        DP_MUTEX_MUST_UNLOCK(lq->mutex);
+        DP_SEMAPHORE_MUST_POST(lq->sem);
+    }
+}
+
+static void locked_consume(void *data)
+{
+    BenchParams *params = data;
+    LockedQueue *lq = params->queue;
+    for (int i = 0; i < params->items; ++i) {
+        DP_SEMAPHORE_MUST_WAIT(lq->sem);
+        DP_MUTEX_MUST_LOCK(lq->mutex);
+        DP_queue_shift(&lq->queue);
+        DP_MUTEX_MUST_UNLOCK(lq->mutex);
+    }
+}
+
+static void ring_produce(void *data)
+{
+    BenchParams *params = data;
+    for (int i = 0; i < params->items; ++i) {
+        DP_ring_queue_push(params->queue, &i);
+    }
+}
+
+static void ring_consume(void *data)
+{
+    BenchParams *params = data;
+    int value;
+    for (int i = 0; i < params->items; ++i) {
+        DP_ring_queue_shift(params->queue, &value);
+    }
+}
+
+
+static double run(void *queue, int producer_count, DP_ThreadFn produce,
+                  DP_ThreadFn consume)
+{
+    int items_per_producer = ITEMS / producer_count;
+    BenchParams producer_params = {queue, items_per_producer};
+    BenchParams consumer_params = {queue, items_per_producer * producer_count};
+    DP_Thread *producers[16];
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    DP_Thread *consumer = DP_thread_new(consume, &consumer_params);
+    for (int i = 0; i < producer_count; ++i) {
+        producers[i] = DP_thread_new(produce, &producer_params);
+    }
+    for (int i = 0; i < producer_count; ++i) {
+        DP_thread_free_join(producers[i]);
+    }
+    DP_thread_free_join(consumer);
+    Uint64 end = SDL_GetPerformanceCounter();
+
+    double seconds =
+        (double)(end - start) / (double)SDL_GetPerformanceFrequency();
+    return seconds * 1e9 / (double)consumer_params.items;
+}
+
+static void bench(int producer_count)
+{
+    LockedQueue lq = {DP_QUEUE_NULL, DP_mutex_new(), DP_semaphore_new(0)};
+    DP_queue_init(&lq.queue, QUEUE_CAPACITY, sizeof(int));
+    double locked_ns = run(&lq, producer_count, locked_produce, locked_consume);
+    DP_queue_dispose(&lq.queue);
+    DP_semaphore_free(lq.sem);
+    DP_mutex_free(lq.mutex);
+
+    DP_RingQueue *rq = DP_ring_queue_new(RING_CAPACITY, sizeof(int));
+    double ring_ns = run(rq, producer_count, ring_produce, ring_consume);
+    DP_ring_queue_free(rq);
+
+    printf("%d producer(s): queue+mutex %.1f ns/item, ring queue %.1f ns/item "
+           "(%.2fx)\n",
+           producer_count, locked_ns, ring_ns, locked_ns / ring_ns);
+}
+
+
+int main(void)
+{
+    bench(1);
+    bench(2);
+    bench(4);
+    return 0;
+}
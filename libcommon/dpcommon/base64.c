@@ -66,3 +66,81 @@ char *DP_base64_encode(const unsigned char *in, size_t in_length,
     }
     return buf;
 }
+
+
+static int decode_symbol(char c)
+{
+    if (c >= 'A' && c <= 'Z') {
+        return c - 'A';
+    }
+    else if (c >= 'a' && c <= 'z') {
+        return c - 'a' + 26;
+    }
+    else if (c >= '0' && c <= '9') {
+        return c - '0' + 52;
+    }
+    else if (c == '+') {
+        return 62;
+    }
+    else if (c == '/') {
+        return 63;
+    }
+    else {
+        return -1;
+    }
+}
+
+static size_t strip_padding(const char *in, size_t in_length)
+{
+    size_t length = in_length;
+    while (length > 0 && in_length - length < 2u && in[length - 1u] == '=') {
+        --length;
+    }
+    return length;
+}
+
+size_t DP_base64_decode_length(const char *in, size_t in_length)
+{
+    DP_ASSERT(in || in_length == 0);
+    size_t length = strip_padding(in, in_length);
+    return length / 4u * 3u + (length % 4u * 3u) / 4u;
+}
+
+bool DP_base64_decode(const char *in, size_t in_length, unsigned char *out,
+                      size_t out_length)
+{
+    DP_ASSERT(in || in_length == 0);
+    DP_ASSERT(out || out_length == 0);
+    size_t length = strip_padding(in, in_length);
+    if (length % 4u == 1u) {
+        DP_error_set("Invalid base64 length %zu", in_length);
+        return false;
+    }
+
+    size_t required = length / 4u * 3u + (length % 4u * 3u) / 4u;
+    if (out_length < required) {
+        DP_error_set("Base64 output buffer too small: %zu < %zu", out_length,
+                     required);
+        return false;
+    }
+
+    uint32_t bits = 0u;
+    int bit_count = 0;
+    size_t j = 0u;
+    for (size_t i = 0u; i < length; ++i) {
+        int value = decode_symbol(in[i]);
+        if (value < 0) {
+            DP_error_set("Invalid base64 character at %zu", i);
+            return false;
+        }
+        bits = (bits << 6u) | (uint32_t)value;
+        bit_count += 6;
+        if (bit_count >= 8) {
+            bit_count -= 8;
+            out[j++] = (unsigned char)((bits >> bit_count) & 0xffu);
+        }
+    }
+
+    DP_ASSERT(j == required);
+    return true;
+}
@@ -21,9 +21,19 @@
  */
 #ifndef DPCOMMON_BASE64_H
 #define DPCOMMON_BASE64_H
+#include <stdbool.h>
 #include <stddef.h>
 
 char *DP_base64_encode(const unsigned char *in, size_t in_length,
                        size_t *out_length);
 
+// Returns the number of bytes that decoding the given base64 input will
+// produce. Doesn't validate the input, that's up to DP_base64_decode.
+size_t DP_base64_decode_length(const char *in, size_t in_length);
+
+// Decodes base64 into a caller-provided buffer, which must be at least
+// DP_base64_decode_length bytes long. Returns false on invalid input.
+bool DP_base64_decode(const char *in, size_t in_length, unsigned char *out,
+                      size_t out_length);
+
 #endif
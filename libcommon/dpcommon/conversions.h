@@ -0,0 +1,1367 @@
+// This is an auto-generated file, don't edit it directly.
+// Look for the generator in generators/generate_conversions.c.
+#ifndef DPCOMMON_CONVERSIONS_H
+#define DPCOMMON_CONVERSIONS_H
+#include "common.h"
+
+DP_INLINE unsigned char DP_char_to_uchar(char x)
+{
+    return (unsigned char)x;
+}
+
+DP_INLINE short DP_char_to_short(char x)
+{
+    return (short)x;
+}
+
+DP_INLINE unsigned short DP_char_to_ushort(char x)
+{
+    return (unsigned short)x;
+}
+
+DP_INLINE int DP_char_to_int(char x)
+{
+    return (int)x;
+}
+
+DP_INLINE unsigned int DP_char_to_uint(char x)
+{
+    return (unsigned int)x;
+}
+
+DP_INLINE long DP_char_to_long(char x)
+{
+    return (long)x;
+}
+
+DP_INLINE unsigned long DP_char_to_ulong(char x)
+{
+    return (unsigned long)x;
+}
+
+DP_INLINE int8_t DP_char_to_int8(char x)
+{
+    return (int8_t)x;
+}
+
+DP_INLINE uint8_t DP_char_to_uint8(char x)
+{
+    return (uint8_t)x;
+}
+
+DP_INLINE int16_t DP_char_to_int16(char x)
+{
+    return (int16_t)x;
+}
+
+DP_INLINE uint16_t DP_char_to_uint16(char x)
+{
+    return (uint16_t)x;
+}
+
+DP_INLINE int32_t DP_char_to_int32(char x)
+{
+    return (int32_t)x;
+}
+
+DP_INLINE uint32_t DP_char_to_uint32(char x)
+{
+    return (uint32_t)x;
+}
+
+DP_INLINE float DP_char_to_float(char x)
+{
+    return (float)x;
+}
+
+DP_INLINE double DP_char_to_double(char x)
+{
+    return (double)x;
+}
+
+DP_INLINE size_t DP_char_to_size(char x)
+{
+    return (size_t)x;
+}
+
+DP_INLINE char DP_uchar_to_char(unsigned char x)
+{
+    return (char)x;
+}
+
+DP_INLINE short DP_uchar_to_short(unsigned char x)
+{
+    return (short)x;
+}
+
+DP_INLINE unsigned short DP_uchar_to_ushort(unsigned char x)
+{
+    return (unsigned short)x;
+}
+
+DP_INLINE int DP_uchar_to_int(unsigned char x)
+{
+    return (int)x;
+}
+
+DP_INLINE unsigned int DP_uchar_to_uint(unsigned char x)
+{
+    return (unsigned int)x;
+}
+
+DP_INLINE long DP_uchar_to_long(unsigned char x)
+{
+    return (long)x;
+}
+
+DP_INLINE unsigned long DP_uchar_to_ulong(unsigned char x)
+{
+    return (unsigned long)x;
+}
+
+DP_INLINE int8_t DP_uchar_to_int8(unsigned char x)
+{
+    return (int8_t)x;
+}
+
+DP_INLINE uint8_t DP_uchar_to_uint8(unsigned char x)
+{
+    return (uint8_t)x;
+}
+
+DP_INLINE int16_t DP_uchar_to_int16(unsigned char x)
+{
+    return (int16_t)x;
+}
+
+DP_INLINE uint16_t DP_uchar_to_uint16(unsigned char x)
+{
+    return (uint16_t)x;
+}
+
+DP_INLINE int32_t DP_uchar_to_int32(unsigned char x)
+{
+    return (int32_t)x;
+}
+
+DP_INLINE uint32_t DP_uchar_to_uint32(unsigned char x)
+{
+    return (uint32_t)x;
+}
+
+DP_INLINE float DP_uchar_to_float(unsigned char x)
+{
+    return (float)x;
+}
+
+DP_INLINE double DP_uchar_to_double(unsigned char x)
+{
+    return (double)x;
+}
+
+DP_INLINE size_t DP_uchar_to_size(unsigned char x)
+{
+    return (size_t)x;
+}
+
+DP_INLINE char DP_short_to_char(short x)
+{
+    return (char)x;
+}
+
+DP_INLINE unsigned char DP_short_to_uchar(short x)
+{
+    return (unsigned char)x;
+}
+
+DP_INLINE unsigned short DP_short_to_ushort(short x)
+{
+    return (unsigned short)x;
+}
+
+DP_INLINE int DP_short_to_int(short x)
+{
+    return (int)x;
+}
+
+DP_INLINE unsigned int DP_short_to_uint(short x)
+{
+    return (unsigned int)x;
+}
+
+DP_INLINE long DP_short_to_long(short x)
+{
+    return (long)x;
+}
+
+DP_INLINE unsigned long DP_short_to_ulong(short x)
+{
+    return (unsigned long)x;
+}
+
+DP_INLINE int8_t DP_short_to_int8(short x)
+{
+    return (int8_t)x;
+}
+
+DP_INLINE uint8_t DP_short_to_uint8(short x)
+{
+    return (uint8_t)x;
+}
+
+DP_INLINE int16_t DP_short_to_int16(short x)
+{
+    return (int16_t)x;
+}
+
+DP_INLINE uint16_t DP_short_to_uint16(short x)
+{
+    return (uint16_t)x;
+}
+
+DP_INLINE int32_t DP_short_to_int32(short x)
+{
+    return (int32_t)x;
+}
+
+DP_INLINE uint32_t DP_short_to_uint32(short x)
+{
+    return (uint32_t)x;
+}
+
+DP_INLINE float DP_short_to_float(short x)
+{
+    return (float)x;
+}
+
+DP_INLINE double DP_short_to_double(short x)
+{
+    return (double)x;
+}
+
+DP_INLINE size_t DP_short_to_size(short x)
+{
+    return (size_t)x;
+}
+
+DP_INLINE char DP_ushort_to_char(unsigned short x)
+{
+    return (char)x;
+}
+
+DP_INLINE unsigned char DP_ushort_to_uchar(unsigned short x)
+{
+    return (unsigned char)x;
+}
+
+DP_INLINE short DP_ushort_to_short(unsigned short x)
+{
+    return (short)x;
+}
+
+DP_INLINE int DP_ushort_to_int(unsigned short x)
+{
+    return (int)x;
+}
+
+DP_INLINE unsigned int DP_ushort_to_uint(unsigned short x)
+{
+    return (unsigned int)x;
+}
+
+DP_INLINE long DP_ushort_to_long(unsigned short x)
+{
+    return (long)x;
+}
+
+DP_INLINE unsigned long DP_ushort_to_ulong(unsigned short x)
+{
+    return (unsigned long)x;
+}
+
+DP_INLINE int8_t DP_ushort_to_int8(unsigned short x)
+{
+    return (int8_t)x;
+}
+
+DP_INLINE uint8_t DP_ushort_to_uint8(unsigned short x)
+{
+    return (uint8_t)x;
+}
+
+DP_INLINE int16_t DP_ushort_to_int16(unsigned short x)
+{
+    return (int16_t)x;
+}
+
+DP_INLINE uint16_t DP_ushort_to_uint16(unsigned short x)
+{
+    return (uint16_t)x;
+}
+
+DP_INLINE int32_t DP_ushort_to_int32(unsigned short x)
+{
+    return (int32_t)x;
+}
+
+DP_INLINE uint32_t DP_ushort_to_uint32(unsigned short x)
+{
+    return (uint32_t)x;
+}
+
+DP_INLINE float DP_ushort_to_float(unsigned short x)
+{
+    return (float)x;
+}
+
+DP_INLINE double DP_ushort_to_double(unsigned short x)
+{
+    return (double)x;
+}
+
+DP_INLINE size_t DP_ushort_to_size(unsigned short x)
+{
+    return (size_t)x;
+}
+
+DP_INLINE char DP_int_to_char(int x)
+{
+    return (char)x;
+}
+
+DP_INLINE unsigned char DP_int_to_uchar(int x)
+{
+    return (unsigned char)x;
+}
+
+DP_INLINE short DP_int_to_short(int x)
+{
+    return (short)x;
+}
+
+DP_INLINE unsigned short DP_int_to_ushort(int x)
+{
+    return (unsigned short)x;
+}
+
+DP_INLINE unsigned int DP_int_to_uint(int x)
+{
+    return (unsigned int)x;
+}
+
+DP_INLINE long DP_int_to_long(int x)
+{
+    return (long)x;
+}
+
+DP_INLINE unsigned long DP_int_to_ulong(int x)
+{
+    return (unsigned long)x;
+}
+
+DP_INLINE int8_t DP_int_to_int8(int x)
+{
+    return (int8_t)x;
+}
+
+DP_INLINE uint8_t DP_int_to_uint8(int x)
+{
+    return (uint8_t)x;
+}
+
+DP_INLINE int16_t DP_int_to_int16(int x)
+{
+    return (int16_t)x;
+}
+
+DP_INLINE uint16_t DP_int_to_uint16(int x)
+{
+    return (uint16_t)x;
+}
+
+DP_INLINE int32_t DP_int_to_int32(int x)
+{
+    return (int32_t)x;
+}
+
+DP_INLINE uint32_t DP_int_to_uint32(int x)
+{
+    return (uint32_t)x;
+}
+
+DP_INLINE float DP_int_to_float(int x)
+{
+    return (float)x;
+}
+
+DP_INLINE double DP_int_to_double(int x)
+{
+    return (double)x;
+}
+
+DP_INLINE size_t DP_int_to_size(int x)
+{
+    return (size_t)x;
+}
+
+DP_INLINE char DP_uint_to_char(unsigned int x)
+{
+    return (char)x;
+}
+
+DP_INLINE unsigned char DP_uint_to_uchar(unsigned int x)
+{
+    return (unsigned char)x;
+}
+
+DP_INLINE short DP_uint_to_short(unsigned int x)
+{
+    return (short)x;
+}
+
+DP_INLINE unsigned short DP_uint_to_ushort(unsigned int x)
+{
+    return (unsigned short)x;
+}
+
+DP_INLINE int DP_uint_to_int(unsigned int x)
+{
+    return (int)x;
+}
+
+DP_INLINE long DP_uint_to_long(unsigned int x)
+{
+    return (long)x;
+}
+
+DP_INLINE unsigned long DP_uint_to_ulong(unsigned int x)
+{
+    return (unsigned long)x;
+}
+
+DP_INLINE int8_t DP_uint_to_int8(unsigned int x)
+{
+    return (int8_t)x;
+}
+
+DP_INLINE uint8_t DP_uint_to_uint8(unsigned int x)
+{
+    return (uint8_t)x;
+}
+
+DP_INLINE int16_t DP_uint_to_int16(unsigned int x)
+{
+    return (int16_t)x;
+}
+
+DP_INLINE uint16_t DP_uint_to_uint16(unsigned int x)
+{
+    return (uint16_t)x;
+}
+
+DP_INLINE int32_t DP_uint_to_int32(unsigned int x)
+{
+    return (int32_t)x;
+}
+
+DP_INLINE uint32_t DP_uint_to_uint32(unsigned int x)
+{
+    return (uint32_t)x;
+}
+
+DP_INLINE float DP_uint_to_float(unsigned int x)
+{
+    return (float)x;
+}
+
+DP_INLINE double DP_uint_to_double(unsigned int x)
+{
+    return (double)x;
+}
+
+DP_INLINE size_t DP_uint_to_size(unsigned int x)
+{
+    return (size_t)x;
+}
+
+DP_INLINE char DP_long_to_char(long x)
+{
+    return (char)x;
+}
+
+DP_INLINE unsigned char DP_long_to_uchar(long x)
+{
+    return (unsigned char)x;
+}
+
+DP_INLINE short DP_long_to_short(long x)
+{
+    return (short)x;
+}
+
+DP_INLINE unsigned short DP_long_to_ushort(long x)
+{
+    return (unsigned short)x;
+}
+
+DP_INLINE int DP_long_to_int(long x)
+{
+    return (int)x;
+}
+
+DP_INLINE unsigned int DP_long_to_uint(long x)
+{
+    return (unsigned int)x;
+}
+
+DP_INLINE unsigned long DP_long_to_ulong(long x)
+{
+    return (unsigned long)x;
+}
+
+DP_INLINE int8_t DP_long_to_int8(long x)
+{
+    return (int8_t)x;
+}
+
+DP_INLINE uint8_t DP_long_to_uint8(long x)
+{
+    return (uint8_t)x;
+}
+
+DP_INLINE int16_t DP_long_to_int16(long x)
+{
+    return (int16_t)x;
+}
+
+DP_INLINE uint16_t DP_long_to_uint16(long x)
+{
+    return (uint16_t)x;
+}
+
+DP_INLINE int32_t DP_long_to_int32(long x)
+{
+    return (int32_t)x;
+}
+
+DP_INLINE uint32_t DP_long_to_uint32(long x)
+{
+    return (uint32_t)x;
+}
+
+DP_INLINE float DP_long_to_float(long x)
+{
+    return (float)x;
+}
+
+DP_INLINE double DP_long_to_double(long x)
+{
+    return (double)x;
+}
+
+DP_INLINE size_t DP_long_to_size(long x)
+{
+    return (size_t)x;
+}
+
+DP_INLINE char DP_ulong_to_char(unsigned long x)
+{
+    return (char)x;
+}
+
+DP_INLINE unsigned char DP_ulong_to_uchar(unsigned long x)
+{
+    return (unsigned char)x;
+}
+
+DP_INLINE short DP_ulong_to_short(unsigned long x)
+{
+    return (short)x;
+}
+
+DP_INLINE unsigned short DP_ulong_to_ushort(unsigned long x)
+{
+    return (unsigned short)x;
+}
+
+DP_INLINE int DP_ulong_to_int(unsigned long x)
+{
+    return (int)x;
+}
+
+DP_INLINE unsigned int DP_ulong_to_uint(unsigned long x)
+{
+    return (unsigned int)x;
+}
+
+DP_INLINE long DP_ulong_to_long(unsigned long x)
+{
+    return (long)x;
+}
+
+DP_INLINE int8_t DP_ulong_to_int8(unsigned long x)
+{
+    return (int8_t)x;
+}
+
+DP_INLINE uint8_t DP_ulong_to_uint8(unsigned long x)
+{
+    return (uint8_t)x;
+}
+
+DP_INLINE int16_t DP_ulong_to_int16(unsigned long x)
+{
+    return (int16_t)x;
+}
+
+DP_INLINE uint16_t DP_ulong_to_uint16(unsigned long x)
+{
+    return (uint16_t)x;
+}
+
+DP_INLINE int32_t DP_ulong_to_int32(unsigned long x)
+{
+    return (int32_t)x;
+}
+
+DP_INLINE uint32_t DP_ulong_to_uint32(unsigned long x)
+{
+    return (uint32_t)x;
+}
+
+DP_INLINE float DP_ulong_to_float(unsigned long x)
+{
+    return (float)x;
+}
+
+DP_INLINE double DP_ulong_to_double(unsigned long x)
+{
+    return (double)x;
+}
+
+DP_INLINE size_t DP_ulong_to_size(unsigned long x)
+{
+    return (size_t)x;
+}
+
+DP_INLINE char DP_int8_to_char(int8_t x)
+{
+    return (char)x;
+}
+
+DP_INLINE unsigned char DP_int8_to_uchar(int8_t x)
+{
+    return (unsigned char)x;
+}
+
+DP_INLINE short DP_int8_to_short(int8_t x)
+{
+    return (short)x;
+}
+
+DP_INLINE unsigned short DP_int8_to_ushort(int8_t x)
+{
+    return (unsigned short)x;
+}
+
+DP_INLINE int DP_int8_to_int(int8_t x)
+{
+    return (int)x;
+}
+
+DP_INLINE unsigned int DP_int8_to_uint(int8_t x)
+{
+    return (unsigned int)x;
+}
+
+DP_INLINE long DP_int8_to_long(int8_t x)
+{
+    return (long)x;
+}
+
+DP_INLINE unsigned long DP_int8_to_ulong(int8_t x)
+{
+    return (unsigned long)x;
+}
+
+DP_INLINE uint8_t DP_int8_to_uint8(int8_t x)
+{
+    return (uint8_t)x;
+}
+
+DP_INLINE int16_t DP_int8_to_int16(int8_t x)
+{
+    return (int16_t)x;
+}
+
+DP_INLINE uint16_t DP_int8_to_uint16(int8_t x)
+{
+    return (uint16_t)x;
+}
+
+DP_INLINE int32_t DP_int8_to_int32(int8_t x)
+{
+    return (int32_t)x;
+}
+
+DP_INLINE uint32_t DP_int8_to_uint32(int8_t x)
+{
+    return (uint32_t)x;
+}
+
+DP_INLINE float DP_int8_to_float(int8_t x)
+{
+    return (float)x;
+}
+
+DP_INLINE double DP_int8_to_double(int8_t x)
+{
+    return (double)x;
+}
+
+DP_INLINE size_t DP_int8_to_size(int8_t x)
+{
+    return (size_t)x;
+}
+
+DP_INLINE char DP_uint8_to_char(uint8_t x)
+{
+    return (char)x;
+}
+
+DP_INLINE unsigned char DP_uint8_to_uchar(uint8_t x)
+{
+    return (unsigned char)x;
+}
+
+DP_INLINE short DP_uint8_to_short(uint8_t x)
+{
+    return (short)x;
+}
+
+DP_INLINE unsigned short DP_uint8_to_ushort(uint8_t x)
+{
+    return (unsigned short)x;
+}
+
+DP_INLINE int DP_uint8_to_int(uint8_t x)
+{
+    return (int)x;
+}
+
+DP_INLINE unsigned int DP_uint8_to_uint(uint8_t x)
+{
+    return (unsigned int)x;
+}
+
+DP_INLINE long DP_uint8_to_long(uint8_t x)
+{
+    return (long)x;
+}
+
+DP_INLINE unsigned long DP_uint8_to_ulong(uint8_t x)
+{
+    return (unsigned long)x;
+}
+
+DP_INLINE int8_t DP_uint8_to_int8(uint8_t x)
+{
+    return (int8_t)x;
+}
+
+DP_INLINE int16_t DP_uint8_to_int16(uint8_t x)
+{
+    return (int16_t)x;
+}
+
+DP_INLINE uint16_t DP_uint8_to_uint16(uint8_t x)
+{
+    return (uint16_t)x;
+}
+
+DP_INLINE int32_t DP_uint8_to_int32(uint8_t x)
+{
+    return (int32_t)x;
+}
+
+DP_INLINE uint32_t DP_uint8_to_uint32(uint8_t x)
+{
+    return (uint32_t)x;
+}
+
+DP_INLINE float DP_uint8_to_float(uint8_t x)
+{
+    return (float)x;
+}
+
+DP_INLINE double DP_uint8_to_double(uint8_t x)
+{
+    return (double)x;
+}
+
+DP_INLINE size_t DP_uint8_to_size(uint8_t x)
+{
+    return (size_t)x;
+}
+
+DP_INLINE char DP_int16_to_char(int16_t x)
+{
+    return (char)x;
+}
+
+DP_INLINE unsigned char DP_int16_to_uchar(int16_t x)
+{
+    return (unsigned char)x;
+}
+
+DP_INLINE short DP_int16_to_short(int16_t x)
+{
+    return (short)x;
+}
+
+DP_INLINE unsigned short DP_int16_to_ushort(int16_t x)
+{
+    return (unsigned short)x;
+}
+
+DP_INLINE int DP_int16_to_int(int16_t x)
+{
+    return (int)x;
+}
+
+DP_INLINE unsigned int DP_int16_to_uint(int16_t x)
+{
+    return (unsigned int)x;
+}
+
+DP_INLINE long DP_int16_to_long(int16_t x)
+{
+    return (long)x;
+}
+
+DP_INLINE unsigned long DP_int16_to_ulong(int16_t x)
+{
+    return (unsigned long)x;
+}
+
+DP_INLINE int8_t DP_int16_to_int8(int16_t x)
+{
+    return (int8_t)x;
+}
+
+DP_INLINE uint8_t DP_int16_to_uint8(int16_t x)
+{
+    return (uint8_t)x;
+}
+
+DP_INLINE uint16_t DP_int16_to_uint16(int16_t x)
+{
+    return (uint16_t)x;
+}
+
+DP_INLINE int32_t DP_int16_to_int32(int16_t x)
+{
+    return (int32_t)x;
+}
+
+DP_INLINE uint32_t DP_int16_to_uint32(int16_t x)
+{
+    return (uint32_t)x;
+}
+
+DP_INLINE float DP_int16_to_float(int16_t x)
+{
+    return (float)x;
+}
+
+DP_INLINE double DP_int16_to_double(int16_t x)
+{
+    return (double)x;
+}
+
+DP_INLINE size_t DP_int16_to_size(int16_t x)
+{
+    return (size_t)x;
+}
+
+DP_INLINE char DP_uint16_to_char(uint16_t x)
+{
+    return (char)x;
+}
+
+DP_INLINE unsigned char DP_uint16_to_uchar(uint16_t x)
+{
+    return (unsigned char)x;
+}
+
+DP_INLINE short DP_uint16_to_short(uint16_t x)
+{
+    return (short)x;
+}
+
+DP_INLINE unsigned short DP_uint16_to_ushort(uint16_t x)
+{
+    return (unsigned short)x;
+}
+
+DP_INLINE int DP_uint16_to_int(uint16_t x)
+{
+    return (int)x;
+}
+
+DP_INLINE unsigned int DP_uint16_to_uint(uint16_t x)
+{
+    return (unsigned int)x;
+}
+
+DP_INLINE long DP_uint16_to_long(uint16_t x)
+{
+    return (long)x;
+}
+
+DP_INLINE unsigned long DP_uint16_to_ulong(uint16_t x)
+{
+    return (unsigned long)x;
+}
+
+DP_INLINE int8_t DP_uint16_to_int8(uint16_t x)
+{
+    return (int8_t)x;
+}
+
+DP_INLINE uint8_t DP_uint16_to_uint8(uint16_t x)
+{
+    return (uint8_t)x;
+}
+
+DP_INLINE int16_t DP_uint16_to_int16(uint16_t x)
+{
+    return (int16_t)x;
+}
+
+DP_INLINE int32_t DP_uint16_to_int32(uint16_t x)
+{
+    return (int32_t)x;
+}
+
+DP_INLINE uint32_t DP_uint16_to_uint32(uint16_t x)
+{
+    return (uint32_t)x;
+}
+
+DP_INLINE float DP_uint16_to_float(uint16_t x)
+{
+    return (float)x;
+}
+
+DP_INLINE double DP_uint16_to_double(uint16_t x)
+{
+    return (double)x;
+}
+
+DP_INLINE size_t DP_uint16_to_size(uint16_t x)
+{
+    return (size_t)x;
+}
+
+DP_INLINE char DP_int32_to_char(int32_t x)
+{
+    return (char)x;
+}
+
+DP_INLINE unsigned char DP_int32_to_uchar(int32_t x)
+{
+    return (unsigned char)x;
+}
+
+DP_INLINE short DP_int32_to_short(int32_t x)
+{
+    return (short)x;
+}
+
+DP_INLINE unsigned short DP_int32_to_ushort(int32_t x)
+{
+    return (unsigned short)x;
+}
+
+DP_INLINE int DP_int32_to_int(int32_t x)
+{
+    return (int)x;
+}
+
+DP_INLINE unsigned int DP_int32_to_uint(int32_t x)
+{
+    return (unsigned int)x;
+}
+
+DP_INLINE long DP_int32_to_long(int32_t x)
+{
+    return (long)x;
+}
+
+DP_INLINE unsigned long DP_int32_to_ulong(int32_t x)
+{
+    return (unsigned long)x;
+}
+
+DP_INLINE int8_t DP_int32_to_int8(int32_t x)
+{
+    return (int8_t)x;
+}
+
+DP_INLINE uint8_t DP_int32_to_uint8(int32_t x)
+{
+    return (uint8_t)x;
+}
+
+DP_INLINE int16_t DP_int32_to_int16(int32_t x)
+{
+    return (int16_t)x;
+}
+
+DP_INLINE uint16_t DP_int32_to_uint16(int32_t x)
+{
+    return (uint16_t)x;
+}
+
+DP_INLINE uint32_t DP_int32_to_uint32(int32_t x)
+{
+    return (uint32_t)x;
+}
+
+DP_INLINE float DP_int32_to_float(int32_t x)
+{
+    return (float)x;
+}
+
+DP_INLINE double DP_int32_to_double(int32_t x)
+{
+    return (double)x;
+}
+
+DP_INLINE size_t DP_int32_to_size(int32_t x)
+{
+    return (size_t)x;
+}
+
+DP_INLINE char DP_uint32_to_char(uint32_t x)
+{
+    return (char)x;
+}
+
+DP_INLINE unsigned char DP_uint32_to_uchar(uint32_t x)
+{
+    return (unsigned char)x;
+}
+
+DP_INLINE short DP_uint32_to_short(uint32_t x)
+{
+    return (short)x;
+}
+
+DP_INLINE unsigned short DP_uint32_to_ushort(uint32_t x)
+{
+    return (unsigned short)x;
+}
+
+DP_INLINE int DP_uint32_to_int(uint32_t x)
+{
+    return (int)x;
+}
+
+DP_INLINE unsigned int DP_uint32_to_uint(uint32_t x)
+{
+    return (unsigned int)x;
+}
+
+DP_INLINE long DP_uint32_to_long(uint32_t x)
+{
+    return (long)x;
+}
+
+DP_INLINE unsigned long DP_uint32_to_ulong(uint32_t x)
+{
+    return (unsigned long)x;
+}
+
+DP_INLINE int8_t DP_uint32_to_int8(uint32_t x)
+{
+    return (int8_t)x;
+}
+
+DP_INLINE uint8_t DP_uint32_to_uint8(uint32_t x)
+{
+    return (uint8_t)x;
+}
+
+DP_INLINE int16_t DP_uint32_to_int16(uint32_t x)
+{
+    return (int16_t)x;
+}
+
+DP_INLINE uint16_t DP_uint32_to_uint16(uint32_t x)
+{
+    return (uint16_t)x;
+}
+
+DP_INLINE int32_t DP_uint32_to_int32(uint32_t x)
+{
+    return (int32_t)x;
+}
+
+DP_INLINE float DP_uint32_to_float(uint32_t x)
+{
+    return (float)x;
+}
+
+DP_INLINE double DP_uint32_to_double(uint32_t x)
+{
+    return (double)x;
+}
+
+DP_INLINE size_t DP_uint32_to_size(uint32_t x)
+{
+    return (size_t)x;
+}
+
+DP_INLINE char DP_float_to_char(float x)
+{
+    return (char)x;
+}
+
+DP_INLINE unsigned char DP_float_to_uchar(float x)
+{
+    return (unsigned char)x;
+}
+
+DP_INLINE short DP_float_to_short(float x)
+{
+    return (short)x;
+}
+
+DP_INLINE unsigned short DP_float_to_ushort(float x)
+{
+    return (unsigned short)x;
+}
+
+DP_INLINE int DP_float_to_int(float x)
+{
+    return (int)x;
+}
+
+DP_INLINE unsigned int DP_float_to_uint(float x)
+{
+    return (unsigned int)x;
+}
+
+DP_INLINE long DP_float_to_long(float x)
+{
+    return (long)x;
+}
+
+DP_INLINE unsigned long DP_float_to_ulong(float x)
+{
+    return (unsigned long)x;
+}
+
+DP_INLINE int8_t DP_float_to_int8(float x)
+{
+    return (int8_t)x;
+}
+
+DP_INLINE uint8_t DP_float_to_uint8(float x)
+{
+    return (uint8_t)x;
+}
+
+DP_INLINE int16_t DP_float_to_int16(float x)
+{
+    return (int16_t)x;
+}
+
+DP_INLINE uint16_t DP_float_to_uint16(float x)
+{
+    return (uint16_t)x;
+}
+
+DP_INLINE int32_t DP_float_to_int32(float x)
+{
+    return (int32_t)x;
+}
+
+DP_INLINE uint32_t DP_float_to_uint32(float x)
+{
+    return (uint32_t)x;
+}
+
+DP_INLINE double DP_float_to_double(float x)
+{
+    return (double)x;
+}
+
+DP_INLINE size_t DP_float_to_size(float x)
+{
+    return (size_t)x;
+}
+
+DP_INLINE char DP_double_to_char(double x)
+{
+    return (char)x;
+}
+
+DP_INLINE unsigned char DP_double_to_uchar(double x)
+{
+    return (unsigned char)x;
+}
+
+DP_INLINE short DP_double_to_short(double x)
+{
+    return (short)x;
+}
+
+DP_INLINE unsigned short DP_double_to_ushort(double x)
+{
+    return (unsigned short)x;
+}
+
+DP_INLINE int DP_double_to_int(double x)
+{
+    return (int)x;
+}
+
+DP_INLINE unsigned int DP_double_to_uint(double x)
+{
+    return (unsigned int)x;
+}
+
+DP_INLINE long DP_double_to_long(double x)
+{
+    return (long)x;
+}
+
+DP_INLINE unsigned long DP_double_to_ulong(double x)
+{
+    return (unsigned long)x;
+}
+
+DP_INLINE int8_t DP_double_to_int8(double x)
+{
+    return (int8_t)x;
+}
+
+DP_INLINE uint8_t DP_double_to_uint8(double x)
+{
+    return (uint8_t)x;
+}
+
+DP_INLINE int16_t DP_double_to_int16(double x)
+{
+    return (int16_t)x;
+}
+
+DP_INLINE uint16_t DP_double_to_uint16(double x)
+{
+    return (uint16_t)x;
+}
+
+DP_INLINE int32_t DP_double_to_int32(double x)
+{
+    return (int32_t)x;
+}
+
+DP_INLINE uint32_t DP_double_to_uint32(double x)
+{
+    return (uint32_t)x;
+}
+
+DP_INLINE float DP_double_to_float(double x)
+{
+    return (float)x;
+}
+
+DP_INLINE size_t DP_double_to_size(double x)
+{
+    return (size_t)x;
+}
+
+DP_INLINE char DP_size_to_char(size_t x)
+{
+    return (char)x;
+}
+
+DP_INLINE unsigned char DP_size_to_uchar(size_t x)
+{
+    return (unsigned char)x;
+}
+
+DP_INLINE short DP_size_to_short(size_t x)
+{
+    return (short)x;
+}
+
+DP_INLINE unsigned short DP_size_to_ushort(size_t x)
+{
+    return (unsigned short)x;
+}
+
+DP_INLINE int DP_size_to_int(size_t x)
+{
+    return (int)x;
+}
+
+DP_INLINE unsigned int DP_size_to_uint(size_t x)
+{
+    return (unsigned int)x;
+}
+
+DP_INLINE long DP_size_to_long(size_t x)
+{
+    return (long)x;
+}
+
+DP_INLINE unsigned long DP_size_to_ulong(size_t x)
+{
+    return (unsigned long)x;
+}
+
+DP_INLINE int8_t DP_size_to_int8(size_t x)
+{
+    return (int8_t)x;
+}
+
+DP_INLINE uint8_t DP_size_to_uint8(size_t x)
+{
+    return (uint8_t)x;
+}
+
+DP_INLINE int16_t DP_size_to_int16(size_t x)
+{
+    return (int16_t)x;
+}
+
+DP_INLINE uint16_t DP_size_to_uint16(size_t x)
+{
+    return (uint16_t)x;
+}
+
+DP_INLINE int32_t DP_size_to_int32(size_t x)
+{
+    return (int32_t)x;
+}
+
+DP_INLINE uint32_t DP_size_to_uint32(size_t x)
+{
+    return (uint32_t)x;
+}
+
+DP_INLINE float DP_size_to_float(size_t x)
+{
+    return (float)x;
+}
+
+DP_INLINE double DP_size_to_double(size_t x)
+{
+    return (double)x;
+}
+
+#endif
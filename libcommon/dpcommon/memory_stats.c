@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2022 askmeaboutloom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "memory_stats.h"
+#include "common.h"
+#include "thread_slots.h"
+#include <SDL_atomic.h>
+
+
+typedef struct DP_MemorySlot {
+    DP_ThreadSlot slot;
+    long long bytes[DP_MEMORY_CATEGORY_COUNT];
+} DP_MemorySlot;
+
+static DP_ThreadSlots memory_slots =
+    DP_THREAD_SLOTS_INIT(DP_MemorySlot, 0, NULL);
+static SDL_SpinLock budget_lock;
+static size_t budget;
+
+
+const char *DP_memory_category_name(DP_MemoryCategory category)
+{
+    switch (category) {
+    case DP_MEMORY_TILES_UNIQUE:
+        return "tiles_unique";
+    case DP_MEMORY_TILES_SHARED:
+        return "tiles_shared";
+    case DP_MEMORY_MESSAGES:
+        return "messages";
+    case DP_MEMORY_HISTORY:
+        return "history";
+    case DP_MEMORY_DRAW_CONTEXTS:
+        return "draw_contexts";
+    case DP_MEMORY_CATEGORY_COUNT:
+        break;
+    }
+    return NULL;
+}
+
+
+static void record(DP_MemoryCategory from, DP_MemoryCategory to, size_t bytes)
+{
+    DP_MemorySlot *slot = (DP_MemorySlot *)DP_thread_slot_get(&memory_slots);
+    DP_thread_slot_write_begin(&slot->slot);
+    if (from != DP_MEMORY_CATEGORY_COUNT) {
+        slot->bytes[from] -= (long long)bytes;
+    }
+    if (to != DP_MEMORY_CATEGORY_COUNT) {
+        slot->bytes[to] += (long long)bytes;
+    }
+    DP_thread_slot_write_end(&slot->slot);
+}
+
+void DP_memory_add(DP_MemoryCategory category, size_t bytes)
+{
+    DP_ASSERT(category >= 0 && category < DP_MEMORY_CATEGORY_COUNT);
+    record(DP_MEMORY_CATEGORY_COUNT, category, bytes);
+}
+
+void DP_memory_sub(DP_MemoryCategory category, size_t bytes)
+{
+    DP_ASSERT(category >= 0 && category < DP_MEMORY_CATEGORY_COUNT);
+    record(category, DP_MEMORY_CATEGORY_COUNT, bytes);
+}
+
+void DP_memory_move(DP_MemoryCategory from, DP_MemoryCategory to,
+                    size_t bytes)
+{
+    DP_ASSERT(from >= 0 && from < DP_MEMORY_CATEGORY_COUNT);
+    DP_ASSERT(to >= 0 && to < DP_MEMORY_CATEGORY_COUNT);
+    record(from, to, bytes);
+}
+
+
+void DP_memory_stats(DP_MemoryStats *out_stats)
+{
+    DP_ASSERT(out_stats);
+    long long sums[DP_MEMORY_CATEGORY_COUNT] = {0};
+    long long bytes[DP_MEMORY_CATEGORY_COUNT];
+    for (DP_ThreadSlot *slot = DP_thread_slots_first(&memory_slots); slot;
+         slot = slot->next) {
+        DP_thread_slot_read(slot, bytes, ((DP_MemorySlot *)slot)->bytes,
+                            sizeof(bytes));
+        for (int i = 0; i < DP_MEMORY_CATEGORY_COUNT; ++i) {
+            sums[i] += bytes[i];
+        }
+    }
+
+    // Moves between categories may get summed up halfway through, so a
+    // category can briefly come out negative.
+    size_t total = 0;
+    for (int i = 0; i < DP_MEMORY_CATEGORY_COUNT; ++i) {
+        size_t value = sums[i] < 0 ? 0 : (size_t)sums[i];
+        out_stats->bytes[i] = value;
+        total += value;
+    }
+    out_stats->total = total;
+    out_stats->budget = DP_memory_budget();
+}
+
+size_t DP_memory_total(void)
+{
+    DP_MemoryStats stats;
+    DP_memory_stats(&stats);
+    return stats.total;
+}
+
+
+void DP_memory_budget_set(size_t bytes)
+{
+    SDL_AtomicLock(&budget_lock);
+    budget = bytes;
+    SDL_AtomicUnlock(&budget_lock);
+}
+
+size_t DP_memory_budget(void)
+{
+    SDL_AtomicLock(&budget_lock);
+    size_t bytes = budget;
+    SDL_AtomicUnlock(&budget_lock);
+    return bytes;
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2022 askmeaboutloom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef DPCOMMON_MEMORY_STATS_H
+#define DPCOMMON_MEMORY_STATS_H
+#include "common.h"
+
+
+// Accounting of how much memory a session is holding on to, by category.
+// Every thread counts into its own slot, those get summed up when the stats
+// are read, so the counting never contends with other threads. Memory may
+// be freed on a different thread than it was allocated on, so a single
+// slot's counts can go negative, only the sum is meaningful.
+
+typedef enum DP_MemoryCategory {
+    // Tiles referenced from only one place, dropping that frees them.
+    DP_MEMORY_TILES_UNIQUE,
+    // Tiles referenced from several places, like a canvas state and the
+    // savepoints in the history that still contain the same tile.
+    DP_MEMORY_TILES_SHARED,
+    DP_MEMORY_MESSAGES,
+    // The history's own bookkeeping. Savepoint tiles count as tiles.
+    DP_MEMORY_HISTORY,
+    DP_MEMORY_DRAW_CONTEXTS,
+    DP_MEMORY_CATEGORY_COUNT,
+} DP_MemoryCategory;
+
+typedef struct DP_MemoryStats {
+    size_t bytes[DP_MEMORY_CATEGORY_COUNT];
+    size_t total;
+    size_t budget;
+} DP_MemoryStats;
+
+const char *DP_memory_category_name(DP_MemoryCategory category);
+
+void DP_memory_add(DP_MemoryCategory category, size_t bytes);
+
+void DP_memory_sub(DP_MemoryCategory category, size_t bytes);
+
+void DP_memory_move(DP_MemoryCategory from, DP_MemoryCategory to,
+                    size_t bytes);
+
+void DP_memory_stats(DP_MemoryStats *out_stats);
+
+size_t DP_memory_total(void);
+
+
+// Zero means unlimited, which is the default. Going over the budget doesn't
+// fail any allocations, it makes the canvas history reclaim memory the next
+// time it gets a chance by having draw contexts release their grown buffers
+// and compressing savepoints, or by shrinking its undo window when it's not
+// in a networked session.
+void DP_memory_budget_set(size_t bytes);
+
+size_t DP_memory_budget(void);
+
+
+#endif
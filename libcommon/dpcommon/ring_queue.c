@@ -0,0 +1,295 @@
+/*
+ * Copyright (c) 2022 askmeaboutloom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "ring_queue.h"
+#include "common.h"
+#include "threading.h"
+#include <SDL_atomic.h>
+
+#define MAX_CAPACITY ((size_t)1 << 30)
+
+
+typedef struct DP_RingQueueSlot {
+    SDL_atomic_t sequence;
+    alignas(max_align_t) unsigned char element[];
+} DP_RingQueueSlot;
+
+typedef struct DP_RingQueueSide {
+    SDL_atomic_t position;
+    SDL_atomic_t waiting;
+    DP_Semaphore *sem;
+} DP_RingQueueSide;
+
+struct DP_RingQueue {
+    size_t element_size;
+    size_t slot_size;
+    int mask;
+    SDL_atomic_t closed;
+    DP_RingQueueSide push;
+    DP_RingQueueSide shift;
+    unsigned char *slots;
+};
+
+
+// Positions and sequence numbers wrap around, so do the arithmetic unsigned.
+static int wrap_add(int a, int b)
+{
+    return (int)((unsigned int)a + (unsigned int)b);
+}
+
+static int wrap_diff(int a, int b)
+{
+    return (int)((unsigned int)a - (unsigned int)b);
+}
+
+static DP_RingQueueSlot *slot_at(DP_RingQueue *rq, int position)
+{
+    size_t index = (size_t)(unsigned int)(position & rq->mask);
+    return (DP_RingQueueSlot *)(rq->slots + index * rq->slot_size);
+}
+
+// A single slot can't tell apart being full from being ready to be written
+// to for the next lap, so there's always at least two of them.
+static size_t round_up_to_power_of_two(size_t value)
+{
+    size_t result = 2;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+
+DP_RingQueue *DP_ring_queue_new(size_t capacity, size_t element_size)
+{
+    DP_ASSERT(capacity > 0);
+    DP_ASSERT(capacity <= MAX_CAPACITY);
+    DP_ASSERT(element_size > 0);
+    size_t slot_count = round_up_to_power_of_two(capacity);
+    size_t alignment = alignof(max_align_t);
+    size_t slot_size = (sizeof(DP_RingQueueSlot) + element_size + alignment - 1)
+                     / alignment * alignment;
+
+    DP_RingQueue *rq = DP_malloc(sizeof(*rq));
+    *rq = (DP_RingQueue){element_size,
+                         slot_size,
+                         (int)(slot_count - 1),
+                         {0},
+                         {{0}, {0}, NULL},
+                         {{0}, {0}, NULL},
+                         DP_malloc(slot_count * slot_size)};
+
+    for (size_t i = 0; i < slot_count; ++i) {
+        SDL_AtomicSet(&slot_at(rq, (int)i)->sequence, (int)i);
+    }
+
+    if (!(rq->push.sem = DP_semaphore_new(0))
+        || !(rq->shift.sem = DP_semaphore_new(0))) {
+        DP_ring_queue_free(rq);
+        return NULL;
+    }
+
+    return rq;
+}
+
+void DP_ring_queue_free(DP_RingQueue *rq)
+{
+    if (rq) {
+        DP_semaphore_free(rq->shift.sem);
+        DP_semaphore_free(rq->push.sem);
+        DP_free(rq->slots);
+        DP_free(rq);
+    }
+}
+
+size_t DP_ring_queue_capacity(DP_RingQueue *rq)
+{
+    DP_ASSERT(rq);
+    return (size_t)rq->mask + 1;
+}
+
+
+// Claims everyone currently registered as waiting on the given side and posts
+// its semaphore once for each of them.
+static void wake_all(DP_RingQueueSide *side)
+{
+    int waiting = SDL_AtomicSet(&side->waiting, 0);
+    for (int i = 0; i < waiting; ++i) {
+        DP_SEMAPHORE_MUST_POST(side->sem);
+    }
+}
+
+// Claims a single waiter and posts for it. Every push or shift only makes room
+// for one more operation on the other side, so waking more than that just
+// makes them fight over it. Claiming instead of just looking at the count also
+// means that a waiter that hasn't gotten around to sleeping yet doesn't get
+// posted again by every single operation on the other side.
+static void wake_one(DP_RingQueueSide *side)
+{
+    while (true) {
+        int waiting = SDL_AtomicGet(&side->waiting);
+        if (waiting <= 0) {
+            return;
+        }
+        else if (SDL_AtomicCAS(&side->waiting, waiting, waiting - 1)) {
+            DP_SEMAPHORE_MUST_POST(side->sem);
+            return;
+        }
+    }
+}
+
+void DP_ring_queue_close(DP_RingQueue *rq)
+{
+    DP_ASSERT(rq);
+    SDL_AtomicSet(&rq->closed, 1);
+    wake_all(&rq->push);
+    wake_all(&rq->shift);
+}
+
+bool DP_ring_queue_closed(DP_RingQueue *rq)
+{
+    DP_ASSERT(rq);
+    return SDL_AtomicGet(&rq->closed);
+}
+
+
+// Claims the slot at the side's position if its sequence number is the
+// expected offset away from it. Returns NULL if the queue is full or empty,
+// depending on which side this is.
+static DP_RingQueueSlot *claim_slot(DP_RingQueue *rq, DP_RingQueueSide *side,
+                                    int offset, int *out_position)
+{
+    int position = SDL_AtomicGet(&side->position);
+    while (true) {
+        DP_RingQueueSlot *slot = slot_at(rq, position);
+        int diff = wrap_diff(SDL_AtomicGet(&slot->sequence),
+                             wrap_add(position, offset));
+        if (diff == 0) {
+            if (SDL_AtomicCAS(&side->position, position,
+                              wrap_add(position, 1))) {
+                *out_position = position;
+                return slot;
+            }
+        }
+        else if (diff < 0) {
+            return NULL;
+        }
+        position = SDL_AtomicGet(&side->position);
+    }
+}
+
+bool DP_ring_queue_try_push(DP_RingQueue *rq, const void *element)
+{
+    DP_ASSERT(rq);
+    DP_ASSERT(element);
+    int position;
+    DP_RingQueueSlot *slot = claim_slot(rq, &rq->push, 0, &position);
+    if (slot) {
+        memcpy(slot->element, element, rq->element_size);
+        SDL_AtomicSet(&slot->sequence, wrap_add(position, 1));
+        wake_one(&rq->shift);
+        return true;
+    }
+    else {
+        return false;
+    }
+}
+
+bool DP_ring_queue_try_shift(DP_RingQueue *rq, void *out_element)
+{
+    DP_ASSERT(rq);
+    DP_ASSERT(out_element);
+    int position;
+    DP_RingQueueSlot *slot = claim_slot(rq, &rq->shift, 1, &position);
+    if (slot) {
+        memcpy(out_element, slot->element, rq->element_size);
+        SDL_AtomicSet(&slot->sequence, wrap_add(position, rq->mask + 1));
+        wake_one(&rq->push);
+        return true;
+    }
+    else {
+        return false;
+    }
+}
+
+
+// Exactly one of in_element and out_element is given, for pushing and
+// shifting respectively.
+static bool try_push_or_shift(DP_RingQueue *rq, const void *in_element,
+                              void *out_element)
+{
+    return in_element ? DP_ring_queue_try_push(rq, in_element)
+                      : DP_ring_queue_try_shift(rq, out_element);
+}
+
+// Takes back a registration as a waiter, unless someone else already claimed
+// it. In that case, there's a spurious post coming that'll just make some
+// waiter check the queue again.
+static void unregister_waiting(DP_RingQueueSide *side)
+{
+    while (true) {
+        int waiting = SDL_AtomicGet(&side->waiting);
+        if (waiting <= 0
+            || SDL_AtomicCAS(&side->waiting, waiting, waiting - 1)) {
+            return;
+        }
+    }
+}
+
+// Register as waiting, then check again before going to sleep. The other side
+// wakes waiters after it's done with an operation, so either we see its change
+// here or it sees us waiting and posts the semaphore. The semaphore only
+// holds posts for waiters that were claimed, so the operations on the other
+// side don't cost anything when nobody is waiting.
+static bool wait_for(DP_RingQueue *rq, DP_RingQueueSide *side,
+                     const void *in_element, void *out_element)
+{
+    while (!SDL_AtomicGet(&rq->closed)) {
+        if (try_push_or_shift(rq, in_element, out_element)) {
+            return true;
+        }
+        SDL_AtomicIncRef(&side->waiting);
+        if (SDL_AtomicGet(&rq->closed)) {
+            unregister_waiting(side);
+            return false;
+        }
+        else if (try_push_or_shift(rq, in_element, out_element)) {
+            unregister_waiting(side);
+            return true;
+        }
+        DP_SEMAPHORE_MUST_WAIT(side->sem);
+    }
+    return false;
+}
+
+bool DP_ring_queue_push(DP_RingQueue *rq, const void *element)
+{
+    DP_ASSERT(rq);
+    DP_ASSERT(element);
+    return wait_for(rq, &rq->push, element, NULL);
+}
+
+bool DP_ring_queue_shift(DP_RingQueue *rq, void *out_element)
+{
+    DP_ASSERT(rq);
+    DP_ASSERT(out_element);
+    return wait_for(rq, &rq->shift, NULL, out_element);
+}
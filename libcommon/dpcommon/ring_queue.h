@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2022 askmeaboutloom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef DPCOMMON_RING_QUEUE_H
+#define DPCOMMON_RING_QUEUE_H
+#include "common.h"
+
+
+// Bounded lock-free queue for handing elements between threads, usable with
+// any number of producers and consumers. Pushing and shifting never take a
+// lock, the blocking variants only sleep on a semaphore when the queue is
+// full or empty respectively, and producers and consumers only post one when
+// the other side is actually waiting.
+//
+// Based on Dmitry Vyukov's bounded MPMC queue: each slot carries a sequence
+// number that tells whether it's ready to be written or read for the current
+// lap around the ring, so producers and consumers only contend on their own
+// position counter.
+
+typedef struct DP_RingQueue DP_RingQueue;
+
+// The capacity gets rounded up to the next power of two, at least 2.
+DP_RingQueue *DP_ring_queue_new(size_t capacity, size_t element_size);
+
+// The queue must be empty and nothing may be waiting on it anymore. Shift off
+// any remaining elements before calling this if they need disposing.
+void DP_ring_queue_free(DP_RingQueue *rq);
+
+size_t DP_ring_queue_capacity(DP_RingQueue *rq);
+
+// Makes all current and future blocking pushes and shifts return false
+// immediately. Elements still in the queue can be retrieved with
+// DP_ring_queue_try_shift.
+void DP_ring_queue_close(DP_RingQueue *rq);
+
+bool DP_ring_queue_closed(DP_RingQueue *rq);
+
+
+// Returns false if the queue is full.
+bool DP_ring_queue_try_push(DP_RingQueue *rq, const void *element);
+
+// Waits while the queue is full, returns false if it got closed.
+bool DP_ring_queue_push(DP_RingQueue *rq, const void *element);
+
+// Returns false if the queue is empty.
+bool DP_ring_queue_try_shift(DP_RingQueue *rq, void *out_element);
+
+// Waits while the queue is empty, returns false if it got closed.
+bool DP_ring_queue_shift(DP_RingQueue *rq, void *out_element);
+
+
+#endif
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2022 askmeaboutloom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "thread_slots.h"
+#include "common.h"
+#include "threading.h"
+#include <SDL_atomic.h>
+
+
+static void SDLCALL release_slot(void *arg)
+{
+    DP_ThreadSlot *slot = arg;
+    SDL_AtomicSet(&slot->owned, 0);
+}
+
+// The ready flag is only set after the key has been created, with the lock
+// making sure that only one thread gets to create it.
+static DP_TlsKey get_tls_key(DP_ThreadSlots *slots)
+{
+    if (!SDL_AtomicGet(&slots->tls_ready)) {
+        SDL_AtomicLock(&slots->tls_lock);
+        if (!SDL_AtomicGet(&slots->tls_ready)) {
+            slots->tls_key = DP_tls_create(release_slot);
+            SDL_AtomicSet(&slots->tls_ready, 1);
+        }
+        SDL_AtomicUnlock(&slots->tls_lock);
+    }
+    return slots->tls_key;
+}
+
+static void reset_slot(DP_ThreadSlots *slots, DP_ThreadSlot *slot)
+{
+    if (slots->reset) {
+        DP_thread_slot_write_begin(slot);
+        slots->reset(slot);
+        DP_thread_slot_write_end(slot);
+    }
+}
+
+static DP_ThreadSlot *claim_slot(DP_ThreadSlots *slots)
+{
+    if (SDL_AtomicGet(&slots->count) >= slots->reuse_threshold) {
+        for (DP_ThreadSlot *slot = SDL_AtomicGetPtr(&slots->first); slot;
+             slot = slot->next) {
+            if (SDL_AtomicCAS(&slot->owned, 0, 1)) {
+                reset_slot(slots, slot);
+                return slot;
+            }
+        }
+    }
+
+    DP_ASSERT(slots->size >= sizeof(DP_ThreadSlot));
+    DP_ThreadSlot *slot = DP_malloc(slots->size);
+    memset(slot, 0, slots->size);
+    SDL_AtomicSet(&slot->owned, 1);
+    reset_slot(slots, slot);
+    do {
+        slot->next = SDL_AtomicGetPtr(&slots->first);
+    } while (!SDL_AtomicCASPtr(&slots->first, slot->next, slot));
+    SDL_AtomicAdd(&slots->count, 1);
+    return slot;
+}
+
+DP_ThreadSlot *DP_thread_slot_get(DP_ThreadSlots *slots)
+{
+    DP_ASSERT(slots);
+    DP_TlsKey key = get_tls_key(slots);
+    DP_ThreadSlot *slot = DP_tls_get(key);
+    if (!slot) {
+        slot = claim_slot(slots);
+        DP_tls_set(key, slot);
+    }
+    return slot;
+}
+
+DP_ThreadSlot *DP_thread_slots_first(DP_ThreadSlots *slots)
+{
+    DP_ASSERT(slots);
+    return SDL_AtomicGetPtr(&slots->first);
+}
+
+
+void DP_thread_slot_write_begin(DP_ThreadSlot *slot)
+{
+    DP_ASSERT(slot);
+    DP_ASSERT(SDL_AtomicGet(&slot->sequence) % 2 == 0);
+    SDL_AtomicAdd(&slot->sequence, 1);
+}
+
+void DP_thread_slot_write_end(DP_ThreadSlot *slot)
+{
+    DP_ASSERT(slot);
+    DP_ASSERT(SDL_AtomicGet(&slot->sequence) % 2 != 0);
+    SDL_AtomicAdd(&slot->sequence, 1);
+}
+
+void DP_thread_slot_read(DP_ThreadSlot *slot, void *dst, const void *src,
+                         size_t size)
+{
+    DP_ASSERT(slot);
+    while (true) {
+        int before = SDL_AtomicGet(&slot->sequence);
+        if (before % 2 == 0) {
+            memcpy(dst, src, size);
+            if (SDL_AtomicGet(&slot->sequence) == before) {
+                return;
+            }
+        }
+    }
+}
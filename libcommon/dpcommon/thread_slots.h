@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2022 askmeaboutloom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef DPCOMMON_THREAD_SLOTS_H
+#define DPCOMMON_THREAD_SLOTS_H
+#include "common.h"
+#include "threading.h"
+#include <SDL_atomic.h>
+
+
+// Per-thread slots for data that gets written often by many threads and read
+// rarely, like statistics. Each thread claims a slot of its own the first time
+// it asks for one and is the only one writing to it, so writers never contend.
+// Writes are bracketed by incrementing the slot's sequence number, so it's odd
+// while a write is in progress. Readers copy the contents and retry if the
+// sequence number was odd or changed in the meantime. Slots are never freed,
+// when a thread exits its slot gets released for a new thread to claim.
+
+typedef struct DP_ThreadSlot {
+    struct DP_ThreadSlot *next;
+    SDL_atomic_t owned;
+    SDL_atomic_t sequence;
+} DP_ThreadSlot;
+
+// Called on every slot that gets claimed, inside of a write.
+typedef void (*DP_ThreadSlotResetFn)(DP_ThreadSlot *slot);
+
+typedef struct DP_ThreadSlots {
+    size_t size;
+    int reuse_threshold;
+    DP_ThreadSlotResetFn reset;
+    void *first;
+    SDL_atomic_t count;
+    SDL_atomic_t tls_ready;
+    SDL_SpinLock tls_lock;
+    DP_TlsKey tls_key;
+} DP_ThreadSlots;
+
+// For static initialization. TYPE must start with a DP_ThreadSlot member, new
+// slots get zeroed. Released slots are only reused once there's at least
+// REUSE_THRESHOLD slots, before that new ones get allocated. RESET may be NULL.
+#define DP_THREAD_SLOTS_INIT(TYPE, REUSE_THRESHOLD, RESET)           \
+    {                                                                \
+        sizeof(TYPE), (REUSE_THRESHOLD), (RESET), NULL, {0}, {0}, 0, \
+            DP_TLS_UNDEFINED                                         \
+    }
+
+
+// Returns the calling thread's slot, claiming one if it doesn't have one yet.
+DP_ThreadSlot *DP_thread_slot_get(DP_ThreadSlots *slots);
+
+// All slots ever claimed, follow the next pointers to iterate them. Slots are
+// only ever prepended, so this is safe to walk while other threads claim more.
+DP_ThreadSlot *DP_thread_slots_first(DP_ThreadSlots *slots);
+
+// Only the thread owning the slot may write to it.
+void DP_thread_slot_write_begin(DP_ThreadSlot *slot);
+
+void DP_thread_slot_write_end(DP_ThreadSlot *slot);
+
+// Copies size bytes at src, which should point into the slot, to dst, retrying
+// until it gets a copy that wasn't written to in the meantime.
+void DP_thread_slot_read(DP_ThreadSlot *slot, void *dst, const void *src,
+                         size_t size);
+
+
+#endif
@@ -22,9 +22,11 @@
 #include "threading.h"
 #include "common.h"
 #include <errno.h>
+#include <limits.h>
 #include <pthread.h>
 #include <semaphore.h>
 #include <string.h>
+#include <unistd.h>
 
 
 struct DP_Mutex {
@@ -281,8 +283,14 @@ void DP_thread_free_join(DP_Thread *thread)
     }
 }
 
+int DP_thread_cpu_count(void)
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 && count <= INT_MAX ? (int)count : 1;
+}
 
-DP_TlsKey DP_tls_create(void (*destructor)(void *))
+
+static DP_TlsKey create_tls_key(void (*destructor)(void *))
 {
     DP_TlsKey key;
     int error = pthread_key_create(&key, destructor);
@@ -290,8 +298,19 @@ DP_TlsKey DP_tls_create(void (*destructor)(void *))
         return key;
     }
     else {
-        DP_panic("Error creating thread-local key: %s", strerror(errno));
+        DP_panic("Error creating thread-local key: %s", strerror(error));
+    }
+}
+
+DP_TlsKey DP_tls_create(void (*destructor)(void *))
+{
+    DP_TlsKey key = create_tls_key(destructor);
+    if (key == DP_TLS_UNDEFINED) {
+        // Zero is a valid pthread key, but it's our undefined value. Leave
+        // it allocated so that it doesn't get handed out again.
+        key = create_tls_key(destructor);
     }
+    return key;
 }
 
 void *DP_tls_get(DP_TlsKey key)
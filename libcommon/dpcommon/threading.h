@@ -113,6 +113,8 @@ DP_Thread *DP_thread_new(DP_ThreadFn fn, void *data);
 
 void DP_thread_free_join(DP_Thread *thread);
 
+int DP_thread_cpu_count(void);
+
 
 DP_TlsKey DP_tls_create(void (*destructor)(void *));
 
@@ -0,0 +1,251 @@
+/*
+ * Copyright (c) 2022 askmeaboutloom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "trace.h"
+#include "common.h"
+#include "output.h"
+
+#ifdef DP_TRACING
+#    include "thread_slots.h"
+#    include <SDL_atomic.h>
+#    include <SDL_timer.h>
+
+
+#    define BUFFER_CAPACITY 16384
+// The head index counts up to this and then wraps back around to the
+// capacity, so that it stays aligned to the ring and can't overflow.
+#    define HEAD_WRAP (BUFFER_CAPACITY * 65536)
+// Buffers of exited threads are kept around so that their events show up in
+// dumps, only once there's this many are they recycled for new threads.
+#    define BUFFER_REUSE_THRESHOLD 32
+
+typedef struct DP_TraceEvent {
+    const char *name;
+    unsigned long long ns;
+    bool begin;
+} DP_TraceEvent;
+
+// Each buffer is written only by the thread owning it, which gets a new
+// sequential id whenever the buffer is claimed. The head is the index of the
+// next event to write, it's only published after the event itself has been
+// written. Buffers of exited threads get reused by new threads, the slot's
+// sequence number changes when that happens so that readers know to skip it.
+typedef struct DP_TraceBuffer {
+    DP_ThreadSlot slot;
+    SDL_atomic_t head;
+    void *name;
+    int thread_id;
+    DP_TraceEvent events[BUFFER_CAPACITY];
+} DP_TraceBuffer;
+
+static SDL_atomic_t last_thread_id;
+
+static void reset_buffer(DP_ThreadSlot *slot)
+{
+    DP_TraceBuffer *buffer = (DP_TraceBuffer *)slot;
+    SDL_AtomicSetPtr(&buffer->name, NULL);
+    buffer->thread_id = SDL_AtomicAdd(&last_thread_id, 1) + 1;
+    SDL_AtomicSet(&buffer->head, 0);
+}
+
+static DP_ThreadSlots trace_buffers = DP_THREAD_SLOTS_INIT(
+    DP_TraceBuffer, BUFFER_REUSE_THRESHOLD, reset_buffer);
+
+static DP_TraceBuffer *get_buffer(void)
+{
+    return (DP_TraceBuffer *)DP_thread_slot_get(&trace_buffers);
+}
+
+
+static unsigned long long now_ns(void)
+{
+    Uint64 counter = SDL_GetPerformanceCounter();
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    return (unsigned long long)(counter / frequency * 1000000000u
+                                + counter % frequency * 1000000000u
+                                      / frequency);
+}
+
+static void record(const char *name, bool begin)
+{
+    DP_TraceBuffer *buffer = get_buffer();
+    int head = SDL_AtomicGet(&buffer->head);
+    buffer->events[head % BUFFER_CAPACITY] =
+        (DP_TraceEvent){name, now_ns(), begin};
+    SDL_AtomicSet(&buffer->head,
+                  head + 1 < HEAD_WRAP ? head + 1 : BUFFER_CAPACITY);
+}
+
+void DP_trace_thread_name(const char *name)
+{
+    DP_ASSERT(name);
+    SDL_AtomicSetPtr(&get_buffer()->name, (void *)name);
+}
+
+void DP_trace_begin(const char *name)
+{
+    DP_ASSERT(name);
+    record(name, true);
+}
+
+void DP_trace_end(void)
+{
+    record(NULL, false);
+}
+
+
+typedef struct DP_TraceSnapshot {
+    int thread_id;
+    const char *name;
+    int start, count;
+    DP_TraceEvent events[BUFFER_CAPACITY];
+} DP_TraceSnapshot;
+
+// Copies the buffer's events without stopping the thread writing to it. Any
+// events that got overwritten during the copy are thrown away afterwards,
+// along with the one that may have been half-written when copying finished.
+static bool snapshot_buffer(DP_TraceBuffer *buffer, DP_TraceSnapshot *ts)
+{
+    int generation = SDL_AtomicGet(&buffer->slot.sequence);
+    if (generation % 2 != 0) {
+        return false;
+    }
+
+    ts->thread_id = buffer->thread_id;
+    ts->name = SDL_AtomicGetPtr(&buffer->name);
+    int head = SDL_AtomicGet(&buffer->head);
+    memcpy(ts->events, buffer->events, sizeof(ts->events));
+    int head_after = SDL_AtomicGet(&buffer->head);
+    if (SDL_AtomicGet(&buffer->slot.sequence) != generation) {
+        return false;
+    }
+
+    int written = head_after - head;
+    if (written < 0) {
+        written += HEAD_WRAP - BUFFER_CAPACITY;
+    }
+    int count = DP_min_int(head, BUFFER_CAPACITY);
+    if (written != 0) {
+        count = DP_max_int(0, DP_min_int(count, BUFFER_CAPACITY - written - 1));
+    }
+    ts->start = head - count;
+    ts->count = count;
+    return true;
+}
+
+static bool print_string(DP_Output *output, const char *s)
+{
+    bool ok = DP_output_print(output, "\"");
+    for (const char *c = s; ok && *c; ++c) {
+        if (*c == '"' || *c == '\\') {
+            ok = DP_output_format(output, "\\%c", *c);
+        }
+        else if ((unsigned char)*c < 0x20) {
+            ok = DP_output_format(output, "\\u%04x",
+                                  (unsigned int)(unsigned char)*c);
+        }
+        else {
+            ok = DP_output_write(output, c, 1);
+        }
+    }
+    return ok && DP_output_print(output, "\"");
+}
+
+static bool print_snapshot(DP_Output *output, DP_TraceSnapshot *ts,
+                           bool *first)
+{
+    if (ts->name) {
+        if (!DP_output_format(output,
+                              "%s\n{\"name\":\"thread_name\",\"ph\":\"M\","
+                              "\"pid\":1,\"tid\":%d,\"args\":{\"name\":",
+                              *first ? "" : ",", ts->thread_id)
+            || !print_string(output, ts->name)
+            || !DP_output_print(output, "}}")) {
+            return false;
+        }
+        *first = false;
+    }
+
+    for (int i = 0; i < ts->count; ++i) {
+        DP_TraceEvent *event = &ts->events[(ts->start + i) % BUFFER_CAPACITY];
+        bool ok = DP_output_format(output, "%s\n{", *first ? "" : ",");
+        if (event->begin) {
+            ok = ok && DP_output_print(output, "\"name\":")
+              && print_string(output, event->name)
+              && DP_output_print(output, ",");
+        }
+        ok = ok
+          && DP_output_format(output,
+                              "\"ph\":\"%c\",\"pid\":1,\"tid\":%d,"
+                              "\"ts\":%llu.%03llu}",
+                              event->begin ? 'B' : 'E', ts->thread_id,
+                              event->ns / 1000u, event->ns % 1000u);
+        if (!ok) {
+            return false;
+        }
+        *first = false;
+    }
+
+    return true;
+}
+
+bool DP_trace_available(void)
+{
+    return true;
+}
+
+bool DP_trace_dump(DP_Output *output)
+{
+    DP_ASSERT(output);
+    if (!DP_output_print(output,
+                         "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[")) {
+        return false;
+    }
+
+    DP_TraceSnapshot *ts = DP_malloc(sizeof(*ts));
+    bool first = true;
+    for (DP_ThreadSlot *slot = DP_thread_slots_first(&trace_buffers); slot;
+         slot = slot->next) {
+        if (snapshot_buffer((DP_TraceBuffer *)slot, ts)
+            && !print_snapshot(output, ts, &first)) {
+            DP_free(ts);
+            return false;
+        }
+    }
+    DP_free(ts);
+
+    return DP_output_print(output, "\n]}\n") && DP_output_flush(output);
+}
+
+#else
+
+bool DP_trace_available(void)
+{
+    return false;
+}
+
+bool DP_trace_dump(DP_UNUSED DP_Output *output)
+{
+    DP_error_set("Tracing not available, build with USE_TRACING to enable it");
+    return false;
+}
+
+#endif
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2022 askmeaboutloom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef DPCOMMON_TRACE_H
+#define DPCOMMON_TRACE_H
+#include "common.h"
+
+typedef struct DP_Output DP_Output;
+
+
+// Timeline tracing, viewable in Chrome's about:tracing or Perfetto. Only built
+// when configured with USE_TRACING, otherwise the macros below expand to
+// nothing and don't evaluate their arguments.
+//
+// Every thread records begin and end events into its own ring buffer, so
+// recording doesn't take any locks. When a buffer is full, the oldest events
+// get overwritten, so a dump shows what happened most recently. Names must
+// live forever, string literals or message type names are fine.
+
+#ifdef DP_TRACING
+void DP_trace_thread_name(const char *name);
+
+void DP_trace_begin(const char *name);
+
+void DP_trace_end(void);
+
+#    define DP_TRACE_THREAD_NAME(NAME) DP_trace_thread_name(NAME)
+#    define DP_TRACE_BEGIN(NAME)       DP_trace_begin(NAME)
+#    define DP_TRACE_END()             DP_trace_end()
+#else
+#    define DP_TRACE_THREAD_NAME(NAME) ((void)0)
+#    define DP_TRACE_BEGIN(NAME)       ((void)0)
+#    define DP_TRACE_END()             ((void)0)
+#endif
+
+
+// Whether tracing got built in, the functions below work either way.
+bool DP_trace_available(void);
+
+// Writes all events currently in the buffers as trace event JSON. Threads may
+// keep recording while this is going on. Fails if tracing isn't built.
+bool DP_trace_dump(DP_Output *output);
+
+
+#endif
@@ -21,86 +21,59 @@
  */
 #include "worker.h"
 #include "common.h"
-#include "queue.h"
+#include "conversions.h"
+#include "ring_queue.h"
 #include "threading.h"
+#include "trace.h"
 
 
-#define ELEMENT_SIZE sizeof(DP_WorkerJob)
-
 typedef struct DP_WorkerJob {
     DP_WorkerFn fn;
     void *user;
 } DP_WorkerJob;
 
 typedef struct DP_Worker {
-    DP_Semaphore *sem;
-    DP_Queue queue;
-    DP_Mutex *queue_mutex;
-    DP_Thread *thread;
+    DP_RingQueue *queue;
+    int thread_count;
+    DP_Thread *threads[];
 } DP_Worker;
 
 
-static DP_WorkerFn shift_worker_job(DP_Mutex *queue_mutex, DP_Queue *queue,
-                                    void **out_user)
-{
-    DP_MUTEX_MUST_LOCK(queue_mutex);
-    DP_WorkerJob *job = DP_queue_peek(queue, ELEMENT_SIZE);
-    DP_WorkerFn fn;
-    if (job) {
-        fn = job->fn;
-        *out_user = job->user;
-        DP_queue_shift(queue);
-    }
-    else {
-        fn = NULL;
-    }
-    DP_MUTEX_MUST_UNLOCK(queue_mutex);
-    return fn;
-}
-
 static void run_worker_thread(void *data)
 {
     DP_Worker *worker = data;
-    DP_Semaphore *sem = worker->sem;
-    DP_Mutex *queue_mutex = worker->queue_mutex;
-    DP_Queue *queue = &worker->queue;
-    while (true) {
-        DP_SEMAPHORE_MUST_WAIT(sem);
-        void *user;
-        DP_WorkerFn fn = shift_worker_job(queue_mutex, queue, &user);
-        if (fn) {
-            fn(user);
-        }
-        else {
-            break;
-        }
+    DP_RingQueue *queue = worker->queue;
+    DP_WorkerJob job;
+    DP_TRACE_THREAD_NAME("worker");
+    // A job without a function is the signal to exit.
+    while (DP_ring_queue_shift(queue, &job) && job.fn) {
+        DP_TRACE_BEGIN("worker_job");
+        job.fn(job.user);
+        DP_TRACE_END();
     }
 }
 
-DP_Worker *DP_worker_new(size_t initial_capacity)
+DP_Worker *DP_worker_new(size_t capacity, int thread_count)
 {
-    DP_ASSERT(initial_capacity > 0);
-    DP_Worker *worker = DP_malloc(sizeof(*worker));
-    *worker = (DP_Worker){NULL, DP_QUEUE_NULL, NULL, NULL};
-
-    worker->sem = DP_semaphore_new(0);
-    if (!worker->sem) {
-        DP_worker_free(worker);
-        return NULL;
-    }
-
-    DP_queue_init(&worker->queue, initial_capacity, ELEMENT_SIZE);
+    DP_ASSERT(capacity > 0);
+    DP_ASSERT(thread_count > 0);
+    DP_Worker *worker = DP_malloc(DP_FLEX_SIZEOF(
+        DP_Worker, threads, DP_int_to_size(thread_count)));
+    worker->thread_count = 0;
 
-    worker->queue_mutex = DP_mutex_new();
-    if (!worker->queue_mutex) {
+    worker->queue = DP_ring_queue_new(capacity, sizeof(DP_WorkerJob));
+    if (!worker->queue) {
         DP_worker_free(worker);
         return NULL;
     }
 
-    worker->thread = DP_thread_new(run_worker_thread, worker);
-    if (!worker->thread) {
-        DP_worker_free(worker);
-        return NULL;
+    for (int i = 0; i < thread_count; ++i) {
+        DP_Thread *thread = DP_thread_new(run_worker_thread, worker);
+        if (!thread) {
+            DP_worker_free(worker);
+            return NULL;
+        }
+        worker->threads[worker->thread_count++] = thread;
     }
 
     return worker;
@@ -109,26 +82,29 @@ DP_Worker *DP_worker_new(size_t initial_capacity)
 void DP_worker_free(DP_Worker *worker)
 {
     if (worker) {
-        DP_Semaphore *sem = worker->sem;
-        if (sem) {
-            DP_SEMAPHORE_MUST_POST(sem);
+        // Jobs run in order, so every thread finishes the work that's
+        // already queued up before it gets to its exit signal.
+        int thread_count = worker->thread_count;
+        for (int i = 0; i < thread_count; ++i) {
+            DP_ring_queue_push(worker->queue, &(DP_WorkerJob){NULL, NULL});
         }
-        DP_thread_free_join(worker->thread);
-        DP_mutex_free(worker->queue_mutex);
-        DP_queue_dispose(&worker->queue);
-        DP_semaphore_free(sem);
+        for (int i = 0; i < thread_count; ++i) {
+            DP_thread_free_join(worker->threads[i]);
+        }
+        DP_ring_queue_free(worker->queue);
         DP_free(worker);
     }
 }
 
+int DP_worker_thread_count(DP_Worker *worker)
+{
+    DP_ASSERT(worker);
+    return worker->thread_count;
+}
+
 void DP_worker_push(DP_Worker *worker, DP_WorkerFn fn, void *user)
 {
     DP_ASSERT(worker);
     DP_ASSERT(fn);
-    DP_Mutex *queue_mutex = worker->queue_mutex;
-    DP_MUTEX_MUST_LOCK(queue_mutex);
-    DP_WorkerJob *job = DP_queue_push(&worker->queue, ELEMENT_SIZE);
-    *job = (DP_WorkerJob){fn, user};
-    DP_MUTEX_MUST_UNLOCK(queue_mutex);
-    DP_SEMAPHORE_MUST_POST(worker->sem);
+    DP_ring_queue_push(worker->queue, &(DP_WorkerJob){fn, user});
 }
@@ -28,10 +28,13 @@ typedef struct DP_Worker DP_Worker;
 
 typedef void (*DP_WorkerFn)(void *user);
 
-DP_Worker *DP_worker_new(size_t initial_capacity);
+// Pushing more than capacity jobs blocks until the worker catches up.
+DP_Worker *DP_worker_new(size_t capacity, int thread_count);
 
 void DP_worker_free(DP_Worker *worker);
 
+int DP_worker_thread_count(DP_Worker *worker);
+
 void DP_worker_push(DP_Worker *worker, DP_WorkerFn fn, void *user);
 
 
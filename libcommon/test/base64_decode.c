@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2022 askmeaboutloom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <dpcommon/base64.h>
+#include <dpcommon/common.h>
+#include <dpcommon_test.h>
+
+
+static void check_decode(void **state, const char *in, const void *expected,
+                         size_t expected_length)
+{
+    size_t in_length = strlen(in);
+    size_t actual_length = DP_base64_decode_length(in, in_length);
+    assert_int_equal(actual_length, expected_length);
+    unsigned char *decoded = DP_malloc(actual_length + 1);
+    destructor_push(state, decoded, DP_free);
+    assert_true(DP_base64_decode(in, in_length, decoded, actual_length));
+    assert_memory_equal(decoded, expected, expected_length);
+}
+
+static void decode_zero(void **state)
+{
+    check_decode(state, "", "", 0);
+}
+
+static void decode_one(void **state)
+{
+    check_decode(state, "YQ==", "a", 1);
+}
+
+static void decode_two(void **state)
+{
+    check_decode(state, "YmM=", "bc", 2);
+}
+
+static void decode_three(void **state)
+{
+    check_decode(state, "ZGVm", "def", 3);
+}
+
+static void decode_unpadded(void **state)
+{
+    check_decode(state, "YmM", "bc", 2);
+}
+
+static void decode_data(void **state)
+{
+    static const unsigned char data[] = {
+        129, 244, 184, 213, 83,  88,  89,  102, 14,  54,  141, 210, 189,
+        245, 215, 235, 72,  233, 15,  213, 73,  79,  233, 53,  31,  186,
+        89,  215, 5,   194, 82,  57,  23,  210, 117, 0,   57,  105, 198,
+        90,  34,  71,  51,  162, 77,  127, 118, 243, 63,  146, 222, 30,
+        146, 19,  3,   221, 158, 210, 107, 99,  63,  118, 169, 154, 11,
+        189, 203, 160, 100, 195, 124, 147, 133, 105, 147, 46,  135, 107,
+        89,  96,  241, 179, 239, 128, 155, 168, 227, 223, 153, 122, 180,
+        234, 37,  215, 157, 173, 68,  150, 29,  51,
+    };
+    check_decode(state,
+                 "gfS41VNYWWYONo3SvfXX60jpD9VJT+"
+                 "k1H7pZ1wXCUjkX0nUAOWnGWiJHM6JNf3bzP5LeHpITA92e0mtjP3apmgu9y6B"
+                 "kw3yThWmTLodrWWDxs++Am6jj35l6tOol152tRJYdMw==",
+                 data, sizeof(data));
+}
+
+static void decode_invalid(DP_UNUSED void **state)
+{
+    unsigned char buffer[3];
+    assert_false(DP_base64_decode("ab$d", 4, buffer, sizeof(buffer)));
+    assert_false(DP_base64_decode("abcde", 5, buffer, sizeof(buffer)));
+    assert_false(DP_base64_decode("abcdef", 6, buffer, 2));
+}
+
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        dp_unit_test(decode_zero),      dp_unit_test(decode_one),
+        dp_unit_test(decode_two),       dp_unit_test(decode_three),
+        dp_unit_test(decode_unpadded),  dp_unit_test(decode_data),
+        dp_unit_test(decode_invalid),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -21,6 +21,8 @@
  */
 #include "dpcommon_test.h"
 #include "dpcommon/queue.h"
+#include "dpcommon/ring_queue.h"
+#include "dpcommon/worker.h"
 #include <dpcommon/common.h>
 #include <dpcommon/input.h>
 #include <dpcommon/output.h>
@@ -156,6 +158,26 @@ void push_queue(void **state, DP_Queue *value)
     destructor_push(state, value, destroy_queue);
 }
 
+static void destroy_ring_queue(void *value)
+{
+    DP_ring_queue_free(value);
+}
+
+void push_ring_queue(void **state, DP_RingQueue *value)
+{
+    destructor_push(state, value, destroy_ring_queue);
+}
+
+static void destroy_worker(void *value)
+{
+    DP_worker_free(value);
+}
+
+void push_worker(void **state, DP_Worker *value)
+{
+    destructor_push(state, value, destroy_worker);
+}
+
 
 void _assert_files_equal(const char *a, const char *b, const char *file,
                          int line)
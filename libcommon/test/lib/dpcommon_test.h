@@ -31,6 +31,8 @@
 typedef struct DP_Input DP_Input;
 typedef struct DP_Output DP_Output;
 typedef struct DP_Queue DP_Queue;
+typedef struct DP_RingQueue DP_RingQueue;
+typedef struct DP_Worker DP_Worker;
 
 
 #define dp_unit_test_prestate(TEST, STATE) \
@@ -63,6 +65,10 @@ void push_output(void **state, DP_Output *value);
 
 void push_queue(void **state, DP_Queue *value);
 
+void push_ring_queue(void **state, DP_RingQueue *value);
+
+void push_worker(void **state, DP_Worker *value);
+
 
 #define assert_files_equal(a, b) _assert_files_equal(a, b, __FILE__, __LINE__)
 
@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2022 askmeaboutloom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <dpcommon/common.h>
+#include <dpcommon/memory_stats.h>
+#include <dpcommon/threading.h>
+#include <dpcommon_test.h>
+
+#define THREADS         4
+#define ADDS_PER_THREAD 1000
+
+
+static void memory_counts(DP_UNUSED void **state)
+{
+    DP_MemoryStats before, after;
+    DP_memory_stats(&before);
+
+    DP_memory_add(DP_MEMORY_TILES_UNIQUE, 1000);
+    DP_memory_add(DP_MEMORY_MESSAGES, 50);
+    DP_memory_move(DP_MEMORY_TILES_UNIQUE, DP_MEMORY_TILES_SHARED, 400);
+    DP_memory_sub(DP_MEMORY_MESSAGES, 20);
+    DP_memory_stats(&after);
+
+    assert_int_equal(after.bytes[DP_MEMORY_TILES_UNIQUE]
+                         - before.bytes[DP_MEMORY_TILES_UNIQUE],
+                     600);
+    assert_int_equal(after.bytes[DP_MEMORY_TILES_SHARED]
+                         - before.bytes[DP_MEMORY_TILES_SHARED],
+                     400);
+    assert_int_equal(after.bytes[DP_MEMORY_MESSAGES]
+                         - before.bytes[DP_MEMORY_MESSAGES],
+                     30);
+    assert_int_equal(after.total - before.total, 1030);
+    assert_int_equal(DP_memory_total(), after.total);
+
+    DP_memory_sub(DP_MEMORY_TILES_UNIQUE, 600);
+    DP_memory_sub(DP_MEMORY_TILES_SHARED, 400);
+    DP_memory_sub(DP_MEMORY_MESSAGES, 30);
+    assert_int_equal(DP_memory_total(), before.total);
+
+    for (int i = 0; i < DP_MEMORY_CATEGORY_COUNT; ++i) {
+        assert_non_null(DP_memory_category_name((DP_MemoryCategory)i));
+    }
+}
+
+
+static void run_adder(DP_UNUSED void *data)
+{
+    for (int i = 0; i < ADDS_PER_THREAD; ++i) {
+        DP_memory_add(DP_MEMORY_HISTORY, 8);
+    }
+}
+
+static void memory_across_threads(DP_UNUSED void **state)
+{
+    size_t before = DP_memory_total();
+    DP_Thread *threads[THREADS];
+    for (int i = 0; i < THREADS; ++i) {
+        threads[i] = DP_thread_new(run_adder, NULL);
+        assert_non_null(threads[i]);
+    }
+    for (int i = 0; i < THREADS; ++i) {
+        DP_thread_free_join(threads[i]);
+    }
+
+    // Slots of exited threads keep their counts.
+    size_t added = (size_t)THREADS * ADDS_PER_THREAD * 8;
+    assert_int_equal(DP_memory_total() - before, added);
+
+    // Freeing on a different thread than allocating still sums up.
+    DP_memory_sub(DP_MEMORY_HISTORY, added);
+    assert_int_equal(DP_memory_total(), before);
+}
+
+
+static void memory_budget(DP_UNUSED void **state)
+{
+    assert_int_equal(DP_memory_budget(), 0);
+    DP_memory_budget_set(1024);
+    assert_int_equal(DP_memory_budget(), 1024);
+    DP_MemoryStats stats;
+    DP_memory_stats(&stats);
+    assert_int_equal(stats.budget, 1024);
+    DP_memory_budget_set(0);
+    assert_int_equal(DP_memory_budget(), 0);
+}
+
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        dp_unit_test(memory_counts),
+        dp_unit_test(memory_across_threads),
+        dp_unit_test(memory_budget),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2022 askmeaboutloom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <dpcommon/common.h>
+#include <dpcommon/output.h>
+#include <dpcommon/ring_queue.h>
+#include <dpcommon/threading.h>
+#include <dpcommon_test.h>
+
+#define PRODUCERS          4
+#define CONSUMERS          3
+#define VALUES_PER_THREAD  100000
+#define THREADED_CAPACITY  64
+
+
+static void try_push(DP_Output *output, DP_RingQueue *rq, int value)
+{
+    bool ok = DP_ring_queue_try_push(rq, &value);
+    DP_output_format(output, "try_push(%d) = %s\n", value,
+                     ok ? "true" : "false");
+}
+
+static void try_shift(DP_Output *output, DP_RingQueue *rq)
+{
+    int value;
+    if (DP_ring_queue_try_shift(rq, &value)) {
+        DP_output_format(output, "try_shift() = %d\n", value);
+    }
+    else {
+        DP_output_print(output, "try_shift() = false\n");
+    }
+}
+
+static void ring_queue_single_thread(void **state)
+{
+    DP_Output *output =
+        DP_file_output_new_from_path("test/tmp/ring_queue_single_thread");
+    push_output(state, output);
+
+    DP_RingQueue *rq = DP_ring_queue_new(3, sizeof(int));
+    assert_non_null(rq);
+    push_ring_queue(state, rq);
+    DP_output_format(output, "capacity = %zu\n", DP_ring_queue_capacity(rq));
+
+    try_shift(output, rq);
+    for (int i = 1; i <= 5; ++i) {
+        try_push(output, rq, i);
+    }
+    try_shift(output, rq);
+    try_shift(output, rq);
+    // Go around the ring a few times.
+    for (int i = 6; i <= 14; ++i) {
+        try_push(output, rq, i);
+        try_shift(output, rq);
+    }
+    for (int i = 0; i < 4; ++i) {
+        try_shift(output, rq);
+    }
+
+    try_push(output, rq, 15);
+    DP_ring_queue_close(rq);
+    DP_output_format(output, "closed = %s\n",
+                     DP_ring_queue_closed(rq) ? "true" : "false");
+    int value = 16;
+    DP_output_format(output, "push(16) = %s\n",
+                     DP_ring_queue_push(rq, &value) ? "true" : "false");
+    DP_output_format(output, "shift() = %s\n",
+                     DP_ring_queue_shift(rq, &value) ? "true" : "false");
+    try_shift(output, rq);
+
+    destructor_run(state, output);
+    assert_files_equal("test/tmp/ring_queue_single_thread",
+                       "test/data/ring_queue_single_thread");
+}
+
+
+typedef struct ThreadedParams {
+    DP_RingQueue *rq;
+    int index;
+    long long sum;
+    int count;
+} ThreadedParams;
+
+static void run_producer(void *data)
+{
+    ThreadedParams *params = data;
+    for (int i = 0; i < VALUES_PER_THREAD; ++i) {
+        int value = params->index * VALUES_PER_THREAD + i + 1;
+        DP_ring_queue_push(params->rq, &value);
+    }
+}
+
+static void run_consumer(void *data)
+{
+    ThreadedParams *params = data;
+    int value;
+    // Zero is the signal to stop.
+    while (DP_ring_queue_shift(params->rq, &value) && value != 0) {
+        params->sum += value;
+        ++params->count;
+    }
+}
+
+static void ring_queue_multiple_threads(void **state)
+{
+    DP_RingQueue *rq = DP_ring_queue_new(THREADED_CAPACITY, sizeof(int));
+    assert_non_null(rq);
+    push_ring_queue(state, rq);
+
+    ThreadedParams producer_params[PRODUCERS];
+    ThreadedParams consumer_params[CONSUMERS];
+    DP_Thread *producers[PRODUCERS];
+    DP_Thread *consumers[CONSUMERS];
+    for (int i = 0; i < CONSUMERS; ++i) {
+        consumer_params[i] = (ThreadedParams){rq, i, 0, 0};
+        consumers[i] = DP_thread_new(run_consumer, &consumer_params[i]);
+        assert_non_null(consumers[i]);
+    }
+    for (int i = 0; i < PRODUCERS; ++i) {
+        producer_params[i] = (ThreadedParams){rq, i, 0, 0};
+        producers[i] = DP_thread_new(run_producer, &producer_params[i]);
+        assert_non_null(producers[i]);
+    }
+
+    for (int i = 0; i < PRODUCERS; ++i) {
+        DP_thread_free_join(producers[i]);
+    }
+    for (int i = 0; i < CONSUMERS; ++i) {
+        int zero = 0;
+        assert_true(DP_ring_queue_push(rq, &zero));
+    }
+    for (int i = 0; i < CONSUMERS; ++i) {
+        DP_thread_free_join(consumers[i]);
+    }
+
+    long long sum = 0;
+    int count = 0;
+    for (int i = 0; i < CONSUMERS; ++i) {
+        sum += consumer_params[i].sum;
+        count += consumer_params[i].count;
+    }
+    long long n = (long long)PRODUCERS * VALUES_PER_THREAD;
+    assert_int_equal(count, n);
+    assert_true(sum == n * (n + 1) / 2);
+}
+
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        dp_unit_test(ring_queue_single_thread),
+        dp_unit_test(ring_queue_multiple_threads),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
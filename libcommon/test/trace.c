@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2022 askmeaboutloom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <dpcommon/common.h>
+#include <dpcommon/output.h>
+#include <dpcommon/threading.h>
+#include <dpcommon/trace.h>
+#include <dpcommon_test.h>
+
+#define SPAM_SPANS 20000
+
+
+static char *dump_trace(void **state)
+{
+    void **buffer;
+    size_t *size;
+    DP_Output *output = DP_mem_output_new(0, true, &buffer, &size);
+    push_output(state, output);
+    bool ok = DP_trace_dump(output);
+    char *json = push_format(state, "%.*s", (int)*size, (char *)*buffer);
+    destructor_run(state, output);
+    return ok ? json : NULL;
+}
+
+static int count_occurrences(const char *haystack, const char *needle)
+{
+    int count = 0;
+    for (const char *s = strstr(haystack, needle); s;
+         s = strstr(s + 1, needle)) {
+        ++count;
+    }
+    return count;
+}
+
+#ifdef DP_TRACING
+
+static void run_traced_thread(DP_UNUSED void *data)
+{
+    DP_TRACE_THREAD_NAME("traced \"thread\"");
+    DP_TRACE_BEGIN("thread_span");
+    DP_TRACE_END();
+}
+
+static void run_spam_thread(DP_UNUSED void *data)
+{
+    DP_TRACE_THREAD_NAME("spam");
+    for (int i = 0; i < SPAM_SPANS; ++i) {
+        DP_TRACE_BEGIN("spam_span");
+        DP_TRACE_END();
+    }
+}
+
+static void trace_dump(void **state)
+{
+    assert_true(DP_trace_available());
+    DP_TRACE_THREAD_NAME("main");
+    DP_TRACE_BEGIN("outer_span");
+    DP_TRACE_BEGIN("inner_span");
+    DP_TRACE_END();
+    DP_TRACE_END();
+
+    DP_Thread *threads[] = {
+        DP_thread_new(run_traced_thread, NULL),
+        DP_thread_new(run_spam_thread, NULL),
+    };
+    for (size_t i = 0; i < DP_ARRAY_LENGTH(threads); ++i) {
+        assert_non_null(threads[i]);
+        DP_thread_free_join(threads[i]);
+    }
+
+    char *json = dump_trace(state);
+    assert_non_null(json);
+    assert_true(strncmp(json, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[",
+                        39)
+                == 0);
+    assert_int_equal(count_occurrences(json, "\"thread_name\""), 3);
+    assert_non_null(strstr(json, "{\"name\":\"main\"}"));
+    assert_non_null(strstr(json, "{\"name\":\"traced \\\"thread\\\"\"}"));
+    assert_int_equal(count_occurrences(json, "\"outer_span\""), 1);
+    assert_int_equal(count_occurrences(json, "\"inner_span\""), 1);
+    assert_int_equal(count_occurrences(json, "\"thread_span\""), 1);
+    // The spam thread overflowed its buffer, so only the most recent events
+    // are left, those all come in pairs. The oldest may be a lone end event.
+    int spam = count_occurrences(json, "\"spam_span\"");
+    assert_true(spam > 0);
+    assert_true(spam < SPAM_SPANS);
+    int begins = count_occurrences(json, "\"ph\":\"B\"");
+    int ends = count_occurrences(json, "\"ph\":\"E\"");
+    assert_int_equal(begins, spam + 3);
+    assert_true(ends == begins || ends == begins + 1);
+}
+
+#else
+
+static void trace_dump(void **state)
+{
+    assert_false(DP_trace_available());
+    // Compiled out, so the argument isn't even evaluated.
+    DP_TRACE_BEGIN(NULL);
+    DP_TRACE_END();
+    assert_null(dump_trace(state));
+    assert_int_equal(count_occurrences(DP_error(), "USE_TRACING"), 1);
+}
+
+#endif
+
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        dp_unit_test(trace_dump),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,565 @@
+/*
+ * Copyright (c) 2022 askmeaboutloom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <dpcommon/binary.h>
+#include <dpcommon/common.h>
+#include <dpcommon/conversions.h>
+#include <dpcommon/input.h>
+#include <dpengine/blend_mode.h>
+#include <dpengine/canvas_history.h>
+#include <dpengine/canvas_state.h>
+#include <dpengine/compress.h>
+#include <dpengine/draw_context.h>
+#include <dpengine/image.h>
+#include <dpengine/paint.h>
+#include <dpengine/pixels.h>
+#include <dpengine/tile.h>
+#include <dpmsg/binary_reader.h>
+#include <dpmsg/message.h>
+#include <SDL_timer.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+#include <zlib.h>
+
+// Micro benchmarks for the innermost loops of the engine and macro benchmarks
+// that replay and flatten every recording in test/data/recordings. Results
+// are written to stdout as JSON, with the time per operation in nanoseconds
+// as percentiles over the samples taken, so that they can be compared across
+// commits. Run it from the project directory, optionally giving substrings of
+// benchmark names to run only those, like `dpbench composite replay/persp`.
+
+#define SAMPLE_COUNT        20
+#define MIN_SAMPLE_NS       1000000.0
+#define MAX_BATCH           (1 << 20)
+#define MAX_MESSAGE_SAMPLES 64
+#define RECORDINGS_DIR      "test/data/recordings"
+
+#define TILE_PIXELS (DP_TILE_SIZE * DP_TILE_SIZE)
+
+
+typedef struct DP_Bench {
+    int filter_count;
+    char **filters;
+    bool first;
+} DP_Bench;
+
+typedef void (*DP_BenchFn)(void *user, int batch);
+
+static bool bench_wanted(DP_Bench *b, const char *name)
+{
+    if (b->filter_count == 0) {
+        return true;
+    }
+    for (int i = 0; i < b->filter_count; ++i) {
+        if (strstr(name, b->filters[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static double time_batch(DP_BenchFn fn, void *user, int batch)
+{
+    Uint64 start = SDL_GetPerformanceCounter();
+    fn(user, batch);
+    Uint64 end = SDL_GetPerformanceCounter();
+    return (double)(end - start) * 1e9 / (double)SDL_GetPerformanceFrequency();
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+static double percentile(double *sorted, int count, int p)
+{
+    int index = (count - 1) * p / 100;
+    return sorted[index];
+}
+
+static void bench_run(DP_Bench *b, const char *name, DP_BenchFn fn,
+                      void *user)
+{
+    if (!bench_wanted(b, name)) {
+        return;
+    }
+
+    // Warm up lazily initialized state, then grow the batch until a sample
+    // takes long enough to not just measure the timer's resolution.
+    fn(user, 1);
+    int batch = 1;
+    double ns = time_batch(fn, user, batch);
+    while (ns < MIN_SAMPLE_NS && batch < MAX_BATCH) {
+        batch *= 2;
+        ns = time_batch(fn, user, batch);
+    }
+
+    double samples[SAMPLE_COUNT];
+    double total = 0.0;
+    for (int i = 0; i < SAMPLE_COUNT; ++i) {
+        samples[i] = time_batch(fn, user, batch) / (double)batch;
+        total += samples[i];
+    }
+    qsort(samples, SAMPLE_COUNT, sizeof(*samples), compare_doubles);
+
+    printf("%s\n    {\"name\": \"%s\", \"batch\": %d, \"samples\": %d, "
+           "\"min\": %.1f, \"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, "
+           "\"max\": %.1f, \"mean\": %.1f}",
+           b->first ? "" : ",", name, batch, SAMPLE_COUNT, samples[0],
+           percentile(samples, SAMPLE_COUNT, 50),
+           percentile(samples, SAMPLE_COUNT, 90),
+           percentile(samples, SAMPLE_COUNT, 99), samples[SAMPLE_COUNT - 1],
+           total / SAMPLE_COUNT);
+    fflush(stdout);
+    b->first = false;
+}
+
+
+static uint32_t next_random(uint32_t *state)
+{
+    // Fixed seed LCG, so that every run composites the same pixels.
+    *state = *state * 1664525u + 1013904223u;
+    return *state >> 8;
+}
+
+static void fill_random_pixels(DP_Pixel *pixels, int count, uint32_t seed)
+{
+    uint32_t state = seed;
+    for (int i = 0; i < count; ++i) {
+        DP_Pixel p;
+        p.color = next_random(&state) | ((next_random(&state) & 0xffu) << 24);
+        pixels[i] = DP_pixel_premultiply(p);
+    }
+}
+
+
+typedef struct DP_CompositeBench {
+    int blend_mode;
+    DP_Pixel *dst;
+    DP_Pixel *src;
+    DP_Pixel color;
+    uint8_t *mask;
+} DP_CompositeBench;
+
+static void run_composite(void *user, int batch)
+{
+    DP_CompositeBench *cb = user;
+    for (int i = 0; i < batch; ++i) {
+        DP_pixels_composite(cb->dst, cb->src, TILE_PIXELS, 200, cb->blend_mode);
+    }
+}
+
+static void run_composite_mask(void *user, int batch)
+{
+    DP_CompositeBench *cb = user;
+    for (int i = 0; i < batch; ++i) {
+        DP_pixels_composite_mask(cb->dst, cb->color, cb->blend_mode, cb->mask,
+                                 DP_TILE_SIZE, DP_TILE_SIZE, 0, 0);
+    }
+}
+
+static void bench_composite(DP_Bench *b)
+{
+    DP_Pixel *dst = DP_malloc(sizeof(*dst) * TILE_PIXELS);
+    DP_Pixel *src = DP_malloc(sizeof(*src) * TILE_PIXELS);
+    uint8_t *mask = DP_malloc(TILE_PIXELS);
+    fill_random_pixels(dst, TILE_PIXELS, 1);
+    fill_random_pixels(src, TILE_PIXELS, 2);
+    uint32_t state = 3;
+    for (int i = 0; i < TILE_PIXELS; ++i) {
+        mask[i] = (uint8_t)next_random(&state);
+    }
+
+    char name[256];
+    for (int blend_mode = 0; blend_mode < DP_BLEND_MODE_COUNT; ++blend_mode) {
+        DP_CompositeBench cb = {blend_mode, dst, src, {0xcc336699}, mask};
+        const char *mode_name = DP_blend_mode_enum_name_unprefixed(blend_mode);
+        if (DP_blend_mode_valid_for_layer(blend_mode)) {
+            snprintf(name, sizeof(name), "composite/%s", mode_name);
+            bench_run(b, name, run_composite, &cb);
+        }
+        if (DP_blend_mode_valid_for_brush(blend_mode)) {
+            snprintf(name, sizeof(name), "composite_mask/%s", mode_name);
+            bench_run(b, name, run_composite_mask, &cb);
+        }
+    }
+
+    DP_free(mask);
+    DP_free(src);
+    DP_free(dst);
+}
+
+
+typedef struct DP_StampBench {
+    DP_DrawContext *dc;
+    int size;
+    bool square;
+} DP_StampBench;
+
+static void run_classic_stamp(void *user, int batch)
+{
+    DP_StampBench *sb = user;
+    int diameter;
+    for (int i = 0; i < batch; ++i) {
+        // Vary the subpixel offset like a stroke would.
+        DP_paint_classic_stamp(sb->dc, i & 3, (i >> 2) & 3, sb->size, 128, 255,
+                               &diameter);
+    }
+}
+
+static void run_pixel_stamp(void *user, int batch)
+{
+    DP_StampBench *sb = user;
+    int diameter;
+    for (int i = 0; i < batch; ++i) {
+        DP_paint_pixel_stamp(sb->dc, sb->square, sb->size, 255, &diameter);
+    }
+}
+
+static void bench_stamps(DP_Bench *b, DP_DrawContext *dc)
+{
+    static const int classic_radii[] = {2, 8, 32, 128};
+    static const int pixel_diameters[] = {4, 16, 64, 255};
+    char name[256];
+    for (int i = 0; i < (int)DP_ARRAY_LENGTH(classic_radii); ++i) {
+        DP_StampBench sb = {dc, classic_radii[i] * 256, false};
+        snprintf(name, sizeof(name), "stamp/classic/r%d", classic_radii[i]);
+        bench_run(b, name, run_classic_stamp, &sb);
+    }
+    for (int i = 0; i < (int)DP_ARRAY_LENGTH(pixel_diameters); ++i) {
+        DP_StampBench round = {dc, pixel_diameters[i], false};
+        snprintf(name, sizeof(name), "stamp/pixel/d%d", pixel_diameters[i]);
+        bench_run(b, name, run_pixel_stamp, &round);
+        DP_StampBench square = {dc, pixel_diameters[i], true};
+        snprintf(name, sizeof(name), "stamp/pixel_square/d%d",
+                 pixel_diameters[i]);
+        bench_run(b, name, run_pixel_stamp, &square);
+    }
+}
+
+
+typedef struct DP_InflateBench {
+    unsigned char *in;
+    size_t in_size;
+    unsigned char *out;
+} DP_InflateBench;
+
+static unsigned char *get_inflate_buffer(size_t size, void *user)
+{
+    DP_InflateBench *ib = user;
+    if (size <= TILE_PIXELS * sizeof(DP_Pixel)) {
+        return ib->out;
+    }
+    else {
+        DP_error_set("Inflated size %zu too large", size);
+        return NULL;
+    }
+}
+
+static void run_inflate(void *user, int batch)
+{
+    DP_InflateBench *ib = user;
+    for (int i = 0; i < batch; ++i) {
+        if (!DP_compress_inflate(ib->in, ib->in_size, get_inflate_buffer,
+                                 ib)) {
+            DP_warn("Inflate: %s", DP_error());
+        }
+    }
+}
+
+static void bench_inflate_tile(DP_Bench *b, const char *name, DP_Pixel *pixels)
+{
+    // Same format as in messages: the inflated size, then the zlib stream.
+    uLong size = (uLong)(TILE_PIXELS * sizeof(*pixels));
+    uLongf in_size = compressBound(size);
+    DP_InflateBench ib = {DP_malloc(in_size + 4), 0, DP_malloc(size)};
+    DP_write_bigendian_uint32((uint32_t)size, ib.in);
+    if (compress(ib.in + 4, &in_size, (const Bytef *)pixels, size) == Z_OK) {
+        ib.in_size = in_size + 4;
+        bench_run(b, name, run_inflate, &ib);
+    }
+    else {
+        DP_warn("Can't compress input for %s", name);
+    }
+    DP_free(ib.out);
+    DP_free(ib.in);
+}
+
+static void bench_inflate(DP_Bench *b)
+{
+    DP_Pixel *pixels = DP_malloc(sizeof(*pixels) * TILE_PIXELS);
+    // Brush strokes compress somewhere between these extremes.
+    fill_random_pixels(pixels, TILE_PIXELS, 4);
+    bench_inflate_tile(b, "inflate/noise", pixels);
+    for (int i = 0; i < TILE_PIXELS; ++i) {
+        pixels[i].color = i < TILE_PIXELS / 2 ? 0xff000000u : 0xffffffffu;
+    }
+    bench_inflate_tile(b, "inflate/flat", pixels);
+    DP_free(pixels);
+}
+
+
+typedef struct DP_Recording {
+    char *name;
+    int count;
+    DP_Message **msgs;
+} DP_Recording;
+
+static int compare_recordings(const void *a, const void *b)
+{
+    return strcmp(((const DP_Recording *)a)->name,
+                  ((const DP_Recording *)b)->name);
+}
+
+static bool load_recording(DP_Recording *r, const char *path)
+{
+    DP_Input *input = DP_file_input_new_from_path(path);
+    if (!input) {
+        return false;
+    }
+    DP_BinaryReader *reader = DP_binary_reader_new(input);
+    if (!reader) {
+        return false;
+    }
+    int capacity = 0;
+    while (DP_binary_reader_has_next(reader)) {
+        DP_Message *msg = DP_binary_reader_read_next(reader);
+        if (!msg) {
+            DP_binary_reader_free(reader);
+            return false;
+        }
+        if (r->count == capacity) {
+            capacity = DP_max_int(64, capacity * 2);
+            size_t size = sizeof(*r->msgs) * DP_int_to_size(capacity);
+            r->msgs = DP_realloc(r->msgs, size);
+        }
+        r->msgs[r->count++] = msg;
+    }
+    DP_binary_reader_free(reader);
+    return true;
+}
+
+static void dispose_recording(DP_Recording *r)
+{
+    for (int i = 0; i < r->count; ++i) {
+        DP_message_decref(r->msgs[i]);
+    }
+    DP_free(r->msgs);
+    DP_free(r->name);
+}
+
+static int load_recordings(DP_Recording **out_recordings)
+{
+    DIR *dir = opendir(RECORDINGS_DIR);
+    if (!dir) {
+        DP_warn("Can't open %s, run this from the project directory",
+                RECORDINGS_DIR);
+        *out_recordings = NULL;
+        return 0;
+    }
+
+    int count = 0;
+    DP_Recording *recordings = NULL;
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        const char *file_name = entry->d_name;
+        size_t length = strlen(file_name);
+        if (length > 6 && strcmp(file_name + length - 6, ".dprec") == 0) {
+            char *path = DP_format(RECORDINGS_DIR "/%s", file_name);
+            DP_Recording r = {DP_format("%.*s", (int)(length - 6), file_name),
+                              0, NULL};
+            if (load_recording(&r, path)) {
+                size_t size = sizeof(*recordings) * DP_int_to_size(count + 1);
+                recordings = DP_realloc(recordings, size);
+                recordings[count++] = r;
+            }
+            else {
+                DP_warn("Can't load %s: %s", path, DP_error());
+                dispose_recording(&r);
+            }
+            DP_free(path);
+        }
+    }
+    closedir(dir);
+
+    qsort(recordings, DP_int_to_size(count), sizeof(*recordings),
+          compare_recordings);
+    *out_recordings = recordings;
+    return count;
+}
+
+
+typedef struct DP_DeserializeBench {
+    int count;
+    unsigned char *buffers[MAX_MESSAGE_SAMPLES];
+    size_t sizes[MAX_MESSAGE_SAMPLES];
+} DP_DeserializeBench;
+
+static unsigned char *get_serialize_buffer(void *user, size_t length)
+{
+    unsigned char **pp = user;
+    *pp = DP_malloc(length);
+    return *pp;
+}
+
+static void run_deserialize(void *user, int batch)
+{
+    DP_DeserializeBench *db = user;
+    for (int i = 0; i < batch; ++i) {
+        int j = i % db->count;
+        DP_Message *msg = DP_message_deserialize(db->buffers[j], db->sizes[j]);
+        if (msg) {
+            DP_message_decref(msg);
+        }
+        else {
+            DP_warn("Deserialize: %s", DP_error());
+        }
+    }
+}
+
+static void bench_deserialize(DP_Bench *b, int recording_count,
+                              DP_Recording *recordings)
+{
+    // Serialize up to a few dozen samples of each message type that shows up
+    // in the recordings, since message sizes vary a lot within a type.
+    DP_DeserializeBench *dbs = DP_malloc(sizeof(*dbs) * DP_MSG_COUNT);
+    for (int i = 0; i < DP_MSG_COUNT; ++i) {
+        dbs[i].count = 0;
+    }
+    for (int i = 0; i < recording_count; ++i) {
+        DP_Recording *r = &recordings[i];
+        for (int j = 0; j < r->count; ++j) {
+            DP_Message *msg = r->msgs[j];
+            DP_DeserializeBench *db = &dbs[DP_message_type(msg)];
+            if (db->count < MAX_MESSAGE_SAMPLES) {
+                unsigned char *buffer;
+                size_t size = DP_message_serialize(msg, true,
+                                                   get_serialize_buffer,
+                                                   &buffer);
+                if (size != 0) {
+                    db->buffers[db->count] = buffer;
+                    db->sizes[db->count] = size;
+                    ++db->count;
+                }
+            }
+        }
+    }
+
+    char name[256];
+    for (int type = 0; type < DP_MSG_COUNT; ++type) {
+        DP_DeserializeBench *db = &dbs[type];
+        if (db->count != 0) {
+            snprintf(name, sizeof(name), "deserialize/%s",
+                     DP_message_type_enum_name_unprefixed(
+                         (DP_MessageType)type));
+            bench_run(b, name, run_deserialize, db);
+            for (int i = 0; i < db->count; ++i) {
+                DP_free(db->buffers[i]);
+            }
+        }
+    }
+    DP_free(dbs);
+}
+
+
+typedef struct DP_ReplayBench {
+    DP_Recording *r;
+    DP_DrawContext *dc;
+    DP_CanvasState *result;
+} DP_ReplayBench;
+
+static DP_CanvasState *replay(DP_Recording *r, DP_DrawContext *dc)
+{
+    DP_CanvasHistory *ch = DP_canvas_history_new();
+    for (int i = 0; i < r->count; ++i) {
+        DP_Message *msg = r->msgs[i];
+        if (DP_message_type_command(DP_message_type(msg))
+            && !DP_canvas_history_handle(ch, dc, msg)) {
+            DP_debug("Replay %s: %s", r->name, DP_error());
+        }
+    }
+    DP_CanvasState *cs = DP_canvas_history_compare_and_get(ch, NULL);
+    DP_canvas_history_free(ch);
+    return cs;
+}
+
+static void run_replay(void *user, int batch)
+{
+    DP_ReplayBench *rb = user;
+    for (int i = 0; i < batch; ++i) {
+        DP_canvas_state_decref(replay(rb->r, rb->dc));
+    }
+}
+
+static void run_flatten(void *user, int batch)
+{
+    DP_ReplayBench *rb = user;
+    for (int i = 0; i < batch; ++i) {
+        DP_Image *img = DP_canvas_state_to_flat_image(
+            rb->result, DP_FLAT_IMAGE_INCLUDE_BACKGROUND);
+        DP_image_free(img);
+    }
+}
+
+static void bench_recordings(DP_Bench *b, DP_DrawContext *dc,
+                             int recording_count, DP_Recording *recordings)
+{
+    char name[256];
+    for (int i = 0; i < recording_count; ++i) {
+        DP_Recording *r = &recordings[i];
+        DP_ReplayBench rb = {r, dc, NULL};
+        snprintf(name, sizeof(name), "replay/%s", r->name);
+        bench_run(b, name, run_replay, &rb);
+        snprintf(name, sizeof(name), "flatten/%s", r->name);
+        if (bench_wanted(b, name)) {
+            rb.result = replay(r, dc);
+            bench_run(b, name, run_flatten, &rb);
+            DP_canvas_state_decref(rb.result);
+        }
+    }
+}
+
+
+int main(int argc, char **argv)
+{
+    DP_Bench b = {argc - 1, argv + 1, true};
+    DP_DrawContext *dc = DP_draw_context_new();
+    DP_Recording *recordings;
+    int recording_count = load_recordings(&recordings);
+
+    printf("{\"unit\": \"ns\", \"benchmarks\": [");
+    bench_composite(&b);
+    bench_stamps(&b, dc);
+    bench_inflate(&b);
+    bench_deserialize(&b, recording_count, recordings);
+    bench_recordings(&b, dc, recording_count, recordings);
+    printf("\n]}\n");
+
+    for (int i = 0; i < recording_count; ++i) {
+        dispose_recording(&recordings[i]);
+    }
+    DP_free(recordings);
+    DP_draw_context_free(dc);
+    return 0;
+}
@@ -100,6 +100,14 @@ void DP_canvas_diff_check_all(DP_CanvasDiff *diff)
     }
 }
 
+void DP_canvas_diff_mark(DP_CanvasDiff *diff, int tile_index)
+{
+    DP_ASSERT(diff);
+    DP_ASSERT(tile_index >= 0);
+    DP_ASSERT(tile_index < diff->count);
+    diff->tile_changes[tile_index] = true;
+}
+
 void DP_canvas_diff_each_index(DP_CanvasDiff *diff, DP_CanvasDiffEachIndexFn fn,
                                void *data)
 {
@@ -41,6 +41,8 @@ void DP_canvas_diff_check(DP_CanvasDiff *diff, DP_CanvasDiffCheckFn fn,
 
 void DP_canvas_diff_check_all(DP_CanvasDiff *diff);
 
+void DP_canvas_diff_mark(DP_CanvasDiff *diff, int tile_index);
+
 void DP_canvas_diff_each_index(DP_CanvasDiff *diff, DP_CanvasDiffEachIndexFn fn,
                                void *data);
 
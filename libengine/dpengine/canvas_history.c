@@ -21,18 +21,29 @@
  */
 #include "canvas_history.h"
 #include "canvas_state.h"
+#include "compressed_tiles.h"
+#include "draw_context.h"
+#include "perf.h"
 #include "dpmsg/messages/undo.h"
 #include <dpcommon/conversions.h>
+#include <dpcommon/memory_stats.h>
 #include <dpcommon/threading.h>
+#include <dpcommon/trace.h>
+#include <dpcommon/worker.h>
 #include <dpmsg/message.h>
 #include <dpmsg/messages/internal.h>
 #include <dpmsg/messages/undo_point.h>
+#include <SDL_atomic.h>
 
 
 #define INITIAL_CAPACITY              1024
 #define EXPAND_CAPACITY(OLD_CAPACITY) ((OLD_CAPACITY)*2)
 
 #define UNDO_DEPTH_LIMIT 30
+// How far the undo window may shrink when over the memory budget.
+#define UNDO_DEPTH_MIN   2
+// Savepoints that undos are most likely to reach don't get compressed.
+#define HOT_SAVEPOINTS   2
 
 typedef enum DP_Undo {
     DP_UNDO_DONE,
@@ -44,21 +55,88 @@ typedef struct DP_CanvasHistoryEntry {
     DP_Undo undo;
     DP_Message *msg;
     DP_CanvasState *state;
+    DP_CompressedTiles *compressed;
+    int compressed_serial;
 } DP_CanvasHistoryEntry;
 
+typedef struct DP_CanvasHistoryParallelJob {
+    DP_CanvasState *cs;
+    DP_DrawContext *dc;
+    DP_Message *msg;
+    DP_Semaphore *sem_done;
+    DP_CanvasState *result;
+} DP_CanvasHistoryParallelJob;
+
+typedef struct DP_CanvasHistoryCompressionJob {
+    int serial;
+    DP_CanvasState *source;
+    DP_CanvasState *newer;
+    DP_Semaphore *sem_done;
+    DP_CanvasState *result;
+    DP_CompressedTiles *tiles;
+} DP_CanvasHistoryCompressionJob;
+
+// The current state is only ever touched by the thread handling messages.
+// Other threads get it through the published state pointer, without locking.
+// Readers announce themselves through the reader count before loading the
+// pointer and leave after taking their reference. When a new state gets
+// published, the previous one is retired and only released once the reader
+// count has been seen at zero, since until then a reader may still be about
+// to increment its refcount. Neither side ever waits on the other.
+//
+// Commands sent by the local user are shown before the server echoes them back
+// by applying them to a local fork of the current state, which gets published
+// in its place. An echo matching the oldest forked command drops it from the
+// fork, an echo further in means that the server rejected or reordered the
+// ones before it, so those get rolled back. Any other change to the current
+// state gets the remaining forked commands replayed on top.
+//
+// Savepoints keep every tile that was current when they were made. Once a
+// savepoint is a few undo points back, the tiles that only it still holds
+// are taken out of it and compressed on the worker, one savepoint at a time,
+// see DP_canvas_history_compress_savepoints. The compression serial changes
+// along with the current state, savepoints compressed against an older one
+// get another pass. An undo to such a savepoint inflates them.
 struct DP_CanvasHistory {
-    DP_Mutex *mutex;
     DP_CanvasState *current_state;
+    int undo_depth_limit;
+    SDL_atomic_t networked;
+    SDL_atomic_t local_context_id;
     int capacity;
     int used;
     DP_CanvasHistoryEntry *entries;
+    struct {
+        void *state;
+        SDL_atomic_t readers;
+        int retired_capacity;
+        int retired_used;
+        DP_CanvasState **retired;
+    } published;
+    struct {
+        int capacity;
+        int used;
+        DP_Message **msgs;
+        DP_CanvasState *base;
+        DP_CanvasState *state;
+    } fork;
+    struct {
+        int serial;
+        DP_CanvasHistoryCompressionJob job;
+    } compression;
+    struct {
+        SDL_atomic_t gets;
+        SDL_atomic_t publishes;
+        SDL_atomic_t deferred_releases;
+        SDL_atomic_t max_retired;
+    } stats;
 };
 
 
 static void set_initial_entry(DP_CanvasHistory *ch, DP_CanvasState *cs)
 {
-    ch->entries[0] = (DP_CanvasHistoryEntry){
-        DP_UNDO_DONE, DP_msg_undo_point_new(0), DP_canvas_state_incref(cs)};
+    ch->entries[0] =
+        (DP_CanvasHistoryEntry){DP_UNDO_DONE, DP_msg_undo_point_new(0),
+                                DP_canvas_state_incref(cs), NULL, -1};
 }
 
 static void validate_history(DP_CanvasHistory *ch)
@@ -93,29 +171,51 @@ static void validate_history(DP_CanvasHistory *ch)
 
 DP_CanvasHistory *DP_canvas_history_new(void)
 {
-    DP_Mutex *mutex = DP_mutex_new();
-    if (!mutex) {
-        return NULL;
-    }
-
     DP_CanvasHistory *ch = DP_malloc(sizeof(*ch));
     DP_CanvasState *cs = DP_canvas_state_new();
     size_t entries_size = sizeof(*ch->entries) * INITIAL_CAPACITY;
 
-    *ch = (DP_CanvasHistory){mutex, cs, INITIAL_CAPACITY, 1,
-                             DP_malloc(entries_size)};
+    *ch = (DP_CanvasHistory){cs,
+                             UNDO_DEPTH_LIMIT,
+                             {0},
+                             {0},
+                             INITIAL_CAPACITY,
+                             1,
+                             DP_malloc(entries_size),
+                             {DP_canvas_state_incref(cs), {0}, 0, 0, NULL},
+                             {0, 0, NULL, NULL, NULL},
+                             {0, {0, NULL, NULL, NULL, NULL, NULL}},
+                             {{0}, {0}, {0}, {0}}};
+    DP_memory_add(DP_MEMORY_HISTORY, sizeof(*ch) + entries_size);
     set_initial_entry(ch, cs);
     validate_history(ch);
     return ch;
 }
 
 
+// Keeps track of the history's arrays in the memory stats.
+static void account_resize(int old_capacity, int new_capacity,
+                           size_t element_size)
+{
+    if (new_capacity > old_capacity) {
+        DP_memory_add(DP_MEMORY_HISTORY,
+                      DP_int_to_size(new_capacity - old_capacity)
+                          * element_size);
+    }
+    else {
+        DP_memory_sub(DP_MEMORY_HISTORY,
+                      DP_int_to_size(old_capacity - new_capacity)
+                          * element_size);
+    }
+}
+
 static void dispose_entry(DP_CanvasHistoryEntry *entry)
 {
     DP_message_decref(entry->msg);
     if (entry->state) {
         DP_canvas_state_decref(entry->state);
     }
+    DP_compressed_tiles_free(entry->compressed);
 }
 
 static void truncate_history(DP_CanvasHistory *ch, int until)
@@ -131,13 +231,64 @@ static void truncate_history(DP_CanvasHistory *ch, int until)
     memmove(entries, entries + until, size);
 }
 
+static void release_retired(DP_CanvasHistory *ch)
+{
+    int used = ch->published.retired_used;
+    DP_CanvasState **retired = ch->published.retired;
+    for (int i = 0; i < used; ++i) {
+        DP_canvas_state_decref(retired[i]);
+    }
+    ch->published.retired_used = 0;
+}
+
+static void clear_local_fork(DP_CanvasHistory *ch)
+{
+    int used = ch->fork.used;
+    DP_Message **msgs = ch->fork.msgs;
+    for (int i = 0; i < used; ++i) {
+        DP_message_decref(msgs[i]);
+    }
+    ch->fork.used = 0;
+    if (ch->fork.state) {
+        DP_canvas_state_decref(ch->fork.state);
+        DP_canvas_state_decref(ch->fork.base);
+        ch->fork.state = NULL;
+        ch->fork.base = NULL;
+    }
+}
+
+static void finish_compression(DP_CanvasHistory *ch);
+
 void DP_canvas_history_free(DP_CanvasHistory *ch)
 {
     if (ch) {
+#ifndef NDEBUG
+        DP_CanvasHistoryStats stats = DP_canvas_history_stats(ch);
+        DP_debug("Canvas history stats: %d gets, %d publishes, "
+                 "%d deferred releases, %d max retired",
+                 stats.gets, stats.publishes, stats.deferred_releases,
+                 stats.max_retired);
+#endif
+        DP_ASSERT(SDL_AtomicGet(&ch->published.readers) == 0);
+        clear_local_fork(ch);
+        DP_free(ch->fork.msgs);
+        release_retired(ch);
+        DP_free(ch->published.retired);
+        DP_canvas_state_decref(SDL_AtomicGetPtr(&ch->published.state));
+        DP_CanvasHistoryCompressionJob *job = &ch->compression.job;
+        if (job->source) {
+            DP_SEMAPHORE_MUST_WAIT(job->sem_done);
+            finish_compression(ch);
+        }
+        DP_semaphore_free(job->sem_done);
         truncate_history(ch, ch->used);
         DP_free(ch->entries);
         DP_canvas_state_decref(ch->current_state);
-        DP_mutex_free(ch->mutex);
+        account_resize(ch->capacity, 0, sizeof(*ch->entries));
+        account_resize(ch->fork.capacity, 0, sizeof(*ch->fork.msgs));
+        account_resize(ch->published.retired_capacity, 0,
+                       sizeof(*ch->published.retired));
+        DP_memory_sub(DP_MEMORY_HISTORY, sizeof(*ch));
         DP_free(ch);
     }
 }
@@ -146,22 +297,95 @@ DP_CanvasState *DP_canvas_history_compare_and_get(DP_CanvasHistory *ch,
                                                   DP_CanvasState *prev)
 {
     DP_ASSERT(ch);
-    DP_Mutex *mutex = ch->mutex;
-    DP_MUTEX_MUST_LOCK(mutex);
-    DP_CanvasState *next = ch->current_state;
+    SDL_AtomicIncRef(&ch->published.readers);
+    DP_CanvasState *next = SDL_AtomicGetPtr(&ch->published.state);
     DP_CanvasState *cs = next == prev ? NULL : DP_canvas_state_incref(next);
-    DP_MUTEX_MUST_UNLOCK(mutex);
+    SDL_AtomicDecRef(&ch->published.readers);
+    SDL_AtomicAdd(&ch->stats.gets, 1);
     return cs;
 }
 
+void DP_canvas_history_networked_set(DP_CanvasHistory *ch, bool networked)
+{
+    DP_ASSERT(ch);
+    SDL_AtomicSet(&ch->networked, networked ? 1 : 0);
+}
+
+void DP_canvas_history_local_context_id_set(DP_CanvasHistory *ch,
+                                            unsigned int context_id)
+{
+    DP_ASSERT(ch);
+    SDL_AtomicSet(&ch->local_context_id, DP_uint_to_int(context_id));
+}
+
+DP_CanvasHistoryStats DP_canvas_history_stats(DP_CanvasHistory *ch)
+{
+    DP_ASSERT(ch);
+    return (DP_CanvasHistoryStats){SDL_AtomicGet(&ch->stats.gets),
+                                   SDL_AtomicGet(&ch->stats.publishes),
+                                   SDL_AtomicGet(&ch->stats.deferred_releases),
+                                   SDL_AtomicGet(&ch->stats.max_retired)};
+}
+
+static void retire_state(DP_CanvasHistory *ch, DP_CanvasState *cs)
+{
+    int used = ch->published.retired_used;
+    if (used == ch->published.retired_capacity) {
+        int capacity = DP_max_int(4, used * 2);
+        ch->published.retired =
+            DP_realloc(ch->published.retired,
+                       sizeof(*ch->published.retired)
+                           * DP_int_to_size(capacity));
+        account_resize(used, capacity, sizeof(*ch->published.retired));
+        ch->published.retired_capacity = capacity;
+    }
+    ch->published.retired[used] = cs;
+    ch->published.retired_used = used + 1;
+    if (used + 1 > SDL_AtomicGet(&ch->stats.max_retired)) {
+        SDL_AtomicSet(&ch->stats.max_retired, used + 1);
+    }
+}
+
+static void publish_state_noinc(DP_CanvasHistory *ch, DP_CanvasState *next)
+{
+    DP_CanvasState *prev = SDL_AtomicGetPtr(&ch->published.state);
+    // Compare-and-swap rather than a plain set, since it acts as a full memory
+    // barrier, so the reader count below can't be loaded before the swap.
+    bool swapped = SDL_AtomicCASPtr(&ch->published.state, prev, next);
+    DP_ASSERT(swapped);
+    (void)swapped;
+    SDL_AtomicAdd(&ch->stats.publishes, 1);
+    retire_state(ch, prev);
+    // Any reader that may have loaded a retired state is gone if there's no
+    // readers now, later ones can only see the state just published.
+    if (SDL_AtomicGet(&ch->published.readers) == 0) {
+        release_retired(ch);
+    }
+    else {
+        SDL_AtomicAdd(&ch->stats.deferred_releases, 1);
+    }
+}
+
+void DP_canvas_history_release_retired(DP_CanvasHistory *ch)
+{
+    DP_ASSERT(ch);
+    // Same as above, the swap happened back when the state got retired.
+    if (ch->published.retired_used != 0
+        && SDL_AtomicGet(&ch->published.readers) == 0) {
+        release_retired(ch);
+    }
+}
+
 static void set_current_state_noinc(DP_CanvasHistory *ch, DP_CanvasState *next)
 {
-    DP_CanvasState *current = ch->current_state;
-    DP_Mutex *mutex = ch->mutex;
-    DP_MUTEX_MUST_LOCK(mutex);
+    DP_CanvasState *prev = ch->current_state;
     ch->current_state = next;
-    DP_MUTEX_MUST_UNLOCK(mutex);
-    DP_canvas_state_decref(current);
+    DP_canvas_state_decref(prev);
+    // With a local fork, the state to publish is only known after reconciling
+    // it with the message that got handled, see update_local_fork.
+    if (ch->fork.used == 0) {
+        publish_state_noinc(ch, DP_canvas_state_incref(next));
+    }
 }
 
 
@@ -219,6 +443,7 @@ static void ensure_append_capacity(DP_CanvasHistory *ch)
         size_t new_size = sizeof(*ch->entries) * DP_int_to_size(new_capacity);
         DP_debug("Resizing history capacity to %d entries", ch->capacity);
         ch->entries = DP_realloc(ch->entries, new_size);
+        account_resize(old_capacity, new_capacity, sizeof(*ch->entries));
         ch->capacity = new_capacity;
     }
 }
@@ -227,8 +452,8 @@ static int append_to_history(DP_CanvasHistory *ch, DP_Message *msg)
 {
     ensure_append_capacity(ch);
     int index = ch->used;
-    ch->entries[index] =
-        (DP_CanvasHistoryEntry){DP_UNDO_DONE, DP_message_incref(msg), NULL};
+    ch->entries[index] = (DP_CanvasHistoryEntry){
+        DP_UNDO_DONE, DP_message_incref(msg), NULL, NULL, -1};
     ch->used = index + 1;
     return index;
 }
@@ -246,7 +471,7 @@ static int mark_undone_actions_gone(DP_CanvasHistory *ch, int index,
     DP_CanvasHistoryEntry *entries = ch->entries;
     int i = index - 1;
     int depth = 1;
-    for (; i >= 0 && depth < UNDO_DEPTH_LIMIT; --i) {
+    for (; i >= 0 && depth < ch->undo_depth_limit; --i) {
         DP_CanvasHistoryEntry *entry = &entries[i];
         if (entry->state) {
             ++depth;
@@ -269,7 +494,7 @@ static int mark_undone_actions_gone(DP_CanvasHistory *ch, int index,
 static int find_first_unreachable_index(DP_CanvasHistory *ch, int i, int depth)
 {
     DP_CanvasHistoryEntry *entries = ch->entries;
-    for (; i >= 0 && depth < UNDO_DEPTH_LIMIT; --i) {
+    for (; i >= 0 && depth < ch->undo_depth_limit; --i) {
         if (entries[i].state) {
             ++depth;
         }
@@ -277,8 +502,59 @@ static int find_first_unreachable_index(DP_CanvasHistory *ch, int i, int depth)
     return i;
 }
 
+// When over the memory budget, the draw context lets go of its grown buffers.
+// In a networked session, the undo depth has to match every other client's,
+// since undos relayed by the server would otherwise fail here while applying
+// everywhere else, so all that can be done beyond that is compressing a
+// savepoint right away. Offline, the undo window gets halved, which drops the
+// oldest savepoints and whatever tiles only they were holding on to. It grows
+// back one step per undo point once memory usage is comfortably below the
+// budget again.
+static void reclaim_memory(DP_CanvasHistory *ch, DP_DrawContext *dc)
+{
+    size_t budget = DP_memory_budget();
+    bool networked = SDL_AtomicGet(&ch->networked) != 0;
+    if (budget == 0 || networked) {
+        ch->undo_depth_limit = UNDO_DEPTH_LIMIT;
+    }
+    if (budget == 0) {
+        return;
+    }
+
+    size_t total = DP_memory_total();
+    if (total > budget) {
+        if (dc) {
+            DP_draw_context_reclaim(dc);
+        }
+        if (networked) {
+            // Don't wait on a compression that's running on a worker.
+            if (!ch->compression.job.source) {
+                DP_canvas_history_compress_savepoints(ch, NULL);
+            }
+            return;
+        }
+        int limit = DP_max_int(UNDO_DEPTH_MIN, ch->undo_depth_limit / 2);
+        if (limit < ch->undo_depth_limit) {
+            DP_warn("Memory usage of %zu bytes is over the budget of %zu, "
+                    "shrinking undo window to %d",
+                    total, budget, limit);
+            ch->undo_depth_limit = limit;
+            int first_unreachable_index =
+                find_first_unreachable_index(ch, ch->used - 1, 0);
+            if (first_unreachable_index > 0) {
+                truncate_history(ch, first_unreachable_index);
+            }
+        }
+    }
+    else if (ch->undo_depth_limit < UNDO_DEPTH_LIMIT
+             && total < budget / 4 * 3) {
+        ++ch->undo_depth_limit;
+    }
+}
+
 static void handle_undo_point(DP_CanvasHistory *ch, DP_Message *msg)
 {
+    ++ch->compression.serial;
     int index = append_to_history(ch, msg);
     make_save_point(ch, index);
     int depth;
@@ -296,7 +572,7 @@ static int find_first_undo_point(DP_CanvasHistory *ch, unsigned int context_id,
     DP_CanvasHistoryEntry *entries = ch->entries;
     int i;
     int depth = 0;
-    for (i = ch->used - 1; i >= 0 && depth <= UNDO_DEPTH_LIMIT; --i) {
+    for (i = ch->used - 1; i >= 0 && depth <= ch->undo_depth_limit; --i) {
         DP_CanvasHistoryEntry *entry = &entries[i];
         if (entry->state) {
             ++depth;
@@ -328,7 +604,7 @@ static int undo(DP_CanvasHistory *ch, unsigned int context_id)
 {
     int depth;
     int undo_start = find_first_undo_point(ch, context_id, &depth);
-    if (depth > UNDO_DEPTH_LIMIT) {
+    if (depth > ch->undo_depth_limit) {
         DP_error_set("Undo by user %u beyond history limit", context_id);
         return -1;
     }
@@ -349,7 +625,7 @@ static int find_oldest_redo_point(DP_CanvasHistory *ch, unsigned int context_id,
     DP_CanvasHistoryEntry *entries = ch->entries;
     int redo_start = -1;
     int depth = 0;
-    for (int i = ch->used - 1; i >= 0 && depth <= UNDO_DEPTH_LIMIT; --i) {
+    for (int i = ch->used - 1; i >= 0 && depth <= ch->undo_depth_limit; --i) {
         DP_CanvasHistoryEntry *entry = &entries[i];
         if (entry->state) {
             ++depth;
@@ -392,7 +668,7 @@ static int redo(DP_CanvasHistory *ch, unsigned int context_id)
 {
     int depth;
     int redo_start = find_oldest_redo_point(ch, context_id, &depth);
-    if (depth > UNDO_DEPTH_LIMIT) {
+    if (depth > ch->undo_depth_limit) {
         DP_error_set("Redo by user %u beyond history limit", context_id);
         return -1;
     }
@@ -412,6 +688,9 @@ static void replay_undo_point(DP_CanvasState *cs, DP_CanvasHistoryEntry *entry)
     DP_CanvasState *prev = entry->state;
     entry->state = DP_canvas_state_incref(cs);
     DP_canvas_state_decref(prev);
+    DP_compressed_tiles_free(entry->compressed);
+    entry->compressed = NULL;
+    entry->compressed_serial = -1;
 }
 
 static DP_CanvasState *
@@ -441,22 +720,52 @@ static DP_CanvasState *replay(DP_CanvasState *cs, DP_DrawContext *dc,
     }
 }
 
+// The savepoint stays decompressed afterwards, since the current state is
+// now based on it. It gets compressed again if it ends up far enough back.
+static void decompress_savepoint(DP_CanvasHistoryEntry *entry)
+{
+    DP_TRACE_BEGIN("savepoint_decompress");
+    DP_CanvasState *cs =
+        DP_compressed_tiles_restore(entry->compressed, entry->state);
+    if (cs) {
+        DP_canvas_state_decref(entry->state);
+        entry->state = cs;
+    }
+    else {
+        DP_warn("Error decompressing savepoint: %s", DP_error());
+    }
+    DP_compressed_tiles_free(entry->compressed);
+    entry->compressed = NULL;
+    entry->compressed_serial = -1;
+    DP_TRACE_END();
+}
+
 static void replay_from(DP_CanvasHistory *ch, DP_DrawContext *dc, int start)
 {
+    unsigned long long perf_start = DP_perf_begin();
+    DP_TRACE_BEGIN("undo_replay");
+    ++ch->compression.serial;
     DP_CanvasHistoryEntry *entries = ch->entries;
+    if (entries[start].compressed) {
+        decompress_savepoint(&entries[start]);
+    }
     DP_CanvasState *cs = DP_canvas_state_incref(entries[start].state);
     DP_ASSERT(cs);
 
     int used = ch->used;
+    int length = 0;
     for (int i = start + 1; i < used; ++i) {
         DP_CanvasHistoryEntry *entry = &entries[i];
         if (entry->undo == DP_UNDO_DONE) {
             cs = replay(cs, dc, entry);
             validate_history(ch);
+            ++length;
         }
     }
 
     set_current_state_noinc(ch, cs);
+    DP_TRACE_END();
+    DP_perf_end_undo_replay(length, perf_start);
 }
 
 
@@ -496,11 +805,134 @@ static bool handle_drawing_command(DP_CanvasHistory *ch, DP_DrawContext *dc,
 }
 
 
+bool DP_canvas_history_can_handle_local(DP_MessageType type)
+{
+    // Undos depend on the history, so they can't be predicted locally.
+    return DP_message_type_command(type) && type != DP_MSG_UNDO_POINT
+        && type != DP_MSG_UNDO;
+}
+
+static DP_CanvasState *fork_command(DP_CanvasState *cs, DP_DrawContext *dc,
+                                    DP_Message *msg)
+{
+    DP_CanvasState *next = DP_canvas_state_handle(cs, dc, msg);
+    if (next) {
+        DP_canvas_state_decref(cs);
+        return next;
+    }
+    else {
+        DP_debug("Error handling local drawing command: %s", DP_error());
+        return cs;
+    }
+}
+
+// Local commands may be sent without a context id, the server fills in the
+// local user's when it echoes them back.
+static bool is_echo_of(DP_Message *forked, unsigned int context_id,
+                       unsigned int local_context_id)
+{
+    unsigned int forked_context_id = DP_message_context_id(forked);
+    return forked_context_id == context_id
+        || (forked_context_id == 0 && local_context_id != 0
+            && context_id == local_context_id);
+}
+
+static int find_forked(DP_CanvasHistory *ch, DP_Message *msg)
+{
+    int used = ch->fork.used;
+    DP_Message **msgs = ch->fork.msgs;
+    unsigned int context_id = DP_message_context_id(msg);
+    unsigned int local_context_id =
+        DP_int_to_uint(SDL_AtomicGet(&ch->local_context_id));
+    for (int i = 0; i < used; ++i) {
+        if (is_echo_of(msgs[i], context_id, local_context_id)
+            && DP_message_equals(msgs[i], msg)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Returns if the local fork state is still valid after the given message got
+// handled, which is the case when it's the echo of the oldest forked command.
+static bool reconcile_local_fork(DP_CanvasHistory *ch, DP_Message *msg)
+{
+    if (ch->fork.used == 0) {
+        return true;
+    }
+
+    DP_MessageType type = DP_message_type(msg);
+    if (type == DP_MSG_INTERNAL) {
+        clear_local_fork(ch); // Resets leave nothing to draw on.
+        return false;
+    }
+    else if (!DP_canvas_history_can_handle_local(type)) {
+        return false;
+    }
+
+    // Forked commands before the echoed one were rejected or reordered by the
+    // server, so those get rolled back. A command that isn't found wasn't
+    // forked or was rolled back already, so there's nothing to reconcile.
+    int index = find_forked(ch, msg);
+    if (index < 0) {
+        return false;
+    }
+    else if (index != 0) {
+        DP_debug("Rolling back %d local commands", index);
+    }
+
+    DP_Message **msgs = ch->fork.msgs;
+    for (int i = 0; i <= index; ++i) {
+        DP_message_decref(msgs[i]);
+    }
+    int used = ch->fork.used - index - 1;
+    memmove(msgs, msgs + index + 1, sizeof(*msgs) * DP_int_to_size(used));
+    ch->fork.used = used;
+    return index == 0;
+}
+
+static void update_local_fork(DP_CanvasHistory *ch, DP_DrawContext *dc,
+                              bool had_fork, bool valid)
+{
+    DP_CanvasState *current = ch->current_state;
+    if (!had_fork) {
+        return; // Current state has been published already.
+    }
+    else if (ch->fork.used == 0) {
+        clear_local_fork(ch);
+        publish_state_noinc(ch, DP_canvas_state_incref(current));
+    }
+    else if (valid) {
+        // The current state caught up with the echoed commands, the fork
+        // state still has the rest of them applied on top of it.
+        DP_canvas_state_decref(ch->fork.base);
+        ch->fork.base = DP_canvas_state_incref(current);
+    }
+    else {
+        int used = ch->fork.used;
+        DP_Message **msgs = ch->fork.msgs;
+        DP_CanvasState *cs = DP_canvas_state_incref(current);
+        for (int i = 0; i < used; ++i) {
+            cs = fork_command(cs, dc, msgs[i]);
+        }
+        if (ch->fork.state) {
+            DP_canvas_state_decref(ch->fork.state);
+            DP_canvas_state_decref(ch->fork.base);
+        }
+        ch->fork.base = DP_canvas_state_incref(current);
+        ch->fork.state = cs;
+        publish_state_noinc(ch, DP_canvas_state_incref(cs));
+    }
+}
+
 bool DP_canvas_history_handle(DP_CanvasHistory *ch, DP_DrawContext *dc,
                               DP_Message *msg)
 {
     DP_ASSERT(ch);
     DP_ASSERT(msg);
+    unsigned long long perf_start = DP_perf_begin();
+    bool had_fork = ch->fork.used != 0;
+    bool valid = ch->current_state == ch->fork.base;
     DP_MessageType type = DP_message_type(msg);
     DP_debug("History command %d %s", (int)type,
              DP_message_type_enum_name(type));
@@ -511,6 +943,7 @@ bool DP_canvas_history_handle(DP_CanvasHistory *ch, DP_DrawContext *dc,
         break;
     case DP_MSG_UNDO_POINT:
         handle_undo_point(ch, msg);
+        reclaim_memory(ch, dc);
         ok = true;
         break;
     case DP_MSG_UNDO:
@@ -521,5 +954,346 @@ bool DP_canvas_history_handle(DP_CanvasHistory *ch, DP_DrawContext *dc,
         break;
     }
     validate_history(ch);
+    valid = reconcile_local_fork(ch, msg) && valid;
+    update_local_fork(ch, dc, had_fork, valid);
+    DP_perf_end(DP_PERF_HISTORY, type, perf_start);
+    return ok;
+}
+
+bool DP_canvas_history_handle_local(DP_CanvasHistory *ch, DP_DrawContext *dc,
+                                    DP_Message *msg)
+{
+    DP_ASSERT(ch);
+    DP_ASSERT(msg);
+    DP_MessageType type = DP_message_type(msg);
+    if (!DP_canvas_history_can_handle_local(type)) {
+        DP_error_set("Can't handle %s locally",
+                     DP_message_type_enum_name(type));
+        return false;
+    }
+
+    int used = ch->fork.used;
+    if (used == ch->fork.capacity) {
+        int capacity = DP_max_int(16, used * 2);
+        size_t size = sizeof(*ch->fork.msgs) * DP_int_to_size(capacity);
+        ch->fork.msgs = DP_realloc(ch->fork.msgs, size);
+        account_resize(used, capacity, sizeof(*ch->fork.msgs));
+        ch->fork.capacity = capacity;
+    }
+    // Commands that fail locally are kept anyway, since their echo will still
+    // arrive and needs to be matched up.
+    ch->fork.msgs[used] = DP_message_incref(msg);
+    ch->fork.used = used + 1;
+
+    if (!ch->fork.state) {
+        ch->fork.base = DP_canvas_state_incref(ch->current_state);
+        ch->fork.state = DP_canvas_state_incref(ch->current_state);
+    }
+    DP_CanvasState *prev = ch->fork.state;
+    ch->fork.state = fork_command(prev, dc, msg);
+    if (ch->fork.state != prev) {
+        publish_state_noinc(ch, DP_canvas_state_incref(ch->fork.state));
+    }
+    return true;
+}
+
+
+static void compress_savepoint(DP_CanvasHistoryCompressionJob *job)
+{
+    DP_TRACE_BEGIN("savepoint_compress");
+    job->tiles = DP_compressed_tiles_new();
+    job->result =
+        DP_compressed_tiles_take(job->tiles, job->source, job->newer);
+    DP_TRACE_END();
+}
+
+static void run_compression_job(void *user)
+{
+    DP_CanvasHistoryCompressionJob *job = user;
+    compress_savepoint(job);
+    DP_SEMAPHORE_MUST_POST(job->sem_done);
+}
+
+static DP_CanvasHistoryEntry *find_savepoint(DP_CanvasHistory *ch,
+                                             DP_CanvasState *cs)
+{
+    DP_CanvasHistoryEntry *entries = ch->entries;
+    for (int i = ch->used - 1; i >= 0; --i) {
+        if (entries[i].state == cs) {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+// The savepoint may have been truncated, undone to or replayed over while the
+// job was running, in which case its state is a different one now and the
+// result gets thrown away.
+static void finish_compression(DP_CanvasHistory *ch)
+{
+    DP_CanvasHistoryCompressionJob *job = &ch->compression.job;
+    DP_CanvasHistoryEntry *entry = find_savepoint(ch, job->source);
+    if (entry) {
+        DP_CompressedTiles *tiles = job->tiles;
+        DP_debug("Compressed %d savepoint tiles into %zu bytes",
+                 DP_compressed_tiles_count(tiles),
+                 DP_compressed_tiles_size(tiles));
+        if (DP_compressed_tiles_count(tiles) == 0) {
+            DP_compressed_tiles_free(tiles);
+        }
+        else if (entry->compressed) {
+            DP_compressed_tiles_append(entry->compressed, tiles);
+        }
+        else {
+            entry->compressed = tiles;
+        }
+        DP_canvas_state_decref(entry->state);
+        entry->state = job->result;
+        entry->compressed_serial = job->serial;
+    }
+    else {
+        DP_compressed_tiles_free(job->tiles);
+        DP_canvas_state_decref(job->result);
+    }
+    DP_canvas_state_decref(job->source);
+    DP_canvas_state_decref(job->newer);
+    job->source = NULL;
+    job->newer = NULL;
+    job->result = NULL;
+    job->tiles = NULL;
+}
+
+static int find_savepoint_to_compress(DP_CanvasHistory *ch)
+{
+    DP_CanvasHistoryEntry *entries = ch->entries;
+    int serial = ch->compression.serial;
+    int hot = 0;
+    for (int i = ch->used - 1; i >= 0; --i) {
+        DP_CanvasHistoryEntry *entry = &entries[i];
+        if (entry->state) {
+            if (hot < HOT_SAVEPOINTS) {
+                ++hot;
+            }
+            else if (entry->compressed_serial != serial) {
+                return i;
+            }
+        }
+    }
+    return -1;
+}
+
+void DP_canvas_history_compress_savepoints(DP_CanvasHistory *ch,
+                                           DP_Worker *worker)
+{
+    DP_ASSERT(ch);
+    DP_CanvasHistoryCompressionJob *job = &ch->compression.job;
+    if (job->source) {
+        if (!DP_SEMAPHORE_MUST_TRY_WAIT(job->sem_done)) {
+            return; // Still running, try again next time.
+        }
+        finish_compression(ch);
+    }
+    else if (worker && !job->sem_done
+             && !(job->sem_done = DP_semaphore_new(0))) {
+        DP_warn("Can't compress savepoints: %s", DP_error());
+        return;
+    }
+
+    int index = find_savepoint_to_compress(ch);
+    if (index >= 0) {
+        job->serial = ch->compression.serial;
+        job->source = DP_canvas_state_incref(ch->entries[index].state);
+        job->newer = DP_canvas_state_incref(ch->current_state);
+        if (worker) {
+            DP_worker_push(worker, run_compression_job, job);
+        }
+        else {
+            compress_savepoint(job);
+            finish_compression(ch);
+        }
+    }
+}
+
+
+struct DP_CanvasHistoryBatcher {
+    DP_Worker *worker;
+    int capacity;
+    int count;
+    DP_DrawContext **dcs;
+    DP_Message **msgs;
+    int *layer_ids;
+    DP_CanvasHistoryParallelJob *jobs;
+    DP_CanvasState **results;
+};
+
+DP_CanvasHistoryBatcher *DP_canvas_history_batcher_new(DP_Worker *worker,
+                                                       DP_DrawContext *dc)
+{
+    DP_ASSERT(dc);
+    int capacity = worker ? DP_worker_thread_count(worker) + 1 : 1;
+    size_t n = DP_int_to_size(capacity);
+    DP_CanvasHistoryBatcher *chb = DP_malloc(sizeof(*chb));
+    *chb = (DP_CanvasHistoryBatcher){worker,
+                                     capacity,
+                                     0,
+                                     DP_malloc(sizeof(*chb->dcs) * n),
+                                     DP_malloc(sizeof(*chb->msgs) * n),
+                                     DP_malloc(sizeof(*chb->layer_ids) * n),
+                                     DP_malloc(sizeof(*chb->jobs) * n),
+                                     DP_malloc(sizeof(*chb->results) * n)};
+    chb->dcs[0] = dc;
+    for (int i = 1; i < capacity; ++i) {
+        chb->dcs[i] = DP_draw_context_new();
+    }
+    return chb;
+}
+
+void DP_canvas_history_batcher_free(DP_CanvasHistoryBatcher *chb)
+{
+    if (chb) {
+        DP_ASSERT(chb->count == 0);
+        for (int i = 1; i < chb->capacity; ++i) {
+            DP_draw_context_free(chb->dcs[i]);
+        }
+        DP_free(chb->results);
+        DP_free(chb->jobs);
+        DP_free(chb->layer_ids);
+        DP_free(chb->msgs);
+        DP_free(chb->dcs);
+        DP_free(chb);
+    }
+}
+
+static void handle_parallel_job(DP_CanvasHistoryParallelJob *job)
+{
+    unsigned long long perf_start = DP_perf_begin();
+    job->result = DP_canvas_state_handle(job->cs, job->dc, job->msg);
+    if (!job->result) {
+        DP_warn("Error handling drawing command: %s", DP_error());
+    }
+    DP_perf_end(DP_PERF_HISTORY, DP_message_type(job->msg), perf_start);
+}
+
+static void run_parallel_job(void *user)
+{
+    DP_CanvasHistoryParallelJob *job = user;
+    handle_parallel_job(job);
+    DP_SEMAPHORE_MUST_POST(job->sem_done);
+}
+
+static bool handle_parallel(DP_CanvasHistoryBatcher *chb, DP_CanvasHistory *ch,
+                            DP_Semaphore *sem_done)
+{
+    DP_TRACE_BEGIN("handle_parallel");
+    int count = chb->count;
+    DP_CanvasState *cs = ch->current_state;
+    bool had_fork = ch->fork.used != 0;
+    bool valid = cs == ch->fork.base;
+    DP_CanvasHistoryParallelJob *jobs = chb->jobs;
+    for (int i = 0; i < count; ++i) {
+        DP_Message *msg = chb->msgs[i];
+        append_to_history(ch, msg);
+        jobs[i] = (DP_CanvasHistoryParallelJob){cs, chb->dcs[i], msg,
+                                                sem_done, NULL};
+        if (i != 0) {
+            DP_worker_push(chb->worker, run_parallel_job, &jobs[i]);
+        }
+    }
+
+    handle_parallel_job(&jobs[0]);
+    for (int i = 1; i < count; ++i) {
+        DP_SEMAPHORE_MUST_WAIT(sem_done);
+    }
+
+    bool ok = true;
+    DP_CanvasState **results = chb->results;
+    for (int i = 0; i < count; ++i) {
+        results[i] = jobs[i].result;
+        ok = ok && results[i];
+    }
+
+    DP_CanvasState *next =
+        DP_canvas_state_stitch_layers(cs, count, results, chb->layer_ids);
+    for (int i = 0; i < count; ++i) {
+        if (results[i]) {
+            DP_canvas_state_decref(results[i]);
+        }
+    }
+
+    set_current_state_noinc(ch, next);
+    validate_history(ch);
+    for (int i = 0; i < count; ++i) {
+        valid = reconcile_local_fork(ch, chb->msgs[i]) && valid;
+    }
+    update_local_fork(ch, chb->dcs[0], had_fork, valid);
+    DP_TRACE_END();
     return ok;
 }
+
+bool DP_canvas_history_batcher_flush(DP_CanvasHistoryBatcher *chb,
+                                     DP_CanvasHistory *ch)
+{
+    DP_ASSERT(chb);
+    DP_ASSERT(ch);
+    int count = chb->count;
+    bool ok;
+    DP_Semaphore *sem_done;
+    if (count == 0) {
+        return true;
+    }
+    else if (count > 1 && (sem_done = DP_semaphore_new(0))) {
+        ok = handle_parallel(chb, ch, sem_done);
+        DP_semaphore_free(sem_done);
+    }
+    else {
+        ok = true;
+        for (int i = 0; i < count; ++i) {
+            if (!DP_canvas_history_handle(ch, chb->dcs[0], chb->msgs[i])) {
+                DP_warn("Error handling drawing command: %s", DP_error());
+                ok = false;
+            }
+        }
+    }
+
+    for (int i = 0; i < count; ++i) {
+        DP_message_decref(chb->msgs[i]);
+    }
+    chb->count = 0;
+    return ok;
+}
+
+static bool batcher_has_layer_id(DP_CanvasHistoryBatcher *chb, int layer_id)
+{
+    int count = chb->count;
+    for (int i = 0; i < count; ++i) {
+        if (chb->layer_ids[i] == layer_id) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool DP_canvas_history_batcher_handle(DP_CanvasHistoryBatcher *chb,
+                                      DP_CanvasHistory *ch, DP_Message *msg)
+{
+    DP_ASSERT(chb);
+    DP_ASSERT(ch);
+    DP_ASSERT(msg);
+    int layer_id;
+    if (chb->capacity > 1 && DP_canvas_state_message_layer_id(msg, &layer_id)) {
+        bool ok = batcher_has_layer_id(chb, layer_id)
+                    ? DP_canvas_history_batcher_flush(chb, ch)
+                    : true;
+        int index = chb->count++;
+        chb->msgs[index] = DP_message_incref(msg);
+        chb->layer_ids[index] = layer_id;
+        if (chb->count == chb->capacity) {
+            ok = DP_canvas_history_batcher_flush(chb, ch) && ok;
+        }
+        return ok;
+    }
+    else {
+        bool flushed = DP_canvas_history_batcher_flush(chb, ch);
+        return DP_canvas_history_handle(ch, chb->dcs[0], msg) && flushed;
+    }
+}
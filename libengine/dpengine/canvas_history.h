@@ -22,14 +22,25 @@
 #ifndef DPENGINE_CANVAS_HISTORY_H
 #define DPENGINE_CANVAS_HISTORY_H
 #include <dpcommon/common.h>
+#include <dpmsg/message.h>
 
 typedef struct DP_CanvasState DP_CanvasState;
 typedef struct DP_DrawContext DP_DrawContext;
-typedef struct DP_Message DP_Message;
+typedef struct DP_Worker DP_Worker;
 
 
 typedef struct DP_CanvasHistory DP_CanvasHistory;
 
+// Counters for how the current state is shared with other threads. A deferred
+// release means that some thread was getting the state right as a new one
+// was published, so the previous one had to be kept around for longer.
+typedef struct DP_CanvasHistoryStats {
+    int gets;
+    int publishes;
+    int deferred_releases;
+    int max_retired;
+} DP_CanvasHistoryStats;
+
 DP_CanvasHistory *DP_canvas_history_new(void);
 
 void DP_canvas_history_free(DP_CanvasHistory *ch);
@@ -37,8 +48,73 @@ void DP_canvas_history_free(DP_CanvasHistory *ch);
 DP_CanvasState *DP_canvas_history_compare_and_get(DP_CanvasHistory *ch,
                                                   DP_CanvasState *prev);
 
+DP_CanvasHistoryStats DP_canvas_history_stats(DP_CanvasHistory *ch);
+
+// Releases the states that publishing had to keep around because some thread
+// was getting the state right then, if no thread is anymore. Publishing the
+// next state does this too, call it when there's nothing else to do so that
+// they don't linger until then.
+void DP_canvas_history_release_retired(DP_CanvasHistory *ch);
+
+// Whether the messages come from a session that other clients are in. In that
+// case going over the memory budget never shrinks the undo window, since the
+// undo depth has to be the same for everyone. May be called from any thread.
+void DP_canvas_history_networked_set(DP_CanvasHistory *ch, bool networked);
+
+// The context id that the server assigned to the local user. Local commands
+// sent with a context id of zero get matched to echoes carrying this one. May
+// be called from any thread.
+void DP_canvas_history_local_context_id_set(DP_CanvasHistory *ch,
+                                            unsigned int context_id);
+
 bool DP_canvas_history_handle(DP_CanvasHistory *ch, DP_DrawContext *dc,
                               DP_Message *msg);
 
+// Whether a command sent by the local user can be applied to the local fork.
+// Undos depend on the history, so they can't be predicted locally.
+bool DP_canvas_history_can_handle_local(DP_MessageType type);
+
+// Applies a command sent by the local user to the local fork, so that it's
+// visible before the server echoes it back. Only fails for messages that can't
+// be predicted locally, see DP_canvas_history_can_handle_local.
+bool DP_canvas_history_handle_local(DP_CanvasHistory *ch, DP_DrawContext *dc,
+                                    DP_Message *msg);
+
+// Takes the tiles that only savepoints a few undo points back are holding on
+// to and compresses them on the worker, one savepoint at a time. Call this
+// when there's nothing else to do: it picks up the previous result if it's
+// done and starts on the next savepoint. An undo to a compressed savepoint
+// inflates it again. Without a worker, one savepoint gets compressed right
+// away on the calling thread instead.
+void DP_canvas_history_compress_savepoints(DP_CanvasHistory *ch,
+                                           DP_Worker *worker);
+
+
+// Collects runs of consecutive messages that each change only a single layer,
+// all different ones (see DP_canvas_state_message_layer_id), and handles them
+// at the same time: one on the calling thread, the rest on the worker. The
+// outcome is the same as handling them one after another. Other messages get
+// handled right away, after flushing anything held back before them.
+typedef struct DP_CanvasHistoryBatcher DP_CanvasHistoryBatcher;
+
+// The draw context is used on the calling thread and isn't owned, the worker
+// may be NULL, in which case nothing is handled in parallel.
+DP_CanvasHistoryBatcher *DP_canvas_history_batcher_new(DP_Worker *worker,
+                                                       DP_DrawContext *dc);
+
+// Held back messages must have been flushed before this.
+void DP_canvas_history_batcher_free(DP_CanvasHistoryBatcher *chb);
+
+// May hold back the message to handle it together with following ones. Errors
+// from handling several messages at once are logged, this returns false if
+// there were any.
+bool DP_canvas_history_batcher_handle(DP_CanvasHistoryBatcher *chb,
+                                      DP_CanvasHistory *ch, DP_Message *msg);
+
+// Handles any held back messages, call it when there's no more messages to be
+// had right now, since they won't become visible before that.
+bool DP_canvas_history_batcher_flush(DP_CanvasHistoryBatcher *chb,
+                                     DP_CanvasHistory *ch);
+
 
 #endif
@@ -27,10 +27,12 @@
 #include "layer.h"
 #include "layer_list.h"
 #include "paint.h"
+#include "perf.h"
 #include "tile.h"
 #include <dpcommon/common.h>
 #include <dpcommon/conversions.h>
 #include <dpcommon/geom.h>
+#include <dpcommon/trace.h>
 #include <dpmsg/message.h>
 #include <dpmsg/messages/canvas_background.h>
 #include <dpmsg/messages/canvas_resize.h>
@@ -135,6 +137,20 @@ bool DP_canvas_state_transient(DP_CanvasState *cs)
     return cs->transient;
 }
 
+int DP_canvas_state_width(DP_CanvasState *cs)
+{
+    DP_ASSERT(cs);
+    DP_ASSERT(SDL_AtomicGet(&cs->refcount) > 0);
+    return cs->width;
+}
+
+int DP_canvas_state_height(DP_CanvasState *cs)
+{
+    DP_ASSERT(cs);
+    DP_ASSERT(SDL_AtomicGet(&cs->refcount) > 0);
+    return cs->height;
+}
+
 
 static DP_TransientLayerList *
 get_transient_layer_list(DP_TransientCanvasState *tcs, int reserve)
@@ -622,15 +638,9 @@ handle_draw_dabs(DP_CanvasState *cs, DP_DrawContext *dc, DP_MessageType type,
     }
 }
 
-DP_CanvasState *DP_canvas_state_handle(DP_CanvasState *cs, DP_DrawContext *dc,
-                                       DP_Message *msg)
+static DP_CanvasState *handle(DP_CanvasState *cs, DP_DrawContext *dc,
+                              DP_MessageType type, DP_Message *msg)
 {
-    DP_ASSERT(cs);
-    DP_ASSERT(msg);
-    DP_ASSERT(SDL_AtomicGet(&cs->refcount) > 0);
-    DP_ASSERT(!cs->transient);
-    DP_MessageType type = DP_message_type(msg);
-    DP_debug("Draw command %d %s", (int)type, DP_message_type_enum_name(type));
     switch (type) {
     case DP_MSG_CANVAS_RESIZE:
         return handle_canvas_resize(cs, DP_message_context_id(msg),
@@ -679,6 +689,78 @@ DP_CanvasState *DP_canvas_state_handle(DP_CanvasState *cs, DP_DrawContext *dc,
     }
 }
 
+DP_CanvasState *DP_canvas_state_handle(DP_CanvasState *cs, DP_DrawContext *dc,
+                                       DP_Message *msg)
+{
+    DP_ASSERT(cs);
+    DP_ASSERT(msg);
+    DP_ASSERT(SDL_AtomicGet(&cs->refcount) > 0);
+    DP_ASSERT(!cs->transient);
+    DP_MessageType type = DP_message_type(msg);
+    DP_debug("Draw command %d %s", (int)type, DP_message_type_enum_name(type));
+    unsigned long long start = DP_perf_begin();
+    DP_TRACE_BEGIN(DP_message_type_enum_name_unprefixed(type));
+    DP_CanvasState *next = handle(cs, dc, type, msg);
+    DP_TRACE_END();
+    DP_perf_end(DP_PERF_HANDLE, type, start);
+    return next;
+}
+
+bool DP_canvas_state_message_layer_id(DP_Message *msg, int *out_layer_id)
+{
+    DP_ASSERT(msg);
+    DP_ASSERT(out_layer_id);
+    switch (DP_message_type(msg)) {
+    case DP_MSG_PUT_IMAGE:
+        *out_layer_id = DP_msg_put_image_layer_id(DP_msg_put_image_cast(msg));
+        return true;
+    case DP_MSG_FILL_RECT:
+        *out_layer_id = DP_msg_fill_rect_layer_id(DP_msg_fill_rect_cast(msg));
+        return true;
+    case DP_MSG_PUT_TILE:
+        *out_layer_id = DP_msg_put_tile_layer_id(DP_msg_put_tile_cast(msg));
+        return true;
+    case DP_MSG_DRAW_DABS_CLASSIC:
+    case DP_MSG_DRAW_DABS_PIXEL:
+    case DP_MSG_DRAW_DABS_PIXEL_SQUARE:
+        *out_layer_id = DP_msg_draw_dabs_layer_id(DP_msg_draw_dabs_cast(msg));
+        return true;
+    default:
+        return false;
+    }
+}
+
+DP_CanvasState *DP_canvas_state_stitch_layers(DP_CanvasState *cs, int count,
+                                              DP_CanvasState **results,
+                                              const int *layer_ids)
+{
+    DP_ASSERT(cs);
+    DP_ASSERT(SDL_AtomicGet(&cs->refcount) > 0);
+    DP_ASSERT(!cs->transient);
+    DP_ASSERT(results);
+    DP_ASSERT(layer_ids);
+    DP_TransientCanvasState *tcs = DP_transient_canvas_state_new(cs);
+    DP_TransientLayerList *tll = NULL;
+    for (int i = 0; i < count; ++i) {
+        DP_CanvasState *result = results[i];
+        if (result && result != cs) {
+            DP_ASSERT(result->width == cs->width);
+            DP_ASSERT(result->height == cs->height);
+            DP_LayerList *ll = result->layers;
+            int index = DP_layer_list_layer_index_by_id(ll, layer_ids[i]);
+            DP_ASSERT(index >= 0);
+            DP_ASSERT(index == DP_layer_list_layer_index_by_id(cs->layers,
+                                                               layer_ids[i]));
+            if (!tll) {
+                tll = get_transient_layer_list(tcs, 0);
+            }
+            DP_transient_layer_list_set_inc(
+                tll, DP_layer_list_at_noinc(ll, index), index);
+        }
+    }
+    return DP_transient_canvas_state_persist(tcs);
+}
+
 DP_Image *DP_canvas_state_to_flat_image(DP_CanvasState *cs, unsigned int flags)
 {
     DP_ASSERT(cs);
@@ -693,6 +775,7 @@ DP_Image *DP_canvas_state_to_flat_image(DP_CanvasState *cs, unsigned int flags)
     // background tile if requested, otherwise leave it transparent.
     bool include_background = flags & DP_FLAT_IMAGE_INCLUDE_BACKGROUND;
     DP_Tile *background_tile = include_background ? cs->background_tile : NULL;
+    DP_TRACE_BEGIN("flatten_image");
     DP_TransientLayer *tl =
         DP_transient_layer_new_init(0, width, height, background_tile);
 
@@ -703,6 +786,7 @@ DP_Image *DP_canvas_state_to_flat_image(DP_CanvasState *cs, unsigned int flags)
     DP_Layer *l = DP_transient_layer_persist(tl);
     DP_Image *img = DP_layer_to_image(l);
     DP_layer_decref(l);
+    DP_TRACE_END();
     return img;
 }
 
@@ -764,11 +848,37 @@ void DP_canvas_state_render(DP_CanvasState *cs, DP_TransientLayer *target,
     DP_ASSERT(cs);
     DP_ASSERT(target);
     DP_ASSERT(diff);
+    DP_TRACE_BEGIN("flatten");
     DP_transient_layer_resize_to(target, 0, cs->width, cs->height);
     DP_canvas_diff_each_index(diff, render_tile, (void *[]){cs, target});
+    DP_TRACE_END();
 }
 
 
+DP_CanvasState *DP_canvas_state_take_unshared_tiles(DP_CanvasState *cs,
+                                                    DP_CanvasState *newer,
+                                                    DP_LayerTakeTileFn fn,
+                                                    void *user)
+{
+    DP_ASSERT(cs);
+    DP_ASSERT(newer);
+    DP_ASSERT(SDL_AtomicGet(&cs->refcount) > 0);
+    DP_ASSERT(SDL_AtomicGet(&newer->refcount) > 0);
+    DP_ASSERT(!cs->transient);
+    DP_LayerList *ll = DP_layer_list_take_unshared_tiles(
+        cs->layers, newer->layers, 0, fn, user);
+    if (ll == cs->layers) {
+        DP_layer_list_decref(ll);
+        return DP_canvas_state_incref(cs);
+    }
+    else {
+        DP_TransientCanvasState *tcs = DP_transient_canvas_state_new(cs);
+        DP_layer_list_decref(tcs->layers);
+        tcs->layers = ll;
+        return DP_transient_canvas_state_persist(tcs);
+    }
+}
+
 DP_LayerList *DP_canvas_state_layers_noinc(DP_CanvasState *cs)
 {
     DP_ASSERT(cs);
@@ -819,6 +929,13 @@ DP_CanvasState *DP_transient_canvas_state_persist(DP_TransientCanvasState *tcs)
     return (DP_CanvasState *)tcs;
 }
 
+DP_TransientLayerList *
+DP_transient_canvas_state_transient_layers(DP_TransientCanvasState *tcs,
+                                           int reserve)
+{
+    return get_transient_layer_list(tcs, reserve);
+}
+
 
 bool DP_transient_canvas_state_resize(DP_TransientCanvasState *tcs,
                                       unsigned int context_id, int top,
@@ -39,12 +39,17 @@ typedef struct DP_Tile DP_Tile;
 typedef struct DP_CanvasState DP_CanvasState;
 typedef struct DP_TransientCanvasState DP_TransientCanvasState;
 typedef struct DP_TransientLayer DP_TransientLayer;
+typedef struct DP_TransientLayerList DP_TransientLayerList;
 #else
 typedef struct DP_CanvasState DP_CanvasState;
 typedef struct DP_CanvasState DP_TransientCanvasState;
 typedef struct DP_Layer DP_TransientLayer;
+typedef struct DP_LayerList DP_TransientLayerList;
 #endif
 
+typedef void (*DP_LayerTakeTileFn)(void *user, int layer_id, int sublayer_id,
+                                   int x, int y, DP_Tile *tile);
+
 DP_CanvasState *DP_canvas_state_new(void);
 
 DP_CanvasState *DP_canvas_state_incref(DP_CanvasState *cs);
@@ -55,9 +60,27 @@ int DP_canvas_state_refcount(DP_CanvasState *cs);
 
 bool DP_canvas_state_transient(DP_CanvasState *cs);
 
+int DP_canvas_state_width(DP_CanvasState *cs);
+
+int DP_canvas_state_height(DP_CanvasState *cs);
+
 DP_CanvasState *DP_canvas_state_handle(DP_CanvasState *cs, DP_DrawContext *dc,
                                        DP_Message *msg);
 
+// If the message only ever changes the one top-level layer it targets, puts
+// that layer's id into out_layer_id and returns true. Such messages on
+// different layers don't affect each other, so they can be handled at the
+// same time and then be stitched together.
+bool DP_canvas_state_message_layer_id(DP_Message *msg, int *out_layer_id);
+
+// Makes a new state from the given one, with the layers of the given ids taken
+// from the corresponding results. Results must have come from handling
+// messages on the given state that only change those layers, NULL results are
+// skipped.
+DP_CanvasState *DP_canvas_state_stitch_layers(DP_CanvasState *cs, int count,
+                                              DP_CanvasState **results,
+                                              const int *layer_ids);
+
 DP_Image *DP_canvas_state_to_flat_image(DP_CanvasState *cs, unsigned int flags);
 
 DP_Tile *DP_canvas_state_flatten_tile(DP_CanvasState *cs, int tile_index);
@@ -68,6 +91,15 @@ void DP_canvas_state_diff(DP_CanvasState *cs, DP_CanvasState *prev_or_null,
 void DP_canvas_state_render(DP_CanvasState *cs, DP_TransientLayer *target,
                             DP_CanvasDiff *diff);
 
+// Returns a copy of the state with every layer tile taken out that isn't at
+// the same position in the given newer state and isn't shared with anything
+// else either, see
+// DP_layer_take_unshared_tiles. The background tile always stays.
+DP_CanvasState *DP_canvas_state_take_unshared_tiles(DP_CanvasState *cs,
+                                                    DP_CanvasState *newer,
+                                                    DP_LayerTakeTileFn fn,
+                                                    void *user);
+
 DP_LayerList *DP_canvas_state_layers_noinc(DP_CanvasState *cs);
 
 
@@ -82,6 +114,10 @@ int DP_transient_canvas_state_refcount(DP_TransientCanvasState *cs);
 
 DP_CanvasState *DP_transient_canvas_state_persist(DP_TransientCanvasState *tcs);
 
+DP_TransientLayerList *
+DP_transient_canvas_state_transient_layers(DP_TransientCanvasState *tcs,
+                                           int reserve);
+
 
 bool DP_transient_canvas_state_resize(DP_TransientCanvasState *tcs,
                                       unsigned int context_id, int top,
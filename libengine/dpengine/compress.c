@@ -98,3 +98,133 @@ bool DP_compress_inflate(const unsigned char *in, size_t in_size,
 
     return true;
 }
+
+bool DP_compress_inflate_chunked(const unsigned char *in, size_t in_size,
+                                 size_t expected_size, unsigned char *buffer,
+                                 DP_CompressInflateChunkFn fn, void *user)
+{
+    DP_ASSERT(buffer);
+    DP_ASSERT(fn);
+    if (in_size < 4) {
+        DP_error_set("Inflate input too short to fit header");
+        return false;
+    }
+
+    size_t out_size = DP_read_bigendian_uint32(in);
+    if (out_size != expected_size) {
+        DP_error_set("Inflate needs size %zu, but got %zu", expected_size,
+                     out_size);
+        return false;
+    }
+
+    z_stream stream = {0};
+    stream.zalloc = malloc_z;
+    stream.zfree = free_z;
+
+    int ret = inflateInit(&stream);
+    if (ret != Z_OK) {
+        DP_error_set("Inflate init error %d: %s", ret, get_z_error(&stream));
+        return false;
+    }
+
+    stream.avail_in = DP_size_to_uint(in_size - 4);
+    stream.next_in = (z_const unsigned char *)(in + 4);
+
+    size_t done = 0;
+    size_t chunk_size = fn(user, NULL, 0);
+    while (done < out_size) {
+        DP_ASSERT(chunk_size > 0);
+        DP_ASSERT(chunk_size <= out_size - done);
+        stream.avail_out = DP_size_to_uint(chunk_size);
+        stream.next_out = buffer;
+        ret = inflate(&stream, Z_NO_FLUSH);
+        if (ret != Z_OK && ret != Z_STREAM_END) {
+            DP_error_set("Inflate decompression error %d: %s", ret,
+                         get_z_error(&stream));
+            free_z_stream(&stream);
+            return false;
+        }
+        else if (stream.avail_out != 0) {
+            DP_error_set("Inflate result is %zu bytes too short",
+                         out_size - done - chunk_size + stream.avail_out);
+            free_z_stream(&stream);
+            return false;
+        }
+        done += chunk_size;
+        chunk_size = fn(user, buffer, chunk_size);
+    }
+
+    // The output is full, so there mustn't be anything left to inflate.
+    if (ret != Z_STREAM_END) {
+        unsigned char extra;
+        stream.avail_out = 1;
+        stream.next_out = &extra;
+        ret = inflate(&stream, Z_FINISH);
+        if (ret != Z_STREAM_END || stream.avail_out == 0) {
+            DP_error_set("Inflate decompression error %d: %s", ret,
+                         get_z_error(&stream));
+            free_z_stream(&stream);
+            return false;
+        }
+    }
+
+    free_z_stream(&stream);
+    return true;
+}
+
+
+static void free_z_deflate_stream(z_stream *stream)
+{
+    int ret = deflateEnd(stream);
+    if (ret != Z_OK && ret != Z_DATA_ERROR) {
+        DP_warn("Deflate end error %d: %s", ret, get_z_error(stream));
+    }
+}
+
+size_t DP_compress_deflate(const unsigned char *in, size_t in_size,
+                           unsigned char *(*get_output_buffer)(size_t, void *),
+                           void *user)
+{
+    DP_ASSERT(in || in_size == 0);
+    DP_ASSERT(get_output_buffer);
+    if (in_size > UINT32_MAX) {
+        DP_error_set("Deflate input of %zu bytes too large", in_size);
+        return 0;
+    }
+
+    z_stream stream = {0};
+    stream.zalloc = malloc_z;
+    stream.zfree = free_z;
+
+    int ret = deflateInit(&stream, Z_BEST_SPEED);
+    if (ret != Z_OK) {
+        DP_error_set("Deflate init error %d: %s", ret, get_z_error(&stream));
+        return 0;
+    }
+
+    size_t bound =
+        DP_ulong_to_size(deflateBound(&stream, DP_size_to_ulong(in_size)));
+    unsigned char *out = get_output_buffer(bound + 4, user);
+    if (!out) {
+        free_z_deflate_stream(&stream);
+        return 0; // The function should have already set the error message.
+    }
+
+    DP_write_bigendian_uint32(DP_size_to_uint32(in_size), out);
+    stream.avail_in = DP_size_to_uint(in_size);
+    stream.next_in = (z_const unsigned char *)in;
+    stream.avail_out = DP_size_to_uint(bound);
+    stream.next_out = out + 4;
+
+    ret = deflate(&stream, Z_FINISH);
+    if (ret != Z_STREAM_END) {
+        DP_error_set("Deflate compression error %d: %s", ret,
+                     get_z_error(&stream));
+        free_z_deflate_stream(&stream);
+        return 0;
+    }
+
+    size_t out_size = DP_ulong_to_size(stream.total_out) + 4;
+    free_z_deflate_stream(&stream);
+    return out_size;
+}
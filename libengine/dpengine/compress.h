@@ -28,5 +28,26 @@ bool DP_compress_inflate(const unsigned char *in, size_t in_size,
                          unsigned char *(*get_output_buffer)(size_t, void *),
                          void *user);
 
+// Called with each chunk of inflated output, returns how many bytes the next
+// chunk should have. The first call happens before inflating anything and
+// gets a NULL chunk with a size of zero.
+typedef size_t (*DP_CompressInflateChunkFn)(void *user, unsigned char *chunk,
+                                            size_t chunk_size);
+
+// Like DP_compress_inflate, but inflates into the given buffer piece by piece
+// instead of needing space for the whole output at once. The inflated size
+// must match the expected size and the chunk sizes must fit into the buffer.
+bool DP_compress_inflate_chunked(const unsigned char *in, size_t in_size,
+                                 size_t expected_size, unsigned char *buffer,
+                                 DP_CompressInflateChunkFn fn, void *user);
+
+
+// Compresses the input at the fastest level into the format that
+// DP_compress_inflate reads. The output buffer gets requested with an upper
+// bound of the size needed, returns the actual size or 0 on error.
+size_t DP_compress_deflate(const unsigned char *in, size_t in_size,
+                           unsigned char *(*get_output_buffer)(size_t, void *),
+                           void *user);
+
 
 #endif
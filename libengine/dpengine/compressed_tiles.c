@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2022 askmeaboutloom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "compressed_tiles.h"
+#include "canvas_state.h"
+#include "layer_list.h"
+#include "tile.h"
+#include <dpcommon/common.h>
+#include <dpcommon/conversions.h>
+#include <dpcommon/memory_stats.h>
+
+
+typedef struct DP_CompressedTile {
+    int layer_id, sublayer_id;
+    int x, y;
+    unsigned int context_id;
+    size_t offset, size;
+} DP_CompressedTile;
+
+struct DP_CompressedTiles {
+    int capacity;
+    int count;
+    DP_CompressedTile *tiles;
+    size_t data_capacity;
+    size_t data_used;
+    unsigned char *data;
+};
+
+
+DP_CompressedTiles *DP_compressed_tiles_new(void)
+{
+    DP_CompressedTiles *ct = DP_malloc(sizeof(*ct));
+    *ct = (DP_CompressedTiles){0, 0, NULL, 0, 0, NULL};
+    DP_memory_add(DP_MEMORY_HISTORY, sizeof(*ct));
+    return ct;
+}
+
+void DP_compressed_tiles_free(DP_CompressedTiles *ct)
+{
+    if (ct) {
+        DP_memory_sub(DP_MEMORY_HISTORY,
+                      sizeof(*ct)
+                          + sizeof(*ct->tiles) * DP_int_to_size(ct->capacity)
+                          + ct->data_capacity);
+        DP_free(ct->data);
+        DP_free(ct->tiles);
+        DP_free(ct);
+    }
+}
+
+int DP_compressed_tiles_count(DP_CompressedTiles *ct)
+{
+    DP_ASSERT(ct);
+    return ct->count;
+}
+
+size_t DP_compressed_tiles_size(DP_CompressedTiles *ct)
+{
+    DP_ASSERT(ct);
+    return ct->data_used;
+}
+
+
+static void reserve_tiles(DP_CompressedTiles *ct, int count)
+{
+    int capacity = ct->capacity;
+    if (ct->count + count > capacity) {
+        int new_capacity = DP_max_int(ct->count + count, capacity * 2);
+        ct->tiles = DP_realloc(ct->tiles, sizeof(*ct->tiles)
+                                              * DP_int_to_size(new_capacity));
+        DP_memory_add(DP_MEMORY_HISTORY,
+                      sizeof(*ct->tiles)
+                          * DP_int_to_size(new_capacity - capacity));
+        ct->capacity = new_capacity;
+    }
+}
+
+static void resize_data(DP_CompressedTiles *ct, size_t data_capacity)
+{
+    size_t old_capacity = ct->data_capacity;
+    ct->data = DP_realloc(ct->data, data_capacity);
+    ct->data_capacity = data_capacity;
+    if (data_capacity > old_capacity) {
+        DP_memory_add(DP_MEMORY_HISTORY, data_capacity - old_capacity);
+    }
+    else {
+        DP_memory_sub(DP_MEMORY_HISTORY, old_capacity - data_capacity);
+    }
+}
+
+static void reserve_data(DP_CompressedTiles *ct, size_t size)
+{
+    size_t needed = ct->data_used + size;
+    if (needed > ct->data_capacity) {
+        resize_data(ct, DP_max_size(needed, ct->data_capacity * 2));
+    }
+}
+
+static unsigned char *get_output_buffer(size_t size, void *user)
+{
+    DP_CompressedTiles *ct = user;
+    reserve_data(ct, size);
+    return ct->data + ct->data_used;
+}
+
+static void take_tile(void *user, int layer_id, int sublayer_id, int x, int y,
+                      DP_Tile *tile)
+{
+    DP_CompressedTiles *ct = user;
+    size_t size = DP_tile_compress(tile, get_output_buffer, ct);
+    if (size == 0) {
+        // Can't happen unless we're out of memory, so the tile is lost.
+        DP_warn("Error compressing tile: %s", DP_error());
+    }
+    else {
+        reserve_tiles(ct, 1);
+        ct->tiles[ct->count++] = (DP_CompressedTile){
+            layer_id, sublayer_id, x, y, DP_tile_context_id(tile),
+            ct->data_used, size};
+        ct->data_used += size;
+    }
+    DP_tile_decref(tile);
+}
+
+DP_CanvasState *DP_compressed_tiles_take(DP_CompressedTiles *ct,
+                                         DP_CanvasState *cs,
+                                         DP_CanvasState *newer)
+{
+    DP_ASSERT(ct);
+    DP_ASSERT(cs);
+    DP_ASSERT(newer);
+    DP_CanvasState *result =
+        DP_canvas_state_take_unshared_tiles(cs, newer, take_tile, ct);
+    // The output buffer grows generously, don't keep the slack around.
+    if (ct->data_used != 0 && ct->data_capacity > ct->data_used) {
+        resize_data(ct, ct->data_used);
+    }
+    return result;
+}
+
+void DP_compressed_tiles_append(DP_CompressedTiles *ct,
+                                DP_CompressedTiles *other)
+{
+    DP_ASSERT(ct);
+    DP_ASSERT(other);
+    int count = other->count;
+    if (count != 0) {
+        reserve_tiles(ct, count);
+        size_t base = ct->data_used;
+        for (int i = 0; i < count; ++i) {
+            DP_CompressedTile *tile = &ct->tiles[ct->count + i];
+            *tile = other->tiles[i];
+            tile->offset += base;
+        }
+        ct->count += count;
+        resize_data(ct, base + other->data_used);
+        memcpy(ct->data + base, other->data, other->data_used);
+        ct->data_used = base + other->data_used;
+    }
+    DP_compressed_tiles_free(other);
+}
+
+DP_CanvasState *DP_compressed_tiles_restore(DP_CompressedTiles *ct,
+                                            DP_CanvasState *cs)
+{
+    DP_ASSERT(ct);
+    DP_ASSERT(cs);
+    int count = ct->count;
+    if (count == 0) {
+        return DP_canvas_state_incref(cs);
+    }
+
+    DP_TransientCanvasState *tcs = DP_transient_canvas_state_new(cs);
+    DP_TransientLayerList *tll =
+        DP_transient_canvas_state_transient_layers(tcs, 0);
+    for (int i = 0; i < count; ++i) {
+        DP_CompressedTile *t = &ct->tiles[i];
+        DP_Tile *tile = DP_tile_new_from_compressed(
+            t->context_id, ct->data + t->offset, t->size);
+        bool ok = tile
+               && DP_transient_layer_list_put_tile(tll, tile, t->layer_id,
+                                                   t->sublayer_id, t->x, t->y,
+                                                   0);
+        DP_tile_decref_nullable(tile);
+        if (!ok) {
+            DP_transient_canvas_state_decref(tcs);
+            return NULL;
+        }
+    }
+    return DP_transient_canvas_state_persist(tcs);
+}
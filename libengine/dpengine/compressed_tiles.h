@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2022 askmeaboutloom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef DPENGINE_COMPRESSED_TILES_H
+#define DPENGINE_COMPRESSED_TILES_H
+#include <dpcommon/common.h>
+
+typedef struct DP_CanvasState DP_CanvasState;
+
+
+// Layer tiles taken out of a canvas state and kept compressed, along with
+// where they go, so that the state can be put back together later. Used for
+// savepoints in the history that undos are unlikely to reach, since those
+// would otherwise keep a full copy of every tile they don't share.
+
+typedef struct DP_CompressedTiles DP_CompressedTiles;
+
+DP_CompressedTiles *DP_compressed_tiles_new(void);
+
+void DP_compressed_tiles_free(DP_CompressedTiles *ct);
+
+int DP_compressed_tiles_count(DP_CompressedTiles *ct);
+
+// Size of the compressed tile data, without any bookkeeping.
+size_t DP_compressed_tiles_size(DP_CompressedTiles *ct);
+
+
+// Takes the layer tiles out of cs that aren't at the same position in newer
+// and aren't shared with anything else either, like other savepoints, and
+// compresses them into ct. Returns cs without those tiles, which gets
+// put back together by DP_compressed_tiles_restore. Doesn't touch anything
+// but the given compressed tiles, so it can run on any thread.
+DP_CanvasState *DP_compressed_tiles_take(DP_CompressedTiles *ct,
+                                         DP_CanvasState *cs,
+                                         DP_CanvasState *newer);
+
+// Moves the tiles from other into ct and frees other.
+void DP_compressed_tiles_append(DP_CompressedTiles *ct,
+                                DP_CompressedTiles *other);
+
+// Returns a copy of cs with the tiles put back in, or NULL on error.
+DP_CanvasState *DP_compressed_tiles_restore(DP_CompressedTiles *ct,
+                                            DP_CanvasState *cs);
+
+
+#endif
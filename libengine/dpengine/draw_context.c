@@ -29,6 +29,7 @@
 #include "draw_context.h"
 #include "pixels.h"
 #include <dpcommon/common.h>
+#include <dpcommon/memory_stats.h>
 
 
 struct DP_DrawContext {
@@ -46,6 +47,9 @@ struct DP_DrawContext {
     // Memory pool used by qgrayraster during region move transform.
     size_t raster_pool_size;
     unsigned char *raster_pool;
+    // Optional worker for painting large draw dabs messages, not owned.
+    DP_Worker *paint_worker;
+    int paint_parallel_min_area;
 };
 
 
@@ -54,12 +58,18 @@ DP_DrawContext *DP_draw_context_new(void)
     DP_DrawContext *dc = DP_malloc(sizeof(*dc));
     dc->raster_pool_size = DP_DRAW_CONTEXT_RASTER_POOL_MIN_SIZE;
     dc->raster_pool = DP_malloc(DP_DRAW_CONTEXT_RASTER_POOL_MIN_SIZE);
+    DP_memory_add(DP_MEMORY_DRAW_CONTEXTS,
+                  sizeof(*dc) + DP_DRAW_CONTEXT_RASTER_POOL_MIN_SIZE);
+    dc->paint_worker = NULL;
+    dc->paint_parallel_min_area = DP_DRAW_CONTEXT_PAINT_PARALLEL_MIN_AREA;
     return dc;
 }
 
 void DP_draw_context_free(DP_DrawContext *dc)
 {
     if (dc) {
+        DP_memory_sub(DP_MEMORY_DRAW_CONTEXTS,
+                      sizeof(*dc) + dc->raster_pool_size);
         DP_free(dc->raster_pool);
         DP_free(dc);
     }
@@ -96,9 +106,38 @@ unsigned char *DP_draw_context_raster_pool_resize(DP_DrawContext *dc,
 {
     DP_ASSERT(dc);
     DP_ASSERT(new_size < DP_DRAW_CONTEXT_RASTER_POOL_MAX_SIZE);
+    DP_memory_sub(DP_MEMORY_DRAW_CONTEXTS, dc->raster_pool_size);
+    DP_memory_add(DP_MEMORY_DRAW_CONTEXTS, new_size);
     DP_free(dc->raster_pool);
     unsigned char *new_raster_pool = DP_malloc(new_size);
     dc->raster_pool = new_raster_pool;
     dc->raster_pool_size = new_size;
     return new_raster_pool;
 }
+
+void DP_draw_context_reclaim(DP_DrawContext *dc)
+{
+    DP_ASSERT(dc);
+    if (dc->raster_pool_size > DP_DRAW_CONTEXT_RASTER_POOL_MIN_SIZE) {
+        DP_draw_context_raster_pool_resize(
+            dc, DP_DRAW_CONTEXT_RASTER_POOL_MIN_SIZE);
+    }
+}
+
+void DP_draw_context_paint_worker_set(DP_DrawContext *dc, DP_Worker *worker,
+                                      int min_area)
+{
+    DP_ASSERT(dc);
+    DP_ASSERT(min_area >= 0);
+    dc->paint_worker = worker;
+    dc->paint_parallel_min_area = min_area;
+}
+
+DP_Worker *DP_draw_context_paint_worker(DP_DrawContext *dc, int *out_min_area)
+{
+    DP_ASSERT(dc);
+    if (out_min_area) {
+        *out_min_area = dc->paint_parallel_min_area;
+    }
+    return dc->paint_worker;
+}
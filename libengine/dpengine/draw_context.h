@@ -30,6 +30,7 @@
 #define DPENGINE_DRAW_CONTEXT_H
 #include <dpcommon/common.h>
 
+typedef struct DP_Worker DP_Worker;
 typedef union DP_Pixel DP_Pixel;
 
 
@@ -41,6 +42,8 @@ typedef union DP_Pixel DP_Pixel;
 #define DP_DRAW_CONTEXT_RASTER_POOL_MIN_SIZE  8192
 #define DP_DRAW_CONTEXT_RASTER_POOL_MAX_SIZE  (1024 * 1024)
 
+#define DP_DRAW_CONTEXT_PAINT_PARALLEL_MIN_AREA (256 * 1024)
+
 typedef struct DP_DrawContext DP_DrawContext;
 
 DP_DrawContext *DP_draw_context_new(void);
@@ -58,5 +61,18 @@ unsigned char *DP_draw_context_raster_pool(DP_DrawContext *dc,
 unsigned char *DP_draw_context_raster_pool_resize(DP_DrawContext *dc,
                                                   size_t new_size);
 
+// Shrinks buffers that grew for an earlier operation back to their initial
+// size, for when memory is tight. They'll just grow again when needed.
+void DP_draw_context_reclaim(DP_DrawContext *dc);
+
+// Lets draw dabs messages be painted in parallel on the given worker, which
+// must outlive the draw context. Messages whose dabs cover less than min_area
+// pixels in total are still painted serially, since it's not worth it for
+// them. Pass NULL to go back to painting everything serially.
+void DP_draw_context_paint_worker_set(DP_DrawContext *dc, DP_Worker *worker,
+                                      int min_area);
+
+DP_Worker *DP_draw_context_paint_worker(DP_DrawContext *dc, int *out_min_area);
+
 
 #endif
@@ -23,11 +23,13 @@
 #include "blend_mode.h"
 #include "canvas_diff.h"
 #include "canvas_state.h"
+#include "compress.h"
 #include "image.h"
 #include "layer_list.h"
 #include "paint.h"
 #include "pixels.h"
 #include "tile.h"
+#include <dpcommon/binary.h>
 #include <dpcommon/common.h>
 #include <dpcommon/conversions.h>
 #include <dpcommon/geom.h>
@@ -40,25 +42,49 @@ typedef struct DP_LayerTitle {
     char title[];
 } DP_LayerTitle;
 
+// Tiles are stored in a persistent radix tree rather than a flat array, so
+// that making layer data transient doesn't need to copy and incref every tile
+// on the canvas. Modifying a tile only copies the chunks on the path to it,
+// chunks that weren't touched stay shared with the previous layer data.
+// Leaf chunks hold tiles, the ones above hold further chunks. A NULL chunk
+// means that every tile below it is blank. Transient chunks are only ever
+// reachable from a single transient layer data, persistent ones never change.
+#define CHUNK_BITS 6
+#define CHUNK_SIZE (1 << CHUNK_BITS)
+#define CHUNK_MASK (CHUNK_SIZE - 1)
+
+typedef union DP_LayerDataElement {
+    DP_Tile *tile;
+    DP_TransientTile *transient_tile;
+} DP_LayerDataElement;
+
+typedef struct DP_LayerDataChunk DP_LayerDataChunk;
+
+struct DP_LayerDataChunk {
+    SDL_atomic_t refcount;
+    bool transient;
+    union {
+        DP_LayerDataElement elements[CHUNK_SIZE];
+        DP_LayerDataChunk *chunks[CHUNK_SIZE];
+    };
+};
+
 #ifdef DP_NO_STRICT_ALIASING
 
 typedef struct DP_LayerData {
     SDL_atomic_t refcount;
     const bool transient;
     const int width, height;
-    union {
-        DP_Tile *const tile;
-    } elements[];
+    const int depth;
+    DP_LayerDataChunk *const root;
 } DP_LayerData;
 
 typedef struct DP_TransientLayerData {
     SDL_atomic_t refcount;
     bool transient;
     int width, height;
-    union {
-        DP_Tile *tile;
-        DP_TransientTile *transient_tile;
-    } elements[];
+    int depth;
+    DP_LayerDataChunk *root;
 } DP_TransientLayerData;
 
 struct DP_Layer {
@@ -105,10 +131,8 @@ typedef struct DP_LayerData {
     SDL_atomic_t refcount;
     bool transient;
     int width, height;
-    union {
-        DP_Tile *tile;
-        DP_TransientTile *transient_tile;
-    } elements[];
+    int depth;
+    DP_LayerDataChunk *root;
 } DP_LayerData;
 
 typedef struct DP_LayerData DP_TransientLayerData;
@@ -180,18 +204,188 @@ static void layer_title_decref_nullable(DP_LayerTitle *lt)
 }
 
 
+static DP_LayerDataChunk *chunk_new(void)
+{
+    DP_LayerDataChunk *c = DP_malloc(sizeof(*c));
+    SDL_AtomicSet(&c->refcount, 1);
+    c->transient = true;
+    for (int i = 0; i < CHUNK_SIZE; ++i) {
+        c->chunks[i] = NULL;
+    }
+    return c;
+}
+
+static DP_LayerDataChunk *chunk_incref_nullable(DP_LayerDataChunk *c)
+{
+    if (c) {
+        DP_ASSERT(SDL_AtomicGet(&c->refcount) > 0);
+        SDL_AtomicIncRef(&c->refcount);
+    }
+    return c;
+}
+
+// The level is the distance from the leaves, so level 0 chunks hold tiles.
+static void chunk_decref_nullable(DP_LayerDataChunk *c, int level)
+{
+    if (c) {
+        DP_ASSERT(SDL_AtomicGet(&c->refcount) > 0);
+        if (SDL_AtomicDecRef(&c->refcount)) {
+            for (int i = 0; i < CHUNK_SIZE; ++i) {
+                if (level == 0) {
+                    DP_tile_decref_nullable(c->elements[i].tile);
+                }
+                else {
+                    chunk_decref_nullable(c->chunks[i], level - 1);
+                }
+            }
+            DP_free(c);
+        }
+    }
+}
+
+static DP_LayerDataChunk *chunk_copy(DP_LayerDataChunk *c, int level)
+{
+    DP_ASSERT(c);
+    DP_ASSERT(SDL_AtomicGet(&c->refcount) > 0);
+    DP_ASSERT(!c->transient);
+    DP_LayerDataChunk *tc = DP_malloc(sizeof(*tc));
+    SDL_AtomicSet(&tc->refcount, 1);
+    tc->transient = true;
+    for (int i = 0; i < CHUNK_SIZE; ++i) {
+        if (level == 0) {
+            tc->elements[i].tile = DP_tile_incref_nullable(c->elements[i].tile);
+        }
+        else {
+            tc->chunks[i] = chunk_incref_nullable(c->chunks[i]);
+        }
+    }
+    return tc;
+}
+
+static void chunk_persist(DP_LayerDataChunk *c, int level)
+{
+    // Persistent chunks can't contain anything transient, so the walk only
+    // needs to follow the chunks that were modified.
+    if (c && c->transient) {
+        c->transient = false;
+        for (int i = 0; i < CHUNK_SIZE; ++i) {
+            if (level == 0) {
+                DP_Tile *tile = c->elements[i].tile;
+                if (tile && DP_tile_transient(tile)) {
+                    // May swap in an equal tile, see DP_tile_intern_enable.
+                    c->elements[i].tile = DP_transient_tile_persist(
+                        c->elements[i].transient_tile);
+                }
+            }
+            else {
+                chunk_persist(c->chunks[i], level - 1);
+            }
+        }
+    }
+}
+
+static bool chunk_has_content(DP_LayerDataChunk *c, int level)
+{
+    if (c) {
+        for (int i = 0; i < CHUNK_SIZE; ++i) {
+            if (level == 0) {
+                DP_Tile *tile = c->elements[i].tile;
+                if (tile && !DP_tile_blank(tile)) {
+                    return true;
+                }
+            }
+            else if (chunk_has_content(c->chunks[i], level - 1)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static int chunk_index(int tile_index, int level)
+{
+    return (tile_index >> (level * CHUNK_BITS)) & CHUNK_MASK;
+}
+
+static int chunk_depth(int tile_count)
+{
+    int depth = 1;
+    for (int capacity = CHUNK_SIZE; capacity < tile_count;
+         capacity <<= CHUNK_BITS) {
+        ++depth;
+    }
+    return depth;
+}
+
+
 static void *alloc_layer_data(int width, int height)
 {
-    size_t count = DP_int_to_size(DP_tile_total_round(width, height));
-    DP_TransientLayerData *tld =
-        DP_malloc(DP_FLEX_SIZEOF(DP_TransientLayerData, elements, count));
+    DP_TransientLayerData *tld = DP_malloc(sizeof(*tld));
     SDL_AtomicSet(&tld->refcount, 1);
     tld->transient = true;
     tld->width = width;
     tld->height = height;
+    tld->depth = chunk_depth(DP_tile_total_round(width, height));
+    tld->root = NULL;
     return tld;
 }
 
+static DP_Tile *layer_data_tile_at(DP_LayerData *ld, int tile_index)
+{
+    DP_ASSERT(ld);
+    DP_ASSERT(SDL_AtomicGet(&ld->refcount) > 0);
+    DP_ASSERT(tile_index >= 0);
+    DP_ASSERT(tile_index < DP_tile_total_round(ld->width, ld->height));
+    DP_LayerDataChunk *c = ld->root;
+    for (int level = ld->depth - 1; c && level > 0; --level) {
+        c = c->chunks[chunk_index(tile_index, level)];
+    }
+    return c ? c->elements[tile_index & CHUNK_MASK].tile : NULL;
+}
+
+static DP_LayerDataChunk *get_transient_chunk(DP_LayerDataChunk **pp,
+                                              int level)
+{
+    DP_LayerDataChunk *c = *pp;
+    if (!c) {
+        *pp = chunk_new();
+    }
+    else if (!c->transient) {
+        *pp = chunk_copy(c, level);
+        chunk_decref_nullable(c, level);
+    }
+    return *pp;
+}
+
+// Makes the path to the given tile transient and returns its slot, which the
+// caller may then modify freely.
+static DP_LayerDataElement *
+transient_layer_data_element_at(DP_TransientLayerData *tld, int tile_index)
+{
+    DP_ASSERT(tld);
+    DP_ASSERT(SDL_AtomicGet(&tld->refcount) > 0);
+    DP_ASSERT(tld->transient);
+    DP_ASSERT(tile_index >= 0);
+    DP_ASSERT(tile_index < DP_tile_total_round(tld->width, tld->height));
+    DP_LayerDataChunk **pp = &tld->root;
+    for (int level = tld->depth - 1; level > 0; --level) {
+        DP_LayerDataChunk *c = get_transient_chunk(pp, level);
+        pp = &c->chunks[chunk_index(tile_index, level)];
+    }
+    DP_LayerDataChunk *leaf = get_transient_chunk(pp, 0);
+    return &leaf->elements[tile_index & CHUNK_MASK];
+}
+
+// Puts the given tile, taking over its reference, and releases the old one.
+static void transient_layer_data_tile_set(DP_TransientLayerData *tld,
+                                          int tile_index, DP_Tile *tile)
+{
+    DP_LayerDataElement *element =
+        transient_layer_data_element_at(tld, tile_index);
+    DP_tile_decref_nullable(element->tile);
+    element->tile = tile;
+}
+
 static DP_LayerData *layer_data_incref(DP_LayerData *ld)
 {
     DP_ASSERT(ld);
@@ -205,23 +399,147 @@ static void layer_data_decref(DP_LayerData *ld)
     DP_ASSERT(ld);
     DP_ASSERT(SDL_AtomicGet(&ld->refcount) > 0);
     if (SDL_AtomicDecRef(&ld->refcount)) {
-        int count = DP_tile_total_round(ld->width, ld->height);
+        chunk_decref_nullable(ld->root, ld->depth - 1);
+        DP_free(ld);
+    }
+}
+
+// Walks two trees in lockstep, skipping the subtrees they share. Transient
+// layer data copies every chunk on the path to a tile it changes, so only the
+// paths to changed tiles get visited, rather than every tile on the layer. If
+// mark_shared is set, tiles present in both trees are marked even if they're
+// the same, otherwise only differing tiles are.
+static void diff_chunks(DP_LayerDataChunk *a, DP_LayerDataChunk *b, int level,
+                        int offset, int tile_total, bool mark_shared,
+                        DP_CanvasDiff *diff)
+{
+    if (a == b && (!mark_shared || !a)) {
+        return;
+    }
+    else if (level == 0) {
+        int count = DP_min_int(CHUNK_SIZE, tile_total - offset);
         for (int i = 0; i < count; ++i) {
-            DP_tile_decref_nullable(ld->elements[i].tile);
+            DP_Tile *ta = a ? a->elements[i].tile : NULL;
+            DP_Tile *tb = b ? b->elements[i].tile : NULL;
+            if (ta != tb || (mark_shared && ta)) {
+                DP_canvas_diff_mark(diff, offset + i);
+            }
+        }
+    }
+    else {
+        int span = 1 << (CHUNK_BITS * level);
+        for (int i = 0; i < CHUNK_SIZE; ++i) {
+            int child_offset = offset + i * span;
+            if (child_offset >= tile_total) {
+                break;
+            }
+            diff_chunks(a ? a->chunks[i] : NULL, b ? b->chunks[i] : NULL,
+                        level - 1, child_offset, tile_total, mark_shared,
+                        diff);
         }
-        DP_free(ld);
     }
 }
 
-static bool diff_tile(void *data, int tile_index)
+typedef struct DP_LayerTakeTiles {
+    int layer_id, sublayer_id;
+    int xcount, tile_total;
+    DP_LayerTakeTileFn fn;
+    void *user;
+} DP_LayerTakeTiles;
+
+// Walks two trees in lockstep like diff_chunks, copying the chunks on the
+// path to each tile that isn't in the other tree and leaving that tile out of
+// the copy, its reference goes to the callback instead. Chunks and tiles that
+// are also held by anything else, like another savepoint, stay where they are,
+// since taking them out would only duplicate them. Returns a new reference to
+// the chunk itself if nothing got taken out of it.
+static DP_LayerDataChunk *take_chunk_tiles(DP_LayerDataChunk *c,
+                                           DP_LayerDataChunk *p, int level,
+                                           int offset, DP_LayerTakeTiles *ltt)
 {
-    DP_ASSERT(data);
-    DP_ASSERT(tile_index >= 0);
-    DP_LayerData *a = ((DP_LayerData **)data)[0];
-    DP_LayerData *b = ((DP_LayerData **)data)[1];
-    DP_ASSERT(tile_index < DP_tile_total_round(a->width, a->height));
-    DP_ASSERT(tile_index < DP_tile_total_round(b->width, b->height));
-    return a->elements[tile_index].tile != b->elements[tile_index].tile;
+    if (!c || c == p || SDL_AtomicGet(&c->refcount) > 1) {
+        return chunk_incref_nullable(c);
+    }
+
+    DP_LayerDataChunk *tc = NULL;
+    if (level == 0) {
+        int count = DP_min_int(CHUNK_SIZE, ltt->tile_total - offset);
+        for (int i = 0; i < count; ++i) {
+            DP_Tile *tile = c->elements[i].tile;
+            if (tile && (!p || p->elements[i].tile != tile)
+                && DP_tile_refcount(tile) == 1) {
+                if (!tc) {
+                    tc = chunk_copy(c, 0);
+                }
+                tc->elements[i].tile = NULL;
+                int tile_index = offset + i;
+                ltt->fn(ltt->user, ltt->layer_id, ltt->sublayer_id,
+                        tile_index % ltt->xcount, tile_index / ltt->xcount,
+                        tile);
+            }
+        }
+    }
+    else {
+        int span = 1 << (CHUNK_BITS * level);
+        for (int i = 0; i < CHUNK_SIZE; ++i) {
+            int child_offset = offset + i * span;
+            if (child_offset >= ltt->tile_total) {
+                break;
+            }
+            DP_LayerDataChunk *child = c->chunks[i];
+            DP_LayerDataChunk *result = take_chunk_tiles(
+                child, p ? p->chunks[i] : NULL, level - 1, child_offset, ltt);
+            if (result == child) {
+                chunk_decref_nullable(result, level - 1);
+            }
+            else {
+                if (!tc) {
+                    tc = chunk_copy(c, level);
+                }
+                chunk_decref_nullable(tc->chunks[i], level - 1);
+                tc->chunks[i] = result;
+            }
+        }
+    }
+
+    if (tc) {
+        tc->transient = false;
+        return tc;
+    }
+    else {
+        return chunk_incref_nullable(c);
+    }
+}
+
+static DP_LayerData *layer_data_take_tiles(DP_LayerData *ld,
+                                           DP_LayerData *prev_or_null,
+                                           DP_LayerTakeTiles *ltt)
+{
+    DP_ASSERT(ld);
+    DP_ASSERT(SDL_AtomicGet(&ld->refcount) > 0);
+    DP_ASSERT(!ld->transient);
+    if (SDL_AtomicGet(&ld->refcount) > 1) {
+        return layer_data_incref(ld);
+    }
+    // Tiles of differently sized layers don't line up, so nothing is shared.
+    DP_LayerDataChunk *p = prev_or_null && prev_or_null->width == ld->width
+                                && prev_or_null->height == ld->height
+                             ? prev_or_null->root
+                             : NULL;
+    ltt->xcount = DP_tile_count_round(ld->width);
+    ltt->tile_total = DP_tile_total_round(ld->width, ld->height);
+    int level = ld->depth - 1;
+    DP_LayerDataChunk *root = take_chunk_tiles(ld->root, p, level, 0, ltt);
+    if (root == ld->root) {
+        chunk_decref_nullable(root, level);
+        return layer_data_incref(ld);
+    }
+    else {
+        DP_TransientLayerData *tld = alloc_layer_data(ld->width, ld->height);
+        tld->transient = false;
+        tld->root = root;
+        return (DP_LayerData *)tld;
+    }
 }
 
 static void layer_data_diff(DP_LayerData *ld, DP_LayerData *prev,
@@ -234,18 +552,9 @@ static void layer_data_diff(DP_LayerData *ld, DP_LayerData *prev,
     DP_ASSERT(SDL_AtomicGet(&prev->refcount) > 0);
     DP_ASSERT(ld->width == prev->width);   // Different sizes could be
     DP_ASSERT(ld->height == prev->height); // supported, but aren't yet.
-    DP_canvas_diff_check(diff, diff_tile, (DP_LayerData *[]){ld, prev});
-}
-
-static bool mark_both(void *data, int tile_index)
-{
-    DP_ASSERT(data);
-    DP_ASSERT(tile_index >= 0);
-    DP_LayerData *a = ((DP_LayerData **)data)[0];
-    DP_LayerData *b = ((DP_LayerData **)data)[1];
-    DP_ASSERT(tile_index < DP_tile_total_round(a->width, a->height));
-    DP_ASSERT(tile_index < DP_tile_total_round(b->width, b->height));
-    return a->elements[tile_index].tile || b->elements[tile_index].tile;
+    DP_ASSERT(ld->depth == prev->depth);
+    diff_chunks(ld->root, prev->root, ld->depth - 1, 0,
+                DP_tile_total_round(ld->width, ld->height), false, diff);
 }
 
 static void layer_data_diff_mark_both(DP_LayerData *ld, DP_LayerData *prev,
@@ -258,16 +567,9 @@ static void layer_data_diff_mark_both(DP_LayerData *ld, DP_LayerData *prev,
     DP_ASSERT(SDL_AtomicGet(&prev->refcount) > 0);
     DP_ASSERT(ld->width == prev->width);   // Different sizes could be
     DP_ASSERT(ld->height == prev->height); // supported, but aren't yet.
-    DP_canvas_diff_check(diff, mark_both, (DP_LayerData *[]){ld, prev});
-}
-
-static bool mark(void *data, int tile_index)
-{
-    DP_ASSERT(data);
-    DP_ASSERT(tile_index >= 0);
-    DP_LayerData *ld = data;
-    DP_ASSERT(tile_index < DP_tile_total_round(ld->width, ld->height));
-    return ld->elements[tile_index].tile;
+    DP_ASSERT(ld->depth == prev->depth);
+    diff_chunks(ld->root, prev->root, ld->depth - 1, 0,
+                DP_tile_total_round(ld->width, ld->height), true, diff);
 }
 
 static void layer_data_diff_mark(DP_LayerData *ld, DP_CanvasDiff *diff)
@@ -275,21 +577,15 @@ static void layer_data_diff_mark(DP_LayerData *ld, DP_CanvasDiff *diff)
     DP_ASSERT(ld);
     DP_ASSERT(diff);
     DP_ASSERT(SDL_AtomicGet(&ld->refcount) > 0);
-    DP_canvas_diff_check(diff, mark, ld);
+    diff_chunks(ld->root, NULL, ld->depth - 1, 0,
+                DP_tile_total_round(ld->width, ld->height), false, diff);
 }
 
 static bool layer_data_has_content(DP_LayerData *ld)
 {
     DP_ASSERT(ld);
     DP_ASSERT(SDL_AtomicGet(&ld->refcount) > 0);
-    int count = DP_tile_total_round(ld->width, ld->height);
-    for (int i = 0; i < count; ++i) {
-        DP_Tile *tile = ld->elements[i].tile;
-        if (tile && !DP_tile_blank(tile)) {
-            return true;
-        }
-    }
-    return false;
+    return chunk_has_content(ld->root, ld->depth - 1);
 }
 
 static DP_Pixel layer_data_pixel_at(DP_LayerData *ld, int x, int y)
@@ -303,7 +599,7 @@ static DP_Pixel layer_data_pixel_at(DP_LayerData *ld, int x, int y)
     int xt = x / DP_TILE_SIZE;
     int yt = y / DP_TILE_SIZE;
     int wt = DP_tile_count_round(ld->width);
-    DP_Tile *t = ld->elements[yt * wt + xt].tile;
+    DP_Tile *t = layer_data_tile_at(ld, yt * wt + xt);
     if (t) {
         return DP_tile_pixel_at(t, x - xt * DP_TILE_SIZE,
                                 y - yt * DP_TILE_SIZE);
@@ -320,13 +616,8 @@ static DP_TransientLayerData *transient_layer_data_new(DP_LayerData *ld)
     DP_ASSERT(SDL_AtomicGet(&ld->refcount) > 0);
     DP_ASSERT(!ld->transient);
     DP_debug("New transient layer data");
-    int width = ld->width;
-    int height = ld->height;
-    DP_TransientLayerData *tld = alloc_layer_data(width, height);
-    int count = DP_tile_total_round(width, height);
-    for (int i = 0; i < count; ++i) {
-        tld->elements[i].tile = DP_tile_incref_nullable(ld->elements[i].tile);
-    }
+    DP_TransientLayerData *tld = alloc_layer_data(ld->width, ld->height);
+    tld->root = chunk_incref_nullable(ld->root);
     return tld;
 }
 
@@ -336,27 +627,10 @@ static DP_LayerData *transient_layer_data_persist(DP_TransientLayerData *tld)
     DP_ASSERT(SDL_AtomicGet(&tld->refcount) > 0);
     DP_ASSERT(tld->transient);
     tld->transient = false;
-    int count = DP_tile_total_round(tld->width, tld->height);
-    for (int i = 0; i < count; ++i) {
-        DP_Tile *tile = tld->elements[i].tile;
-        if (tile && DP_tile_transient(tile)) {
-            DP_transient_tile_persist(tld->elements[i].transient_tile);
-        }
-    }
+    chunk_persist(tld->root, tld->depth - 1);
     return (DP_LayerData *)tld;
 }
 
-static void transient_layer_data_init_null_tiles(DP_TransientLayerData *tld)
-{
-    DP_ASSERT(tld);
-    DP_ASSERT(SDL_AtomicGet(&tld->refcount) > 0);
-    DP_ASSERT(tld->transient);
-    int tile_count = DP_tile_total_round(tld->width, tld->height);
-    for (int i = 0; i < tile_count; ++i) {
-        tld->elements[i].tile = NULL;
-    }
-}
-
 static DP_TransientTile *create_transient_tile(DP_TransientLayerData *tld,
                                                unsigned int context_id, int i)
 {
@@ -365,9 +639,10 @@ static DP_TransientTile *create_transient_tile(DP_TransientLayerData *tld,
     DP_ASSERT(tld->transient);
     DP_ASSERT(i >= 0);
     DP_ASSERT(i < DP_tile_total_round(tld->width, tld->height));
-    DP_ASSERT(!tld->elements[i].tile);
+    DP_LayerDataElement *element = transient_layer_data_element_at(tld, i);
+    DP_ASSERT(!element->tile);
     DP_TransientTile *tt = DP_transient_tile_new_blank(context_id);
-    tld->elements[i].transient_tile = tt;
+    element->transient_tile = tt;
     return tt;
 }
 
@@ -379,14 +654,14 @@ static DP_TransientTile *get_transient_tile(DP_TransientLayerData *tld,
     DP_ASSERT(tld->transient);
     DP_ASSERT(i >= 0);
     DP_ASSERT(i < DP_tile_total_round(tld->width, tld->height));
-    DP_Tile *tile = tld->elements[i].tile;
+    DP_LayerDataElement *element = transient_layer_data_element_at(tld, i);
+    DP_Tile *tile = element->tile;
     DP_ASSERT(tile);
     if (!DP_tile_transient(tile)) {
-        tld->elements[i].transient_tile =
-            DP_transient_tile_new(tile, context_id);
+        element->transient_tile = DP_transient_tile_new(tile, context_id);
         DP_tile_decref(tile);
     }
-    return tld->elements[i].transient_tile;
+    return element->transient_tile;
 }
 
 static DP_TransientTile *
@@ -398,17 +673,38 @@ get_or_create_transient_tile(DP_TransientLayerData *tld,
     DP_ASSERT(tld->transient);
     DP_ASSERT(i >= 0);
     DP_ASSERT(i < DP_tile_total_round(tld->width, tld->height));
-    DP_Tile *tile = tld->elements[i].tile;
+    DP_LayerDataElement *element = transient_layer_data_element_at(tld, i);
+    DP_Tile *tile = element->tile;
     if (!tile) {
-        tld->elements[i].transient_tile =
-            DP_transient_tile_new_blank(context_id);
+        element->transient_tile = DP_transient_tile_new_blank(context_id);
     }
     else if (!DP_tile_transient(tile)) {
-        tld->elements[i].transient_tile =
-            DP_transient_tile_new(tile, context_id);
+        element->transient_tile = DP_transient_tile_new(tile, context_id);
         DP_tile_decref(tile);
     }
-    return tld->elements[i].transient_tile;
+    return element->transient_tile;
+}
+
+int DP_transient_layer_data_width(DP_TransientLayerData *tld)
+{
+    DP_ASSERT(tld);
+    DP_ASSERT(SDL_AtomicGet(&tld->refcount) > 0);
+    return tld->width;
+}
+
+int DP_transient_layer_data_height(DP_TransientLayerData *tld)
+{
+    DP_ASSERT(tld);
+    DP_ASSERT(SDL_AtomicGet(&tld->refcount) > 0);
+    return tld->height;
+}
+
+DP_TransientTile *
+DP_transient_layer_data_transient_tile_at(DP_TransientLayerData *tld,
+                                          unsigned int context_id,
+                                          int tile_index)
+{
+    return get_or_create_transient_tile(tld, context_id, tile_index);
 }
 
 void DP_transient_layer_data_brush_stamp_apply(DP_TransientLayerData *tld,
@@ -465,25 +761,56 @@ void DP_transient_layer_data_brush_stamp_apply(DP_TransientLayerData *tld,
     }
 }
 
-static void transient_layer_data_pixel_at_put(DP_TransientLayerData *tld,
-                                              unsigned int context_id,
-                                              int blend_mode, int x, int y,
-                                              DP_Pixel pixel)
+// Puts the pixels tile by tile, clipped to the layer bounds. Tiles that are
+// replaced entirely just get swapped out for new ones.
+static void transient_layer_data_put_pixels(DP_TransientLayerData *tld,
+                                            unsigned int context_id,
+                                            int blend_mode, DP_Pixel *pixels,
+                                            int pixels_width, int pixels_height,
+                                            int left, int top)
 {
     DP_ASSERT(tld);
     DP_ASSERT(SDL_AtomicGet(&tld->refcount) > 0);
     DP_ASSERT(tld->transient);
-    DP_ASSERT(x >= 0);
-    DP_ASSERT(y >= 0);
-    DP_ASSERT(x < tld->width);
-    DP_ASSERT(y < tld->height);
-    int xt = x / DP_TILE_SIZE;
-    int yt = y / DP_TILE_SIZE;
-    int wt = DP_tile_count_round(tld->width);
-    DP_TransientTile *tt =
-        get_or_create_transient_tile(tld, context_id, yt * wt + xt);
-    DP_transient_tile_pixel_at_put(tt, blend_mode, x - xt * DP_TILE_SIZE,
-                                   y - yt * DP_TILE_SIZE, pixel);
+    DP_ASSERT(pixels);
+
+    int start_x = DP_max_int(left, 0);
+    int start_y = DP_max_int(top, 0);
+    int end_x = DP_min_int(tld->width, left + pixels_width);
+    int end_y = DP_min_int(tld->height, top + pixels_height);
+    if (start_x >= end_x || start_y >= end_y) {
+        return; // Out of bounds, nothing to do.
+    }
+
+    int xtiles = DP_tile_count_round(tld->width);
+    int yindex_end = (end_y - 1) / DP_TILE_SIZE;
+    int xindex_end = (end_x - 1) / DP_TILE_SIZE;
+    for (int yindex = start_y / DP_TILE_SIZE; yindex <= yindex_end; ++yindex) {
+        int tile_top = yindex * DP_TILE_SIZE;
+        int y0 = DP_max_int(start_y, tile_top);
+        int h = DP_min_int(end_y, tile_top + DP_TILE_SIZE) - y0;
+        for (int xindex = start_x / DP_TILE_SIZE; xindex <= xindex_end;
+             ++xindex) {
+            int tile_left = xindex * DP_TILE_SIZE;
+            int x0 = DP_max_int(start_x, tile_left);
+            int w = DP_min_int(end_x, tile_left + DP_TILE_SIZE) - x0;
+            int i = yindex * xtiles + xindex;
+            DP_Pixel *src = pixels + (y0 - top) * pixels_width + (x0 - left);
+            if (blend_mode == DP_BLEND_MODE_REPLACE && w == DP_TILE_SIZE
+                && h == DP_TILE_SIZE) {
+                DP_TransientTile *tt = DP_transient_tile_new_from_pixels(
+                    context_id, src, pixels_width);
+                transient_layer_data_tile_set(tld, i, (DP_Tile *)tt);
+            }
+            else {
+                DP_TransientTile *tt =
+                    get_or_create_transient_tile(tld, context_id, i);
+                DP_transient_tile_pixels_apply(tt, blend_mode, src,
+                                               pixels_width, x0 - tile_left,
+                                               y0 - tile_top, w, h);
+            }
+        }
+    }
 }
 
 static void transient_layer_data_put_image(DP_TransientLayerData *tld,
@@ -491,28 +818,10 @@ static void transient_layer_data_put_image(DP_TransientLayerData *tld,
                                            unsigned int context_id,
                                            int blend_mode, int left, int top)
 {
-    DP_ASSERT(tld);
-    DP_ASSERT(SDL_AtomicGet(&tld->refcount) > 0);
-    DP_ASSERT(tld->transient);
     DP_ASSERT(img);
-
-    int img_width = DP_image_width(img);
-    int img_height = DP_image_height(img);
-    int img_start_x = left < 0 ? -left : 0;
-    int img_start_y = top < 0 ? -top : 0;
-    int start_x = DP_max_int(left, 0);
-    int start_y = DP_max_int(top, 0);
-    int width = DP_min_int(tld->width - start_x, img_width - img_start_x);
-    int height = DP_min_int(tld->height - start_y, img_height - img_start_y);
-    for (int y = 0; y < height; ++y) {
-        int cur_y = start_y + y;
-        int img_y = img_start_y + y;
-        for (int x = 0; x < width; ++x) {
-            DP_Pixel pixel = DP_image_pixel_at(img, img_start_x + x, img_y);
-            transient_layer_data_pixel_at_put(tld, context_id, blend_mode,
-                                              start_x + x, cur_y, pixel);
-        }
-    }
+    transient_layer_data_put_pixels(tld, context_id, blend_mode,
+                                    DP_image_pixels(img), DP_image_width(img),
+                                    DP_image_height(img), left, top);
 }
 
 static void transient_layer_data_fill_rect(DP_TransientLayerData *tld,
@@ -545,12 +854,11 @@ static void transient_layer_data_fill_rect(DP_TransientLayerData *tld,
             int i = ty * xtiles + tx;
 
             DP_TransientTile *tt;
-            if (tld->elements[i].tile) {
+            if (layer_data_tile_at((DP_LayerData *)tld, i)) {
                 tt = get_or_create_transient_tile(tld, context_id, i);
             }
             else if (blend_blank) {
-                tt = DP_transient_tile_new_blank(context_id);
-                tld->elements[i].transient_tile = tt;
+                tt = create_transient_tile(tld, context_id, i);
             }
             else {
                 continue; // Nothing to do on a blank tile.
@@ -572,9 +880,11 @@ static void transient_layer_data_fill(DP_TransientLayerData *tld,
         DP_Tile *tile = DP_tile_new_from_bgra(context_id, pixel.color);
         int tile_count = DP_tile_total_round(tld->width, tld->height);
         DP_tile_incref_by(tile, tile_count - 1);
+        // Every tile gets replaced, so don't bother copying the old chunks.
+        chunk_decref_nullable(tld->root, tld->depth - 1);
+        tld->root = NULL;
         for (int i = 0; i < tile_count; ++i) {
-            DP_tile_decref_nullable(tld->elements[i].tile);
-            tld->elements[i].tile = tile;
+            transient_layer_data_tile_set(tld, i, tile);
         }
     }
     else {
@@ -646,6 +956,45 @@ void DP_layer_diff_mark(DP_Layer *l, DP_CanvasDiff *diff)
     DP_layer_list_diff_mark(l->sublayers, diff);
 }
 
+DP_Layer *DP_layer_take_unshared_tiles(DP_Layer *l, DP_Layer *prev_or_null,
+                                       int parent_id, DP_LayerTakeTileFn fn,
+                                       void *user)
+{
+    DP_ASSERT(l);
+    DP_ASSERT(SDL_AtomicGet(&l->refcount) > 0);
+    DP_ASSERT(!l->transient);
+    DP_ASSERT(fn);
+    if (l == prev_or_null || SDL_AtomicGet(&l->refcount) > 1) {
+        return DP_layer_incref(l);
+    }
+
+    DP_LayerTakeTiles ltt = {parent_id == 0 ? l->id : parent_id,
+                             parent_id == 0 ? 0 : l->id,
+                             0,
+                             0,
+                             fn,
+                             user};
+    DP_LayerData *ld =
+        layer_data_take_tiles(l->data, prev_or_null ? prev_or_null->data : NULL,
+                              &ltt);
+    DP_LayerList *sublayers = DP_layer_list_take_unshared_tiles(
+        l->sublayers, prev_or_null ? prev_or_null->sublayers : NULL, l->id, fn,
+        user);
+    if (ld == l->data && sublayers == l->sublayers) {
+        layer_data_decref(ld);
+        DP_layer_list_decref(sublayers);
+        return DP_layer_incref(l);
+    }
+    else {
+        DP_TransientLayer *tl = DP_transient_layer_new(l);
+        layer_data_decref(tl->data);
+        tl->data = ld;
+        DP_layer_list_decref(tl->sublayers);
+        tl->sublayers = sublayers;
+        return DP_transient_layer_persist(tl);
+    }
+}
+
 
 int DP_layer_id(DP_Layer *l)
 {
@@ -738,7 +1087,7 @@ DP_Tile *DP_layer_tile_at(DP_Layer *l, int x, int y)
     DP_ASSERT(y < DP_tile_count_round(l->data->height));
     DP_LayerData *ld = l->data;
     int xcount = DP_tile_count_round(ld->width);
-    return ld->elements[y * xcount + x].tile;
+    return layer_data_tile_at(ld, y * xcount + x);
 }
 
 
@@ -758,9 +1107,9 @@ static void transient_layer_data_merge(DP_TransientLayerData *tld,
     DP_BlendModeBlankTileBehavior on_blank =
         DP_blend_mode_blank_tile_behavior(blend_mode);
     for (int i = 0; i < count; ++i) {
-        DP_Tile *t = ld->elements[i].tile;
+        DP_Tile *t = layer_data_tile_at(ld, i);
         if (t) {
-            if (tld->elements[i].tile) {
+            if (layer_data_tile_at((DP_LayerData *)tld, i)) {
                 DP_TransientTile *tt = get_transient_tile(tld, context_id, i);
                 DP_ASSERT((void *)tt != (void *)t);
                 DP_transient_tile_merge(tt, t, opacity, blend_mode);
@@ -805,7 +1154,7 @@ static DP_Tile *flatten_tile(DP_Layer *l, int tile_index)
     DP_ASSERT(SDL_AtomicGet(&ld->refcount) > 0);
     DP_ASSERT(tile_index >= 0);
     DP_ASSERT(tile_index < DP_tile_total_round(ld->width, ld->height));
-    DP_Tile *t = ld->elements[tile_index].tile;
+    DP_Tile *t = layer_data_tile_at(ld, tile_index);
     DP_LayerList *ll = l->sublayers;
     if (DP_layer_list_layer_count(ll) == 0) {
         return DP_tile_incref_nullable(t);
@@ -845,8 +1194,8 @@ static DP_Image *layer_data_to_image(DP_LayerData *ld)
     DP_debug("Layer to image %dx%d tiles", tile_counts.x, tile_counts.y);
     for (int y = 0; y < tile_counts.y; ++y) {
         for (int x = 0; x < tile_counts.x; ++x) {
-            DP_tile_copy_to_image(ld->elements[y * tile_counts.x + x].tile, img,
-                                  x * DP_TILE_SIZE, y * DP_TILE_SIZE);
+            DP_tile_copy_to_image(layer_data_tile_at(ld, y * tile_counts.x + x),
+                                  img, x * DP_TILE_SIZE, y * DP_TILE_SIZE);
         }
     }
     return img;
@@ -891,10 +1240,12 @@ DP_TransientLayer *DP_transient_layer_new_init(int id, int width, int height,
     DP_ASSERT(height >= 0);
 
     DP_TransientLayerData *tld = alloc_layer_data(width, height);
-    int tile_count = DP_tile_total_round(width, height);
-    DP_tile_incref_by_nullable(tile, tile_count);
-    for (int i = 0; i < tile_count; ++i) {
-        tld->elements[i].tile = tile;
+    if (tile) {
+        int tile_count = DP_tile_total_round(width, height);
+        DP_tile_incref_by(tile, tile_count);
+        for (int i = 0; i < tile_count; ++i) {
+            transient_layer_data_tile_set(tld, i, tile);
+        }
     }
 
     DP_TransientLayer *tl = DP_malloc(sizeof(*tl));
@@ -1178,61 +1529,134 @@ static void resize_layer_content_aligned(DP_LayerData *ld,
             int old_y = offsets.y + y;
             bool out_of_bounds = old_x < 0 || old_x >= old_counts.x || old_y < 0
                               || old_y >= old_counts.y;
-            DP_Tile *tile = out_of_bounds
-                              ? NULL
-                              : ld->elements[old_y * old_counts.x + old_x].tile;
-            tld->elements[y * new_counts.x + x].tile =
-                DP_tile_incref_nullable(tile);
+            DP_Tile *tile =
+                out_of_bounds
+                    ? NULL
+                    : layer_data_tile_at(ld, old_y * old_counts.x + old_x);
+            if (tile) {
+                transient_layer_data_tile_set(tld, y * new_counts.x + x,
+                                              DP_tile_incref(tile));
+            }
         }
     }
 }
 
 
-static void calculate_resize_offsets(int offset, int *out_pos, int *out_crop)
+// Key for reusing shifted tiles. Tiles that lie fully inside both the old and
+// the new layer bounds get their pixels from the same spots in their source
+// tiles, so the same sources give the same result. That's common for layers
+// filled with a single color, where all tiles are the same one.
+typedef struct DP_ResizeSources {
+    int count;
+    DP_Tile *tiles[4];
+} DP_ResizeSources;
+
+static bool resize_sources_equal(DP_ResizeSources *a, DP_ResizeSources *b)
 {
-    if (offset < 0) {
-        *out_pos = 0;
-        *out_crop = -offset;
+    if (a->count != b->count) {
+        return false;
     }
-    else {
-        *out_pos = offset;
-        *out_crop = 0;
-    }
-}
-
-static void resize_layer_content_copy(DP_LayerData *ld,
-                                      DP_TransientLayerData *tld,
-                                      unsigned int context_id, int top,
-                                      int left)
-{
-    // TODO: This operation is super expensive and obliterates change
-    // information. It could be solved by storing an x and y pixel offset in the
-    // layer instead. Need more functionality to test that out though.
-    transient_layer_data_init_null_tiles(tld);
-
-    DP_Image *img = layer_data_to_image(ld);
-    int width = DP_image_width(img);
-    int height = DP_image_height(img);
-
-    int x, y, crop_x, crop_y;
-    calculate_resize_offsets(left, &x, &crop_x);
-    calculate_resize_offsets(top, &y, &crop_y);
-    if (crop_x != 0 || crop_y != 0) {
-        if (crop_x < width && crop_y < height) {
-            DP_Image *tmp = DP_image_new_subimage(
-                img, crop_x, crop_y, width - crop_x, height - crop_y);
-            DP_image_free(img);
-            img = tmp;
+    for (int i = 0; i < a->count; ++i) {
+        if (a->tiles[i] != b->tiles[i]) {
+            return false;
         }
-        else {
-            DP_image_free(img);
-            return; // Nothing to do, resulting image is out of bounds.
+    }
+    return true;
+}
+
+static DP_Tile *resize_shift_tile(DP_LayerData *ld, unsigned int context_id,
+                                  int top, int left, int tile_left,
+                                  int tile_top, int ox0, int oy0, int ox1,
+                                  int oy1)
+{
+    int old_xtiles = DP_tile_count_round(ld->width);
+    DP_TransientTile *tt = NULL;
+    for (int oyi = oy0 / DP_TILE_SIZE; oyi <= (oy1 - 1) / DP_TILE_SIZE;
+         ++oyi) {
+        for (int oxi = ox0 / DP_TILE_SIZE; oxi <= (ox1 - 1) / DP_TILE_SIZE;
+             ++oxi) {
+            DP_Tile *t = layer_data_tile_at(ld, oyi * old_xtiles + oxi);
+            if (t) {
+                if (!tt) {
+                    tt = DP_transient_tile_new_blank(context_id);
+                }
+                int sx0 = DP_max_int(ox0, oxi * DP_TILE_SIZE);
+                int sy0 = DP_max_int(oy0, oyi * DP_TILE_SIZE);
+                int sx1 = DP_min_int(ox1, (oxi + 1) * DP_TILE_SIZE);
+                int sy1 = DP_min_int(oy1, (oyi + 1) * DP_TILE_SIZE);
+                DP_Pixel *src = DP_tile_pixels(t)
+                              + (sy0 - oyi * DP_TILE_SIZE) * DP_TILE_SIZE
+                              + (sx0 - oxi * DP_TILE_SIZE);
+                DP_transient_tile_pixels_apply(
+                    tt, DP_BLEND_MODE_REPLACE, src, DP_TILE_SIZE,
+                    sx0 + left - tile_left, sy0 + top - tile_top, sx1 - sx0,
+                    sy1 - sy0);
+            }
         }
     }
+    return tt ? DP_transient_tile_persist(tt) : NULL;
+}
 
-    transient_layer_data_put_image(tld, img, context_id, DP_BLEND_MODE_REPLACE,
-                                   x, y);
-    DP_image_free(img);
+static void resize_layer_content_shift(DP_LayerData *ld,
+                                       DP_TransientLayerData *tld,
+                                       unsigned int context_id, int top,
+                                       int left)
+{
+    // Builds each new tile from the up to four old tiles overlapping it,
+    // without going through an intermediate image of the whole layer. Tiles
+    // with no content in them stay blank.
+    int old_xtiles = DP_tile_count_round(ld->width);
+    DP_TileCounts new_counts = DP_tile_counts_round(tld->width, tld->height);
+    DP_ResizeSources last_sources = {0, {NULL, NULL, NULL, NULL}};
+    DP_Tile *last_tile = NULL;
+    for (int y = 0; y < new_counts.y; ++y) {
+        int tile_top = y * DP_TILE_SIZE;
+        int ny1 = DP_min_int(tile_top + DP_TILE_SIZE, tld->height);
+        int oy0 = DP_max_int(tile_top - top, 0);
+        int oy1 = DP_min_int(ny1 - top, ld->height);
+        if (oy0 >= oy1) {
+            continue;
+        }
+        for (int x = 0; x < new_counts.x; ++x) {
+            int tile_left = x * DP_TILE_SIZE;
+            int nx1 = DP_min_int(tile_left + DP_TILE_SIZE, tld->width);
+            int ox0 = DP_max_int(tile_left - left, 0);
+            int ox1 = DP_min_int(nx1 - left, ld->width);
+            if (ox0 >= ox1) {
+                continue;
+            }
+
+            bool full = ox1 - ox0 == DP_TILE_SIZE && oy1 - oy0 == DP_TILE_SIZE;
+            DP_ResizeSources sources = {0, {NULL, NULL, NULL, NULL}};
+            if (full) {
+                for (int oyi = oy0 / DP_TILE_SIZE;
+                     oyi <= (oy1 - 1) / DP_TILE_SIZE; ++oyi) {
+                    for (int oxi = ox0 / DP_TILE_SIZE;
+                         oxi <= (ox1 - 1) / DP_TILE_SIZE; ++oxi) {
+                        sources.tiles[sources.count++] =
+                            layer_data_tile_at(ld, oyi * old_xtiles + oxi);
+                    }
+                }
+                if (last_tile
+                    && resize_sources_equal(&sources, &last_sources)) {
+                    transient_layer_data_tile_set(tld, y * new_counts.x + x,
+                                                  DP_tile_incref(last_tile));
+                    continue;
+                }
+            }
+
+            DP_Tile *tile =
+                resize_shift_tile(ld, context_id, top, left, tile_left,
+                                  tile_top, ox0, oy0, ox1, oy1);
+            if (tile) {
+                transient_layer_data_tile_set(tld, y * new_counts.x + x, tile);
+                if (full) {
+                    last_sources = sources;
+                    last_tile = tile;
+                }
+            }
+        }
+    }
 }
 
 static void resize_layer_content(DP_LayerData *ld, DP_TransientLayerData *tld,
@@ -1243,8 +1667,8 @@ static void resize_layer_content(DP_LayerData *ld, DP_TransientLayerData *tld,
         resize_layer_content_aligned(ld, tld, top, left);
     }
     else {
-        DP_debug("Resize: layer must be copied");
-        resize_layer_content_copy(ld, tld, context_id, top, left);
+        DP_debug("Resize: layer must be shifted");
+        resize_layer_content_shift(ld, tld, context_id, top, left);
     }
 }
 
@@ -1266,7 +1690,6 @@ void DP_transient_layer_resize(DP_TransientLayer *tl, unsigned int context_id,
     }
     else {
         DP_debug("Resize: layer is blank");
-        transient_layer_data_init_null_tiles(tld);
     }
 
     tl->transient_data = tld;
@@ -1313,6 +1736,52 @@ void DP_transient_layer_layer_retitle(DP_TransientLayer *tl, const char *title,
     tl->title = layer_title_new(title, title_length);
 }
 
+struct DP_PutImageBandArgs {
+    DP_TransientLayerData *tld;
+    unsigned int context_id;
+    int blend_mode;
+    int left, top;
+    int width, height;
+    int rows_done;
+};
+
+// Inflates the image in bands of rows that line up with the layer's tiles,
+// so that it never has to exist all at once and each band touches each tile
+// only once.
+static size_t put_image_band(void *user, unsigned char *chunk,
+                             size_t chunk_size)
+{
+    struct DP_PutImageBandArgs *args = user;
+    int width = args->width;
+    if (chunk) {
+        int rows = DP_size_to_int(chunk_size / sizeof(DP_Pixel))
+                 / DP_max_int(width, 1);
+        DP_Pixel *pixels = (DP_Pixel *)chunk;
+#if DP_BYTE_ORDER == DP_LITTLE_ENDIAN
+        // Nothing else to do here.
+#elif DP_BYTE_ORDER == DP_BIG_ENDIAN
+        // Gotta byte-swap the pixels.
+        for (int i = 0; i < width * rows; ++i) {
+            pixels[i].color = DP_swap_uint32(pixels[i].color);
+        }
+#else
+#    error "Unknown byte order"
+#endif
+        int top = args->top + args->rows_done;
+        transient_layer_data_put_pixels(args->tld, args->context_id,
+                                        args->blend_mode, pixels, width, rows,
+                                        args->left, top);
+        args->rows_done += rows;
+    }
+    int y = args->top + args->rows_done;
+    int tile_offset = y % DP_TILE_SIZE;
+    int rows_to_boundary =
+        DP_TILE_SIZE - (tile_offset < 0 ? tile_offset + DP_TILE_SIZE
+                                        : tile_offset);
+    int rows = DP_min_int(rows_to_boundary, args->height - args->rows_done);
+    return DP_int_to_size(width) * DP_int_to_size(rows) * sizeof(DP_Pixel);
+}
+
 bool DP_transient_layer_put_image(DP_TransientLayer *tl,
                                   unsigned int context_id, int blend_mode,
                                   int x, int y, int width, int height,
@@ -1322,17 +1791,25 @@ bool DP_transient_layer_put_image(DP_TransientLayer *tl,
     DP_ASSERT(SDL_AtomicGet(&tl->refcount) > 0);
     DP_ASSERT(tl->transient);
 
-    DP_Image *img =
-        DP_image_new_from_compressed(width, height, image, image_size);
-    if (img) {
-        DP_TransientLayerData *tld = get_transient_layer_data(tl);
-        transient_layer_data_put_image(tld, img, context_id, blend_mode, x, y);
-        DP_image_free(img);
-        return true;
-    }
-    else {
-        return false;
-    }
+    size_t band_size =
+        DP_int_to_size(width) * DP_TILE_SIZE * sizeof(DP_Pixel);
+    unsigned char *buffer = DP_malloc(DP_max_size(band_size, 1));
+    struct DP_PutImageBandArgs args = {get_transient_layer_data(tl),
+                                       context_id,
+                                       blend_mode,
+                                       x,
+                                       y,
+                                       width,
+                                       height,
+                                       0};
+    size_t expected_size =
+        DP_int_to_size(width) * DP_int_to_size(height) * sizeof(DP_Pixel);
+    // On failure, some bands may already have been put. That's fine, the
+    // caller throws away the whole transient state in that case anyway.
+    bool ok = DP_compress_inflate_chunked(image, image_size, expected_size,
+                                          buffer, put_image_band, &args);
+    DP_free(buffer);
+    return ok;
 }
 
 void DP_transient_layer_fill_rect(DP_TransientLayer *tl,
@@ -1376,8 +1853,7 @@ static bool put_tile(DP_TransientLayer *tl, DP_Tile *tile, int x, int y,
         DP_tile_incref_by(tile, end - start);
         DP_TransientLayerData *tld = get_transient_layer_data(tl);
         for (int i = start; i < end; ++i) {
-            DP_tile_decref_nullable(tld->elements[i].tile);
-            tld->elements[i].tile = tile;
+            transient_layer_data_tile_set(tld, i, tile);
         }
         return true;
     }
@@ -1573,7 +2049,6 @@ void DP_transient_layer_render_tile(DP_TransientLayer *tl, DP_CanvasState *cs,
     DP_ASSERT(tile_index >= 0);
     DP_TransientLayerData *tld = get_transient_layer_data(tl);
     DP_ASSERT(tile_index < DP_tile_total_round(tld->width, tld->height));
-    DP_Tile **pp = &tld->elements[tile_index].tile;
-    DP_tile_decref_nullable(*pp);
-    *pp = DP_canvas_state_flatten_tile(cs, tile_index);
+    transient_layer_data_tile_set(tld, tile_index,
+                                  DP_canvas_state_flatten_tile(cs, tile_index));
 }
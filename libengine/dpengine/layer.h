@@ -49,6 +49,15 @@ typedef struct DP_Tile DP_TransientTile;
 #endif
 
 
+int DP_transient_layer_data_width(DP_TransientLayerData *tld);
+
+int DP_transient_layer_data_height(DP_TransientLayerData *tld);
+
+DP_TransientTile *
+DP_transient_layer_data_transient_tile_at(DP_TransientLayerData *tld,
+                                          unsigned int context_id,
+                                          int tile_index);
+
 void DP_transient_layer_data_brush_stamp_apply(DP_TransientLayerData *tld,
                                                unsigned int context_id,
                                                DP_Pixel src, int blend_mode,
@@ -67,6 +76,21 @@ void DP_layer_diff(DP_Layer *l, DP_Layer *prev, DP_CanvasDiff *diff);
 
 void DP_layer_diff_mark(DP_Layer *l, DP_CanvasDiff *diff);
 
+// Gets handed a tile taken out of a layer along with its position in tiles.
+// Tiles of sublayers come with the id of the layer they belong to and their
+// own sublayer id, the sublayer id is 0 otherwise. Gets the tile's reference.
+typedef void (*DP_LayerTakeTileFn)(void *user, int layer_id, int sublayer_id,
+                                   int x, int y, DP_Tile *tile);
+
+// Returns a copy of the layer and its sublayers with every tile taken out that
+// isn't at the same position in prev_or_null and that nothing else holds a
+// reference to, passing those to the given function instead. Only the paths
+// to such tiles get copied, everything else stays shared. Sublayers pass the
+// id of their parent layer, others 0.
+DP_Layer *DP_layer_take_unshared_tiles(DP_Layer *l, DP_Layer *prev_or_null,
+                                       int parent_id, DP_LayerTakeTileFn fn,
+                                       void *user);
+
 
 int DP_layer_id(DP_Layer *l);
 
@@ -173,6 +173,41 @@ void DP_layer_list_diff_mark(DP_LayerList *ll, DP_CanvasDiff *diff)
     mark_layers(ll, diff, 0, ll->count);
 }
 
+DP_LayerList *DP_layer_list_take_unshared_tiles(DP_LayerList *ll,
+                                                DP_LayerList *prev_or_null,
+                                                int parent_id,
+                                                DP_LayerTakeTileFn fn,
+                                                void *user)
+{
+    DP_ASSERT(ll);
+    DP_ASSERT(SDL_AtomicGet(&ll->refcount) > 0);
+    DP_ASSERT(!ll->transient);
+    if (ll == prev_or_null || SDL_AtomicGet(&ll->refcount) > 1) {
+        return DP_layer_list_incref(ll);
+    }
+
+    DP_TransientLayerList *tll = NULL;
+    int count = ll->count;
+    for (int i = 0; i < count; ++i) {
+        DP_Layer *l = ll->elements[i].layer;
+        DP_Layer *prev =
+            prev_or_null
+                ? DP_layer_list_layer_by_id(prev_or_null, DP_layer_id(l))
+                : NULL;
+        DP_Layer *result =
+            DP_layer_take_unshared_tiles(l, prev, parent_id, fn, user);
+        if (result != l) {
+            if (!tll) {
+                tll = DP_transient_layer_list_new(ll, 0);
+            }
+            DP_transient_layer_list_set_inc(tll, result, i);
+        }
+        DP_layer_decref(result);
+    }
+    return tll ? DP_transient_layer_list_persist(tll)
+               : DP_layer_list_incref(ll);
+}
+
 
 int DP_layer_list_layer_count(DP_LayerList *ll)
 {
@@ -419,6 +454,20 @@ void DP_transient_layer_list_remove_at(DP_TransientLayerList *tll, int index)
     }
 }
 
+void DP_transient_layer_list_set_inc(DP_TransientLayerList *tll, DP_Layer *l,
+                                     int index)
+{
+    DP_ASSERT(tll);
+    DP_ASSERT(SDL_AtomicGet(&tll->refcount) > 0);
+    DP_ASSERT(tll->transient);
+    DP_ASSERT(l);
+    DP_ASSERT(index >= 0);
+    DP_ASSERT(index < tll->count);
+    DP_Layer *prev = tll->elements[index].layer;
+    tll->elements[index].layer = DP_layer_incref(l);
+    DP_layer_decref(prev);
+}
+
 
 static void insert_noinc(DP_TransientLayerList *tll, DP_TransientLayer *tl,
                          int i)
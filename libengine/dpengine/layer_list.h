@@ -60,6 +60,16 @@ void DP_layer_list_diff(DP_LayerList *ll, DP_LayerList *prev,
 
 void DP_layer_list_diff_mark(DP_LayerList *ll, DP_CanvasDiff *diff);
 
+typedef void (*DP_LayerTakeTileFn)(void *user, int layer_id, int sublayer_id,
+                                   int x, int y, DP_Tile *tile);
+
+// See DP_layer_take_unshared_tiles, layers are matched up by their ids.
+DP_LayerList *DP_layer_list_take_unshared_tiles(DP_LayerList *ll,
+                                                DP_LayerList *prev_or_null,
+                                                int parent_id,
+                                                DP_LayerTakeTileFn fn,
+                                                void *user);
+
 
 int DP_layer_list_layer_count(DP_LayerList *ll);
 
@@ -112,6 +122,9 @@ DP_transient_layer_list_transient_at(DP_TransientLayerList *tll, int index);
 
 void DP_transient_layer_list_remove_at(DP_TransientLayerList *tll, int index);
 
+void DP_transient_layer_list_set_inc(DP_TransientLayerList *tll, DP_Layer *l,
+                                     int index);
+
 
 void DP_transient_layer_list_resize(DP_TransientLayerList *tll,
                                     unsigned int context_id, int top, int right,
@@ -0,0 +1,273 @@
+/*
+ * Copyright (c) 2022 askmeaboutloom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "mipmap.h"
+#include "pixels.h"
+#include "tile.h"
+#include <dpcommon/common.h>
+#include <dpcommon/conversions.h>
+
+#define HALF_TILE_SIZE (DP_TILE_SIZE / 2)
+
+#define FLAG_DIRTY     (1 << 0) // Changed since the last DP_mipmap_dirty_take.
+#define FLAG_PROPAGATE (1 << 1) // Needs to be downsampled into its parent.
+
+
+typedef struct DP_MipmapLevel {
+    int xtiles, ytiles;
+    unsigned char *flags;
+    DP_Pixel *pixels;
+} DP_MipmapLevel;
+
+struct DP_Mipmap {
+    int width, height;
+    int level_count;
+    DP_MipmapLevel levels[DP_MIPMAP_MAX_LEVELS];
+};
+
+
+DP_Mipmap *DP_mipmap_new(void)
+{
+    DP_Mipmap *mm = DP_malloc(sizeof(*mm));
+    mm->width = 0;
+    mm->height = 0;
+    mm->level_count = 0;
+    return mm;
+}
+
+static void dispose_levels(DP_Mipmap *mm)
+{
+    for (int i = 1; i < mm->level_count; ++i) {
+        DP_free(mm->levels[i].flags);
+        DP_free(mm->levels[i].pixels);
+    }
+    mm->level_count = 0;
+}
+
+void DP_mipmap_free(DP_Mipmap *mm)
+{
+    if (mm) {
+        dispose_levels(mm);
+        DP_free(mm);
+    }
+}
+
+
+void DP_mipmap_resize(DP_Mipmap *mm, int width, int height)
+{
+    DP_ASSERT(mm);
+    DP_ASSERT(width >= 0);
+    DP_ASSERT(height >= 0);
+    if (mm->width == width && mm->height == height) {
+        return;
+    }
+
+    dispose_levels(mm);
+    mm->width = width;
+    mm->height = height;
+    if (width == 0 || height == 0) {
+        return;
+    }
+
+    int xtiles = DP_tile_size_round_up(width);
+    int ytiles = DP_tile_size_round_up(height);
+    mm->levels[0] = (DP_MipmapLevel){xtiles, ytiles, NULL, NULL};
+    int level_count = 1;
+    while ((xtiles > 1 || ytiles > 1) && level_count < DP_MIPMAP_MAX_LEVELS) {
+        xtiles = (xtiles + 1) / 2;
+        ytiles = (ytiles + 1) / 2;
+        size_t tile_total = DP_int_to_size(xtiles) * DP_int_to_size(ytiles);
+        DP_MipmapLevel *ml = &mm->levels[level_count++];
+        ml->xtiles = xtiles;
+        ml->ytiles = ytiles;
+        ml->flags = DP_malloc(tile_total);
+        memset(ml->flags, 0, tile_total);
+        ml->pixels = DP_malloc(tile_total * DP_TILE_BYTES);
+        memset(ml->pixels, 0, tile_total * DP_TILE_BYTES);
+    }
+    mm->level_count = level_count;
+}
+
+int DP_mipmap_width(DP_Mipmap *mm)
+{
+    DP_ASSERT(mm);
+    return mm->width;
+}
+
+int DP_mipmap_height(DP_Mipmap *mm)
+{
+    DP_ASSERT(mm);
+    return mm->height;
+}
+
+int DP_mipmap_level_count(DP_Mipmap *mm)
+{
+    DP_ASSERT(mm);
+    return mm->level_count;
+}
+
+static int scale_down(int value, int level)
+{
+    int divisor = 1 << level;
+    return (value + divisor - 1) / divisor;
+}
+
+int DP_mipmap_level_width(DP_Mipmap *mm, int level)
+{
+    DP_ASSERT(mm);
+    DP_ASSERT(level >= 0);
+    DP_ASSERT(level < mm->level_count);
+    return scale_down(mm->width, level);
+}
+
+int DP_mipmap_level_height(DP_Mipmap *mm, int level)
+{
+    DP_ASSERT(mm);
+    DP_ASSERT(level >= 0);
+    DP_ASSERT(level < mm->level_count);
+    return scale_down(mm->height, level);
+}
+
+
+static DP_Pixel *level_tile_pixels(DP_MipmapLevel *ml, int tile_x, int tile_y)
+{
+    DP_ASSERT(tile_x >= 0 && tile_x < ml->xtiles);
+    DP_ASSERT(tile_y >= 0 && tile_y < ml->ytiles);
+    return ml->pixels + (tile_y * ml->xtiles + tile_x) * DP_TILE_LENGTH;
+}
+
+// Averages each 2x2 block of the source tile into one pixel of the quadrant
+// of the parent tile that the source tile covers. Pixels are premultiplied,
+// so averaging the channels separately is correct. Works on each channel in
+// a flat loop, which compilers turn into vector instructions.
+static void downsample(const DP_Pixel *restrict src, DP_Pixel *restrict dst,
+                       int tile_x, int tile_y)
+{
+    DP_Pixel *quadrant = dst + (tile_y % 2) * HALF_TILE_SIZE * DP_TILE_SIZE
+                       + (tile_x % 2) * HALF_TILE_SIZE;
+    if (src) {
+        for (int y = 0; y < HALF_TILE_SIZE; ++y) {
+            const uint8_t *row1 = (const uint8_t *)(src + y * 2 * DP_TILE_SIZE);
+            const uint8_t *row2 = row1 + DP_TILE_SIZE * 4;
+            uint8_t *out = (uint8_t *)(quadrant + y * DP_TILE_SIZE);
+            for (int x = 0; x < HALF_TILE_SIZE * 4; ++x) {
+                int i = (x / 4) * 8 + x % 4;
+                unsigned int sum = (unsigned int)row1[i] + row1[i + 4]
+                                 + row2[i] + row2[i + 4] + 2u;
+                out[x] = (uint8_t)(sum / 4u);
+            }
+        }
+    }
+    else {
+        for (int y = 0; y < HALF_TILE_SIZE; ++y) {
+            memset(quadrant + y * DP_TILE_SIZE, 0,
+                   HALF_TILE_SIZE * sizeof(*quadrant));
+        }
+    }
+}
+
+static void downsample_into(DP_Mipmap *mm, int level, const DP_Pixel *src,
+                            int tile_x, int tile_y)
+{
+    DP_MipmapLevel *parent = &mm->levels[level + 1];
+    int parent_x = tile_x / 2;
+    int parent_y = tile_y / 2;
+    downsample(src, level_tile_pixels(parent, parent_x, parent_y), tile_x,
+               tile_y);
+    parent->flags[parent_y * parent->xtiles + parent_x] |=
+        FLAG_DIRTY | FLAG_PROPAGATE;
+}
+
+void DP_mipmap_tile_set(DP_Mipmap *mm, int tile_x, int tile_y,
+                        DP_Tile *tile_or_null)
+{
+    DP_ASSERT(mm);
+    DP_ASSERT(tile_x >= 0 && tile_x < mm->levels[0].xtiles);
+    DP_ASSERT(tile_y >= 0 && tile_y < mm->levels[0].ytiles);
+    if (mm->level_count > 1) {
+        downsample_into(mm, 0,
+                        tile_or_null ? DP_tile_pixels(tile_or_null) : NULL,
+                        tile_x, tile_y);
+    }
+}
+
+void DP_mipmap_update(DP_Mipmap *mm)
+{
+    DP_ASSERT(mm);
+    // The topmost level has no parent to propagate into.
+    for (int level = 1; level < mm->level_count - 1; ++level) {
+        DP_MipmapLevel *ml = &mm->levels[level];
+        for (int y = 0; y < ml->ytiles; ++y) {
+            for (int x = 0; x < ml->xtiles; ++x) {
+                unsigned char *flags = &ml->flags[y * ml->xtiles + x];
+                if (*flags & FLAG_PROPAGATE) {
+                    *flags &= (unsigned char)~FLAG_PROPAGATE;
+                    downsample_into(mm, level, level_tile_pixels(ml, x, y),
+                                    x, y);
+                }
+            }
+        }
+    }
+    if (mm->level_count > 1) {
+        DP_MipmapLevel *top = &mm->levels[mm->level_count - 1];
+        top->flags[0] &= (unsigned char)~FLAG_PROPAGATE;
+    }
+}
+
+const DP_Pixel *DP_mipmap_tile_pixels(DP_Mipmap *mm, int level, int tile_x,
+                                      int tile_y)
+{
+    DP_ASSERT(mm);
+    DP_ASSERT(level > 0);
+    DP_ASSERT(level < mm->level_count);
+    return level_tile_pixels(&mm->levels[level], tile_x, tile_y);
+}
+
+void DP_mipmap_dirty_take(DP_Mipmap *mm, int level, DP_MipmapTileFn fn,
+                          void *user)
+{
+    DP_ASSERT(mm);
+    DP_ASSERT(level > 0);
+    DP_ASSERT(level < mm->level_count);
+    DP_ASSERT(fn);
+    DP_MipmapLevel *ml = &mm->levels[level];
+    for (int y = 0; y < ml->ytiles; ++y) {
+        for (int x = 0; x < ml->xtiles; ++x) {
+            unsigned char *flags = &ml->flags[y * ml->xtiles + x];
+            if (*flags & FLAG_DIRTY) {
+                *flags &= (unsigned char)~FLAG_DIRTY;
+                fn(user, x, y);
+            }
+        }
+    }
+}
+
+void DP_mipmap_dirty_clear(DP_Mipmap *mm, int level)
+{
+    DP_ASSERT(mm);
+    DP_ASSERT(level > 0);
+    DP_ASSERT(level < mm->level_count);
+    DP_MipmapLevel *ml = &mm->levels[level];
+    int tile_total = ml->xtiles * ml->ytiles;
+    for (int i = 0; i < tile_total; ++i) {
+        ml->flags[i] &= (unsigned char)~FLAG_DIRTY;
+    }
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2022 askmeaboutloom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef DPENGINE_MIPMAP_H
+#define DPENGINE_MIPMAP_H
+#include <dpcommon/common.h>
+
+typedef union DP_Pixel DP_Pixel;
+typedef struct DP_Tile DP_Tile;
+
+
+#define DP_MIPMAP_MAX_LEVELS 16
+
+// A pyramid of progressively halved versions of a flattened canvas, built
+// up on the CPU from its tiles. Level 0 is the full-size canvas, which isn't
+// stored here, its tiles get downsampled into level 1 as they come in. Each
+// level has tiles of the usual size, a tile on one level covers four on the
+// level below it. Changed tiles are only carried up to the levels above when
+// DP_mipmap_update is called, so a tile whose children all changed in the
+// meantime only gets recomputed once.
+
+typedef struct DP_Mipmap DP_Mipmap;
+
+typedef void (*DP_MipmapTileFn)(void *user, int tile_x, int tile_y);
+
+DP_Mipmap *DP_mipmap_new(void);
+
+void DP_mipmap_free(DP_Mipmap *mm);
+
+
+// Discards all contents if the dimensions changed, every level is blank then.
+void DP_mipmap_resize(DP_Mipmap *mm, int width, int height);
+
+int DP_mipmap_width(DP_Mipmap *mm);
+
+int DP_mipmap_height(DP_Mipmap *mm);
+
+// Levels up to and including the one that fits into a single tile.
+int DP_mipmap_level_count(DP_Mipmap *mm);
+
+// Canvas dimensions on the given level, rounded up.
+int DP_mipmap_level_width(DP_Mipmap *mm, int level);
+
+int DP_mipmap_level_height(DP_Mipmap *mm, int level);
+
+
+// Downsamples the given level 0 tile into level 1, NULL means blank.
+void DP_mipmap_tile_set(DP_Mipmap *mm, int tile_x, int tile_y,
+                        DP_Tile *tile_or_null);
+
+// Recomputes the tiles on levels 2 and up whose children changed.
+void DP_mipmap_update(DP_Mipmap *mm);
+
+// Pixels of a tile on level 1 or up, DP_TILE_LENGTH of them.
+const DP_Pixel *DP_mipmap_tile_pixels(DP_Mipmap *mm, int level, int tile_x,
+                                      int tile_y);
+
+// Calls the given function for every tile on the given level that changed
+// since the last call, then forgets about them. Level 0 isn't tracked.
+void DP_mipmap_dirty_take(DP_Mipmap *mm, int level, DP_MipmapTileFn fn,
+                          void *user);
+
+// Forgets about the changes on the given level, like after re-uploading it.
+void DP_mipmap_dirty_clear(DP_Mipmap *mm, int level);
+
+
+#endif
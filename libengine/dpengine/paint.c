@@ -29,8 +29,12 @@
 #include "paint.h"
 #include "draw_context.h"
 #include "layer.h"
+#include "pixels.h"
+#include "tile.h"
 #include <dpcommon/common.h>
 #include <dpcommon/conversions.h>
+#include <dpcommon/threading.h>
+#include <dpcommon/worker.h>
 #include <dpmsg/message.h>
 #include <dpmsg/messages/draw_dabs.h>
 #include <SDL_atomic.h>
@@ -417,6 +421,431 @@ static void draw_dabs_pixel(DP_PaintDrawDabsParams *params,
 }
 
 
+// Parallel painting. Each pixel only needs to see the dabs in message order,
+// so once the stamps are generated, they get binned by the tiles they overlap
+// and every tile gets its dabs applied in order, independently of the others.
+// Tiles don't overlap, so the result is exactly the same as painting serially.
+// Stamps are generated in batches to keep memory usage bounded.
+
+#define PARALLEL_STAMP_BATCH_SIZE (8 * 1024 * 1024)
+#define PARALLEL_JOBS_PER_THREAD  4
+
+typedef struct DP_ParallelDab {
+    DP_BrushStamp stamp;
+    int x, y;
+    int size;
+    uint8_t hardness;
+    uint8_t opacity;
+    bool generate;
+} DP_ParallelDab;
+
+typedef struct DP_ParallelTileDab {
+    int tile_index;
+    int dab_index;
+} DP_ParallelTileDab;
+
+typedef struct DP_ParallelPaint DP_ParallelPaint;
+
+typedef struct DP_ParallelJob {
+    DP_ParallelPaint *pp;
+    void (*fn)(DP_ParallelPaint *, int, int, uint8_t *);
+    int start, end;
+    uint8_t *mask_buffer;
+} DP_ParallelJob;
+
+struct DP_ParallelPaint {
+    DP_PaintDrawDabsParams *params;
+    DP_TransientLayerData *tld;
+    void (*get_pixel_stamp)(DP_BrushStamp *, int, uint8_t);
+    DP_Worker *worker;
+    DP_Semaphore *sem_done;
+    int last_x, last_y;
+    int dab_count;
+    DP_ParallelDab *dabs;
+    uint8_t *stamp_buffer;
+    int tile_dab_count;
+    int tile_dab_capacity;
+    DP_ParallelTileDab *tile_dabs;
+    int tile_count;
+    int *tile_starts;
+    DP_TransientTile **tiles;
+    int job_count;
+    DP_ParallelJob *jobs;
+};
+
+
+static int classic_stamp_diameter(double radius)
+{
+    // Same calculation as in get_mask and get_high_res_mask.
+    int raw_diameter = DP_double_to_int(ceil(radius) + 2.0);
+    return raw_diameter % 2 == 0 ? raw_diameter + 1 : raw_diameter;
+}
+
+static int collect_classic_dabs(DP_ParallelPaint *pp, int start)
+{
+    DP_PaintDrawDabsParams *params = pp->params;
+    int dab_count = params->dab_count;
+    size_t offset = 0;
+    int count = 0;
+    for (int i = start; i < dab_count; ++i) {
+        DP_ClassicBrushDab *dab = DP_classic_brush_dab_at(params->dabs, i);
+        int size = DP_classic_brush_dab_size(dab);
+        int diameter = classic_stamp_diameter(size / 256.0);
+        size_t stamp_size = DP_int_to_size(DP_square_int(diameter));
+        if (count != 0 && offset + stamp_size > PARALLEL_STAMP_BATCH_SIZE) {
+            break;
+        }
+        int x = pp->last_x + DP_classic_brush_dab_x(dab);
+        int y = pp->last_y + DP_classic_brush_dab_y(dab);
+        pp->dabs[count++] = (DP_ParallelDab){
+            {0, 0, diameter, pp->stamp_buffer + offset},
+            x,
+            y,
+            size,
+            DP_classic_brush_dab_hardness(dab),
+            DP_classic_brush_dab_opacity(dab),
+            true};
+        offset += stamp_size;
+        pp->last_x = x;
+        pp->last_y = y;
+    }
+    pp->dab_count = count;
+    return start + count;
+}
+
+static int collect_pixel_dabs(DP_ParallelPaint *pp, int start)
+{
+    DP_PaintDrawDabsParams *params = pp->params;
+    int dab_count = params->dab_count;
+    size_t offset = 0;
+    int count = 0;
+    uint8_t *data = NULL;
+    int last_size = -1;
+    uint8_t last_opacity = 0;
+    for (int i = start; i < dab_count; ++i) {
+        DP_PixelBrushDab *dab = DP_pixel_brush_dab_at(params->dabs, i);
+        int size = DP_pixel_brush_dab_size(dab);
+        uint8_t opacity = DP_pixel_brush_dab_opacity(dab);
+        // Consecutive dabs of the same size and opacity share their stamp.
+        bool generate = size != last_size || opacity != last_opacity;
+        if (generate) {
+            size_t stamp_size = DP_int_to_size(DP_square_int(size));
+            if (count != 0 && offset + stamp_size > PARALLEL_STAMP_BATCH_SIZE) {
+                break;
+            }
+            data = pp->stamp_buffer + offset;
+            offset += stamp_size;
+            last_size = size;
+            last_opacity = opacity;
+        }
+        int x = pp->last_x + DP_pixel_brush_dab_x(dab);
+        int y = pp->last_y + DP_pixel_brush_dab_y(dab);
+        int stamp_offset = size / 2;
+        pp->dabs[count++] = (DP_ParallelDab){
+            {y - stamp_offset, x - stamp_offset, size, data},
+            x,
+            y,
+            size,
+            0,
+            opacity,
+            generate};
+        pp->last_x = x;
+        pp->last_y = y;
+    }
+    pp->dab_count = count;
+    return start + count;
+}
+
+
+static void run_job(void *user)
+{
+    DP_ParallelJob *job = user;
+    job->fn(job->pp, job->start, job->end, job->mask_buffer);
+    DP_SEMAPHORE_MUST_POST(job->pp->sem_done);
+}
+
+static void run_parallel(DP_ParallelPaint *pp, int count,
+                         void (*fn)(DP_ParallelPaint *, int, int, uint8_t *))
+{
+    int job_count = DP_min_int(count, pp->job_count);
+    for (int i = 0; i < job_count; ++i) {
+        DP_ParallelJob *job = &pp->jobs[i];
+        job->fn = fn;
+        job->start = count * i / job_count;
+        job->end = count * (i + 1) / job_count;
+        DP_worker_push(pp->worker, run_job, job);
+    }
+    for (int i = 0; i < job_count; ++i) {
+        DP_SEMAPHORE_MUST_WAIT(pp->sem_done);
+    }
+}
+
+static void generate_classic_stamps(DP_ParallelPaint *pp, int start, int end,
+                                    uint8_t *mask_buffer)
+{
+    DP_BrushStamp mask_stamp = {0, 0, 0, mask_buffer};
+    for (int i = start; i < end; ++i) {
+        DP_ParallelDab *pd = &pp->dabs[i];
+        get_classic_mask_stamp(&mask_stamp, pd->size / 256.0,
+                               pd->hardness / 255.0, pd->opacity / 255.0);
+        DP_ASSERT(mask_stamp.diameter == pd->stamp.diameter);
+        get_classic_offset_stamp(&pd->stamp, &mask_stamp, pd->x / 4.0,
+                                 pd->y / 4.0);
+    }
+}
+
+static void generate_pixel_stamps(DP_ParallelPaint *pp, int start, int end,
+                                  DP_UNUSED uint8_t *mask_buffer)
+{
+    for (int i = start; i < end; ++i) {
+        DP_ParallelDab *pd = &pp->dabs[i];
+        if (pd->generate) {
+            pp->get_pixel_stamp(&pd->stamp, pd->size, pd->opacity);
+        }
+    }
+}
+
+
+static void push_tile_dab(DP_ParallelPaint *pp, int tile_index, int dab_index)
+{
+    if (pp->tile_dab_count == pp->tile_dab_capacity) {
+        pp->tile_dab_capacity *= 2;
+        pp->tile_dabs = DP_realloc(
+            pp->tile_dabs,
+            sizeof(*pp->tile_dabs) * DP_int_to_size(pp->tile_dab_capacity));
+    }
+    pp->tile_dabs[pp->tile_dab_count++] =
+        (DP_ParallelTileDab){tile_index, dab_index};
+}
+
+static int compare_tile_dabs(const void *a, const void *b)
+{
+    const DP_ParallelTileDab *ta = a;
+    const DP_ParallelTileDab *tb = b;
+    if (ta->tile_index != tb->tile_index) {
+        return ta->tile_index < tb->tile_index ? -1 : 1;
+    }
+    else {
+        return ta->dab_index < tb->dab_index ? -1
+             : ta->dab_index > tb->dab_index ? 1
+                                             : 0;
+    }
+}
+
+// Figures out which tiles each dab overlaps, in the same way that
+// DP_transient_layer_data_brush_stamp_apply does, then groups them by tile
+// and makes those tiles transient. That last part isn't thread-safe, so it
+// has to happen up front.
+static void bin_dabs(DP_ParallelPaint *pp)
+{
+    DP_TransientLayerData *tld = pp->tld;
+    int width = DP_transient_layer_data_width(tld);
+    int height = DP_transient_layer_data_height(tld);
+    int xtiles = DP_tile_count_round(width);
+    pp->tile_dab_count = 0;
+    for (int i = 0; i < pp->dab_count; ++i) {
+        DP_BrushStamp *stamp = &pp->dabs[i].stamp;
+        int left = stamp->left;
+        int top = stamp->top;
+        int d = stamp->diameter;
+        int x0 = DP_max_int(left, 0);
+        int y0 = DP_max_int(top, 0);
+        int right = DP_min_int(left + d, width);
+        int bottom = DP_min_int(top + d, height);
+        if (x0 < right && y0 < bottom) {
+            for (int ty = y0 / DP_TILE_SIZE; ty <= (bottom - 1) / DP_TILE_SIZE;
+                 ++ty) {
+                for (int tx = x0 / DP_TILE_SIZE;
+                     tx <= (right - 1) / DP_TILE_SIZE; ++tx) {
+                    push_tile_dab(pp, ty * xtiles + tx, i);
+                }
+            }
+        }
+    }
+
+    qsort(pp->tile_dabs, DP_int_to_size(pp->tile_dab_count),
+          sizeof(*pp->tile_dabs), compare_tile_dabs);
+
+    // There's at most one tile per tile dab, so these arrays are big enough.
+    pp->tile_starts = DP_realloc(pp->tile_starts,
+                                 sizeof(*pp->tile_starts)
+                                     * DP_int_to_size(pp->tile_dab_count + 1));
+    pp->tiles = DP_realloc(pp->tiles,
+                           sizeof(*pp->tiles)
+                               * DP_int_to_size(pp->tile_dab_count + 1));
+    unsigned int context_id = pp->params->context_id;
+    int tile_count = 0;
+    for (int i = 0; i < pp->tile_dab_count; ++i) {
+        int tile_index = pp->tile_dabs[i].tile_index;
+        if (i == 0 || tile_index != pp->tile_dabs[i - 1].tile_index) {
+            pp->tile_starts[tile_count] = i;
+            pp->tiles[tile_count] = DP_transient_layer_data_transient_tile_at(
+                tld, context_id, tile_index);
+            ++tile_count;
+        }
+    }
+    pp->tile_starts[tile_count] = pp->tile_dab_count;
+    pp->tile_count = tile_count;
+}
+
+static void apply_stamp_to_tile(DP_TransientTile *tt, int tile_x, int tile_y,
+                                DP_Pixel src, int blend_mode,
+                                DP_BrushStamp *stamp)
+{
+    int left = stamp->left;
+    int top = stamp->top;
+    int d = stamp->diameter;
+    int tile_left = tile_x * DP_TILE_SIZE;
+    int tile_top = tile_y * DP_TILE_SIZE;
+    int x0 = DP_max_int(left, tile_left);
+    int y0 = DP_max_int(top, tile_top);
+    int w = DP_min_int(left + d, tile_left + DP_TILE_SIZE) - x0;
+    int h = DP_min_int(top + d, tile_top + DP_TILE_SIZE) - y0;
+    uint8_t *mask = stamp->data + (y0 - top) * d + (x0 - left);
+    DP_transient_tile_brush_apply(tt, src, blend_mode, mask, x0 - tile_left,
+                                  y0 - tile_top, w, h, d - w);
+}
+
+static void apply_tiles(DP_ParallelPaint *pp, int start, int end,
+                        DP_UNUSED uint8_t *mask_buffer)
+{
+    DP_PaintDrawDabsParams *params = pp->params;
+    DP_Pixel src = {params->color};
+    int blend_mode = params->blend_mode;
+    int xtiles = DP_tile_count_round(DP_transient_layer_data_width(pp->tld));
+    for (int i = start; i < end; ++i) {
+        DP_TransientTile *tt = pp->tiles[i];
+        int tile_index = pp->tile_dabs[pp->tile_starts[i]].tile_index;
+        int tile_x = tile_index % xtiles;
+        int tile_y = tile_index / xtiles;
+        for (int j = pp->tile_starts[i]; j < pp->tile_starts[i + 1]; ++j) {
+            DP_ParallelDab *pd = &pp->dabs[pp->tile_dabs[j].dab_index];
+            apply_stamp_to_tile(tt, tile_x, tile_y, src, blend_mode,
+                                &pd->stamp);
+        }
+    }
+}
+
+// Size of the stamp buffer needed for the first batch, which is an upper bound
+// for the ones that come after it.
+static size_t stamp_buffer_size(DP_PaintDrawDabsParams *params)
+{
+    size_t size = 0;
+    int dab_count = params->dab_count;
+    bool classic = params->type == DP_MSG_DRAW_DABS_CLASSIC;
+    for (int i = 0; i < dab_count && size < PARALLEL_STAMP_BATCH_SIZE; ++i) {
+        int d = classic
+                  ? classic_stamp_diameter(
+                      DP_classic_brush_dab_size(
+                          DP_classic_brush_dab_at(params->dabs, i))
+                      / 256.0)
+                  : DP_pixel_brush_dab_size(
+                      DP_pixel_brush_dab_at(params->dabs, i));
+        size += DP_int_to_size(DP_square_int(d));
+    }
+    return DP_min_size(size, PARALLEL_STAMP_BATCH_SIZE);
+}
+
+static void draw_dabs_parallel(DP_PaintDrawDabsParams *params,
+                               DP_TransientLayerData *tld, DP_Worker *worker,
+                               void (*get_pixel_stamp)(DP_BrushStamp *, int,
+                                                       uint8_t))
+{
+    bool classic = params->type == DP_MSG_DRAW_DABS_CLASSIC;
+    int job_count =
+        DP_min_int(DP_worker_thread_count(worker) * PARALLEL_JOBS_PER_THREAD,
+                   params->dab_count);
+    DP_ParallelPaint pp = {
+        params,
+        tld,
+        get_pixel_stamp,
+        worker,
+        DP_semaphore_new(0),
+        params->origin_x,
+        params->origin_y,
+        0,
+        DP_malloc(sizeof(*pp.dabs) * DP_int_to_size(params->dab_count)),
+        DP_malloc(DP_max_size(stamp_buffer_size(params), 1)),
+        0,
+        params->dab_count,
+        DP_malloc(sizeof(*pp.tile_dabs) * DP_int_to_size(params->dab_count)),
+        0,
+        NULL,
+        NULL,
+        job_count,
+        DP_malloc(sizeof(*pp.jobs) * DP_int_to_size(job_count)),
+    };
+    for (int i = 0; i < job_count; ++i) {
+        pp.jobs[i] = (DP_ParallelJob){
+            &pp, NULL, 0, 0,
+            classic ? DP_malloc(DP_DRAW_CONTEXT_STAMP_BUFFER_SIZE) : NULL};
+    }
+
+    int next = 0;
+    while (next < params->dab_count) {
+        if (classic) {
+            next = collect_classic_dabs(&pp, next);
+            run_parallel(&pp, pp.dab_count, generate_classic_stamps);
+        }
+        else {
+            next = collect_pixel_dabs(&pp, next);
+            run_parallel(&pp, pp.dab_count, generate_pixel_stamps);
+        }
+        bin_dabs(&pp);
+        run_parallel(&pp, pp.tile_count, apply_tiles);
+    }
+
+    for (int i = 0; i < job_count; ++i) {
+        DP_free(pp.jobs[i].mask_buffer);
+    }
+    DP_free(pp.jobs);
+    DP_free(pp.tiles);
+    DP_free(pp.tile_starts);
+    DP_free(pp.tile_dabs);
+    DP_free(pp.stamp_buffer);
+    DP_free(pp.dabs);
+    DP_semaphore_free(pp.sem_done);
+}
+
+// Rough number of pixels the dabs cover, to decide if it's worth going
+// parallel. Classic dab sizes are in 256ths of a pixel.
+static long long estimate_dab_area(DP_PaintDrawDabsParams *params)
+{
+    long long area = 0;
+    int dab_count = params->dab_count;
+    if (params->type == DP_MSG_DRAW_DABS_CLASSIC) {
+        for (int i = 0; i < dab_count; ++i) {
+            DP_ClassicBrushDab *dab = DP_classic_brush_dab_at(params->dabs, i);
+            long long d = DP_classic_brush_dab_size(dab) / 256 + 2;
+            area += d * d;
+        }
+    }
+    else {
+        for (int i = 0; i < dab_count; ++i) {
+            DP_PixelBrushDab *dab = DP_pixel_brush_dab_at(params->dabs, i);
+            long long d = DP_pixel_brush_dab_size(dab);
+            area += d * d;
+        }
+    }
+    return area;
+}
+
+static bool should_draw_parallel(DP_PaintDrawDabsParams *params,
+                                 DP_Worker **out_worker)
+{
+    int min_area;
+    DP_Worker *worker =
+        DP_draw_context_paint_worker(params->draw_context, &min_area);
+    if (worker && estimate_dab_area(params) >= min_area) {
+        *out_worker = worker;
+        return true;
+    }
+    else {
+        return false;
+    }
+}
+
+
 bool DP_paint_draw_dabs(DP_PaintDrawDabsParams *params,
                         DP_TransientLayerData *tld)
 {
@@ -424,18 +853,67 @@ bool DP_paint_draw_dabs(DP_PaintDrawDabsParams *params,
     DP_ASSERT(tld);
     DP_ASSERT(params->dab_count > 0); // This should be checked beforehand.
     int type = params->type;
+    DP_Worker *worker;
     switch (type) {
     case DP_MSG_DRAW_DABS_CLASSIC:
-        draw_dabs_classic(params, tld);
+        if (should_draw_parallel(params, &worker)) {
+            draw_dabs_parallel(params, tld, worker, NULL);
+        }
+        else {
+            draw_dabs_classic(params, tld);
+        }
         return true;
     case DP_MSG_DRAW_DABS_PIXEL:
-        draw_dabs_pixel(params, tld, get_round_pixel_mask_stamp);
+        if (should_draw_parallel(params, &worker)) {
+            draw_dabs_parallel(params, tld, worker, get_round_pixel_mask_stamp);
+        }
+        else {
+            draw_dabs_pixel(params, tld, get_round_pixel_mask_stamp);
+        }
         return true;
     case DP_MSG_DRAW_DABS_PIXEL_SQUARE:
-        draw_dabs_pixel(params, tld, get_square_pixel_mask_stamp);
+        if (should_draw_parallel(params, &worker)) {
+            draw_dabs_parallel(params, tld, worker,
+                               get_square_pixel_mask_stamp);
+        }
+        else {
+            draw_dabs_pixel(params, tld, get_square_pixel_mask_stamp);
+        }
         return true;
     default:
         DP_error_set("Unknown paint type %d", type);
         return false;
     }
 }
+
+
+uint8_t *DP_paint_classic_stamp(DP_DrawContext *dc, int x, int y, int size,
+                                uint8_t hardness, uint8_t opacity,
+                                int *out_diameter)
+{
+    DP_ASSERT(dc);
+    DP_ASSERT(out_diameter);
+    DP_BrushStamp mask_stamp = make_brush_stamp1(dc);
+    DP_BrushStamp offset_stamp = make_brush_stamp2(dc);
+    get_classic_mask_stamp(&mask_stamp, size / 256.0, hardness / 255.0,
+                           opacity / 255.0);
+    get_classic_offset_stamp(&offset_stamp, &mask_stamp, x / 4.0, y / 4.0);
+    *out_diameter = offset_stamp.diameter;
+    return offset_stamp.data;
+}
+
+uint8_t *DP_paint_pixel_stamp(DP_DrawContext *dc, bool square, int size,
+                              uint8_t opacity, int *out_diameter)
+{
+    DP_ASSERT(dc);
+    DP_ASSERT(out_diameter);
+    DP_BrushStamp stamp = make_brush_stamp1(dc);
+    if (square) {
+        get_square_pixel_mask_stamp(&stamp, size, opacity);
+    }
+    else {
+        get_round_pixel_mask_stamp(&stamp, size, opacity);
+    }
+    *out_diameter = stamp.diameter;
+    return stamp.data;
+}
@@ -62,4 +62,16 @@ bool DP_paint_draw_dabs(DP_PaintDrawDabsParams *params,
                         DP_TransientLayerData *tld) DP_MUST_CHECK;
 
 
+// Generate the stamp for a single dab into the draw context's stamp buffers,
+// the same way that drawing dabs does. The coordinates of classic dabs are in
+// quarter pixels, their size is in 1/256 pixels. Returns the stamp data, which
+// is a square of the returned diameter.
+uint8_t *DP_paint_classic_stamp(DP_DrawContext *dc, int x, int y, int size,
+                                uint8_t hardness, uint8_t opacity,
+                                int *out_diameter);
+
+uint8_t *DP_paint_pixel_stamp(DP_DrawContext *dc, bool square, int size,
+                              uint8_t opacity, int *out_diameter);
+
+
 #endif
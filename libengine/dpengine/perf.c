@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2022 askmeaboutloom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "perf.h"
+#include <dpcommon/common.h>
+#include <dpcommon/thread_slots.h>
+#include <dpmsg/message.h>
+#include <SDL_atomic.h>
+#include <SDL_timer.h>
+
+
+typedef struct DP_PerfSlot {
+    DP_ThreadSlot slot;
+    DP_PerfStats stats;
+} DP_PerfSlot;
+
+static SDL_atomic_t perf_enabled;
+static DP_ThreadSlots perf_slots = DP_THREAD_SLOTS_INIT(DP_PerfSlot, 0, NULL);
+static SDL_SpinLock baseline_lock;
+static DP_PerfStats *baseline;
+
+
+void DP_perf_enable(bool enable)
+{
+    SDL_AtomicSet(&perf_enabled, enable ? 1 : 0);
+}
+
+bool DP_perf_enabled(void)
+{
+    return SDL_AtomicGet(&perf_enabled) != 0;
+}
+
+
+static void add_timing(DP_PerfTiming *dst, const DP_PerfTiming *src, int sign)
+{
+    dst->count += (unsigned long long)sign * src->count;
+    dst->total_ns += (unsigned long long)sign * src->total_ns;
+    for (int i = 0; i < DP_PERF_BUCKET_COUNT; ++i) {
+        dst->buckets[i] += (unsigned long long)sign * src->buckets[i];
+    }
+}
+
+// Unsigned arithmetic wraps, so a sign of -1 subtracts.
+static void add_stats(DP_PerfStats *dst, const DP_PerfStats *src, int sign)
+{
+    for (int i = 0; i < DP_MSG_COUNT; ++i) {
+        add_timing(&dst->handle[i], &src->handle[i], sign);
+        add_timing(&dst->history[i], &src->history[i], sign);
+    }
+    add_timing(&dst->undo_replay, &src->undo_replay, sign);
+    for (int i = 0; i < DP_PERF_BUCKET_COUNT; ++i) {
+        dst->undo_replay_lengths[i] +=
+            (unsigned long long)sign * src->undo_replay_lengths[i];
+    }
+    dst->uploads.calls += (unsigned long long)sign * src->uploads.calls;
+    dst->uploads.tiles += (unsigned long long)sign * src->uploads.tiles;
+    dst->uploads.bytes += (unsigned long long)sign * src->uploads.bytes;
+}
+
+static void sum_slots(DP_PerfStats *out_stats)
+{
+    *out_stats = (DP_PerfStats){0};
+    DP_PerfStats *tmp = DP_malloc(sizeof(*tmp));
+    for (DP_ThreadSlot *slot = DP_thread_slots_first(&perf_slots); slot;
+         slot = slot->next) {
+        DP_thread_slot_read(slot, tmp, &((DP_PerfSlot *)slot)->stats,
+                            sizeof(*tmp));
+        add_stats(out_stats, tmp, 1);
+    }
+    DP_free(tmp);
+}
+
+void DP_perf_stats(DP_PerfStats *out_stats)
+{
+    DP_ASSERT(out_stats);
+    sum_slots(out_stats);
+    SDL_AtomicLock(&baseline_lock);
+    if (baseline) {
+        add_stats(out_stats, baseline, -1);
+    }
+    SDL_AtomicUnlock(&baseline_lock);
+}
+
+void DP_perf_reset(void)
+{
+    DP_PerfStats *stats = DP_malloc(sizeof(*stats));
+    sum_slots(stats);
+    SDL_AtomicLock(&baseline_lock);
+    DP_PerfStats *prev = baseline;
+    baseline = stats;
+    SDL_AtomicUnlock(&baseline_lock);
+    DP_free(prev);
+}
+
+
+static DP_PerfSlot *begin_write(void)
+{
+    DP_PerfSlot *slot = (DP_PerfSlot *)DP_thread_slot_get(&perf_slots);
+    DP_thread_slot_write_begin(&slot->slot);
+    return slot;
+}
+
+static void end_write(DP_PerfSlot *slot)
+{
+    DP_thread_slot_write_end(&slot->slot);
+}
+
+
+static int bucket_for(unsigned long long value)
+{
+    int bucket = 0;
+    while (value != 0 && bucket < DP_PERF_BUCKET_COUNT - 1) {
+        value >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+static void record_timing(DP_PerfTiming *timing, unsigned long long ns)
+{
+    ++timing->count;
+    timing->total_ns += ns;
+    ++timing->buckets[bucket_for(ns / 1000)];
+}
+
+static DP_PerfTiming *get_timing(DP_PerfSlot *slot, DP_PerfCategory category,
+                                 DP_MessageType type)
+{
+    return category == DP_PERF_HANDLE ? &slot->stats.handle[type]
+                                      : &slot->stats.history[type];
+}
+
+static unsigned long long elapsed_ns(unsigned long long start)
+{
+    Uint64 end = SDL_GetPerformanceCounter();
+    return (unsigned long long)((double)(end - start) * 1e9
+                                / (double)SDL_GetPerformanceFrequency());
+}
+
+unsigned long long DP_perf_begin(void)
+{
+    return SDL_AtomicGet(&perf_enabled) ? SDL_GetPerformanceCounter() : 0;
+}
+
+void DP_perf_end(DP_PerfCategory category, DP_MessageType type,
+                 unsigned long long start)
+{
+    if (start != 0) {
+        unsigned long long ns = elapsed_ns(start);
+        DP_PerfSlot *slot = begin_write();
+        record_timing(get_timing(slot, category, type), ns);
+        end_write(slot);
+    }
+}
+
+void DP_perf_end_undo_replay(int length, unsigned long long start)
+{
+    if (start != 0) {
+        unsigned long long ns = elapsed_ns(start);
+        DP_PerfSlot *slot = begin_write();
+        record_timing(&slot->stats.undo_replay, ns);
+        int bucket = bucket_for(length < 0 ? 0u : (unsigned long long)length);
+        ++slot->stats.undo_replay_lengths[bucket];
+        end_write(slot);
+    }
+}
+
+void DP_perf_record_uploads(int calls, int tiles, size_t bytes)
+{
+    if (SDL_AtomicGet(&perf_enabled) && calls > 0) {
+        DP_PerfSlot *slot = begin_write();
+        slot->stats.uploads.calls += (unsigned long long)calls;
+        slot->stats.uploads.tiles += (unsigned long long)DP_max_int(tiles, 0);
+        slot->stats.uploads.bytes += (unsigned long long)bytes;
+        end_write(slot);
+    }
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2022 askmeaboutloom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef DPENGINE_PERF_H
+#define DPENGINE_PERF_H
+#include <dpcommon/common.h>
+#include <dpmsg/message.h>
+
+
+// Opt-in timing of message handling, cheap enough to leave on. Every thread
+// counts into its own slot, those get summed up when the stats are read, so
+// recording never contends with other threads.
+
+// Latencies are bucketed by powers of two: bucket 0 counts anything under a
+// microsecond, bucket n counts from 2^(n-1) up to 2^n microseconds and the
+// last bucket counts everything beyond. Undo replay lengths are bucketed the
+// same way, just by the number of replayed history entries.
+#define DP_PERF_BUCKET_COUNT 24
+
+typedef struct DP_PerfTiming {
+    unsigned long long count;
+    unsigned long long total_ns;
+    unsigned long long buckets[DP_PERF_BUCKET_COUNT];
+} DP_PerfTiming;
+
+// Texture uploads by the renderer, which reports them itself. A call is a
+// single upload, which may cover several tiles at once.
+typedef struct DP_PerfUploads {
+    unsigned long long calls;
+    unsigned long long tiles;
+    unsigned long long bytes;
+} DP_PerfUploads;
+
+typedef struct DP_PerfStats {
+    // Handling of drawing commands in DP_canvas_state_handle.
+    DP_PerfTiming handle[DP_MSG_COUNT];
+    // Handling in the canvas history, which includes the above as well as
+    // undos, resets and publishing the resulting state. Messages handled in
+    // parallel only count their own handling on whichever thread ran them.
+    DP_PerfTiming history[DP_MSG_COUNT];
+    DP_PerfTiming undo_replay;
+    unsigned long long undo_replay_lengths[DP_PERF_BUCKET_COUNT];
+    DP_PerfUploads uploads;
+} DP_PerfStats;
+
+typedef enum DP_PerfCategory {
+    DP_PERF_HANDLE,
+    DP_PERF_HISTORY,
+} DP_PerfCategory;
+
+
+void DP_perf_enable(bool enable);
+
+bool DP_perf_enabled(void);
+
+// Sums up the stats of all threads since the last reset. The stats are pretty
+// large, so they get written to the given pointer instead of being returned.
+void DP_perf_stats(DP_PerfStats *out_stats);
+
+void DP_perf_reset(void);
+
+
+// Returns a performance counter value to pass to the functions below, or zero
+// if recording is disabled, in which case they don't record anything.
+unsigned long long DP_perf_begin(void);
+
+void DP_perf_end(DP_PerfCategory category, DP_MessageType type,
+                 unsigned long long start);
+
+void DP_perf_end_undo_replay(int length, unsigned long long start);
+
+// Doesn't record anything if recording is disabled.
+void DP_perf_record_uploads(int calls, int tiles, size_t bytes);
+
+
+#endif
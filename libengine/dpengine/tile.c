@@ -26,8 +26,17 @@
 #include <dpcommon/binary.h>
 #include <dpcommon/common.h>
 #include <dpcommon/conversions.h>
+#include <dpcommon/memory_stats.h>
 #include <SDL_atomic.h>
 
+#define INTERN_INITIAL_CAPACITY 1024
+
+
+typedef struct DP_TileInternLink {
+    bool interned;
+    uint64_t hash;
+    DP_Tile *next;
+} DP_TileInternLink;
 
 #ifdef DP_NO_STRICT_ALIASING
 
@@ -35,6 +44,7 @@ struct DP_Tile {
     SDL_atomic_t refcount;
     const bool transient;
     const unsigned int context_id;
+    DP_TileInternLink intern;
     DP_Pixel pixels[DP_TILE_LENGTH];
 };
 
@@ -42,6 +52,7 @@ struct DP_TransientTile {
     SDL_atomic_t refcount;
     bool transient;
     unsigned int context_id;
+    DP_TileInternLink intern;
     DP_Pixel pixels[DP_TILE_LENGTH];
 };
 
@@ -51,22 +62,220 @@ struct DP_Tile {
     SDL_atomic_t refcount;
     bool transient;
     unsigned int context_id;
+    DP_TileInternLink intern;
     DP_Pixel pixels[DP_TILE_LENGTH];
 };
 
 #endif
 
 
+// Optional table of persistent tiles by their content, so that tiles with the
+// same pixels collapse into a single one. The table doesn't hold references,
+// tiles take themselves out when they get freed. Lookups only take tiles
+// whose refcount hasn't dropped to zero yet, since those are about to go.
+typedef struct DP_TileInternTable {
+    SDL_SpinLock lock;
+    SDL_atomic_t enabled;
+    size_t capacity;
+    size_t count;
+    DP_Tile **buckets;
+    unsigned long long lookups;
+    unsigned long long hits;
+} DP_TileInternTable;
+
+static DP_TileInternTable intern_table;
+
+
 static void *alloc_tile(bool transient, unsigned int context_id)
 {
     DP_TransientTile *tt = DP_malloc(sizeof(*tt));
+    DP_memory_add(DP_MEMORY_TILES_UNIQUE, sizeof(*tt));
     SDL_AtomicSet(&tt->refcount, 1);
     tt->transient = transient;
     tt->context_id = context_id;
+    tt->intern = (DP_TileInternLink){false, 0, NULL};
     return tt;
 }
 
 
+// Runs four independent lanes over the pixels so that the multiplications
+// don't have to wait on each other, then mixes them together at the end.
+static uint64_t hash_pixels(const DP_Pixel *pixels)
+{
+    const unsigned char *data = (const unsigned char *)pixels;
+    uint64_t lanes[4] = {0x9e3779b97f4a7c15u, 0xc2b2ae3d27d4eb4fu,
+                         0x165667b19e3779f9u, 0x27d4eb2f165667c5u};
+    for (size_t i = 0; i < DP_TILE_BYTES; i += sizeof(lanes)) {
+        for (int j = 0; j < 4; ++j) {
+            uint64_t word;
+            memcpy(&word, data + i + (size_t)j * sizeof(word), sizeof(word));
+            lanes[j] = (lanes[j] ^ word) * 0x100000001b3u;
+            lanes[j] ^= lanes[j] >> 29;
+        }
+    }
+    uint64_t hash = lanes[0];
+    for (int j = 1; j < 4; ++j) {
+        hash = (hash ^ lanes[j]) * 0xff51afd7ed558ccdu;
+        hash ^= hash >> 33;
+    }
+    return hash;
+}
+
+static size_t intern_bucket(uint64_t hash, size_t capacity)
+{
+    return (size_t)(hash & (capacity - 1));
+}
+
+// Like DP_tile_incref, but fails if the tile is already on its way out.
+static bool intern_try_incref(DP_Tile *tile)
+{
+    while (true) {
+        int refcount = SDL_AtomicGet(&tile->refcount);
+        if (refcount <= 0) {
+            return false;
+        }
+        else if (SDL_AtomicCAS(&tile->refcount, refcount, refcount + 1)) {
+            if (refcount == 1) {
+                DP_memory_move(DP_MEMORY_TILES_UNIQUE, DP_MEMORY_TILES_SHARED,
+                               sizeof(*tile));
+            }
+            return true;
+        }
+    }
+}
+
+static DP_Tile *intern_find(uint64_t hash, DP_Tile *tile)
+{
+    DP_TileInternTable *it = &intern_table;
+    if (it->capacity == 0) {
+        return NULL;
+    }
+    for (DP_Tile *t = it->buckets[intern_bucket(hash, it->capacity)]; t;
+         t = t->intern.next) {
+        if (t->intern.hash == hash && t->context_id == tile->context_id
+            && memcmp(t->pixels, tile->pixels, DP_TILE_BYTES) == 0
+            && intern_try_incref(t)) {
+            return t;
+        }
+    }
+    return NULL;
+}
+
+static void intern_grow(void)
+{
+    DP_TileInternTable *it = &intern_table;
+    size_t old_capacity = it->capacity;
+    size_t new_capacity =
+        old_capacity == 0 ? INTERN_INITIAL_CAPACITY : old_capacity * 2;
+    DP_Tile **old_buckets = it->buckets;
+    DP_Tile **new_buckets = DP_malloc(sizeof(*new_buckets) * new_capacity);
+    for (size_t i = 0; i < new_capacity; ++i) {
+        new_buckets[i] = NULL;
+    }
+    for (size_t i = 0; i < old_capacity; ++i) {
+        DP_Tile *t = old_buckets[i];
+        while (t) {
+            DP_Tile *next = t->intern.next;
+            size_t bucket = intern_bucket(t->intern.hash, new_capacity);
+            t->intern.next = new_buckets[bucket];
+            new_buckets[bucket] = t;
+            t = next;
+        }
+    }
+    DP_free(old_buckets);
+    it->buckets = new_buckets;
+    it->capacity = new_capacity;
+}
+
+static void intern_insert(uint64_t hash, DP_Tile *tile)
+{
+    DP_TileInternTable *it = &intern_table;
+    if (it->count >= it->capacity) {
+        intern_grow();
+    }
+    size_t bucket = intern_bucket(hash, it->capacity);
+    tile->intern = (DP_TileInternLink){true, hash, it->buckets[bucket]};
+    it->buckets[bucket] = tile;
+    ++it->count;
+}
+
+static void intern_remove(DP_Tile *tile)
+{
+    DP_TileInternTable *it = &intern_table;
+    SDL_AtomicLock(&it->lock);
+    DP_Tile **pp = &it->buckets[intern_bucket(tile->intern.hash, it->capacity)];
+    while (*pp != tile) {
+        DP_ASSERT(*pp);
+        pp = &(*pp)->intern.next;
+    }
+    *pp = tile->intern.next;
+    --it->count;
+    SDL_AtomicUnlock(&it->lock);
+}
+
+// Takes ownership of the given persistent tile and returns either it or an
+// equal tile from the table. The given tile is only swapped out if nobody
+// else holds a reference to it, otherwise it just gets added to the table.
+static DP_Tile *intern(DP_Tile *tile)
+{
+    DP_ASSERT(!tile->transient);
+    DP_TileInternTable *it = &intern_table;
+    if (!SDL_AtomicGet(&it->enabled) || tile->intern.interned) {
+        return tile;
+    }
+
+    uint64_t hash = hash_pixels(tile->pixels);
+    bool unique = SDL_AtomicGet(&tile->refcount) == 1;
+    SDL_AtomicLock(&it->lock);
+    ++it->lookups;
+    DP_Tile *found = unique ? intern_find(hash, tile) : NULL;
+    if (found) {
+        ++it->hits;
+    }
+    else {
+        intern_insert(hash, tile);
+    }
+    SDL_AtomicUnlock(&it->lock);
+
+    if (found) {
+        DP_tile_decref(tile);
+        return found;
+    }
+    else {
+        return tile;
+    }
+}
+
+
+void DP_tile_intern_enable(bool enable)
+{
+    SDL_AtomicSet(&intern_table.enabled, enable ? 1 : 0);
+}
+
+bool DP_tile_intern_enabled(void)
+{
+    return SDL_AtomicGet(&intern_table.enabled);
+}
+
+void DP_tile_intern_stats(DP_TileInternStats *out_stats)
+{
+    DP_ASSERT(out_stats);
+    DP_TileInternTable *it = &intern_table;
+    SDL_AtomicLock(&it->lock);
+    *out_stats = (DP_TileInternStats){it->lookups, it->hits, it->count};
+    SDL_AtomicUnlock(&it->lock);
+}
+
+void DP_tile_intern_stats_reset(void)
+{
+    DP_TileInternTable *it = &intern_table;
+    SDL_AtomicLock(&it->lock);
+    it->lookups = 0;
+    it->hits = 0;
+    SDL_AtomicUnlock(&it->lock);
+}
+
+
 DP_Tile *DP_tile_new(unsigned int context_id)
 {
     return DP_tile_new_from_bgra(context_id, 0);
@@ -78,7 +287,7 @@ DP_Tile *DP_tile_new_from_bgra(unsigned int context_id, uint32_t bgra)
     for (int i = 0; i < DP_TILE_LENGTH; ++i) {
         tt->pixels[i].color = bgra;
     }
-    return (DP_Tile *)tt;
+    return intern((DP_Tile *)tt);
 }
 
 
@@ -118,7 +327,7 @@ DP_Tile *DP_tile_new_from_compressed(unsigned int context_id,
 #else
 #    error "Unknown byte order"
 #endif
-        return (DP_Tile *)args.tt;
+        return intern((DP_Tile *)args.tt);
     }
     else {
         DP_tile_decref_nullable((DP_Tile *)args.tt);
@@ -127,11 +336,16 @@ DP_Tile *DP_tile_new_from_compressed(unsigned int context_id,
 }
 
 
+// Tiles count as shared while their refcount is above one. Only the thread
+// making the refcount cross that line moves them between the categories.
 DP_Tile *DP_tile_incref(DP_Tile *tile)
 {
     DP_ASSERT(tile);
     DP_ASSERT(SDL_AtomicGet(&tile->refcount) > 0);
-    SDL_AtomicIncRef(&tile->refcount);
+    if (SDL_AtomicAdd(&tile->refcount, 1) == 1) {
+        DP_memory_move(DP_MEMORY_TILES_UNIQUE, DP_MEMORY_TILES_SHARED,
+                       sizeof(*tile));
+    }
     return tile;
 }
 
@@ -145,7 +359,10 @@ DP_Tile *DP_tile_incref_by(DP_Tile *tile, int refcount)
     DP_ASSERT(tile);
     DP_ASSERT(SDL_AtomicGet(&tile->refcount) > 0);
     DP_ASSERT(refcount >= 0);
-    SDL_AtomicAdd(&tile->refcount, refcount);
+    if (SDL_AtomicAdd(&tile->refcount, refcount) == 1 && refcount != 0) {
+        DP_memory_move(DP_MEMORY_TILES_UNIQUE, DP_MEMORY_TILES_SHARED,
+                       sizeof(*tile));
+    }
     return tile;
 }
 
@@ -158,9 +375,18 @@ void DP_tile_decref(DP_Tile *tile)
 {
     DP_ASSERT(tile);
     DP_ASSERT(SDL_AtomicGet(&tile->refcount) > 0);
-    if (SDL_AtomicDecRef(&tile->refcount)) {
+    int prev_refcount = SDL_AtomicAdd(&tile->refcount, -1);
+    if (prev_refcount == 1) {
+        if (tile->intern.interned) {
+            intern_remove(tile);
+        }
+        DP_memory_sub(DP_MEMORY_TILES_UNIQUE, sizeof(*tile));
         DP_free(tile);
     }
+    else if (prev_refcount == 2) {
+        DP_memory_move(DP_MEMORY_TILES_SHARED, DP_MEMORY_TILES_UNIQUE,
+                       sizeof(*tile));
+    }
 }
 
 void DP_tile_decref_nullable(DP_Tile *tile_or_null)
@@ -170,6 +396,13 @@ void DP_tile_decref_nullable(DP_Tile *tile_or_null)
     }
 }
 
+int DP_tile_refcount(DP_Tile *tile)
+{
+    DP_ASSERT(tile);
+    DP_ASSERT(SDL_AtomicGet(&tile->refcount) > 0);
+    return SDL_AtomicGet(&tile->refcount);
+}
+
 bool DP_tile_transient(DP_Tile *tile)
 {
     DP_ASSERT(tile);
@@ -177,6 +410,13 @@ bool DP_tile_transient(DP_Tile *tile)
     return tile->transient;
 }
 
+unsigned int DP_tile_context_id(DP_Tile *tile)
+{
+    DP_ASSERT(tile);
+    DP_ASSERT(SDL_AtomicGet(&tile->refcount) > 0);
+    return tile->context_id;
+}
+
 
 DP_Pixel *DP_tile_pixels(DP_Tile *tile)
 {
@@ -201,13 +441,35 @@ bool DP_tile_blank(DP_Tile *tile)
     DP_Pixel *pixels = DP_tile_pixels(tile);
     for (int i = 0; i < DP_TILE_LENGTH; ++i) {
         // Colors should be premultiplied.
-        if (pixels[i].color == 0) {
+        if (pixels[i].color != 0) {
             return false;
         }
     }
     return true;
 }
 
+size_t DP_tile_compress(DP_Tile *tile,
+                        unsigned char *(*get_buffer)(size_t, void *),
+                        void *user)
+{
+    DP_ASSERT(tile);
+    DP_ASSERT(SDL_AtomicGet(&tile->refcount) > 0);
+#if DP_BYTE_ORDER == DP_LITTLE_ENDIAN
+    return DP_compress_deflate((const unsigned char *)tile->pixels,
+                               DP_TILE_BYTES, get_buffer, user);
+#elif DP_BYTE_ORDER == DP_BIG_ENDIAN
+    // The compressed format is little-endian, swap the pixels around first.
+    uint32_t swapped[DP_TILE_LENGTH];
+    for (int i = 0; i < DP_TILE_LENGTH; ++i) {
+        swapped[i] = DP_swap_uint32(tile->pixels[i].color);
+    }
+    return DP_compress_deflate((const unsigned char *)swapped, DP_TILE_BYTES,
+                               get_buffer, user);
+#else
+#    error "Unknown byte order"
+#endif
+}
+
 
 void DP_tile_copy_to_image(DP_Tile *tile_or_null, DP_Image *img, int x, int y)
 {
@@ -258,13 +520,27 @@ DP_TransientTile *DP_transient_tile_new_nullable(DP_Tile *tile_or_null,
                         : DP_transient_tile_new_blank(context_id);
 }
 
+DP_TransientTile *DP_transient_tile_new_from_pixels(unsigned int context_id,
+                                                    const DP_Pixel *pixels,
+                                                    int stride)
+{
+    DP_ASSERT(pixels);
+    DP_ASSERT(stride >= DP_TILE_SIZE);
+    DP_TransientTile *tt = alloc_tile(true, context_id);
+    for (int y = 0; y < DP_TILE_SIZE; ++y) {
+        memcpy(tt->pixels + y * DP_TILE_SIZE, pixels + y * stride,
+               DP_TILE_SIZE * sizeof(*pixels));
+    }
+    return tt;
+}
+
 DP_Tile *DP_transient_tile_persist(DP_TransientTile *tt)
 {
     DP_ASSERT(tt);
     DP_ASSERT(SDL_AtomicGet(&tt->refcount) > 0);
     DP_ASSERT(tt->transient);
     tt->transient = false;
-    return (DP_Tile *)tt;
+    return intern((DP_Tile *)tt);
 }
 
 
@@ -308,3 +584,24 @@ void DP_transient_tile_brush_apply(DP_TransientTile *tt, DP_Pixel src,
     DP_pixels_composite_mask(tt->pixels + y * DP_TILE_SIZE + x, src, blend_mode,
                              mask, w, h, skip, DP_TILE_SIZE - w);
 }
+
+void DP_transient_tile_pixels_apply(DP_TransientTile *tt, int blend_mode,
+                                    DP_Pixel *pixels, int stride, int x, int y,
+                                    int w, int h)
+{
+    DP_ASSERT(tt);
+    DP_ASSERT(SDL_AtomicGet(&tt->refcount) > 0);
+    DP_ASSERT(tt->transient);
+    DP_ASSERT(pixels);
+    DP_ASSERT(x >= 0);
+    DP_ASSERT(y >= 0);
+    DP_ASSERT(w > 0);
+    DP_ASSERT(h > 0);
+    DP_ASSERT(x + w <= DP_TILE_SIZE);
+    DP_ASSERT(y + h <= DP_TILE_SIZE);
+    DP_ASSERT(stride >= w);
+    for (int i = 0; i < h; ++i) {
+        DP_pixels_composite(tt->pixels + (y + i) * DP_TILE_SIZE + x,
+                            pixels + i * stride, w, 255, blend_mode);
+    }
+}
@@ -35,6 +35,15 @@ typedef struct DP_TileCounts {
     int x, y;
 } DP_TileCounts;
 
+typedef struct DP_TileInternStats {
+    // Tiles that were checked against the intern table.
+    unsigned long long lookups;
+    // Tiles that got replaced by an equal one from the table.
+    unsigned long long hits;
+    // Tiles currently in the table.
+    size_t interned;
+} DP_TileInternStats;
+
 #ifdef DP_NO_STRICT_ALIASING
 
 typedef struct DP_Tile DP_Tile;
@@ -77,6 +86,21 @@ DP_INLINE int DP_tile_total_round(int width, int height)
 }
 
 
+// Off by default. While on, persisting a transient tile and creating a tile
+// from a color or from compressed data look for an existing tile with the same
+// pixels and context id and return that instead, so the result may not be the
+// same pointer that was passed in. Turning it off again leaves the tiles that
+// are already in the table there until they get freed.
+void DP_tile_intern_enable(bool enable);
+
+bool DP_tile_intern_enabled(void);
+
+// The counts since the last reset, the interned count is always current.
+void DP_tile_intern_stats(DP_TileInternStats *out_stats);
+
+void DP_tile_intern_stats_reset(void);
+
+
 DP_Tile *DP_tile_new(unsigned int context_id);
 
 DP_Tile *DP_tile_new_from_bgra(unsigned int context_id, uint32_t bgra);
@@ -97,8 +121,12 @@ void DP_tile_decref(DP_Tile *tile);
 
 void DP_tile_decref_nullable(DP_Tile *tile_or_null);
 
+int DP_tile_refcount(DP_Tile *tile);
+
 bool DP_tile_transient(DP_Tile *tile);
 
+unsigned int DP_tile_context_id(DP_Tile *tile);
+
 
 DP_Pixel *DP_tile_pixels(DP_Tile *tile);
 
@@ -106,6 +134,12 @@ DP_Pixel DP_tile_pixel_at(DP_Tile *tile, int x, int y);
 
 bool DP_tile_blank(DP_Tile *tile);
 
+// Compresses the pixels in the same format that DP_tile_new_from_compressed
+// takes, see DP_compress_deflate for the parameters.
+size_t DP_tile_compress(DP_Tile *tile,
+                        unsigned char *(*get_buffer)(size_t, void *),
+                        void *user);
+
 
 void DP_tile_copy_to_image(DP_Tile *tile_or_null, DP_Image *img, int x, int y);
 
@@ -117,6 +151,11 @@ DP_TransientTile *DP_transient_tile_new_blank(unsigned int context_id);
 DP_TransientTile *DP_transient_tile_new_nullable(DP_Tile *tile_or_null,
                                                  unsigned int context_id);
 
+// Copies a whole tile's worth of pixels, the stride is in pixels.
+DP_TransientTile *DP_transient_tile_new_from_pixels(unsigned int context_id,
+                                                    const DP_Pixel *pixels,
+                                                    int stride);
+
 DP_Tile *DP_transient_tile_persist(DP_TransientTile *tt);
 
 
@@ -130,5 +169,11 @@ void DP_transient_tile_brush_apply(DP_TransientTile *tt, DP_Pixel src,
                                    int blend_mode, uint8_t *mask, int x, int y,
                                    int w, int h, int skip);
 
+// Composites a rectangle of pixels onto the tile row by row, the stride is in
+// pixels.
+void DP_transient_tile_pixels_apply(DP_TransientTile *tt, int blend_mode,
+                                    DP_Pixel *pixels, int stride, int x, int y,
+                                    int w, int h);
+
 
 #endif
@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2022 askmeaboutloom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <dpcommon/common.h>
+#include <dpcommon/conversions.h>
+#include <dpcommon/memory_stats.h>
+#include <dpengine/canvas_history.h>
+#include <dpengine/canvas_state.h>
+#include <dpengine/compressed_tiles.h>
+#include <dpengine/draw_context.h>
+#include <dpengine/tile.h>
+#include <dpmsg/message.h>
+#include <dpmsg/messages/undo.h>
+#include <dpengine_test.h>
+
+#define RECORDING_PATH "test/data/recordings/multilayer.dprec"
+
+
+typedef struct DP_ReplayProgress {
+    bool compress;
+    DP_CanvasState **out_halfway;
+    int undo_points;
+    unsigned int context_id;
+} DP_ReplayProgress;
+
+static void on_replayed(void *user, DP_CanvasHistory *ch, DP_Message *msg)
+{
+    DP_ReplayProgress *progress = user;
+    if (DP_message_type(msg) == DP_MSG_UNDO_POINT) {
+        progress->context_id = DP_message_context_id(msg);
+        if (++progress->undo_points == 70 && progress->out_halfway) {
+            *progress->out_halfway =
+                DP_canvas_history_compare_and_get(ch, NULL);
+        }
+        if (progress->compress) {
+            DP_canvas_history_compress_savepoints(ch, NULL);
+        }
+    }
+}
+
+// Plays the recording into the history, compressing savepoints after each
+// undo point if requested. Returns the context id of the last undo point.
+static unsigned int play_recording(void **state, DP_CanvasHistory *ch,
+                                   DP_DrawContext *dc, bool compress,
+                                   DP_CanvasState **out_halfway)
+{
+    DP_ReplayProgress progress = {compress, out_halfway, 0, 0};
+    replay_recording(state, RECORDING_PATH, ch, dc, on_replayed, &progress);
+    return progress.context_id;
+}
+
+
+static void compressed_tiles_restore(void **state)
+{
+    DP_CanvasHistory *ch = DP_canvas_history_new();
+    push_canvas_history(state, ch);
+    DP_DrawContext *dc = DP_draw_context_new();
+    push_draw_context(state, dc);
+    DP_CanvasState *halfway = NULL;
+    play_recording(state, ch, dc, false, &halfway);
+    assert_non_null(halfway);
+    DP_CanvasState *current = DP_canvas_history_compare_and_get(ch, NULL);
+
+    DP_CompressedTiles *ct = DP_compressed_tiles_new();
+    DP_CanvasState *taken = DP_compressed_tiles_take(ct, halfway, current);
+    int count = DP_compressed_tiles_count(ct);
+    DP_debug("Compressed %d tiles into %zu bytes", count,
+             DP_compressed_tiles_size(ct));
+    assert_int_not_equal(count, 0);
+    assert_true(DP_compressed_tiles_size(ct)
+                < DP_int_to_size(count) * DP_TILE_BYTES / 2);
+
+    DP_CanvasState *restored = DP_compressed_tiles_restore(ct, taken);
+    assert_non_null(restored);
+    assert_canvas_states_equal(state, restored, halfway);
+
+    // Taking tiles out of a state against itself leaves nothing to take.
+    DP_CompressedTiles *none = DP_compressed_tiles_new();
+    DP_CanvasState *same = DP_compressed_tiles_take(none, current, current);
+    assert_true(same == current);
+    assert_int_equal(DP_compressed_tiles_count(none), 0);
+
+    // Tiles that another state still holds would just end up duplicated.
+    DP_TransientCanvasState *tcs = DP_transient_canvas_state_new(halfway);
+    DP_CanvasState *copy = DP_transient_canvas_state_persist(tcs);
+    DP_CompressedTiles *shared = DP_compressed_tiles_new();
+    DP_CanvasState *kept = DP_compressed_tiles_take(shared, halfway, current);
+    assert_true(kept == halfway);
+    assert_int_equal(DP_compressed_tiles_count(shared), 0);
+
+    DP_canvas_state_decref(kept);
+    DP_compressed_tiles_free(shared);
+    DP_canvas_state_decref(copy);
+    DP_canvas_state_decref(same);
+    DP_compressed_tiles_free(none);
+    DP_canvas_state_decref(restored);
+    DP_canvas_state_decref(taken);
+    DP_compressed_tiles_free(ct);
+    DP_canvas_state_decref(current);
+    DP_canvas_state_decref(halfway);
+}
+
+static void savepoints_compressed_and_undone(void **state)
+{
+    DP_CanvasHistory *plain = DP_canvas_history_new();
+    push_canvas_history(state, plain);
+    DP_CanvasHistory *compressed = DP_canvas_history_new();
+    push_canvas_history(state, compressed);
+    DP_DrawContext *dc = DP_draw_context_new();
+    push_draw_context(state, dc);
+
+    unsigned int context_id = play_recording(state, plain, dc, false, NULL);
+    play_recording(state, compressed, dc, true, NULL);
+    size_t after_playing = DP_memory_total();
+    // Without any new undo points, every cold savepoint is done eventually.
+    for (int i = 0; i < 100; ++i) {
+        DP_canvas_history_compress_savepoints(compressed, NULL);
+    }
+    size_t after_compressing = DP_memory_total();
+    DP_debug("Memory after playing %zu, after compressing %zu", after_playing,
+             after_compressing);
+    assert_true(after_compressing < after_playing);
+
+    // Undoing far enough back has to go through compressed savepoints.
+    for (int i = 0; i < 8; ++i) {
+        DP_Message *msg = DP_msg_undo_new(context_id, 0, false);
+        push_message(state, msg);
+        assert_true(DP_canvas_history_handle(plain, dc, msg));
+        assert_true(DP_canvas_history_handle(compressed, dc, msg));
+        destructor_run(state, msg);
+        DP_CanvasState *a = DP_canvas_history_compare_and_get(plain, NULL);
+        DP_CanvasState *b = DP_canvas_history_compare_and_get(compressed, NULL);
+        assert_canvas_states_equal(state, a, b);
+        DP_canvas_state_decref(b);
+        DP_canvas_state_decref(a);
+    }
+
+    destructor_run(state, dc);
+    destructor_run(state, compressed);
+    destructor_run(state, plain);
+}
+
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        dp_unit_test(compressed_tiles_restore),
+        dp_unit_test(savepoints_compressed_and_undone),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
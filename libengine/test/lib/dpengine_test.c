@@ -22,10 +22,16 @@
 #include "dpengine_test.h"
 #include "dpcommon_test.h"
 #include "dpengine/draw_context.h"
+#include <dpcommon/conversions.h>
 #include <dpcommon/input.h>
 #include <dpengine/canvas_history.h>
 #include <dpengine/canvas_state.h>
 #include <dpengine/image.h>
+#include <dpengine/mipmap.h>
+#include <dpengine/pixels.h>
+#include <dpengine/tile.h>
+#include <dpmsg/binary_reader.h>
+#include <dpmsg/message.h>
 #include <endian.h>
 
 
@@ -39,6 +45,16 @@ void push_canvas_history(void **state, DP_CanvasHistory *value)
     destructor_push(state, value, destroy_canvas_history);
 }
 
+static void destroy_canvas_history_batcher(void *value)
+{
+    DP_canvas_history_batcher_free(value);
+}
+
+void push_canvas_history_batcher(void **state, DP_CanvasHistoryBatcher *value)
+{
+    destructor_push(state, value, destroy_canvas_history_batcher);
+}
+
 static void destroy_canvas_state(void *value)
 {
     DP_canvas_state_decref(value);
@@ -69,6 +85,55 @@ void push_image(void **state, DP_Image *value)
     destructor_push(state, value, destroy_image);
 }
 
+static void destroy_mipmap(void *value)
+{
+    DP_mipmap_free(value);
+}
+
+void push_mipmap(void **state, DP_Mipmap *value)
+{
+    destructor_push(state, value, destroy_mipmap);
+}
+
+static void destroy_tile(void *value)
+{
+    DP_tile_decref(value);
+}
+
+void push_tile(void **state, DP_Tile *value)
+{
+    destructor_push(state, value, destroy_tile);
+}
+
+
+void replay_recording(void **state, const char *path, DP_CanvasHistory *ch,
+                      DP_DrawContext *dc, DP_ReplayCallback callback,
+                      void *user)
+{
+    DP_Input *input = DP_file_input_new_from_path(path);
+    assert_non_null(input);
+    push_input(state, input);
+    DP_BinaryReader *reader = DP_binary_reader_new(input);
+    assert_non_null(reader);
+    push_binary_reader(state, reader, input);
+
+    while (DP_binary_reader_has_next(reader)) {
+        DP_Message *msg = DP_binary_reader_read_next(reader);
+        assert_non_null(msg);
+        push_message(state, msg);
+        if (DP_message_type_command(DP_message_type(msg))
+            && !DP_canvas_history_handle(ch, dc, msg)) {
+            DP_warn("%s", DP_error());
+        }
+        if (callback) {
+            callback(user, ch, msg);
+        }
+        destructor_run(state, msg);
+    }
+
+    destructor_run(state, reader);
+}
+
 
 static DP_Image *read_image(void **state, const char *path)
 {
@@ -107,3 +172,32 @@ void _assert_image_files_equal(void **state, const char *a, const char *b,
     destructor_run(state, img_a);
     destructor_run(state, img_b);
 }
+
+void _assert_canvas_states_equal(void **state, DP_CanvasState *a,
+                                 DP_CanvasState *b, const char *file, int line)
+{
+    DP_Image *img_a = DP_canvas_state_to_flat_image(a, 0);
+    _assert_true(cast_to_largest_integral_type(img_a != NULL), "img_a", file,
+                 line);
+    push_image(state, img_a);
+    DP_Image *img_b = DP_canvas_state_to_flat_image(b, 0);
+    _assert_true(cast_to_largest_integral_type(img_b != NULL), "img_b", file,
+                 line);
+    push_image(state, img_b);
+
+    int width = DP_image_width(img_a);
+    int height = DP_image_height(img_a);
+    _assert_int_equal(cast_to_largest_integral_type(width),
+                      cast_to_largest_integral_type(DP_image_width(img_b)),
+                      file, line);
+    _assert_int_equal(cast_to_largest_integral_type(height),
+                      cast_to_largest_integral_type(DP_image_height(img_b)),
+                      file, line);
+    _assert_memory_equal(DP_image_pixels(img_a), DP_image_pixels(img_b),
+                         DP_int_to_size(width) * DP_int_to_size(height)
+                             * sizeof(DP_Pixel),
+                         file, line);
+
+    destructor_run(state, img_b);
+    destructor_run(state, img_a);
+}
@@ -24,19 +24,40 @@
 #include <dpmsg_test.h> // IWYU pragma: export
 
 typedef struct DP_CanvasHistory DP_CanvasHistory;
+typedef struct DP_CanvasHistoryBatcher DP_CanvasHistoryBatcher;
 typedef struct DP_CanvasState DP_CanvasState;
 typedef struct DP_DrawContext DP_DrawContext;
 typedef struct DP_Image DP_Image;
+typedef struct DP_Message DP_Message;
+typedef struct DP_Mipmap DP_Mipmap;
+typedef struct DP_Tile DP_Tile;
+
+typedef void (*DP_ReplayCallback)(void *user, DP_CanvasHistory *ch,
+                                  DP_Message *msg);
 
 
 void push_canvas_history(void **state, DP_CanvasHistory *value);
 
+void push_canvas_history_batcher(void **state, DP_CanvasHistoryBatcher *value);
+
 void push_canvas_state(void **state, DP_CanvasState *value);
 
 void push_draw_context(void **state, DP_DrawContext *value);
 
 void push_image(void **state, DP_Image *value);
 
+void push_mipmap(void **state, DP_Mipmap *value);
+
+void push_tile(void **state, DP_Tile *value);
+
+
+// Handles the drawing commands of the binary recording at the given path,
+// warning about any that fail. The callback is optional, it gets called with
+// every message in the recording after it has been handled.
+void replay_recording(void **state, const char *path, DP_CanvasHistory *ch,
+                      DP_DrawContext *dc, DP_ReplayCallback callback,
+                      void *user);
+
 
 #define assert_image_files_equal(state, a, b) \
     _assert_image_files_equal(state, a, b, __FILE__, __LINE__)
@@ -44,5 +65,13 @@ void push_image(void **state, DP_Image *value);
 void _assert_image_files_equal(void **state, const char *a, const char *b,
                                const char *file, int line);
 
+#define assert_canvas_states_equal(state, a, b) \
+    _assert_canvas_states_equal(state, a, b, __FILE__, __LINE__)
+
+// Compares the flattened images of the two canvas states.
+void _assert_canvas_states_equal(void **state, DP_CanvasState *a,
+                                 DP_CanvasState *b, const char *file,
+                                 int line);
+
 
 #endif
@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2022 askmeaboutloom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <dpcommon/common.h>
+#include <dpcommon/memory_stats.h>
+#include <dpengine/canvas_history.h>
+#include <dpengine/draw_context.h>
+#include <dpmsg/message.h>
+#include <dpmsg/messages/undo.h>
+#include <dpmsg/messages/undo_point.h>
+#include <dpengine_test.h>
+
+
+// Plays the recording into a fresh history and returns how much memory was
+// in use at the end, relative to before. Everything gets freed afterwards.
+static size_t play_recording(void **state, const char *path)
+{
+    size_t before = DP_memory_total();
+    DP_CanvasHistory *ch = DP_canvas_history_new();
+    push_canvas_history(state, ch);
+    DP_DrawContext *dc = DP_draw_context_new();
+    push_draw_context(state, dc);
+    replay_recording(state, path, ch, dc, NULL, NULL);
+
+    DP_MemoryStats stats;
+    DP_memory_stats(&stats);
+    assert_int_not_equal(stats.bytes[DP_MEMORY_TILES_UNIQUE]
+                             + stats.bytes[DP_MEMORY_TILES_SHARED],
+                         0);
+    assert_int_not_equal(stats.bytes[DP_MEMORY_HISTORY], 0);
+    assert_int_not_equal(stats.bytes[DP_MEMORY_DRAW_CONTEXTS], 0);
+
+    destructor_run(state, dc);
+    destructor_run(state, ch);
+    return stats.total - before;
+}
+
+static void memory_balanced(void **state)
+{
+    size_t before = DP_memory_total();
+    play_recording(state, "test/data/recordings/transform.dprec");
+    assert_int_equal(DP_memory_total(), before);
+}
+
+static void memory_budget_reclaims(void **state)
+{
+    const char *path = "test/data/recordings/transform.dprec";
+    size_t unlimited = play_recording(state, path);
+    DP_memory_budget_set(1);
+    size_t limited = play_recording(state, path);
+    DP_memory_budget_set(0);
+    DP_debug("Memory used unlimited %zu, limited %zu", unlimited, limited);
+    assert_true(limited < unlimited);
+}
+
+// Undo depth has to match every other client in a session, so going over the
+// budget mustn't cut off undos that are still within the regular window.
+static bool undo_depth_kept(void **state, bool networked)
+{
+    DP_CanvasHistory *ch = DP_canvas_history_new();
+    push_canvas_history(state, ch);
+    DP_DrawContext *dc = DP_draw_context_new();
+    push_draw_context(state, dc);
+    DP_canvas_history_networked_set(ch, networked);
+
+    DP_memory_budget_set(1);
+    for (int i = 0; i < 20; ++i) {
+        DP_Message *msg = DP_msg_undo_point_new(1);
+        assert_true(DP_canvas_history_handle(ch, dc, msg));
+        DP_message_decref(msg);
+    }
+    bool ok = true;
+    for (int i = 0; i < 20; ++i) {
+        DP_Message *msg = DP_msg_undo_new(1, 0, false);
+        ok = DP_canvas_history_handle(ch, dc, msg) && ok;
+        DP_message_decref(msg);
+    }
+    DP_memory_budget_set(0);
+
+    destructor_run(state, dc);
+    destructor_run(state, ch);
+    return ok;
+}
+
+static void memory_budget_keeps_networked_undo_depth(void **state)
+{
+    assert_false(undo_depth_kept(state, false));
+    assert_true(undo_depth_kept(state, true));
+}
+
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        dp_unit_test(memory_balanced),
+        dp_unit_test(memory_budget_reclaims),
+        dp_unit_test(memory_budget_keeps_networked_undo_depth),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
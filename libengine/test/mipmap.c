@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2022 askmeaboutloom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <dpcommon/common.h>
+#include <dpengine/blend_mode.h>
+#include <dpengine/mipmap.h>
+#include <dpengine/pixels.h>
+#include <dpengine/tile.h>
+#include <dpengine_test.h>
+
+
+static int count_color(const DP_Pixel *pixels, int x1, int y1, int x2, int y2,
+                       uint32_t color)
+{
+    int count = 0;
+    for (int y = y1; y < y2; ++y) {
+        for (int x = x1; x < x2; ++x) {
+            if (pixels[y * DP_TILE_SIZE + x].color == color) {
+                ++count;
+            }
+        }
+    }
+    return count;
+}
+
+static void count_dirty(void *user, int tile_x, int tile_y)
+{
+    int *count = user;
+    assert_int_equal(tile_x, 0);
+    assert_int_equal(tile_y, 0);
+    ++*count;
+}
+
+static void mipmap_levels(void **state)
+{
+    DP_Mipmap *mm = DP_mipmap_new();
+    push_mipmap(state, mm);
+
+    DP_mipmap_resize(mm, 200, 130);
+    assert_int_equal(DP_mipmap_level_count(mm), 3);
+    assert_int_equal(DP_mipmap_level_width(mm, 1), 100);
+    assert_int_equal(DP_mipmap_level_height(mm, 1), 65);
+    assert_int_equal(DP_mipmap_level_width(mm, 2), 50);
+    assert_int_equal(DP_mipmap_level_height(mm, 2), 33);
+
+    uint32_t color = 0x80402010;
+    DP_Tile *tile = DP_tile_new_from_bgra(0, color);
+    push_tile(state, tile);
+    DP_mipmap_tile_set(mm, 1, 0, tile);
+    DP_mipmap_update(mm);
+
+    // Level 1 has the tile in the top-right quadrant of its first tile.
+    const DP_Pixel *level1 = DP_mipmap_tile_pixels(mm, 1, 0, 0);
+    assert_int_equal(count_color(level1, 32, 0, 64, 32, color), 32 * 32);
+    assert_int_equal(count_color(level1, 0, 0, 64, 64, 0), 64 * 64 - 32 * 32);
+
+    // Level 2 has it halved again.
+    const DP_Pixel *level2 = DP_mipmap_tile_pixels(mm, 2, 0, 0);
+    assert_int_equal(count_color(level2, 16, 0, 32, 16, color), 16 * 16);
+    assert_int_equal(count_color(level2, 0, 0, 64, 64, 0), 64 * 64 - 16 * 16);
+
+    int dirty = 0;
+    DP_mipmap_dirty_take(mm, 2, count_dirty, &dirty);
+    assert_int_equal(dirty, 1);
+    DP_mipmap_dirty_take(mm, 2, count_dirty, &dirty);
+    assert_int_equal(dirty, 1);
+
+    // Blanking the tile again clears all levels above it.
+    DP_mipmap_tile_set(mm, 1, 0, NULL);
+    DP_mipmap_update(mm);
+    assert_int_equal(count_color(level1, 0, 0, 64, 64, 0), 64 * 64);
+    assert_int_equal(count_color(level2, 0, 0, 64, 64, 0), 64 * 64);
+    DP_mipmap_dirty_clear(mm, 2);
+    DP_mipmap_dirty_take(mm, 2, count_dirty, &dirty);
+    assert_int_equal(dirty, 1);
+}
+
+static void mipmap_box_filter(void **state)
+{
+    DP_Mipmap *mm = DP_mipmap_new();
+    push_mipmap(state, mm);
+    DP_mipmap_resize(mm, 128, 64);
+    assert_int_equal(DP_mipmap_level_count(mm), 2);
+
+    // Alternating rows average out to the color in between.
+    DP_TransientTile *tt = DP_transient_tile_new_blank(0);
+    for (int y = 0; y < DP_TILE_SIZE; y += 2) {
+        for (int x = 0; x < DP_TILE_SIZE; ++x) {
+            DP_transient_tile_pixel_at_put(tt, DP_BLEND_MODE_REPLACE, x, y,
+                                           (DP_Pixel){0xff6040c0});
+        }
+    }
+    DP_Tile *tile = DP_transient_tile_persist(tt);
+    push_tile(state, tile);
+    DP_mipmap_tile_set(mm, 0, 0, tile);
+
+    const DP_Pixel *level1 = DP_mipmap_tile_pixels(mm, 1, 0, 0);
+    assert_int_equal(count_color(level1, 0, 0, 32, 32, 0x80302060), 32 * 32);
+}
+
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        dp_unit_test(mipmap_levels),
+        dp_unit_test(mipmap_box_filter),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2022 askmeaboutloom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <dpcommon/common.h>
+#include <dpengine/canvas_history.h>
+#include <dpengine/draw_context.h>
+#include <dpengine/perf.h>
+#include <dpengine/tile.h>
+#include <dpmsg/message.h>
+#include <dpmsg/messages/undo.h>
+#include <dpengine_test.h>
+
+
+static DP_PerfStats *push_stats(void **state)
+{
+    DP_PerfStats *stats = DP_malloc(sizeof(*stats));
+    destructor_push(state, stats, DP_free);
+    DP_perf_stats(stats);
+    return stats;
+}
+
+static void handle(DP_CanvasHistory *ch, DP_DrawContext *dc, DP_Message *msg,
+                   unsigned long long *counts)
+{
+    if (!DP_canvas_history_handle(ch, dc, msg)) {
+        DP_warn("%s", DP_error());
+    }
+    ++counts[DP_message_type(msg)];
+}
+
+static unsigned long long sum_buckets(const unsigned long long *buckets)
+{
+    unsigned long long sum = 0;
+    for (int i = 0; i < DP_PERF_BUCKET_COUNT; ++i) {
+        sum += buckets[i];
+    }
+    return sum;
+}
+
+static void assert_timing(const DP_PerfTiming *timing,
+                          unsigned long long expected_count)
+{
+    assert_int_equal(timing->count, expected_count);
+    assert_int_equal(sum_buckets(timing->buckets), expected_count);
+    if (expected_count == 0) {
+        assert_int_equal(timing->total_ns, 0);
+    }
+}
+
+static bool handled_by_canvas_state(DP_MessageType type)
+{
+    return type != DP_MSG_UNDO_POINT && type != DP_MSG_UNDO
+        && type != DP_MSG_INTERNAL;
+}
+
+static void count_replayed(void *user, DP_UNUSED DP_CanvasHistory *ch,
+                           DP_Message *msg)
+{
+    unsigned long long *counts = user;
+    DP_MessageType type = DP_message_type(msg);
+    if (DP_message_type_command(type)) {
+        ++counts[type];
+    }
+}
+
+static void perf_counts(void **state)
+{
+    DP_CanvasHistory *ch = DP_canvas_history_new();
+    push_canvas_history(state, ch);
+
+    DP_DrawContext *dc = DP_draw_context_new();
+    push_draw_context(state, dc);
+
+    unsigned long long *counts = DP_malloc(sizeof(*counts) * DP_MSG_COUNT);
+    destructor_push(state, counts, DP_free);
+    memset(counts, 0, sizeof(*counts) * DP_MSG_COUNT);
+
+    DP_perf_reset();
+    DP_perf_enable(true);
+    assert_true(DP_perf_enabled());
+
+    replay_recording(state, "test/data/recordings/rect.dprec", ch, dc,
+                     count_replayed, counts);
+
+    DP_Message *undo = DP_msg_undo_new(1, 0, false);
+    push_message(state, undo);
+    handle(ch, dc, undo, counts);
+    DP_Message *redo = DP_msg_undo_new(1, 0, true);
+    push_message(state, redo);
+    handle(ch, dc, redo, counts);
+
+    DP_perf_enable(false);
+    assert_false(DP_perf_enabled());
+    handle(ch, dc, undo, counts); // Not recorded anymore.
+    --counts[DP_MSG_UNDO];
+
+    DP_PerfStats *stats = push_stats(state);
+    for (int i = 0; i < DP_MSG_COUNT; ++i) {
+        DP_MessageType type = (DP_MessageType)i;
+        assert_timing(&stats->history[i], counts[i]);
+        // Undo replays handle the replayed messages again.
+        const DP_PerfTiming *handle_timing = &stats->handle[i];
+        if (handled_by_canvas_state(type)) {
+            assert_true(handle_timing->count >= counts[i]);
+            assert_int_equal(sum_buckets(handle_timing->buckets),
+                             handle_timing->count);
+        }
+        else {
+            assert_timing(handle_timing, 0);
+        }
+    }
+    assert_int_not_equal(counts[DP_MSG_DRAW_DABS_CLASSIC], 0);
+    assert_timing(&stats->undo_replay, 2);
+    assert_int_equal(sum_buckets(stats->undo_replay_lengths), 2);
+
+    DP_perf_reset();
+    DP_PerfStats *reset_stats = push_stats(state);
+    for (int i = 0; i < DP_MSG_COUNT; ++i) {
+        assert_timing(&reset_stats->history[i], 0);
+        assert_timing(&reset_stats->handle[i], 0);
+    }
+    assert_timing(&reset_stats->undo_replay, 0);
+    assert_int_equal(sum_buckets(reset_stats->undo_replay_lengths), 0);
+}
+
+static void perf_uploads(void **state)
+{
+    DP_perf_reset();
+    DP_perf_record_uploads(1, 1, DP_TILE_BYTES); // Disabled, not recorded.
+    DP_perf_enable(true);
+    DP_perf_record_uploads(1, 1, DP_TILE_BYTES);
+    DP_perf_record_uploads(2, 16, 16 * DP_TILE_BYTES);
+    DP_perf_record_uploads(0, 0, 0);
+    DP_perf_enable(false);
+
+    DP_PerfStats *stats = push_stats(state);
+    assert_int_equal(stats->uploads.calls, 3);
+    assert_int_equal(stats->uploads.tiles, 17);
+    assert_int_equal(stats->uploads.bytes, 17 * DP_TILE_BYTES);
+
+    DP_perf_reset();
+    DP_PerfStats *reset_stats = push_stats(state);
+    assert_int_equal(reset_stats->uploads.calls, 0);
+    assert_int_equal(reset_stats->uploads.tiles, 0);
+    assert_int_equal(reset_stats->uploads.bytes, 0);
+}
+
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        dp_unit_test(perf_counts),
+        dp_unit_test(perf_uploads),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
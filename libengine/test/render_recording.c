@@ -22,22 +22,92 @@
 #include <dpcommon/common.h>
 #include <dpcommon/input.h>
 #include <dpcommon/output.h>
+#include <dpcommon/worker.h>
+#include <dpengine/blend_mode.h>
 #include <dpengine/canvas_history.h>
 #include <dpengine/canvas_state.h>
 #include <dpengine/draw_context.h>
 #include <dpengine/image.h>
 #include <dpmsg/binary_reader.h>
 #include <dpmsg/message.h>
+#include <dpmsg/message_arena.h>
+#include <dpmsg/messages/canvas_resize.h>
+#include <dpmsg/messages/fill_rect.h>
+#include <dpmsg/messages/layer_create.h>
 #include <dpengine_test.h>
 
 
-static void test_render_recording(void **state)
+#define PARALLEL_THREAD_COUNT 4
+
+// How many local commands are waiting for their echo at most.
+#define LOCAL_ECHO_LAG 8
+
+// Every so often, a local command is sent twice, but only echoed once, which
+// makes the local fork get rolled back when the next echo doesn't match.
+#define LOCAL_UNECHOED_INTERVAL 64
+
+
+typedef enum RenderRecordingMode {
+    RENDER_RECORDING_SERIAL,
+    RENDER_RECORDING_PARALLEL,
+    RENDER_RECORDING_LOCAL,
+} RenderRecordingMode;
+
+static void handle_message(DP_CanvasHistory *ch, DP_DrawContext *dc,
+                           DP_CanvasHistoryBatcher *chb, DP_Message *msg)
+{
+    bool ok = chb ? DP_canvas_history_batcher_handle(chb, ch, msg)
+                  : DP_canvas_history_handle(ch, dc, msg);
+    if (!ok) {
+        DP_warn("%s", DP_error());
+    }
+}
+
+static void handle_echoes(DP_CanvasHistory *ch, DP_DrawContext *dc,
+                          DP_Message **echoes, int *in_out_count)
+{
+    int count = *in_out_count;
+    for (int i = 0; i < count; ++i) {
+        handle_message(ch, dc, NULL, echoes[i]);
+        DP_message_decref(echoes[i]);
+    }
+    *in_out_count = 0;
+}
+
+static void handle_message_locally(DP_CanvasHistory *ch, DP_DrawContext *dc,
+                                   DP_Message *msg, DP_Message **echoes,
+                                   int *in_out_count, int *in_out_sent)
 {
+    if (DP_canvas_history_handle_local(ch, dc, msg)) {
+        int sent = ++*in_out_sent;
+        if (sent % LOCAL_UNECHOED_INTERVAL == 0) {
+            DP_canvas_history_handle_local(ch, dc, msg);
+        }
+        if (*in_out_count == LOCAL_ECHO_LAG) {
+            handle_message(ch, dc, NULL, echoes[0]);
+            DP_message_decref(echoes[0]);
+            memmove(echoes, echoes + 1, sizeof(*echoes) * (LOCAL_ECHO_LAG - 1));
+            --*in_out_count;
+        }
+        echoes[(*in_out_count)++] = DP_message_persist(msg);
+    }
+    else {
+        // Can't be handled locally, so it needs to wait for the echoes.
+        handle_echoes(ch, dc, echoes, in_out_count);
+        handle_message(ch, dc, NULL, msg);
+    }
+}
+
+static void render_recording(void **state, RenderRecordingMode mode)
+{
+    bool parallel = mode == RENDER_RECORDING_PARALLEL;
+    bool local = mode == RENDER_RECORDING_LOCAL;
     const char *name = initial_state(state);
     char *dprec_path =
         push_format(state, "test/data/recordings/%s.dprec", name);
     char *out_path =
-        push_format(state, "test/tmp/render_recording_%s.png", name);
+        push_format(state, "test/tmp/render_recording_%s%s.png", name,
+                    parallel ? "_parallel" : local ? "_local" : "");
     char *expected_path =
         push_format(state, "test/data/recordings/%s.png", name);
 
@@ -48,28 +118,62 @@ static void test_render_recording(void **state)
     assert_non_null(reader);
     push_binary_reader(state, reader, input);
 
+    DP_MessageArena *arena =
+        DP_message_arena_new(DP_MESSAGE_ARENA_DEFAULT_CHUNK_SIZE);
+    push_message_arena(state, arena);
+    DP_binary_reader_arena_set(reader, arena);
+
     DP_CanvasHistory *ch = DP_canvas_history_new();
     assert_non_null(ch);
     push_canvas_history(state, ch);
 
+    DP_Worker *worker = NULL;
+    if (parallel) {
+        worker = DP_worker_new(64, PARALLEL_THREAD_COUNT);
+        assert_non_null(worker);
+        push_worker(state, worker);
+    }
+
     DP_DrawContext *dc = DP_draw_context_new();
     assert_non_null(dc);
     push_draw_context(state, dc);
+    // Paint every message in parallel and handle messages on different layers
+    // at the same time, the result must be exactly the same.
+    DP_draw_context_paint_worker_set(dc, worker, 0);
+    DP_CanvasHistoryBatcher *chb = NULL;
+    if (parallel) {
+        chb = DP_canvas_history_batcher_new(worker, dc);
+        push_canvas_history_batcher(state, chb);
+    }
 
+    // Commands handled locally first, waiting for the server to echo them.
+    DP_Message *echoes[LOCAL_ECHO_LAG];
+    int echo_count = 0;
+    int sent = 0;
     while (DP_binary_reader_has_next(reader)) {
         DP_Message *msg = DP_binary_reader_read_next(reader);
         assert_non_null(msg);
         push_message(state, msg);
 
         if (DP_message_type_command(DP_message_type(msg))) {
-            if (!DP_canvas_history_handle(ch, dc, msg)) {
-                DP_warn("%s", DP_error());
+            if (local) {
+                handle_message_locally(ch, dc, msg, echoes, &echo_count,
+                                       &sent);
+            }
+            else {
+                handle_message(ch, dc, chb, msg);
             }
         }
 
         destructor_run(state, msg);
     }
 
+    handle_echoes(ch, dc, echoes, &echo_count);
+
+    if (chb && !DP_canvas_history_batcher_flush(chb, ch)) {
+        DP_warn("%s", DP_error());
+    }
+
     DP_CanvasState *cs = DP_canvas_history_compare_and_get(ch, NULL);
     push_canvas_state(state, cs);
     DP_Image *img =
@@ -87,6 +191,66 @@ static void test_render_recording(void **state)
     assert_image_files_equal(state, out_path, expected_path);
 }
 
+static void test_render_recording(void **state)
+{
+    render_recording(state, RENDER_RECORDING_SERIAL);
+}
+
+static void test_render_recording_parallel(void **state)
+{
+    render_recording(state, RENDER_RECORDING_PARALLEL);
+}
+
+static void test_render_recording_local(void **state)
+{
+    render_recording(state, RENDER_RECORDING_LOCAL);
+}
+
+
+static void handle_new(DP_CanvasHistory *ch, DP_DrawContext *dc,
+                       DP_Message *msg, bool local)
+{
+    assert_true(local ? DP_canvas_history_handle_local(ch, dc, msg)
+                      : DP_canvas_history_handle(ch, dc, msg));
+    DP_message_decref(msg);
+}
+
+static DP_CanvasState *fill_rect(void **state, unsigned int local_context_id)
+{
+    DP_CanvasHistory *ch = DP_canvas_history_new();
+    push_canvas_history(state, ch);
+    DP_DrawContext *dc = DP_draw_context_new();
+    push_draw_context(state, dc);
+    handle_new(ch, dc, DP_msg_canvas_resize_new(1, 0, 64, 64, 0), false);
+    handle_new(ch, dc, DP_msg_layer_create_new(1, 0x100, 0, 0, 0, "", 0),
+               false);
+    if (local_context_id != 0) {
+        DP_canvas_history_local_context_id_set(ch, local_context_id);
+        // Sent without a context id, echoed back with the assigned one.
+        handle_new(ch, dc,
+                   DP_msg_fill_rect_new(0, 0x100, DP_BLEND_MODE_NORMAL, 0, 0,
+                                        32, 32, 0x80ff0000),
+                   true);
+    }
+    handle_new(ch, dc,
+               DP_msg_fill_rect_new(local_context_id, 0x100,
+                                    DP_BLEND_MODE_NORMAL, 0, 0, 32, 32,
+                                    0x80ff0000),
+               false);
+    DP_CanvasState *cs = DP_canvas_history_compare_and_get(ch, NULL);
+    push_canvas_state(state, cs);
+    return cs;
+}
+
+// The echo has to replace the locally drawn command rather than get drawn a
+// second time on top of it.
+static void local_echo_with_assigned_context_id(void **state)
+{
+    DP_CanvasState *expected = fill_rect(state, 0);
+    DP_CanvasState *actual = fill_rect(state, 5);
+    assert_canvas_states_equal(state, expected, actual);
+}
+
 
 #define recording_unit_test(NAME)                          \
     (struct CMUnitTest)                                    \
@@ -94,12 +258,40 @@ static void test_render_recording(void **state)
         NAME, test_render_recording, setup, teardown, NAME \
     }
 
+#define recording_unit_test_parallel(NAME)                          \
+    (struct CMUnitTest)                                             \
+    {                                                               \
+        NAME, test_render_recording_parallel, setup, teardown, NAME \
+    }
+
+#define recording_unit_test_local(NAME)                          \
+    (struct CMUnitTest)                                          \
+    {                                                            \
+        NAME, test_render_recording_local, setup, teardown, NAME \
+    }
+
 int main(void)
 {
     const struct CMUnitTest tests[] = {
         recording_unit_test("brushmodes"), recording_unit_test("layermodes"),
-        recording_unit_test("persp"),      recording_unit_test("rect"),
-        recording_unit_test("resize"),     recording_unit_test("transform"),
+        recording_unit_test("multilayer"), recording_unit_test("persp"),
+        recording_unit_test("rect"),       recording_unit_test("resize"),
+        recording_unit_test("transform"),
+        recording_unit_test_parallel("brushmodes"),
+        recording_unit_test_parallel("layermodes"),
+        recording_unit_test_parallel("multilayer"),
+        recording_unit_test_parallel("persp"),
+        recording_unit_test_parallel("rect"),
+        recording_unit_test_parallel("resize"),
+        recording_unit_test_parallel("transform"),
+        recording_unit_test_local("brushmodes"),
+        recording_unit_test_local("layermodes"),
+        recording_unit_test_local("multilayer"),
+        recording_unit_test_local("persp"),
+        recording_unit_test_local("rect"),
+        recording_unit_test_local("resize"),
+        recording_unit_test_local("transform"),
+        dp_unit_test(local_echo_with_assigned_context_id),
     };
     return cmocka_run_group_tests(tests, NULL, NULL);
 }
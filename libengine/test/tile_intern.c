@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2022 askmeaboutloom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <dpcommon/common.h>
+#include <dpengine/blend_mode.h>
+#include <dpengine/canvas_history.h>
+#include <dpengine/draw_context.h>
+#include <dpengine/pixels.h>
+#include <dpengine/tile.h>
+#include <dpengine_test.h>
+
+#define RECORDING_PATH "test/data/recordings/multilayer.dprec"
+
+
+static DP_Tile *new_tile(unsigned int context_id, int x, int y)
+{
+    DP_TransientTile *tt = DP_transient_tile_new_blank(context_id);
+    DP_transient_tile_pixel_at_put(tt, DP_BLEND_MODE_REPLACE, x, y,
+                                   (DP_Pixel){0xff102030});
+    return DP_transient_tile_persist(tt);
+}
+
+static unsigned char *get_compress_buffer(size_t size, void *user)
+{
+    unsigned char **buffer = user;
+    *buffer = DP_malloc(size);
+    return *buffer;
+}
+
+static void tile_intern_equal_tiles(void **state)
+{
+    (void)state;
+    DP_tile_intern_enable(true);
+    DP_tile_intern_stats_reset();
+    DP_TileInternStats before;
+    DP_tile_intern_stats(&before);
+
+    DP_Tile *a = new_tile(1, 3, 4);
+    DP_Tile *b = new_tile(1, 3, 4);
+    DP_Tile *other_pixels = new_tile(1, 4, 3);
+    DP_Tile *other_context = new_tile(2, 3, 4);
+    assert_true(a == b);
+    assert_true(a != other_pixels);
+    assert_true(a != other_context);
+
+    // Tiles coming out of compressed data get collapsed the same way.
+    unsigned char *buffer = NULL;
+    size_t size = DP_tile_compress(a, get_compress_buffer, &buffer);
+    assert_int_not_equal(size, 0);
+    DP_Tile *decompressed = DP_tile_new_from_compressed(1, buffer, size);
+    DP_free(buffer);
+    assert_true(decompressed == a);
+
+    DP_TileInternStats stats;
+    DP_tile_intern_stats(&stats);
+    assert_int_equal(stats.lookups, 5);
+    assert_int_equal(stats.hits, 2);
+    assert_int_equal(stats.interned, before.interned + 3);
+
+    // Freed tiles take themselves out of the table.
+    DP_tile_decref(decompressed);
+    DP_tile_decref(other_context);
+    DP_tile_decref(other_pixels);
+    DP_tile_decref(b);
+    DP_tile_decref(a);
+    DP_tile_intern_stats(&stats);
+    assert_int_equal(stats.interned, before.interned);
+
+    // With interning off, equal tiles stay separate.
+    DP_tile_intern_enable(false);
+    DP_Tile *c = DP_tile_new_from_bgra(1, 0xff102030);
+    DP_Tile *d = DP_tile_new_from_bgra(1, 0xff102030);
+    assert_true(c != d);
+    DP_tile_decref(d);
+    DP_tile_decref(c);
+}
+
+
+static DP_CanvasState *play_recording(void **state)
+{
+    DP_CanvasHistory *ch = DP_canvas_history_new();
+    push_canvas_history(state, ch);
+    DP_DrawContext *dc = DP_draw_context_new();
+    push_draw_context(state, dc);
+    replay_recording(state, RECORDING_PATH, ch, dc, NULL, NULL);
+    return DP_canvas_history_compare_and_get(ch, NULL);
+}
+
+static void tile_intern_recording(void **state)
+{
+    DP_CanvasState *plain = play_recording(state);
+    push_canvas_state(state, plain);
+
+    DP_tile_intern_enable(true);
+    DP_tile_intern_stats_reset();
+    DP_CanvasState *interned = play_recording(state);
+    push_canvas_state(state, interned);
+    DP_tile_intern_enable(false);
+
+    DP_TileInternStats stats;
+    DP_tile_intern_stats(&stats);
+    DP_debug("Interned %llu of %llu tiles", stats.hits, stats.lookups);
+    assert_int_not_equal(stats.lookups, 0);
+    assert_canvas_states_equal(state, plain, interned);
+}
+
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        dp_unit_test(tile_intern_equal_tiles),
+        dp_unit_test(tile_intern_recording),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -69,3 +69,15 @@ const char *DP_access_tier_name(int tier)
     const DP_AccessTierAttributes *attributes = access_tier_at(tier);
     return attributes ? attributes->name : NULL;
 }
+
+int DP_access_tier_from_name(const char *name)
+{
+    DP_ASSERT(name);
+    for (int tier = 0; tier < DP_ACCESS_TIER_COUNT; ++tier) {
+        if (strcmp(access_tier_attributes[tier].name, name) == 0) {
+            return tier;
+        }
+    }
+    DP_error_set("Unknown access tier name: '%s'", name);
+    return -1;
+}
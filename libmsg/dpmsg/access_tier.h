@@ -37,5 +37,7 @@ const char *DP_access_tier_enum_name(int tier);
 
 const char *DP_access_tier_name(int tier);
 
+int DP_access_tier_from_name(const char *name);
+
 
 #endif
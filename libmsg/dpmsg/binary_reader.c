@@ -21,6 +21,7 @@
  */
 #include "binary_reader.h"
 #include "message.h"
+#include "message_arena.h"
 #include <dpcommon/binary.h>
 #include <dpcommon/common.h>
 #include <dpcommon/input.h>
@@ -37,6 +38,7 @@ struct DP_BinaryReader {
     unsigned char *buffer;
     size_t buffer_size;
     size_t message_size;
+    DP_MessageArena *arena;
 };
 
 
@@ -154,7 +156,7 @@ DP_BinaryReader *DP_binary_reader_new(DP_Input *input)
     }
 
     DP_BinaryReader *reader = DP_malloc(sizeof(*reader));
-    *reader = (DP_BinaryReader){input, header, NULL, 0, 0};
+    *reader = (DP_BinaryReader){input, header, NULL, 0, 0, NULL};
     return reader;
 }
 
@@ -258,8 +260,10 @@ DP_Message *DP_binary_reader_read_next(DP_BinaryReader *reader)
 {
     DP_ASSERT(reader);
     if (DP_binary_reader_has_next(reader)) {
+        DP_MessageArena *prev_arena = DP_message_arena_bind(reader->arena);
         DP_Message *message =
             DP_message_deserialize(reader->buffer, reader->message_size);
+        DP_message_arena_bind(prev_arena);
         reader->message_size = 0;
         return message;
     }
@@ -267,3 +271,10 @@ DP_Message *DP_binary_reader_read_next(DP_BinaryReader *reader)
         return NULL;
     }
 }
+
+void DP_binary_reader_arena_set(DP_BinaryReader *reader,
+                                DP_MessageArena *arena)
+{
+    DP_ASSERT(reader);
+    reader->arena = arena;
+}
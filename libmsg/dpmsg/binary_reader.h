@@ -26,6 +26,7 @@
 
 typedef struct DP_Input DP_Input;
 typedef struct DP_Message DP_Message;
+typedef struct DP_MessageArena DP_MessageArena;
 
 #define DP_DPREC_MAGIC        "DPREC"
 #define DP_DPREC_MAGIC_LENGTH 6
@@ -43,5 +44,10 @@ bool DP_binary_reader_has_next(DP_BinaryReader *reader);
 
 DP_Message *DP_binary_reader_read_next(DP_BinaryReader *reader);
 
+// Allocate messages read from here in the given arena, NULL to stop doing so.
+// The arena is not owned by the reader and must outlive its use in it.
+void DP_binary_reader_arena_set(DP_BinaryReader *reader,
+                                DP_MessageArena *arena);
+
 
 #endif
@@ -20,6 +20,7 @@
  * License, version 3. See 3rdparty/licenses/drawpile/COPYING for details.
  */
 #include "message.h"
+#include "message_arena.h"
 #include "messages/canvas_background.h"
 #include "messages/canvas_resize.h"
 #include "messages/chat.h"
@@ -50,9 +51,11 @@
 #include "messages/user_acl.h"
 #include "messages/user_join.h"
 #include "messages/user_leave.h"
+#include "text_reader.h"
 #include "text_writer.h"
 #include <dpcommon/binary.h>
 #include <dpcommon/common.h>
+#include <dpcommon/memory_stats.h>
 #include <SDL_atomic.h>
 
 
@@ -76,6 +79,7 @@ typedef struct DP_MessageTypeAttributes {
     };
     DP_Message *(*deserialize)(unsigned int context_id,
                                const unsigned char *buffer, size_t length);
+    DP_Message *(*parse)(unsigned int context_id, DP_TextReader *reader);
 } DP_MessageTypeAttributes;
 
 static DP_Message *invalid_deserialize(DP_UNUSED unsigned int context_id,
@@ -90,6 +94,7 @@ static const DP_MessageTypeAttributes invalid_attributes = {
     "DP_MSG_UNKNOWN",
     {"unknown"},
     invalid_deserialize,
+    NULL,
 };
 
 static const DP_MessageTypeAttributes type_attributes[DP_MSG_COUNT] = {
@@ -99,6 +104,7 @@ static const DP_MessageTypeAttributes type_attributes[DP_MSG_COUNT] = {
             "DP_MSG_COMMAND",
             {"command"},
             DP_msg_command_deserialize,
+            DP_msg_command_parse,
         },
     [DP_MSG_DISCONNECT] =
         {
@@ -106,6 +112,7 @@ static const DP_MessageTypeAttributes type_attributes[DP_MSG_COUNT] = {
             "DP_MSG_DISCONNECT",
             {"disconnect"},
             DP_msg_disconnect_deserialize,
+            DP_msg_disconnect_parse,
         },
     [DP_MSG_PING] =
         {
@@ -113,6 +120,7 @@ static const DP_MessageTypeAttributes type_attributes[DP_MSG_COUNT] = {
             "DP_MSG_PING",
             {"ping"},
             DP_msg_ping_deserialize,
+            DP_msg_ping_parse,
         },
     [DP_MSG_INTERNAL] =
         {
@@ -120,6 +128,7 @@ static const DP_MessageTypeAttributes type_attributes[DP_MSG_COUNT] = {
             "DP_MSG_INTERNAL",
             {"internal"},
             NULL,
+            NULL,
         },
     [DP_MSG_USER_JOIN] =
         {
@@ -127,6 +136,7 @@ static const DP_MessageTypeAttributes type_attributes[DP_MSG_COUNT] = {
             "DP_MSG_USER_JOIN",
             {"join"},
             DP_msg_user_join_deserialize,
+            DP_msg_user_join_parse,
         },
     [DP_MSG_USER_LEAVE] =
         {
@@ -134,6 +144,7 @@ static const DP_MessageTypeAttributes type_attributes[DP_MSG_COUNT] = {
             "DP_MSG_USER_LEAVE",
             {"leave"},
             DP_msg_user_leave_deserialize,
+            DP_msg_user_leave_parse,
         },
     [DP_MSG_SESSION_OWNER] =
         {
@@ -141,6 +152,7 @@ static const DP_MessageTypeAttributes type_attributes[DP_MSG_COUNT] = {
             "DP_MSG_SESSION_OWNER",
             {"owner"},
             DP_msg_session_owner_deserialize,
+            DP_msg_session_owner_parse,
         },
     [DP_MSG_CHAT] =
         {
@@ -148,6 +160,7 @@ static const DP_MessageTypeAttributes type_attributes[DP_MSG_COUNT] = {
             "DP_MSG_CHAT",
             {"chat"},
             DP_msg_chat_deserialize,
+            DP_msg_chat_parse,
         },
     [DP_MSG_TRUSTED_USERS] =
         {
@@ -155,6 +168,7 @@ static const DP_MessageTypeAttributes type_attributes[DP_MSG_COUNT] = {
             "DP_MSG_TRUSTED_USERS",
             {"trusted"},
             DP_msg_trusted_users_deserialize,
+            DP_msg_trusted_users_parse,
         },
     [DP_MSG_SOFT_RESET] =
         {
@@ -162,6 +176,7 @@ static const DP_MessageTypeAttributes type_attributes[DP_MSG_COUNT] = {
             "DP_MSG_SOFT_RESET",
             {"softreset"},
             DP_msg_soft_reset_deserialize,
+            DP_msg_soft_reset_parse,
         },
     [DP_MSG_PRIVATE_CHAT] =
         {
@@ -169,6 +184,7 @@ static const DP_MessageTypeAttributes type_attributes[DP_MSG_COUNT] = {
             "DP_MSG_PRIVATE_CHAT",
             {"pm"},
             DP_msg_private_chat_deserialize,
+            DP_msg_private_chat_parse,
         },
     [DP_MSG_INTERVAL] =
         {
@@ -176,6 +192,7 @@ static const DP_MessageTypeAttributes type_attributes[DP_MSG_COUNT] = {
             "DP_MSG_INTERVAL",
             {"interval"},
             DP_msg_interval_deserialize,
+            DP_msg_interval_parse,
         },
     [DP_MSG_USER_ACL] =
         {
@@ -183,6 +200,7 @@ static const DP_MessageTypeAttributes type_attributes[DP_MSG_COUNT] = {
             "DP_MSG_USER_ACL",
             {"useracl"},
             DP_msg_user_acl_deserialize,
+            DP_msg_user_acl_parse,
         },
     [DP_MSG_LAYER_ACL] =
         {
@@ -190,6 +208,7 @@ static const DP_MessageTypeAttributes type_attributes[DP_MSG_COUNT] = {
             "DP_MSG_LAYER_ACL",
             {"layeracl"},
             DP_msg_layer_acl_deserialize,
+            DP_msg_layer_acl_parse,
         },
     [DP_MSG_FEATURE_LEVELS] =
         {
@@ -197,6 +216,7 @@ static const DP_MessageTypeAttributes type_attributes[DP_MSG_COUNT] = {
             "DP_MSG_FEATURE_LEVELS",
             {"featureaccess"},
             DP_msg_feature_levels_deserialize,
+            DP_msg_feature_levels_parse,
         },
     [DP_MSG_UNDO_POINT] =
         {
@@ -204,6 +224,7 @@ static const DP_MessageTypeAttributes type_attributes[DP_MSG_COUNT] = {
             "DP_MSG_UNDO_POINT",
             {"undopoint"},
             DP_msg_undo_point_deserialize,
+            DP_msg_undo_point_parse,
         },
     [DP_MSG_CANVAS_RESIZE] =
         {
@@ -211,6 +232,7 @@ static const DP_MessageTypeAttributes type_attributes[DP_MSG_COUNT] = {
             "DP_MSG_CANVAS_RESIZE",
             {"resize"},
             DP_msg_canvas_resize_deserialize,
+            DP_msg_canvas_resize_parse,
         },
     [DP_MSG_LAYER_CREATE] =
         {
@@ -218,6 +240,7 @@ static const DP_MessageTypeAttributes type_attributes[DP_MSG_COUNT] = {
             "DP_MSG_LAYER_CREATE",
             {"newlayer"},
             DP_msg_layer_create_deserialize,
+            DP_msg_layer_create_parse,
         },
     [DP_MSG_LAYER_DELETE] =
         {
@@ -225,6 +248,7 @@ static const DP_MessageTypeAttributes type_attributes[DP_MSG_COUNT] = {
             "DP_MSG_LAYER_DELETE",
             {"deletelayer"},
             DP_msg_layer_delete_deserialize,
+            DP_msg_layer_delete_parse,
         },
     [DP_MSG_LAYER_ATTR] =
         {
@@ -232,6 +256,7 @@ static const DP_MessageTypeAttributes type_attributes[DP_MSG_COUNT] = {
             "DP_MSG_LAYER_ATTR",
             {"layerattr"},
             DP_msg_layer_attr_deserialize,
+            DP_msg_layer_attr_parse,
         },
     [DP_MSG_LAYER_ORDER] =
         {
@@ -239,6 +264,7 @@ static const DP_MessageTypeAttributes type_attributes[DP_MSG_COUNT] = {
             "DP_MSG_LAYER_ORDER",
             {"layerorder"},
             DP_msg_layer_order_deserialize,
+            DP_msg_layer_order_parse,
         },
     [DP_MSG_LAYER_RETITLE] =
         {
@@ -246,6 +272,7 @@ static const DP_MessageTypeAttributes type_attributes[DP_MSG_COUNT] = {
             "DP_MSG_LAYER_RETITLE",
             {"retitlelayer"},
             DP_msg_layer_retitle_deserialize,
+            DP_msg_layer_retitle_parse,
         },
     [DP_MSG_LAYER_VISIBILITY] =
         {
@@ -253,6 +280,7 @@ static const DP_MessageTypeAttributes type_attributes[DP_MSG_COUNT] = {
             "DP_MSG_LAYER_VISIBILITY",
             {"layervisibility"},
             DP_msg_layer_visibility_deserialize,
+            DP_msg_layer_visibility_parse,
         },
     [DP_MSG_PUT_IMAGE] =
         {
@@ -260,6 +288,7 @@ static const DP_MessageTypeAttributes type_attributes[DP_MSG_COUNT] = {
             "DP_MSG_PUT_IMAGE",
             {"putimage"},
             DP_msg_put_image_deserialize,
+            DP_msg_put_image_parse,
         },
     [DP_MSG_FILL_RECT] =
         {
@@ -267,6 +296,7 @@ static const DP_MessageTypeAttributes type_attributes[DP_MSG_COUNT] = {
             "DP_MSG_FILL_RECT",
             {"fillrect"},
             DP_msg_fill_rect_deserialize,
+            DP_msg_fill_rect_parse,
         },
     [DP_MSG_PEN_UP] =
         {
@@ -274,6 +304,7 @@ static const DP_MessageTypeAttributes type_attributes[DP_MSG_COUNT] = {
             "DP_MSG_PEN_UP",
             {"penup"},
             DP_msg_pen_up_deserialize,
+            DP_msg_pen_up_parse,
         },
     [DP_MSG_REGION_MOVE] =
         {
@@ -281,6 +312,7 @@ static const DP_MessageTypeAttributes type_attributes[DP_MSG_COUNT] = {
             "DP_MSG_REGION_MOVE",
             {"moveregion"},
             DP_msg_region_move_deserialize,
+            DP_msg_region_move_parse,
         },
     [DP_MSG_PUT_TILE] =
         {
@@ -288,6 +320,7 @@ static const DP_MessageTypeAttributes type_attributes[DP_MSG_COUNT] = {
             "DP_MSG_PUT_TILE",
             {"puttile"},
             DP_msg_put_tile_deserialize,
+            DP_msg_put_tile_parse,
         },
     [DP_MSG_CANVAS_BACKGROUND] =
         {
@@ -295,6 +328,7 @@ static const DP_MessageTypeAttributes type_attributes[DP_MSG_COUNT] = {
             "DP_MSG_CANVAS_BACKGROUND",
             {"background"},
             DP_msg_canvas_background_deserialize,
+            DP_msg_canvas_background_parse,
         },
     [DP_MSG_DRAW_DABS_CLASSIC] =
         {
@@ -302,6 +336,7 @@ static const DP_MessageTypeAttributes type_attributes[DP_MSG_COUNT] = {
             "DP_MSG_DRAW_DABS_CLASSIC",
             {"classicdabs"},
             DP_msg_draw_dabs_classic_deserialize,
+            DP_msg_draw_dabs_classic_parse,
         },
     [DP_MSG_DRAW_DABS_PIXEL] =
         {
@@ -309,6 +344,7 @@ static const DP_MessageTypeAttributes type_attributes[DP_MSG_COUNT] = {
             "DP_MSG_DRAW_DABS_PIXEL",
             {"pixeldabs"},
             DP_msg_draw_dabs_pixel_deserialize,
+            DP_msg_draw_dabs_pixel_parse,
         },
     [DP_MSG_DRAW_DABS_PIXEL_SQUARE] =
         {
@@ -316,6 +352,7 @@ static const DP_MessageTypeAttributes type_attributes[DP_MSG_COUNT] = {
             "DP_MSG_DRAW_DABS_PIXEL_SQUARE",
             {"squarepixeldabs"},
             DP_msg_draw_dabs_pixel_square_deserialize,
+            DP_msg_draw_dabs_pixel_square_parse,
         },
     [DP_MSG_UNDO] =
         {
@@ -323,6 +360,7 @@ static const DP_MessageTypeAttributes type_attributes[DP_MSG_COUNT] = {
             "DP_MSG_UNDO",
             {.get_name = DP_msg_undo_message_name},
             DP_msg_undo_deserialize,
+            DP_msg_undo_parse,
         },
 };
 
@@ -380,10 +418,32 @@ struct DP_Message {
     SDL_atomic_t refcount;
     DP_MessageType type;
     unsigned int context_id;
+    uint32_t internal_size;
     const DP_MessageMethods *methods;
+    DP_MessageArenaChunk *chunk;
     alignas(max_align_t) unsigned char internal[];
 };
 
+static DP_Message *allocate_message(const DP_MessageMethods *methods,
+                                    size_t size)
+{
+    // Messages with a dispose method may own memory outside of themselves,
+    // which would make copying them out of the arena unsafe.
+    DP_MessageArena *arena = methods->dispose ? NULL : DP_message_arena_bound();
+    if (arena) {
+        DP_MessageArenaChunk *chunk;
+        DP_Message *msg = DP_message_arena_alloc(arena, size, &chunk);
+        if (msg) {
+            msg->chunk = chunk;
+            return msg;
+        }
+    }
+    DP_Message *msg = DP_malloc(size);
+    DP_memory_add(DP_MEMORY_MESSAGES, size);
+    msg->chunk = NULL;
+    return msg;
+}
+
 DP_Message *DP_message_new(DP_MessageType type, unsigned int context_id,
                            const DP_MessageMethods *methods,
                            size_t internal_size)
@@ -395,11 +455,12 @@ DP_Message *DP_message_new(DP_MessageType type, unsigned int context_id,
     DP_ASSERT(methods->payload_length);
     DP_ASSERT(methods->serialize_payload);
     DP_ASSERT(methods->equals);
-    DP_ASSERT(internal_size <= SIZE_MAX - sizeof(DP_Message));
-    DP_Message *msg = DP_malloc(sizeof(*msg) + internal_size);
+    DP_ASSERT(internal_size <= UINT32_MAX);
+    DP_Message *msg = allocate_message(methods, sizeof(*msg) + internal_size);
     SDL_AtomicSet(&msg->refcount, 1);
     msg->type = type;
     msg->context_id = context_id;
+    msg->internal_size = (uint32_t)internal_size;
     msg->methods = methods;
     memset(msg->internal, 0, internal_size);
     return msg;
@@ -422,7 +483,33 @@ void DP_message_decref(DP_Message *msg)
         if (dispose) {
             dispose(msg);
         }
-        DP_free(msg);
+        DP_MessageArenaChunk *chunk = msg->chunk;
+        if (chunk) {
+            DP_message_arena_chunk_release(chunk);
+        }
+        else {
+            DP_memory_sub(DP_MEMORY_MESSAGES,
+                          sizeof(*msg) + msg->internal_size);
+            DP_free(msg);
+        }
+    }
+}
+
+DP_Message *DP_message_persist(DP_Message *msg)
+{
+    DP_ASSERT(msg);
+    DP_ASSERT(SDL_AtomicGet(&msg->refcount) > 0);
+    if (msg->chunk) {
+        size_t size = sizeof(*msg) + msg->internal_size;
+        DP_Message *copy = DP_malloc(size);
+        DP_memory_add(DP_MEMORY_MESSAGES, size);
+        memcpy(copy, msg, size);
+        SDL_AtomicSet(&copy->refcount, 1);
+        copy->chunk = NULL;
+        return copy;
+    }
+    else {
+        return DP_message_incref(msg);
     }
 }
 
@@ -630,3 +717,38 @@ DP_Message *DP_message_deserialize(const unsigned char *buf, size_t bufsize)
         return NULL;
     }
 }
+
+
+static const DP_MessageTypeAttributes *search_attributes_by_name(
+    const char *name)
+{
+    // Undo and redo are the same message type with a dynamic name.
+    if (strcmp(name, "undo") == 0 || strcmp(name, "redo") == 0) {
+        return &type_attributes[DP_MSG_UNDO];
+    }
+
+    for (int i = 0; i < DP_MSG_COUNT; ++i) {
+        const DP_MessageTypeAttributes *attrs = &type_attributes[i];
+        if (attrs->parse && !(attrs->flags & DYNAMIC_NAME)
+            && strcmp(attrs->name, name) == 0) {
+            return attrs;
+        }
+    }
+
+    return NULL;
+}
+
+DP_Message *DP_message_parse(const char *name, unsigned int context_id,
+                             DP_TextReader *reader)
+{
+    DP_ASSERT(name);
+    DP_ASSERT(reader);
+    const DP_MessageTypeAttributes *attrs = search_attributes_by_name(name);
+    if (attrs) {
+        return attrs->parse(context_id, reader);
+    }
+    else {
+        DP_text_reader_fail(reader, "unknown message type");
+        return NULL;
+    }
+}
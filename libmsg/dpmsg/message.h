@@ -23,6 +23,7 @@
 #define DPMSG_MESSAGE_H
 #include <dpcommon/common.h>
 
+typedef struct DP_TextReader DP_TextReader;
 typedef struct DP_TextWriter DP_TextWriter;
 
 
@@ -114,6 +115,10 @@ DP_Message *DP_message_incref(DP_Message *msg);
 
 void DP_message_decref(DP_Message *msg);
 
+// Like DP_message_incref, except that if the message lives in an arena (see
+// message_arena.h), it returns a heap-allocated copy with a refcount of 1.
+DP_Message *DP_message_persist(DP_Message *msg);
+
 int DP_message_refcount(DP_Message *msg);
 
 
@@ -151,4 +156,8 @@ DP_Message *DP_message_deserialize_length(const unsigned char *buf,
 DP_Message *DP_message_deserialize(const unsigned char *buf, size_t bufsize);
 
 
+DP_Message *DP_message_parse(const char *name, unsigned int context_id,
+                             DP_TextReader *reader);
+
+
 #endif
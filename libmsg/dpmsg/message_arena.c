@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2022 askmeaboutloom
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * --------------------------------------------------------------------
+ *
+ * This code is based on Drawpile, using it under the GNU General Public
+ * License, version 3. See 3rdparty/licenses/drawpile/COPYING for details.
+ */
+#include "message_arena.h"
+#include <dpcommon/common.h>
+#include <dpcommon/memory_stats.h>
+#include <dpcommon/threading.h>
+#include <SDL_atomic.h>
+
+#define ALIGNMENT          alignof(max_align_t)
+#define MIN_CHUNK_SIZE     1024
+// Anything larger than this fraction of a chunk gets allocated separately,
+// otherwise a few big messages would waste most of the chunk's space.
+#define MAX_ALLOC_FRACTION 4
+
+
+struct DP_MessageArenaChunk {
+    SDL_atomic_t refcount;
+    size_t used;
+    size_t capacity;
+    alignas(max_align_t) unsigned char data[];
+};
+
+struct DP_MessageArena {
+    size_t chunk_size;
+    DP_MessageArenaChunk *chunk;
+};
+
+static SDL_atomic_t arena_tls_ready;
+static SDL_SpinLock arena_tls_lock;
+static DP_TlsKey arena_tls;
+
+
+DP_MessageArena *DP_message_arena_new(size_t chunk_size)
+{
+    DP_MessageArena *arena = DP_malloc(sizeof(*arena));
+    *arena = (DP_MessageArena){
+        chunk_size < MIN_CHUNK_SIZE ? MIN_CHUNK_SIZE : chunk_size, NULL};
+    return arena;
+}
+
+void DP_message_arena_free(DP_MessageArena *arena)
+{
+    if (arena) {
+        DP_ASSERT(DP_message_arena_bound() != arena);
+        if (arena->chunk) {
+            DP_message_arena_chunk_release(arena->chunk);
+        }
+        DP_free(arena);
+    }
+}
+
+
+static DP_TlsKey get_tls_key(void)
+{
+    if (!SDL_AtomicGet(&arena_tls_ready)) {
+        SDL_AtomicLock(&arena_tls_lock);
+        if (!SDL_AtomicGet(&arena_tls_ready)) {
+            arena_tls = DP_tls_create(NULL);
+            SDL_AtomicSet(&arena_tls_ready, 1);
+        }
+        SDL_AtomicUnlock(&arena_tls_lock);
+    }
+    return arena_tls;
+}
+
+DP_MessageArena *DP_message_arena_bind(DP_MessageArena *arena)
+{
+    DP_TlsKey key = get_tls_key();
+    DP_MessageArena *prev = DP_tls_get(key);
+    DP_tls_set(key, arena);
+    return prev;
+}
+
+DP_MessageArena *DP_message_arena_bound(void)
+{
+    return SDL_AtomicGet(&arena_tls_ready) ? DP_tls_get(arena_tls) : NULL;
+}
+
+
+static DP_MessageArenaChunk *new_chunk(size_t capacity)
+{
+    DP_MessageArenaChunk *chunk = DP_malloc(sizeof(*chunk) + capacity);
+    DP_memory_add(DP_MEMORY_MESSAGES, sizeof(*chunk) + capacity);
+    SDL_AtomicSet(&chunk->refcount, 1);
+    chunk->used = 0;
+    chunk->capacity = capacity;
+    return chunk;
+}
+
+void *DP_message_arena_alloc(DP_MessageArena *arena, size_t size,
+                             DP_MessageArenaChunk **out_chunk)
+{
+    DP_ASSERT(arena);
+    DP_ASSERT(out_chunk);
+    size_t aligned_size = (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    if (aligned_size > arena->chunk_size / MAX_ALLOC_FRACTION) {
+        return NULL;
+    }
+
+    DP_MessageArenaChunk *chunk = arena->chunk;
+    if (!chunk || chunk->capacity - chunk->used < aligned_size) {
+        if (chunk) {
+            DP_message_arena_chunk_release(chunk);
+        }
+        chunk = new_chunk(arena->chunk_size);
+        arena->chunk = chunk;
+    }
+
+    void *ptr = chunk->data + chunk->used;
+    chunk->used += aligned_size;
+    SDL_AtomicIncRef(&chunk->refcount);
+    *out_chunk = chunk;
+    return ptr;
+}
+
+void DP_message_arena_chunk_release(DP_MessageArenaChunk *chunk)
+{
+    DP_ASSERT(chunk);
+    DP_ASSERT(SDL_AtomicGet(&chunk->refcount) > 0);
+    if (SDL_AtomicDecRef(&chunk->refcount)) {
+        DP_memory_sub(DP_MEMORY_MESSAGES, sizeof(*chunk) + chunk->capacity);
+        DP_free(chunk);
+    }
+}
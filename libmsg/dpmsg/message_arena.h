@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2022 askmeaboutloom
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * --------------------------------------------------------------------
+ *
+ * This code is based on Drawpile, using it under the GNU General Public
+ * License, version 3. See 3rdparty/licenses/drawpile/COPYING for details.
+ */
+#ifndef DPMSG_MESSAGE_ARENA_H
+#define DPMSG_MESSAGE_ARENA_H
+#include <dpcommon/common.h>
+
+
+// Bump allocator for short-lived messages, meant for replaying recordings.
+// Bind an arena to the current thread and any DP_Message created on it
+// while it's bound gets carved out of the arena's current chunk instead of
+// being allocated individually. Each chunk is reference counted by the
+// messages living in it, so messages can escape the arena and outlive it
+// just fine: a chunk is freed once its last message is. Since messages
+// are generally released in about the order they were read in, chunks
+// drain in order too. Messages that are going to be retained indefinitely
+// should be copied out using DP_message_persist to avoid pinning a chunk.
+
+#define DP_MESSAGE_ARENA_DEFAULT_CHUNK_SIZE 65536
+
+typedef struct DP_MessageArena DP_MessageArena;
+typedef struct DP_MessageArenaChunk DP_MessageArenaChunk;
+
+DP_MessageArena *DP_message_arena_new(size_t chunk_size);
+
+// Messages allocated from the arena remain valid after this.
+void DP_message_arena_free(DP_MessageArena *arena);
+
+// Binds the given arena (or NULL to unbind) to the calling thread, returns
+// the previously bound one. An arena must only be bound to one thread.
+DP_MessageArena *DP_message_arena_bind(DP_MessageArena *arena);
+
+DP_MessageArena *DP_message_arena_bound(void);
+
+
+// Returns NULL if the allocation is too large to be worth putting into the
+// arena, the caller should fall back to a regular allocation in that case.
+void *DP_message_arena_alloc(DP_MessageArena *arena, size_t size,
+                             DP_MessageArenaChunk **out_chunk);
+
+void DP_message_arena_chunk_release(DP_MessageArenaChunk *chunk);
+
+
+#endif
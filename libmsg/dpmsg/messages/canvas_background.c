@@ -21,6 +21,7 @@
  */
 #include "canvas_background.h"
 #include "../message.h"
+#include "../text_reader.h"
 #include "../text_writer.h"
 #include <dpcommon/binary.h>
 #include <dpcommon/common.h>
@@ -106,6 +107,28 @@ DP_Message *DP_msg_canvas_background_deserialize(unsigned int context_id,
     }
 }
 
+DP_Message *DP_msg_canvas_background_parse(unsigned int context_id,
+                                           DP_TextReader *reader)
+{
+    if (DP_text_reader_has(reader, "color")) {
+        unsigned char image[4];
+        DP_write_bigendian_uint32(
+            DP_text_reader_get_argb_color(reader, "color"), image);
+        return DP_msg_canvas_background_new(context_id, image, sizeof(image));
+    }
+
+    size_t image_size;
+    const unsigned char *image =
+        DP_text_reader_get_base64(reader, "img", &image_size);
+    if (image_size >= MIN_PAYLOAD_LENGTH && image_size <= MAX_IMAGE_SIZE) {
+        return DP_msg_canvas_background_new(context_id, image, image_size);
+    }
+    else {
+        DP_text_reader_fail(reader, "invalid image size %zu", image_size);
+        return NULL;
+    }
+}
+
 
 DP_MsgCanvasBackground *DP_msg_canvas_background_cast(DP_Message *msg)
 {
@@ -24,6 +24,7 @@
 #include <dpcommon/common.h>
 
 typedef struct DP_Message DP_Message;
+typedef struct DP_TextReader DP_TextReader;
 
 
 typedef struct DP_MsgCanvasBackground DP_MsgCanvasBackground;
@@ -36,6 +37,9 @@ DP_Message *DP_msg_canvas_background_deserialize(unsigned int context_id,
                                                  const unsigned char *buffer,
                                                  size_t length);
 
+DP_Message *DP_msg_canvas_background_parse(unsigned int context_id,
+                                           DP_TextReader *reader);
+
 DP_MsgCanvasBackground *DP_msg_canvas_background_cast(DP_Message *msg);
 
 bool DP_msg_canvas_background_color(DP_MsgCanvasBackground *mcb,
@@ -21,6 +21,7 @@
  */
 #include "canvas_resize.h"
 #include "../message.h"
+#include "../text_reader.h"
 #include "../text_writer.h"
 #include <dpcommon/binary.h>
 #include <dpcommon/common.h>
@@ -113,6 +114,16 @@ DP_Message *DP_msg_canvas_resize_deserialize(unsigned int context_id,
     }
 }
 
+DP_Message *DP_msg_canvas_resize_parse(unsigned int context_id,
+                                       DP_TextReader *reader)
+{
+    return DP_msg_canvas_resize_new(
+        context_id, DP_text_reader_get_int(reader, "top", INT32_MIN, INT32_MAX),
+        DP_text_reader_get_int(reader, "right", INT32_MIN, INT32_MAX),
+        DP_text_reader_get_int(reader, "bottom", INT32_MIN, INT32_MAX),
+        DP_text_reader_get_int(reader, "left", INT32_MIN, INT32_MAX));
+}
+
 
 DP_MsgCanvasResize *DP_msg_canvas_resize_cast(DP_Message *msg)
 {
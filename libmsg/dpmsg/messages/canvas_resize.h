@@ -24,6 +24,7 @@
 #include <dpcommon/common.h>
 
 typedef struct DP_Message DP_Message;
+typedef struct DP_TextReader DP_TextReader;
 
 
 typedef struct DP_MsgCanvasResize DP_MsgCanvasResize;
@@ -35,6 +36,9 @@ DP_Message *DP_msg_canvas_resize_deserialize(unsigned int context_id,
                                              const unsigned char *buffer,
                                              size_t length);
 
+DP_Message *DP_msg_canvas_resize_parse(unsigned int context_id,
+                                       DP_TextReader *reader);
+
 DP_MsgCanvasResize *DP_msg_canvas_resize_cast(DP_Message *msg);
 
 int DP_msg_canvas_resize_top(DP_MsgCanvasResize *mcr);
@@ -21,6 +21,7 @@
  */
 #include "chat.h"
 #include "../message.h"
+#include "../text_reader.h"
 #include "../text_writer.h"
 #include "dpcommon/binary.h"
 #include <dpcommon/common.h>
@@ -127,6 +128,26 @@ DP_Message *DP_msg_chat_deserialize(unsigned int context_id,
     }
 }
 
+DP_Message *DP_msg_chat_parse(unsigned int context_id, DP_TextReader *reader)
+{
+    unsigned int combined_flags = DP_text_reader_get_flags(
+        reader, "flags", "bypass", DP_MSG_CHAT_BYPASS << 8, "shout",
+        DP_MSG_CHAT_SHOUT, "action", DP_MSG_CHAT_ACTION, "pin",
+        DP_MSG_CHAT_PIN, (const char *)NULL);
+
+    size_t text_length;
+    const char *text =
+        DP_text_reader_get_string(reader, "message", &text_length);
+    if (text_length >= MIN_TEXT_LENGTH) {
+        return DP_msg_chat_new(context_id, combined_flags >> 8,
+                               combined_flags & 0xff, text, text_length);
+    }
+    else {
+        DP_text_reader_fail(reader, "empty message");
+        return NULL;
+    }
+}
+
 
 DP_MsgChat *DP_msg_chat_cast(DP_Message *msg)
 {
@@ -24,6 +24,7 @@
 #include <dpcommon/common.h>
 
 typedef struct DP_Message DP_Message;
+typedef struct DP_TextReader DP_TextReader;
 
 
 #define DP_MSG_CHAT_BYPASS (1 << 0)
@@ -43,6 +44,8 @@ DP_Message *DP_msg_chat_new(unsigned int context_id,
 DP_Message *DP_msg_chat_deserialize(unsigned int context_id,
                                     const unsigned char *buffer, size_t length);
 
+DP_Message *DP_msg_chat_parse(unsigned int context_id, DP_TextReader *reader);
+
 DP_MsgChat *DP_msg_chat_cast(DP_Message *msg);
 
 
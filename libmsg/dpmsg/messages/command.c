@@ -21,6 +21,7 @@
  */
 #include "command.h"
 #include "../message.h"
+#include "../text_reader.h"
 #include "../text_writer.h"
 #include <dpcommon/binary.h>
 #include <dpcommon/common.h>
@@ -97,6 +98,21 @@ DP_Message *DP_msg_command_deserialize(unsigned int context_id,
     }
 }
 
+DP_Message *DP_msg_command_parse(unsigned int context_id,
+                                 DP_TextReader *reader)
+{
+    size_t message_len;
+    const char *message =
+        DP_text_reader_get_string(reader, "message", &message_len);
+    if (message_len <= MAX_PAYLOAD_LENGTH) {
+        return DP_msg_command_new(context_id, message, message_len);
+    }
+    else {
+        DP_text_reader_fail(reader, "message too long");
+        return NULL;
+    }
+}
+
 
 DP_MsgCommand *DP_msg_command_cast(DP_Message *msg)
 {
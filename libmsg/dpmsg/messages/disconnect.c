@@ -21,6 +21,7 @@
  */
 #include "disconnect.h"
 #include "../message.h"
+#include "../text_reader.h"
 #include "../text_writer.h"
 #include <dpcommon/binary.h>
 #include <dpcommon/common.h>
@@ -109,6 +110,23 @@ DP_Message *DP_msg_disconnect_deserialize(unsigned int context_id,
     }
 }
 
+DP_Message *DP_msg_disconnect_parse(unsigned int context_id,
+                                    DP_TextReader *reader)
+{
+    int reason = DP_text_reader_get_int(reader, "reason", 0, UINT8_MAX);
+    size_t message_len;
+    const char *message =
+        DP_text_reader_get_string(reader, "message", &message_len);
+    if (message_len <= MAX_PAYLOAD_LENGTH) {
+        return DP_msg_disconnect_new(context_id, (DP_DisconnectReason)reason,
+                                     message, message_len);
+    }
+    else {
+        DP_text_reader_fail(reader, "message too long");
+        return NULL;
+    }
+}
+
 
 DP_MsgDisconnect *DP_msg_disconnect_cast(DP_Message *msg)
 {
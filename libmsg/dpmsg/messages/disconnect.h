@@ -24,6 +24,7 @@
 #include <dpcommon/common.h>
 
 typedef struct DP_Message DP_Message;
+typedef struct DP_TextReader DP_TextReader;
 
 
 typedef enum DP_DisconnectReason {
@@ -43,6 +44,9 @@ DP_Message *DP_msg_disconnect_deserialize(unsigned int context_id,
                                           const unsigned char *buffer,
                                           size_t length);
 
+DP_Message *DP_msg_disconnect_parse(unsigned int context_id,
+                                    DP_TextReader *reader);
+
 DP_MsgDisconnect *DP_msg_disconnect_cast(DP_Message *msg);
 
 
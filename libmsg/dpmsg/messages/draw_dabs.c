@@ -21,6 +21,7 @@
  */
 #include "draw_dabs.h"
 #include "../message.h"
+#include "../text_reader.h"
 #include "../text_writer.h"
 #include <dpcommon/binary.h>
 #include <dpcommon/common.h>
@@ -455,6 +456,52 @@ DP_Message *DP_msg_draw_dabs_classic_deserialize(unsigned int context_id,
 }
 
 
+static int parse_dab_count(DP_TextReader *reader, int max_dab_count)
+{
+    int dab_count = DP_text_reader_get_tuple_count(reader);
+    if (dab_count > 0 && dab_count <= max_dab_count) {
+        return dab_count;
+    }
+    else {
+        DP_text_reader_fail(reader, "invalid dab count %d", dab_count);
+        return 0;
+    }
+}
+
+DP_Message *DP_msg_draw_dabs_classic_parse(unsigned int context_id,
+                                           DP_TextReader *reader)
+{
+    int dab_count = parse_dab_count(reader, MAX_CLASSIC_DAB_COUNT);
+    if (dab_count == 0) {
+        return NULL;
+    }
+
+    DP_Message *msg = DP_msg_draw_dabs_classic_new(
+        context_id, DP_text_reader_get_int(reader, "layer", 0, UINT16_MAX),
+        DP_text_reader_get_subpixel(reader, "x", INT32_MIN, INT32_MAX),
+        DP_text_reader_get_subpixel(reader, "y", INT32_MIN, INT32_MAX),
+        DP_text_reader_get_argb_color(reader, "color"),
+        DP_text_reader_get_int(reader, "mode", 0, UINT8_MAX), dab_count);
+
+    DP_MsgDrawDabsClassic *mddc = DP_message_internal(msg);
+    for (int i = 0; i < dab_count; ++i) {
+        mddc->dabs[i] = (DP_ClassicBrushDab){
+            {DP_int_to_int8(DP_text_reader_get_tuple_subpixel(
+                 reader, i, 0, INT8_MIN, INT8_MAX)),
+             DP_int_to_int8(DP_text_reader_get_tuple_subpixel(
+                 reader, i, 1, INT8_MIN, INT8_MAX)),
+             DP_int_to_uint8(
+                 DP_text_reader_get_tuple_int(reader, i, 4, 0, UINT8_MAX))},
+            DP_int_to_uint16(
+                DP_text_reader_get_tuple_int(reader, i, 2, 0, UINT16_MAX)),
+            DP_int_to_uint8(
+                DP_text_reader_get_tuple_int(reader, i, 3, 0, UINT8_MAX))};
+    }
+
+    return msg;
+}
+
+
 DP_MsgDrawDabsClassic *DP_msg_draw_dabs_classic_cast(DP_Message *msg)
 {
     return DP_message_cast(msg, DP_MSG_DRAW_DABS_CLASSIC);
@@ -679,6 +726,51 @@ DP_Message *DP_msg_draw_dabs_pixel_square_deserialize(
 }
 
 
+static DP_Message *pixel_parse(int type, unsigned int context_id,
+                               DP_TextReader *reader)
+{
+    int dab_count = parse_dab_count(reader, MAX_PIXEL_DAB_COUNT);
+    if (dab_count == 0) {
+        return NULL;
+    }
+
+    DP_Message *msg = DP_msg_draw_dabs_pixel_new(
+        type, context_id,
+        DP_text_reader_get_int(reader, "layer", 0, UINT16_MAX),
+        DP_text_reader_get_int(reader, "x", INT32_MIN, INT32_MAX),
+        DP_text_reader_get_int(reader, "y", INT32_MIN, INT32_MAX),
+        DP_text_reader_get_argb_color(reader, "color"),
+        DP_text_reader_get_int(reader, "mode", 0, UINT8_MAX), dab_count);
+
+    DP_MsgDrawDabsPixel *mddp = DP_message_internal(msg);
+    for (int i = 0; i < dab_count; ++i) {
+        mddp->dabs[i] = (DP_PixelBrushDab){
+            {DP_int_to_int8(DP_text_reader_get_tuple_int(reader, i, 0,
+                                                         INT8_MIN, INT8_MAX)),
+             DP_int_to_int8(DP_text_reader_get_tuple_int(reader, i, 1,
+                                                         INT8_MIN, INT8_MAX)),
+             DP_int_to_uint8(
+                 DP_text_reader_get_tuple_int(reader, i, 3, 0, UINT8_MAX))},
+            DP_int_to_uint8(
+                DP_text_reader_get_tuple_int(reader, i, 2, 0, UINT8_MAX))};
+    }
+
+    return msg;
+}
+
+DP_Message *DP_msg_draw_dabs_pixel_parse(unsigned int context_id,
+                                         DP_TextReader *reader)
+{
+    return pixel_parse(DP_MSG_DRAW_DABS_PIXEL, context_id, reader);
+}
+
+DP_Message *DP_msg_draw_dabs_pixel_square_parse(unsigned int context_id,
+                                                DP_TextReader *reader)
+{
+    return pixel_parse(DP_MSG_DRAW_DABS_PIXEL_SQUARE, context_id, reader);
+}
+
+
 DP_MsgDrawDabsPixel *DP_msg_draw_dabs_pixel_cast(DP_Message *msg)
 {
     return DP_message_cast2(msg, DP_MSG_DRAW_DABS_PIXEL,
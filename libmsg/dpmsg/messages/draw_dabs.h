@@ -24,6 +24,7 @@
 #include <dpcommon/common.h>
 
 typedef struct DP_Message DP_Message;
+typedef struct DP_TextReader DP_TextReader;
 
 
 typedef struct DP_BrushDab DP_BrushDab;
@@ -100,6 +101,9 @@ DP_Message *DP_msg_draw_dabs_classic_deserialize(unsigned int context_id,
                                                  const unsigned char *buffer,
                                                  size_t length);
 
+DP_Message *DP_msg_draw_dabs_classic_parse(unsigned int context_id,
+                                           DP_TextReader *reader);
+
 DP_MsgDrawDabsClassic *DP_msg_draw_dabs_classic_cast(DP_Message *msg);
 
 
@@ -133,6 +137,12 @@ DP_Message *DP_msg_draw_dabs_pixel_deserialize(unsigned int context_id,
 DP_Message *DP_msg_draw_dabs_pixel_square_deserialize(
     unsigned int context_id, const unsigned char *buffer, size_t length);
 
+DP_Message *DP_msg_draw_dabs_pixel_parse(unsigned int context_id,
+                                         DP_TextReader *reader);
+
+DP_Message *DP_msg_draw_dabs_pixel_square_parse(unsigned int context_id,
+                                                DP_TextReader *reader);
+
 
 DP_MsgDrawDabsPixel *DP_msg_draw_dabs_pixel_cast(DP_Message *msg);
 
@@ -22,14 +22,21 @@
 #include "feature_levels.h"
 #include "../access_tier.h"
 #include "../message.h"
+#include "../text_reader.h"
 #include "../text_writer.h"
 #include <dpcommon/common.h>
+#include <dpcommon/conversions.h>
 
 
 struct DP_MsgFeatureLevels {
     uint8_t feature_tiers[DP_MSG_FEATURE_LEVELS_FEATURE_COUNT];
 };
 
+static const char *feature_names[DP_MSG_FEATURE_LEVELS_FEATURE_COUNT] = {
+    "putimage",  "regionmove",       "resize", "background", "editlayers",
+    "ownlayers", "createannotation", "laser",  "undo",
+};
+
 static size_t payload_length(DP_UNUSED DP_Message *msg)
 {
     return DP_MSG_FEATURE_LEVELS_FEATURE_COUNT;
@@ -49,10 +56,6 @@ static bool write_payload_text(DP_Message *msg, DP_TextWriter *writer)
         {
             3, 6, 4, 7, 5, 0, 1, 2, 8,
         };
-    static const char *names[DP_MSG_FEATURE_LEVELS_FEATURE_COUNT] = {
-        "putimage",  "regionmove",       "resize", "background", "editlayers",
-        "ownlayers", "createannotation", "laser",  "undo",
-    };
 
     DP_MsgFeatureLevels *mfl = DP_msg_feature_levels_cast(msg);
     DP_ASSERT(mfl);
@@ -61,8 +64,9 @@ static bool write_payload_text(DP_Message *msg, DP_TextWriter *writer)
         int feature_index = alphabetic_feature_indexes[i];
         int tier = DP_access_tier_clamp(mfl->feature_tiers[feature_index]);
         if (tier != 0) {
+            const char *name = feature_names[feature_index];
             DP_RETURN_UNLESS(DP_text_writer_write_string(
-                writer, names[feature_index], DP_access_tier_name(tier)));
+                writer, name, DP_access_tier_name(tier)));
         }
     }
 
@@ -108,6 +112,28 @@ DP_Message *DP_msg_feature_levels_deserialize(unsigned int context_id,
     }
 }
 
+DP_Message *DP_msg_feature_levels_parse(unsigned int context_id,
+                                        DP_TextReader *reader)
+{
+    unsigned char feature_tiers[DP_MSG_FEATURE_LEVELS_FEATURE_COUNT];
+    for (int i = 0; i < DP_MSG_FEATURE_LEVELS_FEATURE_COUNT; ++i) {
+        const char *name = feature_names[i];
+        if (DP_text_reader_has(reader, name)) {
+            const char *value = DP_text_reader_get_string(reader, name, NULL);
+            int tier = DP_access_tier_from_name(value);
+            if (tier == -1) {
+                DP_text_reader_fail(reader, "unknown tier %s=%s", name, value);
+                return NULL;
+            }
+            feature_tiers[i] = DP_int_to_uchar(tier);
+        }
+        else {
+            feature_tiers[i] = 0;
+        }
+    }
+    return DP_msg_feature_levels_new(context_id, feature_tiers);
+}
+
 
 DP_MsgFeatureLevels *DP_msg_feature_levels_cast(DP_Message *msg)
 {
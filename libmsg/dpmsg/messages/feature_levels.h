@@ -24,6 +24,7 @@
 #include <dpcommon/common.h>
 
 typedef struct DP_Message DP_Message;
+typedef struct DP_TextReader DP_TextReader;
 
 
 #define DP_MSG_FEATURE_LEVELS_FEATURE_COUNT 9
@@ -38,6 +39,9 @@ DP_Message *DP_msg_feature_levels_deserialize(unsigned int context_id,
                                               const unsigned char *buffer,
                                               size_t length);
 
+DP_Message *DP_msg_feature_levels_parse(unsigned int context_id,
+                                        DP_TextReader *reader);
+
 DP_MsgFeatureLevels *DP_msg_feature_levels_cast(DP_Message *msg);
 
 
@@ -21,6 +21,7 @@
  */
 #include "fill_rect.h"
 #include "../message.h"
+#include "../text_reader.h"
 #include "../text_writer.h"
 #include <dpcommon/binary.h>
 #include <dpcommon/common.h>
@@ -136,6 +137,19 @@ DP_Message *DP_msg_fill_rect_deserialize(unsigned int context_id,
     }
 }
 
+DP_Message *DP_msg_fill_rect_parse(unsigned int context_id,
+                                   DP_TextReader *reader)
+{
+    return DP_msg_fill_rect_new(
+        context_id, DP_text_reader_get_int(reader, "layer", 0, UINT16_MAX),
+        DP_text_reader_get_int(reader, "blend", 0, UINT8_MAX),
+        DP_text_reader_get_int(reader, "x", 0, INT32_MAX),
+        DP_text_reader_get_int(reader, "y", 0, INT32_MAX),
+        DP_text_reader_get_int(reader, "w", 0, INT32_MAX),
+        DP_text_reader_get_int(reader, "h", 0, INT32_MAX),
+        DP_text_reader_get_argb_color(reader, "color"));
+}
+
 
 DP_MsgFillRect *DP_msg_fill_rect_cast(DP_Message *msg)
 {
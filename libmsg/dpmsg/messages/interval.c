@@ -21,6 +21,7 @@
  */
 #include "interval.h"
 #include "../message.h"
+#include "../text_reader.h"
 #include "../text_writer.h"
 #include <dpcommon/binary.h>
 #include <dpcommon/common.h>
@@ -89,6 +90,13 @@ DP_Message *DP_msg_interval_deserialize(unsigned int context_id,
     }
 }
 
+DP_Message *DP_msg_interval_parse(unsigned int context_id,
+                                  DP_TextReader *reader)
+{
+    return DP_msg_interval_new(
+        context_id, DP_text_reader_get_uint(reader, "msecs", UINT16_MAX));
+}
+
 
 DP_MsgInterval *DP_msg_interval_cast(DP_Message *msg)
 {
@@ -24,6 +24,7 @@
 #include <dpcommon/common.h>
 
 typedef struct DP_Message DP_Message;
+typedef struct DP_TextReader DP_TextReader;
 
 
 typedef struct DP_MsgInterval DP_MsgInterval;
@@ -34,6 +35,9 @@ DP_Message *DP_msg_interval_deserialize(unsigned int context_id,
                                         const unsigned char *buffer,
                                         size_t length);
 
+DP_Message *DP_msg_interval_parse(unsigned int context_id,
+                                  DP_TextReader *reader);
+
 DP_MsgInterval *DP_msg_interval_cast(DP_Message *msg);
 
 
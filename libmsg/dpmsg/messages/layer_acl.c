@@ -20,7 +20,9 @@
  * License, version 3. See 3rdparty/licenses/drawpile/COPYING for details.
  */
 #include "layer_acl.h"
+#include "../access_tier.h"
 #include "../message.h"
+#include "../text_reader.h"
 #include "../text_writer.h"
 #include <dpcommon/binary.h>
 #include <dpcommon/common.h>
@@ -172,6 +174,42 @@ DP_Message *DP_msg_layer_acl_deserialize(unsigned int context_id,
     }
 }
 
+static unsigned int get_parsed_exclusive_id(void *user, int i)
+{
+    const int *exclusive_ids = user;
+    return DP_int_to_uint(exclusive_ids[i]);
+}
+
+DP_Message *DP_msg_layer_acl_parse(unsigned int context_id,
+                                   DP_TextReader *reader)
+{
+    int layer_id = DP_text_reader_get_int(reader, "id", 0, UINT16_MAX);
+    unsigned int flags =
+        DP_text_reader_get_bool(reader, "locked") ? LOCKED_MASK : 0;
+
+    if (DP_text_reader_has(reader, "tier")) {
+        const char *value = DP_text_reader_get_string(reader, "tier", NULL);
+        int tier = DP_access_tier_from_name(value);
+        if (tier == -1) {
+            DP_text_reader_fail(reader, "unknown tier %s", value);
+            return NULL;
+        }
+        flags |= DP_int_to_uint(tier) & TIER_MASK;
+    }
+
+    int exclusive_id_count;
+    const int *exclusive_ids = DP_text_reader_get_list(
+        reader, "exclusive", 0, UINT8_MAX, &exclusive_id_count);
+    if (exclusive_id_count > UINT8_MAX) {
+        DP_text_reader_fail(reader, "too many exclusive ids");
+        return NULL;
+    }
+
+    return DP_msg_layer_acl_new(context_id, layer_id, flags,
+                                exclusive_id_count, get_parsed_exclusive_id,
+                                (void *)exclusive_ids);
+}
+
 
 DP_MsgLayerAcl *DP_msg_layer_acl_cast(DP_Message *msg)
 {
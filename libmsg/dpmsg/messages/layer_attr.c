@@ -21,6 +21,7 @@
  */
 #include "layer_attr.h"
 #include "../message.h"
+#include "../text_reader.h"
 #include "../text_writer.h"
 #include <dpcommon/binary.h>
 #include <dpcommon/common.h>
@@ -135,6 +136,20 @@ DP_Message *DP_msg_layer_attr_deserialize(unsigned int context_id,
     }
 }
 
+DP_Message *DP_msg_layer_attr_parse(unsigned int context_id,
+                                    DP_TextReader *reader)
+{
+    return DP_msg_layer_attr_new(
+        context_id, DP_text_reader_get_int(reader, "layer", 0, UINT16_MAX),
+        DP_uint_to_int(DP_text_reader_get_uint(reader, "sublayer", UINT8_MAX)),
+        DP_text_reader_get_flags(reader, "flags", "censor",
+                                 DP_MSG_LAYER_ATTR_FLAG_CENSORED, "fixed",
+                                 DP_MSG_LAYER_ATTR_FLAG_FIXED,
+                                 (const char *)NULL),
+        DP_text_reader_get_decimal(reader, "opacity"),
+        DP_uint_to_int(DP_text_reader_get_uint(reader, "blend", UINT8_MAX)));
+}
+
 
 DP_MsgLayerAttr *DP_msg_layer_attr_cast(DP_Message *msg)
 {
@@ -24,6 +24,7 @@
 #include <dpcommon/common.h>
 
 typedef struct DP_Message DP_Message;
+typedef struct DP_TextReader DP_TextReader;
 
 
 #define DP_MSG_LAYER_ATTR_FLAG_CENSORED (1 << 0)
@@ -42,6 +43,9 @@ DP_Message *DP_msg_layer_attr_deserialize(unsigned int context_id,
                                           const unsigned char *buffer,
                                           size_t length);
 
+DP_Message *DP_msg_layer_attr_parse(unsigned int context_id,
+                                    DP_TextReader *reader);
+
 DP_MsgLayerAttr *DP_msg_layer_attr_cast(DP_Message *msg);
 
 
@@ -21,6 +21,7 @@
  */
 #include "layer_create.h"
 #include "../message.h"
+#include "../text_reader.h"
 #include "../text_writer.h"
 #include <dpcommon/binary.h>
 #include <dpcommon/common.h>
@@ -148,6 +149,23 @@ DP_Message *DP_msg_layer_create_deserialize(unsigned int context_id,
     }
 }
 
+DP_Message *DP_msg_layer_create_parse(unsigned int context_id,
+                                      DP_TextReader *reader)
+{
+    size_t title_length;
+    const char *title =
+        DP_text_reader_get_string(reader, "title", &title_length);
+    return DP_msg_layer_create_new(
+        context_id, DP_text_reader_get_int(reader, "id", 0, UINT16_MAX),
+        DP_text_reader_get_int(reader, "source", 0, UINT16_MAX),
+        DP_text_reader_get_argb_color(reader, "fill"),
+        DP_text_reader_get_flags(reader, "flags", "copy",
+                                 DP_MSG_LAYER_CREATE_FLAG_COPY, "insert",
+                                 DP_MSG_LAYER_CREATE_FLAG_INSERT,
+                                 (const char *)NULL),
+        title, title_length);
+}
+
 
 DP_MsgLayerCreate *DP_msg_layer_create_cast(DP_Message *msg)
 {
@@ -24,6 +24,7 @@
 #include <dpcommon/common.h>
 
 typedef struct DP_Message DP_Message;
+typedef struct DP_TextReader DP_TextReader;
 
 
 #define DP_MSG_LAYER_CREATE_FLAG_COPY   (1 << 0)
@@ -43,6 +44,9 @@ DP_Message *DP_msg_layer_create_deserialize(unsigned int context_id,
                                             const unsigned char *buffer,
                                             size_t length);
 
+DP_Message *DP_msg_layer_create_parse(unsigned int context_id,
+                                      DP_TextReader *reader);
+
 DP_MsgLayerCreate *DP_msg_layer_create_cast(DP_Message *msg);
 
 
@@ -21,6 +21,7 @@
  */
 #include "layer_delete.h"
 #include "../message.h"
+#include "../text_reader.h"
 #include "../text_writer.h"
 #include <dpcommon/binary.h>
 #include <dpcommon/common.h>
@@ -102,6 +103,14 @@ DP_Message *DP_msg_layer_delete_deserialize(unsigned int context_id,
     }
 }
 
+DP_Message *DP_msg_layer_delete_parse(unsigned int context_id,
+                                      DP_TextReader *reader)
+{
+    return DP_msg_layer_delete_new(
+        context_id, DP_text_reader_get_int(reader, "layer", 0, UINT16_MAX),
+        DP_text_reader_get_bool(reader, "merge"));
+}
+
 
 DP_MsgLayerDelete *DP_msg_layer_delete_cast(DP_Message *msg)
 {
@@ -21,6 +21,7 @@
  */
 #include "layer_order.h"
 #include "../message.h"
+#include "../text_reader.h"
 #include "../text_writer.h"
 #include <dpcommon/binary.h>
 #include <dpcommon/common.h>
@@ -57,7 +58,6 @@ static bool write_payload_text(DP_Message *msg, DP_TextWriter *writer)
     DP_MsgLayerOrder *mlo = DP_msg_layer_order_cast(msg);
     DP_ASSERT(mlo);
 
-    DP_RETURN_UNLESS(DP_text_writer_raw_print(writer, " layers="));
     DP_RETURN_UNLESS(DP_text_writer_write_id_list(writer, "layers",
                                                   mlo->layer_ids, mlo->count));
 
@@ -125,6 +125,22 @@ DP_Message *DP_msg_layer_order_deserialize(unsigned int context_id,
     }
 }
 
+static int get_parsed_layer_id(void *user, int i)
+{
+    const int *layer_ids = user;
+    return layer_ids[i];
+}
+
+DP_Message *DP_msg_layer_order_parse(unsigned int context_id,
+                                     DP_TextReader *reader)
+{
+    int count;
+    const int *layer_ids =
+        DP_text_reader_get_list(reader, "layers", 0, UINT16_MAX, &count);
+    return DP_msg_layer_order_new(context_id, count, get_parsed_layer_id,
+                                  (void *)layer_ids);
+}
+
 
 DP_MsgLayerOrder *DP_msg_layer_order_cast(DP_Message *msg)
 {
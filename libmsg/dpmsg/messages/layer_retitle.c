@@ -21,6 +21,7 @@
  */
 #include "layer_retitle.h"
 #include "../message.h"
+#include "../text_reader.h"
 #include "../text_writer.h"
 #include <dpcommon/binary.h>
 #include <dpcommon/common.h>
@@ -107,6 +108,17 @@ DP_Message *DP_msg_layer_retitle_deserialize(unsigned int context_id,
     }
 }
 
+DP_Message *DP_msg_layer_retitle_parse(unsigned int context_id,
+                                       DP_TextReader *reader)
+{
+    size_t title_length;
+    const char *title =
+        DP_text_reader_get_string(reader, "title", &title_length);
+    return DP_msg_layer_retitle_new(
+        context_id, DP_text_reader_get_int(reader, "id", 0, UINT16_MAX), title,
+        title_length);
+}
+
 
 DP_MsgLayerRetitle *DP_msg_layer_retitle_cast(DP_Message *msg)
 {
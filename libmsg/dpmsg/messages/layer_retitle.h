@@ -24,6 +24,7 @@
 #include <dpcommon/common.h>
 
 typedef struct DP_Message DP_Message;
+typedef struct DP_TextReader DP_TextReader;
 
 
 typedef struct DP_MsgLayerRetitle DP_MsgLayerRetitle;
@@ -35,6 +36,9 @@ DP_Message *DP_msg_layer_retitle_deserialize(unsigned int context_id,
                                              const unsigned char *buffer,
                                              size_t length);
 
+DP_Message *DP_msg_layer_retitle_parse(unsigned int context_id,
+                                       DP_TextReader *reader);
+
 DP_MsgLayerRetitle *DP_msg_layer_retitle_cast(DP_Message *msg);
 
 
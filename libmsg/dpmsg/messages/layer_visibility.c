@@ -21,6 +21,7 @@
  */
 #include "layer_visibility.h"
 #include "../message.h"
+#include "../text_reader.h"
 #include "../text_writer.h"
 #include <dpcommon/binary.h>
 #include <dpcommon/common.h>
@@ -100,6 +101,14 @@ DP_Message *DP_msg_layer_visibility_deserialize(unsigned int context_id,
     }
 }
 
+DP_Message *DP_msg_layer_visibility_parse(unsigned int context_id,
+                                          DP_TextReader *reader)
+{
+    return DP_msg_layer_visibility_new(
+        context_id, DP_text_reader_get_int(reader, "layer", 0, UINT16_MAX),
+        DP_text_reader_get_bool(reader, "visible"));
+}
+
 
 DP_MsgLayerVisibility *DP_msg_layer_visibility_cast(DP_Message *msg)
 {
@@ -24,6 +24,7 @@
 #include <dpcommon/common.h>
 
 typedef struct DP_Message DP_Message;
+typedef struct DP_TextReader DP_TextReader;
 
 
 typedef struct DP_MsgLayerVisibility DP_MsgLayerVisibility;
@@ -35,6 +36,9 @@ DP_Message *DP_msg_layer_visibility_deserialize(unsigned int context_id,
                                                 const unsigned char *buffer,
                                                 size_t length);
 
+DP_Message *DP_msg_layer_visibility_parse(unsigned int context_id,
+                                          DP_TextReader *reader);
+
 DP_MsgLayerVisibility *DP_msg_layer_visibility_cast(DP_Message *msg);
 
 
@@ -21,6 +21,7 @@
  */
 #include "pen_up.h"
 #include "../message.h"
+#include "../text_reader.h"
 #include "zero_length.h"
 #include <dpcommon/common.h>
 
@@ -38,6 +39,12 @@ DP_Message *DP_msg_pen_up_deserialize(unsigned int context_id,
                                       length);
 }
 
+DP_Message *DP_msg_pen_up_parse(unsigned int context_id,
+                                DP_UNUSED DP_TextReader *reader)
+{
+    return DP_msg_pen_up_new(context_id);
+}
+
 
 DP_MsgPenUp *DP_msg_pen_up_cast(DP_Message *msg)
 {
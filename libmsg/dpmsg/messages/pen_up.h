@@ -24,6 +24,7 @@
 #include <dpcommon/common.h>
 
 typedef struct DP_Message DP_Message;
+typedef struct DP_TextReader DP_TextReader;
 
 
 typedef struct DP_MsgPenUp DP_MsgPenUp;
@@ -34,6 +35,8 @@ DP_Message *DP_msg_pen_up_deserialize(unsigned int context_id,
                                       const unsigned char *buffer,
                                       size_t length);
 
+DP_Message *DP_msg_pen_up_parse(unsigned int context_id, DP_TextReader *reader);
+
 DP_MsgPenUp *DP_msg_pen_up_cast(DP_Message *msg);
 
 
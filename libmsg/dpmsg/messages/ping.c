@@ -21,6 +21,7 @@
  */
 #include "ping.h"
 #include "../message.h"
+#include "../text_reader.h"
 #include "../text_writer.h"
 #include <dpcommon/binary.h>
 #include <dpcommon/common.h>
@@ -85,6 +86,12 @@ DP_Message *DP_msg_ping_deserialize(unsigned int context_id,
     }
 }
 
+DP_Message *DP_msg_ping_parse(unsigned int context_id, DP_TextReader *reader)
+{
+    return DP_msg_ping_new(context_id,
+                           DP_text_reader_get_int(reader, "pong", 0, 1) != 0);
+}
+
 
 DP_MsgPing *DP_msg_ping_cast(DP_Message *msg)
 {
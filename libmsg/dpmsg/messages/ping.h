@@ -24,6 +24,7 @@
 #include <dpcommon/common.h>
 
 typedef struct DP_Message DP_Message;
+typedef struct DP_TextReader DP_TextReader;
 
 
 typedef struct DP_MsgPing DP_MsgPing;
@@ -33,6 +34,8 @@ DP_Message *DP_msg_ping_new(unsigned int context_id, bool is_pong);
 DP_Message *DP_msg_ping_deserialize(unsigned int context_id,
                                     const unsigned char *buffer, size_t length);
 
+DP_Message *DP_msg_ping_parse(unsigned int context_id, DP_TextReader *reader);
+
 DP_MsgPing *DP_msg_ping_cast(DP_Message *msg);
 
 
@@ -21,6 +21,7 @@
  */
 #include "private_chat.h"
 #include "../message.h"
+#include "../text_reader.h"
 #include "../text_writer.h"
 #include "dpcommon/binary.h"
 #include <dpcommon/common.h>
@@ -124,6 +125,27 @@ DP_Message *DP_msg_private_chat_deserialize(unsigned int context_id,
     }
 }
 
+DP_Message *DP_msg_private_chat_parse(unsigned int context_id,
+                                      DP_TextReader *reader)
+{
+    unsigned int target = DP_text_reader_get_uint(reader, "target", UINT8_MAX);
+    unsigned int opaque_flags = DP_text_reader_get_flags(
+        reader, "flags", "action", DP_MSG_PRIVATE_CHAT_ACTION,
+        (const char *)NULL);
+
+    size_t text_length;
+    const char *text =
+        DP_text_reader_get_string(reader, "message", &text_length);
+    if (text_length >= MIN_TEXT_LENGTH) {
+        return DP_msg_private_chat_new(context_id, target, opaque_flags, text,
+                                       text_length);
+    }
+    else {
+        DP_text_reader_fail(reader, "empty message");
+        return NULL;
+    }
+}
+
 
 DP_MsgPrivateChat *DP_msg_private_chat_cast(DP_Message *msg)
 {
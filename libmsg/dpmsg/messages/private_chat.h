@@ -24,6 +24,7 @@
 #include <dpcommon/common.h>
 
 typedef struct DP_Message DP_Message;
+typedef struct DP_TextReader DP_TextReader;
 
 
 #define DP_MSG_PRIVATE_CHAT_ACTION (1 << 1)
@@ -40,6 +41,9 @@ DP_Message *DP_msg_private_chat_deserialize(unsigned int context_id,
                                             const unsigned char *buffer,
                                             size_t length);
 
+DP_Message *DP_msg_private_chat_parse(unsigned int context_id,
+                                      DP_TextReader *reader);
+
 DP_MsgPrivateChat *DP_msg_private_chat_cast(DP_Message *msg);
 
 
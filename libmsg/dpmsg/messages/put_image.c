@@ -21,6 +21,7 @@
  */
 #include "put_image.h"
 #include "../message.h"
+#include "../text_reader.h"
 #include "../text_writer.h"
 #include <dpcommon/binary.h>
 #include <dpcommon/common.h>
@@ -145,6 +146,29 @@ DP_Message *DP_msg_put_image_deserialize(unsigned int context_id,
     }
 }
 
+DP_Message *DP_msg_put_image_parse(unsigned int context_id,
+                                   DP_TextReader *reader)
+{
+    int layer_id = DP_text_reader_get_int(reader, "layer", 0, UINT16_MAX);
+    int blend_mode = DP_text_reader_get_int(reader, "mode", 0, UINT8_MAX);
+    int x = DP_text_reader_get_int(reader, "x", 0, INT32_MAX);
+    int y = DP_text_reader_get_int(reader, "y", 0, INT32_MAX);
+    int width = DP_text_reader_get_int(reader, "w", 0, INT32_MAX);
+    int height = DP_text_reader_get_int(reader, "h", 0, INT32_MAX);
+
+    size_t image_size;
+    const unsigned char *image =
+        DP_text_reader_get_base64(reader, "img", &image_size);
+    if (image_size <= MAX_IMAGE_SIZE) {
+        return DP_msg_put_image_new(context_id, layer_id, blend_mode, x, y,
+                                    width, height, image, image_size);
+    }
+    else {
+        DP_text_reader_fail(reader, "image too large");
+        return NULL;
+    }
+}
+
 
 DP_MsgPutImage *DP_msg_put_image_cast(DP_Message *msg)
 {
@@ -24,6 +24,7 @@
 #include <dpcommon/common.h>
 
 typedef struct DP_Message DP_Message;
+typedef struct DP_TextReader DP_TextReader;
 
 
 typedef struct DP_MsgPutImage DP_MsgPutImage;
@@ -37,6 +38,9 @@ DP_Message *DP_msg_put_image_deserialize(unsigned int context_id,
                                          const unsigned char *buffer,
                                          size_t length);
 
+DP_Message *DP_msg_put_image_parse(unsigned int context_id,
+                                   DP_TextReader *reader);
+
 DP_MsgPutImage *DP_msg_put_image_cast(DP_Message *msg);
 
 
@@ -21,6 +21,7 @@
  */
 #include "put_tile.h"
 #include "../message.h"
+#include "../text_reader.h"
 #include "../text_writer.h"
 #include <dpcommon/binary.h>
 #include <dpcommon/common.h>
@@ -159,6 +160,36 @@ DP_Message *DP_msg_put_tile_deserialize(unsigned int context_id,
     }
 }
 
+DP_Message *DP_msg_put_tile_parse(unsigned int context_id,
+                                  DP_TextReader *reader)
+{
+    int layer_id = DP_text_reader_get_int(reader, "layer", 0, UINT16_MAX);
+    int sublayer_id = DP_text_reader_get_int(reader, "sublayer", 0, UINT8_MAX);
+    int x = DP_text_reader_get_int(reader, "col", 0, UINT16_MAX);
+    int y = DP_text_reader_get_int(reader, "row", 0, UINT16_MAX);
+    int repeat = DP_text_reader_get_int(reader, "repeat", 0, UINT16_MAX);
+
+    if (DP_text_reader_has(reader, "color")) {
+        unsigned char image[4];
+        DP_write_bigendian_uint32(
+            DP_text_reader_get_argb_color(reader, "color"), image);
+        return DP_msg_put_tile_new(context_id, layer_id, sublayer_id, x, y,
+                                   repeat, image, sizeof(image));
+    }
+
+    size_t image_size;
+    const unsigned char *image =
+        DP_text_reader_get_base64(reader, "img", &image_size);
+    if (image_size >= 4 && image_size <= MAX_IMAGE_SIZE) {
+        return DP_msg_put_tile_new(context_id, layer_id, sublayer_id, x, y,
+                                   repeat, image, image_size);
+    }
+    else {
+        DP_text_reader_fail(reader, "invalid image size %zu", image_size);
+        return NULL;
+    }
+}
+
 
 DP_MsgPutTile *DP_msg_put_tile_cast(DP_Message *msg)
 {
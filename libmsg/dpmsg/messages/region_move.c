@@ -21,6 +21,7 @@
  */
 #include "region_move.h"
 #include "../message.h"
+#include "../text_reader.h"
 #include "../text_writer.h"
 #include <dpcommon/binary.h>
 #include <dpcommon/common.h>
@@ -199,6 +200,33 @@ DP_Message *DP_msg_region_move_deserialize(unsigned int context_id,
     }
 }
 
+DP_Message *DP_msg_region_move_parse(unsigned int context_id,
+                                     DP_TextReader *reader)
+{
+    int values[12];
+    static const char *keys[] = {"bx", "by", "bw", "bh", "x1", "y1",
+                                 "x2", "y2", "x3", "y3", "x4", "y4"};
+    for (int i = 0; i < 12; ++i) {
+        values[i] =
+            DP_text_reader_get_int(reader, keys[i], INT32_MIN, INT32_MAX);
+    }
+
+    size_t mask_size;
+    const unsigned char *mask =
+        DP_text_reader_get_base64(reader, "mask", &mask_size);
+    if (mask_size <= MAX_MASK_SIZE) {
+        return DP_msg_region_move_new(
+            context_id, DP_text_reader_get_int(reader, "layer", 0, UINT16_MAX),
+            values[0], values[1], values[2], values[3], values[4], values[5],
+            values[6], values[7], values[8], values[9], values[10], values[11],
+            mask, mask_size);
+    }
+    else {
+        DP_text_reader_fail(reader, "mask too large");
+        return NULL;
+    }
+}
+
 
 DP_MsgRegionMove *DP_msg_region_move_cast(DP_Message *msg)
 {
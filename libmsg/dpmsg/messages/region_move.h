@@ -24,6 +24,7 @@
 #include <dpcommon/common.h>
 
 typedef struct DP_Message DP_Message;
+typedef struct DP_TextReader DP_TextReader;
 
 
 typedef struct DP_MsgRegionMove DP_MsgRegionMove;
@@ -38,6 +39,9 @@ DP_Message *DP_msg_region_move_deserialize(unsigned int context_id,
                                            const unsigned char *buffer,
                                            size_t length);
 
+DP_Message *DP_msg_region_move_parse(unsigned int context_id,
+                                     DP_TextReader *reader);
+
 DP_MsgRegionMove *DP_msg_region_move_cast(DP_Message *msg);
 
 
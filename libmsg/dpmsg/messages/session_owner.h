@@ -24,6 +24,7 @@
 #include <dpcommon/common.h>
 
 typedef struct DP_Message DP_Message;
+typedef struct DP_TextReader DP_TextReader;
 
 
 typedef struct DP_MsgSessionOwner DP_MsgSessionOwner;
@@ -36,6 +37,9 @@ DP_Message *DP_msg_session_owner_deserialize(unsigned int context_id,
                                              const unsigned char *buffer,
                                              size_t length);
 
+DP_Message *DP_msg_session_owner_parse(unsigned int context_id,
+                                       DP_TextReader *reader);
+
 DP_MsgSessionOwner *DP_msg_session_owner_cast(DP_Message *msg);
 
 
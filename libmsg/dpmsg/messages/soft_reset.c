@@ -21,6 +21,7 @@
  */
 #include "soft_reset.h"
 #include "../message.h"
+#include "../text_reader.h"
 #include "zero_length.h"
 #include <dpcommon/common.h>
 
@@ -38,6 +39,12 @@ DP_Message *DP_msg_soft_reset_deserialize(unsigned int context_id,
                                       length);
 }
 
+DP_Message *DP_msg_soft_reset_parse(unsigned int context_id,
+                                    DP_UNUSED DP_TextReader *reader)
+{
+    return DP_msg_soft_reset_new(context_id);
+}
+
 
 DP_MsgSoftReset *DP_msg_soft_reset_cast(DP_Message *msg)
 {
@@ -24,6 +24,7 @@
 #include <dpcommon/common.h>
 
 typedef struct DP_Message DP_Message;
+typedef struct DP_TextReader DP_TextReader;
 
 
 typedef struct DP_MsgSoftReset DP_MsgSoftReset;
@@ -34,6 +35,9 @@ DP_Message *DP_msg_soft_reset_deserialize(unsigned int context_id,
                                           const unsigned char *buffer,
                                           size_t length);
 
+DP_Message *DP_msg_soft_reset_parse(unsigned int context_id,
+                                    DP_TextReader *reader);
+
 DP_MsgSoftReset *DP_msg_soft_reset_cast(DP_Message *msg);
 
 
@@ -21,6 +21,7 @@
  */
 #include "undo.h"
 #include "../message.h"
+#include "../text_reader.h"
 #include "../text_writer.h"
 #include <dpcommon/binary.h>
 #include <dpcommon/common.h>
@@ -99,6 +100,14 @@ DP_Message *DP_msg_undo_deserialize(unsigned int context_id,
     }
 }
 
+DP_Message *DP_msg_undo_parse(unsigned int context_id, DP_TextReader *reader)
+{
+    bool is_redo = strcmp(DP_text_reader_message_name(reader), "redo") == 0;
+    return DP_msg_undo_new(
+        context_id, DP_text_reader_get_uint(reader, "override", UINT8_MAX),
+        is_redo);
+}
+
 
 DP_MsgUndo *DP_msg_undo_cast(DP_Message *msg)
 {
@@ -24,6 +24,7 @@
 #include <dpcommon/common.h>
 
 typedef struct DP_Message DP_Message;
+typedef struct DP_TextReader DP_TextReader;
 
 
 typedef struct DP_MsgUndo DP_MsgUndo;
@@ -34,6 +35,8 @@ DP_Message *DP_msg_undo_new(unsigned int context_id, unsigned int override_id,
 DP_Message *DP_msg_undo_deserialize(unsigned int context_id,
                                     const unsigned char *buffer, size_t length);
 
+DP_Message *DP_msg_undo_parse(unsigned int context_id, DP_TextReader *reader);
+
 DP_MsgUndo *DP_msg_undo_cast(DP_Message *msg);
 
 const char *DP_msg_undo_message_name(DP_Message *msg);
@@ -21,6 +21,7 @@
  */
 #include "undo_point.h"
 #include "../message.h"
+#include "../text_reader.h"
 #include "zero_length.h"
 #include <dpcommon/common.h>
 
@@ -38,6 +39,12 @@ DP_Message *DP_msg_undo_point_deserialize(unsigned int context_id,
                                       length);
 }
 
+DP_Message *DP_msg_undo_point_parse(unsigned int context_id,
+                                    DP_UNUSED DP_TextReader *reader)
+{
+    return DP_msg_undo_point_new(context_id);
+}
+
 
 DP_MsgUndoPoint *DP_msg_undo_point_cast(DP_Message *msg)
 {
@@ -22,6 +22,7 @@
 #ifndef DPMSG_USER_IDS_H
 #define DPMSG_USER_IDS_H
 #include "../message.h"
+#include "../text_reader.h"
 #include "../text_writer.h"
 #include "dpcommon/binary.h"
 #include "dpcommon/conversions.h"
@@ -119,6 +120,22 @@
     {                                                                          \
         return DP_msg_##NAME##_new(context_id, DP_size_to_int(length),         \
                                    deserialize_id, (void *)buffer);            \
+    }                                                                          \
+                                                                               \
+    static unsigned int get_parsed_id(void *user, int i)                       \
+    {                                                                          \
+        const int *ids = user;                                                 \
+        return DP_int_to_uint(ids[i]);                                         \
+    }                                                                          \
+                                                                               \
+    DP_Message *DP_msg_##NAME##_parse(unsigned int context_id,                 \
+                                      DP_TextReader *reader)                   \
+    {                                                                          \
+        int count;                                                             \
+        const int *ids =                                                       \
+            DP_text_reader_get_list(reader, "users", 0, UINT8_MAX, &count);    \
+        return DP_msg_##NAME##_new(context_id, count, get_parsed_id,           \
+                                   (void *)ids);                               \
     }                                                                          \
                                                                                \
                                                                                \
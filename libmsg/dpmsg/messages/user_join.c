@@ -21,6 +21,7 @@
  */
 #include "user_join.h"
 #include "../message.h"
+#include "../text_reader.h"
 #include "../text_writer.h"
 #include "dpcommon/binary.h"
 #include <dpcommon/common.h>
@@ -152,6 +153,32 @@ DP_Message *DP_msg_user_join_deserialize(unsigned int context_id,
     }
 }
 
+DP_Message *DP_msg_user_join_parse(unsigned int context_id,
+                                   DP_TextReader *reader)
+{
+    unsigned int flags = DP_text_reader_get_flags(
+        reader, "flags", "mod", FLAG_MODERATOR, "auth", FLAG_AUTHENTICATED,
+        "bot", FLAG_BOT, (const char *)NULL);
+
+    size_t name_length;
+    const char *name = DP_text_reader_get_string(reader, "name", &name_length);
+    if (name_length > UINT8_MAX) {
+        DP_text_reader_fail(reader, "name too long");
+        return NULL;
+    }
+
+    size_t avatar_size;
+    const unsigned char *avatar =
+        DP_text_reader_get_base64(reader, "avatar", &avatar_size);
+    if (name_length + avatar_size > UINT16_MAX - MIN_PAYLOAD_LENGTH) {
+        DP_text_reader_fail(reader, "avatar too large");
+        return NULL;
+    }
+
+    return DP_msg_user_join_new(context_id, flags, name, name_length, avatar,
+                                avatar_size);
+}
+
 
 DP_MsgUserJoin *DP_msg_user_join_cast(DP_Message *msg)
 {
@@ -24,6 +24,7 @@
 #include <dpcommon/common.h>
 
 typedef struct DP_Message DP_Message;
+typedef struct DP_TextReader DP_TextReader;
 
 
 typedef struct DP_MsgUserJoin DP_MsgUserJoin;
@@ -37,6 +38,9 @@ DP_Message *DP_msg_user_join_deserialize(unsigned int context_id,
                                          const unsigned char *buffer,
                                          size_t length);
 
+DP_Message *DP_msg_user_join_parse(unsigned int context_id,
+                                   DP_TextReader *reader);
+
 DP_MsgUserJoin *DP_msg_user_join_cast(DP_Message *msg);
 
 
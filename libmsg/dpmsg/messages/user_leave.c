@@ -21,6 +21,7 @@
  */
 #include "user_leave.h"
 #include "../message.h"
+#include "../text_reader.h"
 #include "zero_length.h"
 #include <dpcommon/common.h>
 
@@ -38,6 +39,12 @@ DP_Message *DP_msg_user_leave_deserialize(unsigned int context_id,
                                       length);
 }
 
+DP_Message *DP_msg_user_leave_parse(unsigned int context_id,
+                                    DP_UNUSED DP_TextReader *reader)
+{
+    return DP_msg_user_leave_new(context_id);
+}
+
 
 DP_MsgUserLeave *DP_msg_user_leave_cast(DP_Message *msg)
 {
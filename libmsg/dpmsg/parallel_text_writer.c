@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2022 askmeaboutloom
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * --------------------------------------------------------------------
+ *
+ * This code is based on Drawpile, using it under the GNU General Public
+ * License, version 3. See 3rdparty/licenses/drawpile/COPYING for details.
+ */
+#include "parallel_text_writer.h"
+#include "message.h"
+#include "text_writer.h"
+#include <dpcommon/common.h>
+#include <dpcommon/conversions.h>
+#include <dpcommon/output.h>
+#include <dpcommon/threading.h>
+#include <dpcommon/worker.h>
+
+#define CHUNK_MESSAGE_COUNT 256
+#define CHUNKS_PER_THREAD   2
+
+
+typedef struct DP_TextChunk {
+    DP_TextWriter *writer;
+    DP_Output *output;
+    void **buffer;
+    size_t *size;
+    DP_Semaphore *sem_done;
+    char *error;
+    int count;
+    DP_Message *messages[CHUNK_MESSAGE_COUNT];
+} DP_TextChunk;
+
+struct DP_ParallelTextWriter {
+    DP_TextWriter *writer;
+    DP_Worker *worker;
+    bool ok;
+    int current;
+    int oldest;
+    int in_flight;
+    int chunk_count;
+    DP_TextChunk chunks[];
+};
+
+
+DP_ParallelTextWriter *DP_parallel_text_writer_new(DP_Output *output,
+                                                   int thread_count)
+{
+    DP_ASSERT(output);
+    DP_ASSERT(thread_count > 0);
+    int chunk_count = thread_count * CHUNKS_PER_THREAD;
+    DP_Worker *worker =
+        DP_worker_new(DP_int_to_size(chunk_count), thread_count);
+    if (!worker) {
+        DP_output_free(output);
+        return NULL;
+    }
+
+    DP_ParallelTextWriter *writer = DP_malloc(DP_FLEX_SIZEOF(
+        DP_ParallelTextWriter, chunks, DP_int_to_size(chunk_count)));
+    writer->writer = DP_text_writer_new(output);
+    writer->worker = worker;
+    writer->ok = true;
+    writer->current = 0;
+    writer->oldest = 0;
+    writer->in_flight = 0;
+    writer->chunk_count = chunk_count;
+    for (int i = 0; i < chunk_count; ++i) {
+        DP_TextChunk *chunk = &writer->chunks[i];
+        chunk->output =
+            DP_mem_output_new(0, true, &chunk->buffer, &chunk->size);
+        chunk->writer = DP_text_writer_new(chunk->output);
+        chunk->sem_done = DP_semaphore_new(0);
+        chunk->error = NULL;
+        chunk->count = 0;
+    }
+    return writer;
+}
+
+static void wait_for_chunk(DP_TextChunk *chunk)
+{
+    DP_SEMAPHORE_MUST_WAIT(chunk->sem_done);
+}
+
+void DP_parallel_text_writer_free(DP_ParallelTextWriter *writer)
+{
+    if (writer) {
+        for (int i = 0; i < writer->in_flight; ++i) {
+            wait_for_chunk(
+                &writer->chunks[(writer->oldest + i) % writer->chunk_count]);
+        }
+        DP_worker_free(writer->worker);
+        for (int i = 0; i < writer->chunk_count; ++i) {
+            DP_TextChunk *chunk = &writer->chunks[i];
+            for (int j = 0; j < chunk->count; ++j) {
+                DP_message_decref(chunk->messages[j]);
+            }
+            DP_free(chunk->error);
+            DP_semaphore_free(chunk->sem_done);
+            DP_text_writer_free(chunk->writer);
+        }
+        DP_text_writer_free(writer->writer);
+        DP_free(writer);
+    }
+}
+
+
+bool DP_parallel_text_writer_write_header(DP_ParallelTextWriter *writer,
+                                          JSON_Object *header)
+{
+    DP_ASSERT(writer);
+    DP_ASSERT(writer->in_flight == 0);
+    DP_ASSERT(writer->chunks[writer->current].count == 0);
+    return DP_text_writer_write_header(writer->writer, header);
+}
+
+
+// Runs on a worker thread. The error state is thread-local, so any error
+// message gets copied over to be reported on the writing thread.
+static void format_chunk(void *user)
+{
+    DP_TextChunk *chunk = user;
+    int count = chunk->count;
+    for (int i = 0; i < count; ++i) {
+        DP_Message *msg = chunk->messages[i];
+        if (!chunk->error && !DP_message_write_text(msg, chunk->writer)) {
+            chunk->error = DP_strdup(DP_error());
+        }
+        DP_message_decref(msg);
+    }
+    chunk->count = 0;
+    DP_SEMAPHORE_MUST_POST(chunk->sem_done);
+}
+
+static void write_oldest_chunk(DP_ParallelTextWriter *writer)
+{
+    DP_ASSERT(writer->in_flight > 0);
+    DP_TextChunk *chunk = &writer->chunks[writer->oldest];
+    wait_for_chunk(chunk);
+
+    if (chunk->error) {
+        if (writer->ok) {
+            DP_error_set("%s", chunk->error);
+            writer->ok = false;
+        }
+        DP_free(chunk->error);
+        chunk->error = NULL;
+    }
+    else if (writer->ok) {
+        writer->ok = DP_text_writer_raw_write(writer->writer, *chunk->buffer,
+                                              *chunk->size);
+    }
+
+    DP_output_clear(chunk->output);
+    writer->oldest = (writer->oldest + 1) % writer->chunk_count;
+    --writer->in_flight;
+}
+
+static void submit_current_chunk(DP_ParallelTextWriter *writer)
+{
+    DP_TextChunk *chunk = &writer->chunks[writer->current];
+    DP_worker_push(writer->worker, format_chunk, chunk);
+    writer->current = (writer->current + 1) % writer->chunk_count;
+    if (++writer->in_flight == writer->chunk_count) {
+        write_oldest_chunk(writer);
+    }
+}
+
+bool DP_parallel_text_writer_write_message(DP_ParallelTextWriter *writer,
+                                           DP_Message *msg)
+{
+    DP_ASSERT(writer);
+    DP_ASSERT(msg);
+    DP_TextChunk *chunk = &writer->chunks[writer->current];
+    chunk->messages[chunk->count++] = DP_message_incref(msg);
+    if (chunk->count == CHUNK_MESSAGE_COUNT) {
+        submit_current_chunk(writer);
+    }
+    return writer->ok;
+}
+
+bool DP_parallel_text_writer_finish(DP_ParallelTextWriter *writer)
+{
+    DP_ASSERT(writer);
+    if (writer->chunks[writer->current].count != 0) {
+        submit_current_chunk(writer);
+    }
+    while (writer->in_flight > 0) {
+        write_oldest_chunk(writer);
+    }
+    return writer->ok;
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2022 askmeaboutloom
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * --------------------------------------------------------------------
+ *
+ * This code is based on Drawpile, using it under the GNU General Public
+ * License, version 3. See 3rdparty/licenses/drawpile/COPYING for details.
+ */
+#ifndef DPMSG_PARALLEL_TEXT_WRITER_H
+#define DPMSG_PARALLEL_TEXT_WRITER_H
+#include <dpcommon/common.h>
+#include <parson.h>
+
+typedef struct DP_Message DP_Message;
+typedef struct DP_Output DP_Output;
+
+
+// Formats messages as text on a pool of worker threads. Messages are batched
+// into chunks, each chunk is formatted into its own buffer and the buffers are
+// written to the output in order, so the result is identical to what a plain
+// DP_TextWriter would produce. Takes ownership of the given output.
+typedef struct DP_ParallelTextWriter DP_ParallelTextWriter;
+
+DP_ParallelTextWriter *DP_parallel_text_writer_new(DP_Output *output,
+                                                   int thread_count);
+
+void DP_parallel_text_writer_free(DP_ParallelTextWriter *writer);
+
+
+bool DP_parallel_text_writer_write_header(DP_ParallelTextWriter *writer,
+                                          JSON_Object *header) DP_MUST_CHECK;
+
+bool DP_parallel_text_writer_write_message(DP_ParallelTextWriter *writer,
+                                           DP_Message *msg) DP_MUST_CHECK;
+
+// Waits for all pending messages to be formatted and written.
+bool DP_parallel_text_writer_finish(DP_ParallelTextWriter *writer)
+    DP_MUST_CHECK;
+
+
+#endif
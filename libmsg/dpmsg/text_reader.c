@@ -0,0 +1,1044 @@
+/*
+ * Copyright (C) 2022 askmeaboutloom
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * --------------------------------------------------------------------
+ *
+ * This code is based on Drawpile, using it under the GNU General Public
+ * License, version 3. See 3rdparty/licenses/drawpile/COPYING for details.
+ */
+#include "text_reader.h"
+#include "message.h"
+#include "message_arena.h"
+#include <dpcommon/base64.h>
+#include <dpcommon/common.h>
+#include <dpcommon/conversions.h>
+#include <dpcommon/input.h>
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <parson.h>
+#include <stdarg.h>
+
+#define READ_CHUNK_SIZE 65536
+
+
+// Keys and values are stored as offsets into the buffer, since it may move
+// around when it gets reallocated while a message is being read. They're
+// NUL-terminated in place, so no copying is needed to get at them.
+typedef struct DP_TextReaderField {
+    size_t key;
+    size_t value;
+    size_t length;
+} DP_TextReaderField;
+
+typedef struct DP_TextReaderTuple {
+    int first_token;
+    int token_count;
+} DP_TextReaderTuple;
+
+struct DP_TextReader {
+    DP_Input *input;
+    JSON_Value *header;
+    DP_MessageArena *arena;
+    bool eof;
+    bool failed;
+    long line_number;
+    long message_line_number;
+    struct {
+        char *data;
+        size_t capacity;
+        size_t fill;
+        size_t pos;
+    } buffer;
+    size_t name;
+    struct {
+        DP_TextReaderField *data;
+        int capacity;
+        int count;
+    } fields;
+    struct {
+        DP_TextReaderTuple *data;
+        int capacity;
+        int count;
+    } tuples;
+    struct {
+        size_t *data;
+        int capacity;
+        int count;
+    } tokens;
+    struct {
+        char *data;
+        size_t capacity;
+    } scratch;
+    struct {
+        unsigned char *data;
+        size_t capacity;
+    } decoded;
+    struct {
+        int *data;
+        int capacity;
+    } list;
+};
+
+
+static size_t find_char(const char *data, size_t pos, size_t end, char c)
+{
+    while (pos < end && data[pos] != c) {
+        ++pos;
+    }
+    return pos;
+}
+
+static bool fill_buffer(DP_TextReader *reader)
+{
+    if (reader->eof) {
+        return false;
+    }
+
+    size_t fill = reader->buffer.fill;
+    size_t capacity = reader->buffer.capacity;
+    if (capacity - fill < READ_CHUNK_SIZE) {
+        size_t new_capacity = DP_max_size(capacity * 2, fill + READ_CHUNK_SIZE);
+        reader->buffer.data = DP_realloc(reader->buffer.data, new_capacity);
+        reader->buffer.capacity = new_capacity;
+    }
+
+    bool error;
+    size_t read = DP_input_read(reader->input, reader->buffer.data + fill,
+                                reader->buffer.capacity - fill, &error);
+    if (error) {
+        reader->eof = true;
+        return false;
+    }
+    else if (read == 0) {
+        reader->eof = true;
+        return false;
+    }
+    else {
+        reader->buffer.fill = fill + read;
+        return true;
+    }
+}
+
+// Drops everything before the current read position, so that the next
+// message starts at the beginning of the buffer. This keeps the buffer from
+// growing beyond the size of the largest message plus one read chunk.
+static void shift_buffer(DP_TextReader *reader)
+{
+    size_t pos = reader->buffer.pos;
+    if (pos != 0) {
+        size_t remaining = reader->buffer.fill - pos;
+        memmove(reader->buffer.data, reader->buffer.data + pos, remaining);
+        reader->buffer.fill = remaining;
+        reader->buffer.pos = 0;
+    }
+}
+
+// Finds the next line in the buffer, reading more input as necessary. The
+// line is NUL-terminated in place, a trailing carriage return is dropped.
+static bool next_line(DP_TextReader *reader, size_t *out_start,
+                      size_t *out_end)
+{
+    size_t start = reader->buffer.pos;
+    size_t search = start;
+    while (true) {
+        char *data = reader->buffer.data;
+        size_t fill = reader->buffer.fill;
+        size_t newline = find_char(data, search, fill, '\n');
+        if (newline < fill) {
+            size_t end = newline;
+            reader->buffer.pos = end + 1;
+            if (end > start && data[end - 1] == '\r') {
+                --end;
+            }
+            data[end] = '\0';
+            ++reader->line_number;
+            *out_start = start;
+            *out_end = end;
+            return true;
+        }
+
+        search = fill;
+        if (!fill_buffer(reader)) {
+            if (start < reader->buffer.fill) {
+                // Last line without a trailing newline, make room for the
+                // terminator and pretend there was one.
+                if (reader->buffer.fill == reader->buffer.capacity) {
+                    reader->buffer.capacity += 1;
+                    reader->buffer.data = DP_realloc(reader->buffer.data,
+                                                     reader->buffer.capacity);
+                }
+                reader->buffer.data[reader->buffer.fill++] = '\n';
+            }
+            else {
+                return false;
+            }
+        }
+    }
+}
+
+static size_t skip_space(const char *data, size_t pos, size_t end)
+{
+    while (pos < end && isspace((unsigned char)data[pos])) {
+        ++pos;
+    }
+    return pos;
+}
+
+static bool is_blank(const char *data, size_t start, size_t end)
+{
+    return skip_space(data, start, end) == end;
+}
+
+
+static JSON_Value *parse_header_value(const char *value)
+{
+    if (strcmp(value, "null") == 0) {
+        return json_value_init_null();
+    }
+    else if (strcmp(value, "true") == 0) {
+        return json_value_init_boolean(1);
+    }
+    else if (strcmp(value, "false") == 0) {
+        return json_value_init_boolean(0);
+    }
+    else {
+        char *end;
+        errno = 0;
+        double number = strtod(value, &end);
+        if (*value != '\0' && *end == '\0' && errno == 0) {
+            return json_value_init_number(number);
+        }
+        else {
+            return json_value_init_string(value);
+        }
+    }
+}
+
+static bool read_header_line(DP_TextReader *reader, JSON_Object *header,
+                             size_t start, size_t end)
+{
+    char *data = reader->buffer.data;
+    size_t equals = find_char(data, start, end, '=');
+    if (equals == end) {
+        DP_error_set("Line %ld: header field without '='", reader->line_number);
+        return false;
+    }
+
+    data[equals] = '\0';
+    const char *key = data + start + 1;
+    JSON_Value *value = parse_header_value(data + equals + 1);
+    if (json_object_set_value(header, key, value) != JSONSuccess) {
+        json_value_free(value);
+        DP_error_set("Line %ld: can't set header field '%s'",
+                     reader->line_number, key);
+        return false;
+    }
+    return true;
+}
+
+// The header consists of lines of the form "!key=value", terminated by a
+// blank line. Since everything in a header is a string in text form, values
+// that look like numbers, booleans or null are turned into those types.
+static bool read_header(DP_TextReader *reader)
+{
+    JSON_Object *header = json_value_get_object(reader->header);
+    while (true) {
+        size_t pos = reader->buffer.pos;
+        size_t start, end;
+        if (!next_line(reader, &start, &end)) {
+            return true;
+        }
+
+        char *data = reader->buffer.data;
+        if (data[start] == '!') {
+            if (!read_header_line(reader, header, start, end)) {
+                return false;
+            }
+        }
+        else if (is_blank(data, start, end)) {
+            return true;
+        }
+        else {
+            // No blank line after the header, so this is already a message.
+            reader->buffer.pos = pos;
+            --reader->line_number;
+            data[end] = '\n';
+            return true;
+        }
+    }
+}
+
+
+DP_TextReader *DP_text_reader_new(DP_Input *input)
+{
+    DP_ASSERT(input);
+    DP_TextReader *reader = DP_malloc(sizeof(*reader));
+    *reader = (DP_TextReader){
+        .input = input,
+        .header = json_value_init_object(),
+    };
+    if (read_header(reader)) {
+        return reader;
+    }
+    else {
+        DP_text_reader_free(reader);
+        return NULL;
+    }
+}
+
+void DP_text_reader_free(DP_TextReader *reader)
+{
+    if (reader) {
+        DP_free(reader->list.data);
+        DP_free(reader->decoded.data);
+        DP_free(reader->scratch.data);
+        DP_free(reader->tokens.data);
+        DP_free(reader->tuples.data);
+        DP_free(reader->fields.data);
+        DP_free(reader->buffer.data);
+        json_value_free(reader->header);
+        DP_input_free(reader->input);
+        DP_free(reader);
+    }
+}
+
+
+JSON_Object *DP_text_reader_header(DP_TextReader *reader)
+{
+    DP_ASSERT(reader);
+    return json_value_get_object(reader->header);
+}
+
+
+bool DP_text_reader_has_next(DP_TextReader *reader)
+{
+    DP_ASSERT(reader);
+    while (true) {
+        char *data = reader->buffer.data;
+        size_t pos = reader->buffer.pos;
+        size_t fill = reader->buffer.fill;
+        while (pos < fill && isspace((unsigned char)data[pos])) {
+            if (data[pos] == '\n') {
+                ++reader->line_number;
+            }
+            ++pos;
+        }
+        reader->buffer.pos = pos;
+
+        if (pos < fill) {
+            return true;
+        }
+        else {
+            shift_buffer(reader);
+            if (!fill_buffer(reader)) {
+                return false;
+            }
+        }
+    }
+}
+
+
+static void push_field(DP_TextReader *reader, size_t key, size_t value,
+                       size_t length)
+{
+    int count = reader->fields.count;
+    if (count == reader->fields.capacity) {
+        int capacity = DP_max_int(16, count * 2);
+        reader->fields.data =
+            DP_realloc(reader->fields.data,
+                       sizeof(*reader->fields.data) * DP_int_to_size(capacity));
+        reader->fields.capacity = capacity;
+    }
+    reader->fields.data[count] = (DP_TextReaderField){key, value, length};
+    reader->fields.count = count + 1;
+}
+
+static void push_token(DP_TextReader *reader, size_t offset)
+{
+    int count = reader->tokens.count;
+    if (count == reader->tokens.capacity) {
+        int capacity = DP_max_int(64, count * 2);
+        reader->tokens.data =
+            DP_realloc(reader->tokens.data,
+                       sizeof(*reader->tokens.data) * DP_int_to_size(capacity));
+        reader->tokens.capacity = capacity;
+    }
+    reader->tokens.data[count] = offset;
+    reader->tokens.count = count + 1;
+}
+
+static void push_tuple(DP_TextReader *reader, int first_token, int token_count)
+{
+    int count = reader->tuples.count;
+    if (count == reader->tuples.capacity) {
+        int capacity = DP_max_int(32, count * 2);
+        reader->tuples.data =
+            DP_realloc(reader->tuples.data,
+                       sizeof(*reader->tuples.data) * DP_int_to_size(capacity));
+        reader->tuples.capacity = capacity;
+    }
+    reader->tuples.data[count] = (DP_TextReaderTuple){first_token, token_count};
+    reader->tuples.count = count + 1;
+}
+
+// Splits the given range on whitespace, NUL-terminating each word in place.
+// Returns the offset of the next word, or end if there's none left.
+static size_t next_word(char *data, size_t pos, size_t end, size_t *out_start,
+                        size_t *out_end)
+{
+    pos = skip_space(data, pos, end);
+    *out_start = pos;
+    while (pos < end && !isspace((unsigned char)data[pos])) {
+        ++pos;
+    }
+    *out_end = pos;
+    if (pos < end) {
+        data[pos++] = '\0';
+    }
+    return pos;
+}
+
+static bool parse_argument(DP_TextReader *reader, size_t start, size_t end)
+{
+    char *data = reader->buffer.data;
+    size_t equals = find_char(data, start, end, '=');
+    if (equals == end || equals == start) {
+        DP_error_set("Line %ld: invalid argument '%s'", reader->line_number,
+                     data + start);
+        return false;
+    }
+    data[equals] = '\0';
+    push_field(reader, start, equals + 1, end - equals - 1);
+    return true;
+}
+
+// Parses "<context id> <name> key=value... [{]". Returns true and sets
+// out_block if the line opens a block.
+static bool parse_message_line(DP_TextReader *reader, size_t start, size_t end,
+                               unsigned int *out_context_id, bool *out_block)
+{
+    char *data = reader->buffer.data;
+    size_t word, word_end;
+    size_t pos = next_word(data, start, end, &word, &word_end);
+
+    char *context_end;
+    errno = 0;
+    unsigned long context_id = strtoul(data + word, &context_end, 10);
+    if (word == end || *context_end != '\0' || errno != 0
+        || context_id > UINT8_MAX || data[word] == '-') {
+        DP_error_set("Line %ld: invalid context id '%s'", reader->line_number,
+                     data + word);
+        return false;
+    }
+    *out_context_id = DP_ulong_to_uint(context_id);
+
+    pos = next_word(data, pos, end, &word, &word_end);
+    if (word == end) {
+        DP_error_set("Line %ld: missing message name", reader->line_number);
+        return false;
+    }
+    reader->name = word;
+
+    *out_block = false;
+    while (true) {
+        pos = next_word(data, pos, end, &word, &word_end);
+        if (word == end) {
+            return true;
+        }
+        else if (*out_block) {
+            DP_error_set("Line %ld: garbage after '{'", reader->line_number);
+            return false;
+        }
+        else if (strcmp(data + word, "{") == 0) {
+            *out_block = true;
+        }
+        else if (!parse_argument(reader, word, word_end)) {
+            return false;
+        }
+    }
+}
+
+static void parse_tuple_line(DP_TextReader *reader, size_t start, size_t end)
+{
+    char *data = reader->buffer.data;
+    int first_token = reader->tokens.count;
+    size_t pos = start;
+    while (true) {
+        size_t word, word_end;
+        pos = next_word(data, pos, end, &word, &word_end);
+        if (word == end) {
+            break;
+        }
+        push_token(reader, word);
+    }
+    push_tuple(reader, first_token, reader->tokens.count - first_token);
+}
+
+// Lines inside of a block are either multiline arguments of the form
+// "key=value" or tuples of whitespace-separated values, as used by dabs.
+static bool parse_block(DP_TextReader *reader)
+{
+    while (true) {
+        size_t start, end;
+        if (!next_line(reader, &start, &end)) {
+            DP_error_set("Line %ld: unterminated block", reader->line_number);
+            return false;
+        }
+
+        char *data = reader->buffer.data;
+        start = skip_space(data, start, end);
+        if (start == end) {
+            continue;
+        }
+        else if (data[start] == '}' && is_blank(data, start + 1, end)) {
+            return true;
+        }
+
+        size_t key_end = start;
+        while (key_end < end && data[key_end] != '='
+               && !isspace((unsigned char)data[key_end])) {
+            ++key_end;
+        }
+
+        if (key_end < end && key_end != start && data[key_end] == '=') {
+            data[key_end] = '\0';
+            push_field(reader, start, key_end + 1, end - key_end - 1);
+        }
+        else {
+            parse_tuple_line(reader, start, end);
+        }
+    }
+}
+
+static bool read_message(DP_TextReader *reader, unsigned int *out_context_id)
+{
+    shift_buffer(reader);
+    reader->failed = false;
+    reader->fields.count = 0;
+    reader->tuples.count = 0;
+    reader->tokens.count = 0;
+    reader->message_line_number = reader->line_number + 1;
+
+    size_t start, end;
+    if (!next_line(reader, &start, &end)) {
+        DP_error_set("Unexpected end of input");
+        return false;
+    }
+
+    bool block;
+    return parse_message_line(reader, start, end, out_context_id, &block)
+        && (!block || parse_block(reader));
+}
+
+DP_Message *DP_text_reader_read_next(DP_TextReader *reader)
+{
+    DP_ASSERT(reader);
+    if (!DP_text_reader_has_next(reader)) {
+        return NULL;
+    }
+
+    unsigned int context_id;
+    if (!read_message(reader, &context_id)) {
+        return NULL;
+    }
+
+    const char *name = reader->buffer.data + reader->name;
+    DP_MessageArena *prev_arena = DP_message_arena_bind(reader->arena);
+    DP_Message *msg = DP_message_parse(name, context_id, reader);
+    DP_message_arena_bind(prev_arena);
+    if (reader->failed) {
+        if (msg) {
+            DP_message_decref(msg);
+        }
+        return NULL;
+    }
+    else {
+        return msg;
+    }
+}
+
+void DP_text_reader_arena_set(DP_TextReader *reader, DP_MessageArena *arena)
+{
+    DP_ASSERT(reader);
+    reader->arena = arena;
+}
+
+
+void DP_text_reader_fail(DP_TextReader *reader, const char *fmt, ...)
+{
+    DP_ASSERT(reader);
+    DP_ASSERT(fmt);
+    va_list ap;
+    va_start(ap, fmt);
+    char *message = DP_vformat(fmt, ap);
+    va_end(ap);
+    DP_error_set("Line %ld: %s: %s", reader->message_line_number,
+                 reader->buffer.data + reader->name, message);
+    DP_free(message);
+    reader->failed = true;
+}
+
+
+static int search_field(DP_TextReader *reader, const char *key, int from)
+{
+    const char *data = reader->buffer.data;
+    int count = reader->fields.count;
+    for (int i = from; i < count; ++i) {
+        if (strcmp(data + reader->fields.data[i].key, key) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static const char *get_value(DP_TextReader *reader, const char *key)
+{
+    int i = search_field(reader, key, 0);
+    return i == -1 ? NULL : reader->buffer.data + reader->fields.data[i].value;
+}
+
+static char *reserve_scratch(DP_TextReader *reader, size_t size)
+{
+    if (reader->scratch.capacity < size) {
+        reader->scratch.data = DP_realloc(reader->scratch.data, size);
+        reader->scratch.capacity = size;
+    }
+    return reader->scratch.data;
+}
+
+// Multiline arguments are split across several fields with the same key.
+// This concatenates them, with the given separator between each of them.
+static const char *join_values(DP_TextReader *reader, const char *key,
+                               const char *separator, size_t *out_length)
+{
+    const char *data = reader->buffer.data;
+    int first_index = search_field(reader, key, 0);
+    if (first_index == -1) {
+        *out_length = 0;
+        return NULL;
+    }
+
+    if (search_field(reader, key, first_index + 1) == -1) {
+        DP_TextReaderField *first = &reader->fields.data[first_index];
+        *out_length = first->length;
+        return data + first->value;
+    }
+
+    size_t separator_length = strlen(separator);
+    size_t total = 0;
+    int count = reader->fields.count;
+    for (int i = first_index; i < count; ++i) {
+        DP_TextReaderField *field = &reader->fields.data[i];
+        if (strcmp(data + field->key, key) == 0) {
+            total += field->length + separator_length;
+        }
+    }
+
+    char *scratch = reserve_scratch(reader, total + 1);
+    size_t length = 0;
+    for (int i = first_index; i < count; ++i) {
+        DP_TextReaderField *field = &reader->fields.data[i];
+        if (strcmp(data + field->key, key) == 0) {
+            if (length != 0) {
+                memcpy(scratch + length, separator, separator_length);
+                length += separator_length;
+            }
+            memcpy(scratch + length, data + field->value, field->length);
+            length += field->length;
+        }
+    }
+
+    scratch[length] = '\0';
+    *out_length = length;
+    return scratch;
+}
+
+
+const char *DP_text_reader_message_name(DP_TextReader *reader)
+{
+    DP_ASSERT(reader);
+    return reader->buffer.data + reader->name;
+}
+
+bool DP_text_reader_has(DP_TextReader *reader, const char *key)
+{
+    DP_ASSERT(reader);
+    DP_ASSERT(key);
+    return search_field(reader, key, 0) != -1;
+}
+
+static bool parse_long(const char *value, long *out_value)
+{
+    const char *digits = value[0] == '-' ? value + 1 : value;
+    int base = digits[0] == '0' && (digits[1] == 'x' || digits[1] == 'X') ? 16
+                                                                          : 10;
+    char *end;
+    errno = 0;
+    long result = strtol(value, &end, base);
+    if (*value != '\0' && *end == '\0' && errno == 0) {
+        *out_value = result;
+        return true;
+    }
+    else {
+        return false;
+    }
+}
+
+static int check_int(DP_TextReader *reader, const char *what, const char *value,
+                     long number, int min, int max)
+{
+    if (number < min || number > max) {
+        DP_text_reader_fail(reader, "%s '%s' out of bounds [%d, %d]", what,
+                            value, min, max);
+        return min;
+    }
+    return DP_long_to_int(number);
+}
+
+int DP_text_reader_get_int(DP_TextReader *reader, const char *key, int min,
+                           int max)
+{
+    DP_ASSERT(reader);
+    DP_ASSERT(key);
+    DP_ASSERT(min <= max);
+    const char *value = get_value(reader, key);
+    if (!value) {
+        return min > 0 ? min : max < 0 ? max : 0;
+    }
+
+    long number;
+    if (parse_long(value, &number)) {
+        return check_int(reader, key, value, number, min, max);
+    }
+    else {
+        DP_text_reader_fail(reader, "invalid integer %s=%s", key, value);
+        return min;
+    }
+}
+
+unsigned int DP_text_reader_get_uint(DP_TextReader *reader, const char *key,
+                                     unsigned int max)
+{
+    DP_ASSERT(reader);
+    DP_ASSERT(key);
+    const char *value = get_value(reader, key);
+    if (!value) {
+        return 0;
+    }
+
+    char *end;
+    errno = 0;
+    unsigned long number = strtoul(value, &end, 10);
+    if (*value == '\0' || *value == '-' || *end != '\0' || errno != 0) {
+        DP_text_reader_fail(reader, "invalid unsigned integer %s=%s", key,
+                            value);
+        return 0;
+    }
+    else if (number > max) {
+        DP_text_reader_fail(reader, "%s '%s' out of bounds [0, %u]", key, value,
+                            max);
+        return 0;
+    }
+    else {
+        return DP_ulong_to_uint(number);
+    }
+}
+
+static bool parse_double(const char *value, double *out_value)
+{
+    char *end;
+    errno = 0;
+    double result = strtod(value, &end);
+    if (*value != '\0' && *end == '\0' && errno == 0 && isfinite(result)) {
+        *out_value = result;
+        return true;
+    }
+    else {
+        return false;
+    }
+}
+
+uint8_t DP_text_reader_get_decimal(DP_TextReader *reader, const char *key)
+{
+    DP_ASSERT(reader);
+    DP_ASSERT(key);
+    const char *value = get_value(reader, key);
+    if (!value) {
+        return 0;
+    }
+
+    double number;
+    if (parse_double(value, &number) && number >= 0.0 && number <= 100.0) {
+        return DP_double_to_uint8(round(number / 100.0 * 255.0));
+    }
+    else {
+        DP_text_reader_fail(reader, "invalid decimal %s=%s", key, value);
+        return 0;
+    }
+}
+
+// Subpixel values are written as the value divided by 4 with one decimal
+// place. That's still precise enough to get back the original integer.
+static int parse_subpixel(DP_TextReader *reader, const char *what,
+                          const char *value, int min, int max)
+{
+    double number;
+    if (parse_double(value, &number)) {
+        double subpixel = round(number * 4.0);
+        if (subpixel >= min && subpixel <= max) {
+            return DP_double_to_int(subpixel);
+        }
+    }
+    DP_text_reader_fail(reader, "invalid subpixel %s '%s'", what, value);
+    return min;
+}
+
+int DP_text_reader_get_subpixel(DP_TextReader *reader, const char *key,
+                                int min, int max)
+{
+    DP_ASSERT(reader);
+    DP_ASSERT(key);
+    const char *value = get_value(reader, key);
+    return value ? parse_subpixel(reader, key, value, min, max) : 0;
+}
+
+bool DP_text_reader_get_bool(DP_TextReader *reader, const char *key)
+{
+    DP_ASSERT(reader);
+    DP_ASSERT(key);
+    const char *value = get_value(reader, key);
+    if (!value || strcmp(value, "false") == 0 || strcmp(value, "0") == 0) {
+        return false;
+    }
+    else if (strcmp(value, "true") == 0 || strcmp(value, "1") == 0) {
+        return true;
+    }
+    else {
+        DP_text_reader_fail(reader, "invalid boolean %s=%s", key, value);
+        return false;
+    }
+}
+
+uint32_t DP_text_reader_get_argb_color(DP_TextReader *reader, const char *key)
+{
+    DP_ASSERT(reader);
+    DP_ASSERT(key);
+    const char *value = get_value(reader, key);
+    if (!value) {
+        return 0;
+    }
+
+    size_t length = strlen(value);
+    if (value[0] == '#' && (length == 7 || length == 9)) {
+        char *end;
+        errno = 0;
+        unsigned long color = strtoul(value + 1, &end, 16);
+        if (*end == '\0' && errno == 0 && isxdigit((unsigned char)value[1])) {
+            return length == 7 ? DP_ulong_to_uint32(color) | 0xff000000u
+                               : DP_ulong_to_uint32(color);
+        }
+    }
+
+    DP_text_reader_fail(reader, "invalid color %s=%s", key, value);
+    return 0;
+}
+
+const char *DP_text_reader_get_string(DP_TextReader *reader, const char *key,
+                                      size_t *out_length)
+{
+    DP_ASSERT(reader);
+    DP_ASSERT(key);
+    size_t length;
+    const char *value = join_values(reader, key, "\n", &length);
+    if (out_length) {
+        *out_length = length;
+    }
+    return value ? value : "";
+}
+
+const unsigned char *DP_text_reader_get_base64(DP_TextReader *reader,
+                                               const char *key,
+                                               size_t *out_size)
+{
+    DP_ASSERT(reader);
+    DP_ASSERT(key);
+    DP_ASSERT(out_size);
+    size_t length;
+    const char *value = join_values(reader, key, "", &length);
+
+    size_t size = value ? DP_base64_decode_length(value, length) : 0;
+    if (reader->decoded.capacity < size || !reader->decoded.data) {
+        size_t capacity = DP_max_size(size, 64);
+        reader->decoded.data = DP_realloc(reader->decoded.data, capacity);
+        reader->decoded.capacity = capacity;
+    }
+
+    if (size != 0
+        && !DP_base64_decode(value, length, reader->decoded.data, size)) {
+        DP_text_reader_fail(reader, "invalid base64 in %s: %s", key,
+                            DP_error());
+        *out_size = 0;
+    }
+    else {
+        *out_size = size;
+    }
+    return reader->decoded.data;
+}
+
+static unsigned int find_flag(const char *flag, size_t length, va_list ap)
+{
+    const char *name;
+    while ((name = va_arg(ap, const char *))) {
+        unsigned int mask = va_arg(ap, unsigned int);
+        if (strlen(name) == length && memcmp(name, flag, length) == 0) {
+            return mask;
+        }
+    }
+    return 0;
+}
+
+unsigned int DP_text_reader_get_flags(DP_TextReader *reader, const char *key,
+                                      ...)
+{
+    DP_ASSERT(reader);
+    DP_ASSERT(key);
+    const char *value = get_value(reader, key);
+    if (!value) {
+        return 0;
+    }
+
+    unsigned int flags = 0;
+    size_t value_length = strlen(value);
+    size_t start = 0;
+    while (start < value_length) {
+        size_t end = find_char(value, start, value_length, ',');
+        size_t length = end - start;
+
+        va_list ap;
+        va_start(ap, key);
+        unsigned int mask = find_flag(value + start, length, ap);
+        va_end(ap);
+
+        if (mask == 0) {
+            DP_text_reader_fail(reader, "unknown flag '%.*s' in %s",
+                                DP_size_to_int(length), value + start, key);
+            return 0;
+        }
+
+        flags |= mask;
+        start = end + 1;
+    }
+    return flags;
+}
+
+const int *DP_text_reader_get_list(DP_TextReader *reader, const char *key,
+                                   int min, int max, int *out_count)
+{
+    DP_ASSERT(reader);
+    DP_ASSERT(key);
+    DP_ASSERT(out_count);
+    const char *value = get_value(reader, key);
+    if (!value || *value == '\0') {
+        *out_count = 0;
+        return reader->list.data;
+    }
+
+    size_t length = strlen(value);
+    char *copy = reserve_scratch(reader, length + 1);
+    memcpy(copy, value, length + 1);
+
+    int count = 0;
+    char *element = copy;
+    while (element) {
+        char *comma = strchr(element, ',');
+        if (comma) {
+            *comma = '\0';
+        }
+
+        long number;
+        if (!parse_long(element, &number)) {
+            DP_text_reader_fail(reader, "invalid list element '%s' in %s",
+                                element, key);
+            *out_count = 0;
+            return reader->list.data;
+        }
+
+        if (count == reader->list.capacity) {
+            int capacity = DP_max_int(16, count * 2);
+            reader->list.data =
+                DP_realloc(reader->list.data, sizeof(*reader->list.data)
+                                                  * DP_int_to_size(capacity));
+            reader->list.capacity = capacity;
+        }
+        reader->list.data[count++] =
+            check_int(reader, key, element, number, min, max);
+
+        element = comma ? comma + 1 : NULL;
+    }
+
+    *out_count = count;
+    return reader->list.data;
+}
+
+int DP_text_reader_get_tuple_count(DP_TextReader *reader)
+{
+    DP_ASSERT(reader);
+    return reader->tuples.count;
+}
+
+static const char *get_tuple_token(DP_TextReader *reader, int index, int field)
+{
+    DP_ASSERT(index >= 0);
+    DP_ASSERT(index < reader->tuples.count);
+    DP_TextReaderTuple *tuple = &reader->tuples.data[index];
+    if (field < tuple->token_count) {
+        size_t offset = reader->tokens.data[tuple->first_token + field];
+        return reader->buffer.data + offset;
+    }
+    else {
+        DP_text_reader_fail(reader, "missing field %d in block line %d", field,
+                            index);
+        return NULL;
+    }
+}
+
+int DP_text_reader_get_tuple_int(DP_TextReader *reader, int index, int field,
+                                 int min, int max)
+{
+    DP_ASSERT(reader);
+    const char *value = get_tuple_token(reader, index, field);
+    if (!value) {
+        return min;
+    }
+
+    long number;
+    if (parse_long(value, &number)) {
+        return check_int(reader, "block value", value, number, min, max);
+    }
+    else {
+        DP_text_reader_fail(reader, "invalid integer '%s' in block", value);
+        return min;
+    }
+}
+
+int DP_text_reader_get_tuple_subpixel(DP_TextReader *reader, int index,
+                                      int field, int min, int max)
+{
+    DP_ASSERT(reader);
+    const char *value = get_tuple_token(reader, index, field);
+    return value ? parse_subpixel(reader, "block value", value, min, max) : min;
+}
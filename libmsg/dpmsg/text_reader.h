@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2022 askmeaboutloom
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * --------------------------------------------------------------------
+ *
+ * This code is based on Drawpile, using it under the GNU General Public
+ * License, version 3. See 3rdparty/licenses/drawpile/COPYING for details.
+ */
+#ifndef DPMSG_TEXT_READER_H
+#define DPMSG_TEXT_READER_H
+#include <dpcommon/common.h>
+#include <parson.h>
+
+typedef struct DP_Input DP_Input;
+typedef struct DP_Message DP_Message;
+typedef struct DP_MessageArena DP_MessageArena;
+
+
+typedef struct DP_TextReader DP_TextReader;
+
+DP_TextReader *DP_text_reader_new(DP_Input *input);
+
+void DP_text_reader_free(DP_TextReader *reader);
+
+
+JSON_Object *DP_text_reader_header(DP_TextReader *reader);
+
+bool DP_text_reader_has_next(DP_TextReader *reader);
+
+DP_Message *DP_text_reader_read_next(DP_TextReader *reader);
+
+// Allocate messages read from here in the given arena, NULL to stop doing so.
+// The arena is not owned by the reader and must outlive its use in it.
+void DP_text_reader_arena_set(DP_TextReader *reader, DP_MessageArena *arena);
+
+
+// The following functions are for the message types to pull their fields out
+// of the message currently being parsed. Missing fields result in a zero
+// value, since the text writer omits many fields when they're zero. Malformed
+// or out-of-range values flag the message as invalid and set an error.
+
+const char *DP_text_reader_message_name(DP_TextReader *reader);
+
+bool DP_text_reader_has(DP_TextReader *reader, const char *key);
+
+int DP_text_reader_get_int(DP_TextReader *reader, const char *key, int min,
+                           int max);
+
+unsigned int DP_text_reader_get_uint(DP_TextReader *reader, const char *key,
+                                     unsigned int max);
+
+uint8_t DP_text_reader_get_decimal(DP_TextReader *reader, const char *key);
+
+int DP_text_reader_get_subpixel(DP_TextReader *reader, const char *key,
+                                int min, int max);
+
+bool DP_text_reader_get_bool(DP_TextReader *reader, const char *key);
+
+uint32_t DP_text_reader_get_argb_color(DP_TextReader *reader, const char *key);
+
+const char *DP_text_reader_get_string(DP_TextReader *reader, const char *key,
+                                      size_t *out_length);
+
+const unsigned char *DP_text_reader_get_base64(DP_TextReader *reader,
+                                               const char *key,
+                                               size_t *out_size);
+
+unsigned int DP_text_reader_get_flags(DP_TextReader *reader, const char *key,
+                                      ...);
+
+const int *DP_text_reader_get_list(DP_TextReader *reader, const char *key,
+                                   int min, int max, int *out_count);
+
+int DP_text_reader_get_tuple_count(DP_TextReader *reader);
+
+int DP_text_reader_get_tuple_int(DP_TextReader *reader, int index, int field,
+                                 int min, int max);
+
+int DP_text_reader_get_tuple_subpixel(DP_TextReader *reader, int index,
+                                      int field, int min, int max);
+
+void DP_text_reader_fail(DP_TextReader *reader, const char *fmt, ...)
+    DP_FORMAT(2, 3);
+
+
+#endif
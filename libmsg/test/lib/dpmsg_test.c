@@ -24,6 +24,9 @@
 #include "dpcommon_test.h"
 #include "dpmsg/binary_writer.h"
 #include "dpmsg/message.h"
+#include "dpmsg/message_arena.h"
+#include "dpmsg/parallel_text_writer.h"
+#include "dpmsg/text_reader.h"
 #include "dpmsg/text_writer.h"
 #include <dpmsg/binary_reader.h>
 
@@ -60,6 +63,16 @@ void push_message(void **state, DP_Message *value)
     destructor_push(state, value, destroy_message);
 }
 
+static void destroy_message_arena(void *value)
+{
+    DP_message_arena_free(value);
+}
+
+void push_message_arena(void **state, DP_MessageArena *value)
+{
+    destructor_push(state, value, destroy_message_arena);
+}
+
 static void destroy_text_writer(void *value)
 {
     DP_text_writer_free(value);
@@ -70,3 +83,26 @@ void push_text_writer(void **state, DP_TextWriter *value, DP_Output *output)
     destructor_remove(state, output);
     destructor_push(state, value, destroy_text_writer);
 }
+
+static void destroy_text_reader(void *value)
+{
+    DP_text_reader_free(value);
+}
+
+void push_text_reader(void **state, DP_TextReader *value, DP_Input *input)
+{
+    destructor_remove(state, input);
+    destructor_push(state, value, destroy_text_reader);
+}
+
+static void destroy_parallel_text_writer(void *value)
+{
+    DP_parallel_text_writer_free(value);
+}
+
+void push_parallel_text_writer(void **state, DP_ParallelTextWriter *value,
+                               DP_Output *output)
+{
+    destructor_remove(state, output);
+    destructor_push(state, value, destroy_parallel_text_writer);
+}
@@ -26,6 +26,9 @@
 typedef struct DP_BinaryReader DP_BinaryReader;
 typedef struct DP_BinaryWriter DP_BinaryWriter;
 typedef struct DP_Message DP_Message;
+typedef struct DP_MessageArena DP_MessageArena;
+typedef struct DP_ParallelTextWriter DP_ParallelTextWriter;
+typedef struct DP_TextReader DP_TextReader;
 typedef struct DP_TextWriter DP_TextWriter;
 
 
@@ -36,7 +39,14 @@ void push_binary_writer(void **state, DP_BinaryWriter *value,
 
 void push_message(void **state, DP_Message *value);
 
+void push_message_arena(void **state, DP_MessageArena *value);
+
 void push_text_writer(void **state, DP_TextWriter *value, DP_Output *output);
 
+void push_text_reader(void **state, DP_TextReader *value, DP_Input *input);
+
+void push_parallel_text_writer(void **state, DP_ParallelTextWriter *value,
+                               DP_Output *output);
+
 
 #endif
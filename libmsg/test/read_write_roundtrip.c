@@ -26,6 +26,8 @@
 #include <dpmsg/binary_reader.h>
 #include <dpmsg/binary_writer.h>
 #include <dpmsg/message.h>
+#include <dpmsg/parallel_text_writer.h>
+#include <dpmsg/text_reader.h>
 #include <dpmsg/text_writer.h>
 #include <dpmsg_test.h>
 #include <parson.h>
@@ -35,6 +37,7 @@ typedef struct TestPaths {
     const char *in_path;
     const char *out_path;
     const char *expected_path;
+    int threads;
 } TestPaths;
 
 
@@ -118,6 +121,94 @@ static void test_binary_to_text(void **state)
 }
 
 
+static void test_binary_to_text_parallel(void **state)
+{
+    TestPaths *paths = initial_state(state);
+
+    DP_Input *input = DP_file_input_new_from_path(paths->in_path);
+    assert_non_null(input);
+    push_input(state, input);
+
+    DP_BinaryReader *reader = DP_binary_reader_new(input);
+    assert_non_null(reader);
+    push_binary_reader(state, reader, input);
+
+    DP_Output *output = DP_file_output_new_from_path(paths->out_path);
+    assert_non_null(output);
+    push_output(state, output);
+
+    DP_ParallelTextWriter *writer =
+        DP_parallel_text_writer_new(output, paths->threads);
+    assert_non_null(writer);
+    push_parallel_text_writer(state, writer, output);
+
+    JSON_Object *header = DP_binary_reader_header(reader);
+    assert_non_null(header);
+
+    assert_true(DP_parallel_text_writer_write_header(writer, header));
+
+    unsigned int error_count = DP_error_count();
+    while (DP_binary_reader_has_next(reader)) {
+        DP_Message *message = DP_binary_reader_read_next(reader);
+        assert_non_null(message);
+        push_message(state, message);
+        assert_true(DP_parallel_text_writer_write_message(writer, message));
+        destructor_run(state, message);
+    }
+
+    assert_true(DP_parallel_text_writer_finish(writer));
+    destructor_run(state, writer);
+    assert_null(DP_error_since(error_count));
+    assert_files_equal(paths->out_path, paths->expected_path);
+}
+
+
+static void test_text_to_binary(void **state)
+{
+    TestPaths *paths = initial_state(state);
+
+    DP_Input *input = DP_file_input_new_from_path(paths->in_path);
+    assert_non_null(input);
+    push_input(state, input);
+
+    DP_TextReader *reader = DP_text_reader_new(input);
+    assert_non_null(reader);
+    push_text_reader(state, reader, input);
+
+    DP_Output *output = DP_file_output_new_from_path(paths->out_path);
+    assert_non_null(output);
+    push_output(state, output);
+
+    DP_BinaryWriter *writer = DP_binary_writer_new(output);
+    assert_non_null(writer);
+    push_binary_writer(state, writer, output);
+
+    JSON_Object *header = DP_text_reader_header(reader);
+    assert_non_null(header);
+
+    assert_true(DP_binary_writer_write_header(writer, header));
+
+    unsigned int error_count = DP_error_count();
+    while (DP_text_reader_has_next(reader)) {
+        DP_Message *message = DP_text_reader_read_next(reader);
+        assert_non_null(message);
+        push_message(state, message);
+        assert_true(DP_binary_writer_write_message(writer, message));
+        destructor_run(state, message);
+    }
+
+    destructor_run(state, writer);
+    assert_null(DP_error_since(error_count));
+    assert_files_equal(paths->out_path, paths->expected_path);
+}
+
+
+static bool has_extension(const char *path, const char *extension)
+{
+    return strcmp(path + strlen(path) - strlen(extension), extension) == 0;
+}
+
+
 int main(void)
 {
     TestPaths paths[] = {
@@ -125,61 +216,109 @@ int main(void)
             "test/data/blank.dprec",
             "test/tmp/blank.dprec",
             "test/data/blank.dprec",
+            0,
         },
         {
             "test/data/blank.dprec",
             "test/tmp/blank.dptxt",
             "test/data/blank.dptxt",
+            0,
         },
         {
             "test/data/recordings/rect.dprec",
             "test/tmp/rect.dptxt",
             "test/data/recordings/rect.dptxt",
+            0,
         },
         {
             "test/data/recordings/rect.dprec",
             "test/tmp/rect.dprec",
             "test/data/recordings/rect.dprec",
+            0,
         },
         {
             "test/data/resize.dprec",
             "test/tmp/resize.dprec",
             "test/data/resize.dprec",
+            0,
         },
         {
             "test/data/resize.dprec",
             "test/tmp/resize.dptxt",
             "test/data/resize.dptxt",
+            0,
         },
         {
             "test/data/stroke.dprec",
             "test/tmp/stroke.dprec",
             "test/data/stroke.dprec",
+            0,
         },
         {
             "test/data/stroke.dprec",
             "test/tmp/stroke.dptxt",
             "test/data/stroke.dptxt",
+            0,
         },
         {
             "test/data/recordings/transform.dprec",
             "test/tmp/transform.dptxt",
             "test/data/recordings/transform.dptxt",
+            0,
         },
         {
             "test/data/recordings/transform.dprec",
             "test/tmp/transform.dprec",
             "test/data/recordings/transform.dprec",
+            0,
         },
         {
             "test/data/drawdabs.dprec",
             "test/tmp/drawdabs.dprec",
             "test/data/drawdabs.dprec",
+            0,
         },
         {
             "test/data/drawdabs.dprec",
             "test/tmp/drawdabs.dptxt",
             "test/data/drawdabs.dptxt",
+            0,
+        },
+        {
+            "test/data/recordings/transform.dprec",
+            "test/tmp/transform_parallel.dptxt",
+            "test/data/recordings/transform.dptxt",
+            4,
+        },
+        {
+            "test/data/drawdabs.dprec",
+            "test/tmp/drawdabs_parallel.dptxt",
+            "test/data/drawdabs.dptxt",
+            3,
+        },
+        {
+            "test/data/blank.dptxt",
+            "test/tmp/blank_from_text.dprec",
+            "test/data/blank.dprec",
+            0,
+        },
+        {
+            "test/data/recordings/rect.dptxt",
+            "test/tmp/rect_from_text.dprec",
+            "test/data/recordings/rect.dprec",
+            0,
+        },
+        {
+            "test/data/recordings/transform.dptxt",
+            "test/tmp/transform_from_text.dprec",
+            "test/data/recordings/transform.dprec",
+            0,
+        },
+        {
+            "test/data/drawdabs.dptxt",
+            "test/tmp/drawdabs_from_text.dprec",
+            "test/data/drawdabs.dprec",
+            0,
         },
     };
 
@@ -188,8 +327,12 @@ int main(void)
         TestPaths *p = &paths[i];
         char *name = DP_format("%s -> %s", p->in_path, p->out_path);
         CMUnitTestFunction test_func;
-        if (strcmp(p->out_path + strlen(p->out_path) - 6, ".dptxt") == 0) {
-            test_func = test_binary_to_text;
+        if (has_extension(p->in_path, ".dptxt")) {
+            test_func = test_text_to_binary;
+        }
+        else if (has_extension(p->out_path, ".dptxt")) {
+            test_func = p->threads == 0 ? test_binary_to_text
+                                        : test_binary_to_text_parallel;
         }
         else {
             test_func = test_binary_to_binary;